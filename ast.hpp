@@ -1,5 +1,6 @@
 #pragma once
 #include "token/token.hpp"
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -13,6 +14,9 @@ struct Node
     {
         return "Node: " + token.TokenLiteral;
     };
+    Node() = default;
+    Node(Token tok) : token(tok) {};
+    virtual ~Node() = default;
 };
 
 // GENERAL EXPRESSION NODE
@@ -23,7 +27,7 @@ struct Expression : Node
     {
         return "Expression: " + expression.TokenLiteral;
     }
-    Expression(Token expr) : expression(expr) {};
+    Expression(Token expr) : Node(expr), expression(expr) {};
 };
 
 // GENERAL STATEMENT NODE
@@ -34,7 +38,7 @@ struct Statement : Node
     {
         return "Statement: " + statement.TokenLiteral;
     }
-    Statement(Token stmt) : statement(stmt) {};
+    Statement(Token stmt) : Node(stmt), statement(stmt) {};
 };
 
 // Identifier statement node
@@ -127,6 +131,7 @@ struct CallExpression : Expression
 struct FunctionExpression : Expression
 {
     Token func_key;
+    Token func_name;
     std::vector<std::unique_ptr<Statement>> call;
     std::unique_ptr<Expression> return_type;
 
@@ -148,13 +153,13 @@ struct FunctionExpression : Expression
         std::string ret_str = return_type ? return_type->toString() : "<no type>";
         std::string block_str = block ? block->toString() : "<no block>";
 
-        return "FunctionExpression: " + func_key.TokenLiteral + " " +
+        return "FunctionExpression: " + func_name.TokenLiteral + " " +
                "Function parameters: " + cl +
                " Return type: " + ret_str +
                " Function block: " + block_str;
     }
 
-    FunctionExpression(Token fn, std::vector<std::unique_ptr<Statement>> c, std::unique_ptr<Expression> return_t, std::unique_ptr<Expression> bl) : Expression(fn), call(std::move(c)), return_type(std::move(return_t)), block(std::move(bl)) {};
+    FunctionExpression(Token fn, Token name, std::vector<std::unique_ptr<Statement>> c, std::unique_ptr<Expression> return_t, std::unique_ptr<Expression> bl) : Expression(fn), func_key(fn), func_name(name), call(std::move(c)), return_type(std::move(return_t)), block(std::move(bl)) {};
 };
 
 // Return type expression
@@ -194,6 +199,52 @@ struct InfixExpression : Expression
     InfixExpression(std::unique_ptr<Expression> left, Token op, std::unique_ptr<Expression> right) : Expression(op), left_operand(move(left)), operat(op), right_operand(move(right)) {};
 };
 
+// Heap allocation, alloc(int) gives a zeroed cell, alloc(int, n) a zeroed array of n ints and make(value) a cell holding the value
+struct AllocExpression : Expression
+{
+    Token alloc_token;
+    std::optional<Token> data_type_token; // alloc only
+    std::unique_ptr<Expression> value;    // make only
+    std::unique_ptr<Expression> count;    // alloc of an array only
+    std::string toString() override
+    {
+        return "Alloc Expression: " + alloc_token.TokenLiteral + "(" + (value ? value->toString() : data_type_token ? data_type_token->TokenLiteral : "") +
+               (count ? ", " + count->toString() : "") + ")";
+    }
+    AllocExpression(Token alloc, std::optional<Token> data_t, std::unique_ptr<Expression> val, std::unique_ptr<Expression> n = nullptr)
+        : Expression(alloc), alloc_token(alloc), data_type_token(data_t), value(std::move(val)), count(std::move(n)) {};
+};
+
+// Array element like a[i], a[i] = v writes it
+struct IndexExpression : Expression
+{
+    std::unique_ptr<Expression> array;
+    Token lbracket;
+    std::unique_ptr<Expression> index;
+    std::string toString() override
+    {
+        return "Index Expression: " + array->toString() + "[" + index->toString() + "]";
+    }
+    IndexExpression(std::unique_ptr<Expression> arr, Token lbrack, std::unique_ptr<Expression> idx) : Expression(lbrack), array(std::move(arr)), lbracket(lbrack), index(std::move(idx)) {};
+};
+
+// Array literal like [1, 2, 3], a fixed size array on the allocator heap
+struct ArrayLiteral : Expression
+{
+    Token lbracket;
+    std::vector<std::unique_ptr<Expression>> elements;
+    std::string toString() override
+    {
+        std::string items;
+        for (size_t i = 0; i < elements.size(); ++i)
+        {
+            items += (i ? ", " : "") + elements[i]->toString();
+        }
+        return "Array Literal: [" + items + "]";
+    }
+    ArrayLiteral(Token lbrack, std::vector<std::unique_ptr<Expression>> elems) : Expression(lbrack), lbracket(lbrack), elements(std::move(elems)) {};
+};
+
 //-----STATEMENTS----
 
 struct ExpressionStatement : Statement
@@ -240,9 +291,13 @@ struct LetStatement : Statement
     Token ident_token;
     std::optional<Token> assign_token;
     std::unique_ptr<Expression> value;
+    std::optional<Token> fixed_token; // Present for fixed bindings like fixed int x=2;
+    std::optional<Token> gc_token;    // Present for bindings whose strings live on the collected heap like gc string s="";
+    std::optional<Token> unique_token; // Present for pointers that own their cell like unique pointer<int> p=make(1);
+    std::optional<Token> access_token; // read or write on pointers like read pointer<int> p=q;
     std::string toString() override
     {
-        std::string result = "Let Statement: ( Data Type:" + data_type_token.TokenLiteral +
+        std::string result = std::string("Let Statement: (") + (fixed_token ? " Fixed" : "") + (gc_token ? " Gc" : "") + (unique_token ? " Unique" : "") + (access_token ? " Access: " + access_token->TokenLiteral : "") + " Data Type:" + data_type_token.TokenLiteral +
                              " Variable name: " + ident_token.TokenLiteral;
 
         if (value)
@@ -258,7 +313,7 @@ struct LetStatement : Statement
         return result;
     }
 
-    LetStatement(Token data_t, Token ident_t, std::optional<Token> assign_t, std::unique_ptr<Expression> val) : data_type_token(data_t), ident_token(ident_t), assign_token(assign_t), Statement(data_t), value(move(val)) {};
+    LetStatement(Token data_t, Token ident_t, std::optional<Token> assign_t, std::unique_ptr<Expression> val, std::optional<Token> fixed_t = std::nullopt, std::optional<Token> gc_t = std::nullopt, std::optional<Token> unique_t = std::nullopt, std::optional<Token> access_t = std::nullopt) : data_type_token(data_t), ident_token(ident_t), assign_token(assign_t), Statement(data_t), value(move(val)), fixed_token(fixed_t), gc_token(gc_t), unique_token(unique_t), access_token(access_t) {};
 };
 
 struct AssignmentStatement : Statement
@@ -286,7 +341,7 @@ struct SignalStatement : Statement
         return result;
     }
 
-    SignalStatement(Token signal, std::unique_ptr<Expression> ident, std::unique_ptr<Statement> thread_st, std::unique_ptr<Expression> arg) : Statement(signal), identifier(std::move(ident)), tstart(std::move(thread_st)), func_arg(move(arg)) {};
+    SignalStatement(Token signal, std::unique_ptr<Expression> ident, std::unique_ptr<Statement> thread_st, std::unique_ptr<Expression> arg) : Statement(signal), signal_token(signal), identifier(std::move(ident)), tstart(std::move(thread_st)), func_arg(move(arg)) {};
 };
 
 // Start statement
@@ -305,7 +360,7 @@ struct WaitStatement: Statement{
     std::string toString() override {
         return "Wait Statement: "+ wait_token.TokenLiteral + "(" + arg->toString() + ")";
     };
-    WaitStatement(Token wait,std::unique_ptr<Expression> a): Statement(wait),arg(std::move(a)){};
+    WaitStatement(Token wait,std::unique_ptr<Expression> a): Statement(wait),wait_token(wait),arg(std::move(a)){};
 };
 
 // Return statement node
@@ -440,6 +495,46 @@ struct WhileStatement : Statement
     WhileStatement(Token while_k, std::unique_ptr<Expression> condition, std::unique_ptr<Statement> l) : Statement(while_k), while_key(while_k), condition(move(condition)), loop(move(l)) {};
 };
 
+// Zone statement, the strings built inside the block come from a region that is freed in one go when it ends
+struct ZoneStatement : Statement
+{
+    Token zone_token;
+    std::unique_ptr<Statement> body;
+
+    std::string toString() override
+    {
+        return "Zone Statement: " + body->toString();
+    }
+
+    ZoneStatement(Token zone, std::unique_ptr<Statement> b) : Statement(zone), zone_token(zone), body(std::move(b)) {};
+};
+
+// Unsafe block node, elevate is only allowed inside of it
+struct UnsafeStatement : Statement
+{
+    Token unsafe_token;
+    std::unique_ptr<Statement> body;
+
+    std::string toString() override
+    {
+        return "Unsafe Statement: " + body->toString();
+    }
+
+    UnsafeStatement(Token unsafe, std::unique_ptr<Statement> b) : Statement(unsafe), unsafe_token(unsafe), body(std::move(b)) {};
+};
+
+// Free statement node for syntax like free p;
+struct FreeStatement : Statement
+{
+    Token free_token;
+    std::unique_ptr<Expression> value;
+    std::string toString() override
+    {
+        return "Free Statement: " + (value ? value->toString() : "");
+    }
+    FreeStatement(Token free, std::unique_ptr<Expression> val) : Statement(free), free_token(free), value(std::move(val)) {};
+};
+
 //Function Statement
 struct FunctionStatement: Statement{
     Token token;
@@ -468,7 +563,7 @@ struct BlockStatement : Statement
         out += " }";
         return out;
     }
-    BlockStatement(Token brac, std::vector<std::unique_ptr<Statement>> cont) : Statement(brace), brace(brac), statements(move(cont)) {}
+    BlockStatement(Token brac, std::vector<std::unique_ptr<Statement>> cont) : Statement(brac), brace(brac), statements(move(cont)) {}
 };
 
 // BLOCKS
@@ -496,6 +591,131 @@ struct BlockExpression : Expression
     BlockExpression(Token lbrace) : Expression(lbrace) {};
 };
 
+// Calls fn on every direct child of a node, used by the passes that need to walk the whole tree
+inline void forEachChild(Node *node, const std::function<void(Node *)> &fn)
+{
+    auto visit = [&fn](Node *child)
+    {
+        if (child)
+            fn(child);
+    };
+
+    if (auto call = dynamic_cast<CallExpression *>(node))
+    {
+        visit(call->function_identifier.get());
+        for (auto &param : call->parameters)
+            visit(param.get());
+    }
+    else if (auto func = dynamic_cast<FunctionExpression *>(node))
+    {
+        for (auto &param : func->call)
+            visit(param.get());
+        visit(func->return_type.get());
+        visit(func->block.get());
+    }
+    else if (auto prefix = dynamic_cast<PrefixExpression *>(node))
+    {
+        visit(prefix->operand.get());
+    }
+    else if (auto infix = dynamic_cast<InfixExpression *>(node))
+    {
+        visit(infix->left_operand.get());
+        visit(infix->right_operand.get());
+    }
+    else if (auto alloc = dynamic_cast<AllocExpression *>(node))
+    {
+        visit(alloc->value.get());
+        visit(alloc->count.get());
+    }
+    else if (auto index = dynamic_cast<IndexExpression *>(node))
+    {
+        visit(index->array.get());
+        visit(index->index.get());
+    }
+    else if (auto literal = dynamic_cast<ArrayLiteral *>(node))
+    {
+        for (auto &element : literal->elements)
+            visit(element.get());
+    }
+    else if (auto exprStmt = dynamic_cast<ExpressionStatement *>(node))
+    {
+        visit(exprStmt->expression.get());
+    }
+    else if (auto letStmt = dynamic_cast<LetStatement *>(node))
+    {
+        visit(letStmt->value.get());
+    }
+    else if (auto assignStmt = dynamic_cast<AssignmentStatement *>(node))
+    {
+        visit(assignStmt->value.get());
+    }
+    else if (auto signalStmt = dynamic_cast<SignalStatement *>(node))
+    {
+        visit(signalStmt->identifier.get());
+        visit(signalStmt->tstart.get());
+        visit(signalStmt->func_arg.get());
+    }
+    else if (auto waitStmt = dynamic_cast<WaitStatement *>(node))
+    {
+        visit(waitStmt->arg.get());
+    }
+    else if (auto retStmt = dynamic_cast<ReturnStatement *>(node))
+    {
+        visit(retStmt->return_value.get());
+    }
+    else if (auto ifStmt = dynamic_cast<ifStatement *>(node))
+    {
+        visit(ifStmt->condition.get());
+        visit(ifStmt->if_result.get());
+        if (ifStmt->elseif_condition.has_value())
+            visit(ifStmt->elseif_condition->get());
+        if (ifStmt->elseif_result.has_value())
+            visit(ifStmt->elseif_result->get());
+        if (ifStmt->else_result.has_value())
+            visit(ifStmt->else_result->get());
+    }
+    else if (auto forStmt = dynamic_cast<ForStatement *>(node))
+    {
+        visit(forStmt->initializer.get());
+        visit(forStmt->condition.get());
+        visit(forStmt->step.get());
+        visit(forStmt->body.get());
+    }
+    else if (auto whileStmt = dynamic_cast<WhileStatement *>(node))
+    {
+        visit(whileStmt->condition.get());
+        visit(whileStmt->loop.get());
+    }
+    else if (auto zoneStmt = dynamic_cast<ZoneStatement *>(node))
+    {
+        visit(zoneStmt->body.get());
+    }
+    else if (auto unsafeStmt = dynamic_cast<UnsafeStatement *>(node))
+    {
+        visit(unsafeStmt->body.get());
+    }
+    else if (auto freeStmt = dynamic_cast<FreeStatement *>(node))
+    {
+        visit(freeStmt->value.get());
+    }
+    else if (auto funcStmt = dynamic_cast<FunctionStatement *>(node))
+    {
+        visit(funcStmt->funcExpr.get());
+    }
+    else if (auto blockStmt = dynamic_cast<BlockStatement *>(node))
+    {
+        for (auto &stmt : blockStmt->statements)
+            visit(stmt.get());
+    }
+    else if (auto blockExpr = dynamic_cast<BlockExpression *>(node))
+    {
+        for (auto &stmt : blockExpr->statements)
+            visit(stmt.get());
+        if (blockExpr->finalexpr.has_value())
+            visit(blockExpr->finalexpr->get());
+    }
+}
+
 enum class Precedence
 {
     PREC_NONE = 0,
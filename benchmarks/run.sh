@@ -0,0 +1,8 @@
+#!/bin/sh
+# Runs every benchmark program on the VM, usage: benchmarks/run.sh [path/to/iron]
+IRON=${1:-./iron}
+DIR=$(dirname "$0")
+for program in "$DIR"/*.unn; do
+    echo "== $(basename "$program")"
+    "$IRON" --bench "$program" | grep "ns/op"
+done
@@ -0,0 +1,631 @@
+#include "c_emitter.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <unordered_set>
+#include "codegen.hpp"
+#include "ir/folding.hpp"
+
+// C keywords and every name the generated file declares itself
+static const std::unordered_set<std::string> RESERVED_NAMES = {
+    "auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum", "extern",
+    "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return", "short", "signed",
+    "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void", "volatile", "while",
+    "bool", "true", "false", "main", "strcmp", "fmod"};
+
+CEmitter::CEmitter(Module &module, const std::string &sourceName) : module(module), sourceName(sourceName) {}
+
+std::string CEmitter::emit()
+{
+    std::string base = sourceName.substr(sourceName.find_last_of('/') + 1);
+    base = base.substr(0, base.find_last_of('.'));
+    for (auto fn : module.functions)
+    {
+        for (auto block : fn->blocks)
+        {
+            for (auto inst : block->instructions)
+            {
+                if (inst->op == Opcode::SPAWN && std::find(spawned.begin(), spawned.end(), inst->callee) == spawned.end())
+                    spawned.push_back(inst->callee);
+            }
+        }
+    }
+    collector = module.usesCollector();
+    out << "/* Generated by iron from " << sourceName << "\n"
+        << " * Build with: cc -O3 -std=c11 " << base << ".c runtime/runtime.c " << (collector ? "runtime/gc.c " : "")
+        << (module.usesAllocator() ? "runtime/alloc.c " : "")
+        << (spawned.empty() ? "" : "runtime/tasks.c -pthread ")
+        << "-Iruntime -lm */\n"
+        << "#include <stdbool.h>\n"
+        << "#include <stdint.h>\n"
+        << "#include \"runtime.h\"\n\n"
+        << "int strcmp(const char *left, const char *right);\n"
+        << "double fmod(double left, double right);\n";
+
+    emitGlobals();
+    emitPrototypes();
+    emitThunks();
+    for (auto fn : module.functions)
+    {
+        emitFunction(fn);
+    }
+    emitEntryPoint();
+    return out.str();
+}
+
+void CEmitter::emitGlobals()
+{
+    if (module.globals.empty())
+        return;
+    out << "\n";
+    for (auto global : module.globals)
+    {
+        Constant *initial = global->initializer ? module.constant(*global->initializer) : module.zeroOf(global->type);
+        out << declaration(global->type->scalar, identifier(global->name)) << " = " << constant(initial) << ";\n";
+        if (collector && global->type->scalar == TypeSystem::STRING)
+            out << "static uint64_t " << cardName(global) << ";\n";
+    }
+}
+
+// Declared up front so the functions can call each other in any order
+void CEmitter::emitPrototypes()
+{
+    out << "\n";
+    for (auto fn : module.functions)
+    {
+        out << prototype(fn) << ";\n";
+    }
+}
+
+// The runtime starts a task with a pointer to its argument slots, the thunk turns them back into a normal call
+void CEmitter::emitThunks()
+{
+    for (auto fn : spawned)
+    {
+        std::string call = symbolName(fn) + "(";
+        for (size_t i = 0; i < fn->arguments.size(); ++i)
+        {
+            call += (i ? ", " : "") + fromBits(fn->arguments[i]->scalar(), "args[" + std::to_string(i) + "]");
+        }
+        call += ")";
+        out << "\nstatic uint64_t " << thunkName(fn) << "(const uint64_t *args)\n{\n";
+        if (fn->arguments.empty())
+            out << "    (void)args;\n";
+        if (fn->returnType->scalar == TypeSystem::VOID)
+            out << "    " << call << ";\n    return 0;\n";
+        else
+            out << "    return " << toBits(fn->returnType->scalar, call) << ";\n";
+        out << "}\n";
+    }
+}
+
+// A compare that only feeds the branch right after it is written into the if itself
+static bool feedsBranchOnly(Instruction *inst)
+{
+    if (inst->op < Opcode::EQ || inst->op > Opcode::GE || inst->users.size() != 1)
+        return false;
+    auto &instructions = inst->parent->instructions;
+    Instruction *user = inst->users[0];
+    return user->op == Opcode::CONDBR && user == instructions.back() && instructions.size() >= 2 && instructions[instructions.size() - 2] == inst;
+}
+
+void CEmitter::emitFunction(Function *target)
+{
+    function = target;
+    names.clear();
+    labels.clear();
+
+    // Source names keep their variable in front of the id, the ids keep them apart since identifiers never hold digits
+    uint32_t counter = 0;
+    std::vector<Instruction *> locals;
+    for (size_t i = 0; i < target->blocks.size(); ++i)
+    {
+        BasicBlock *block = target->blocks[i];
+        if (!block->predecessors.empty())
+        {
+            std::string label = block->label;
+            for (auto &c : label)
+            {
+                if (!std::isalnum(static_cast<unsigned char>(c)))
+                    c = '_';
+            }
+            labels[block] = label + "_" + std::to_string(i);
+        }
+        for (auto inst : block->instructions)
+        {
+            if (inst->scalar() == TypeSystem::VOID || inst->scalar() == TypeSystem::UNKNOWN || inst->users.empty() || feedsBranchOnly(inst))
+                continue;
+            ++counter;
+            names[inst] = inst->name.empty() ? "t" + std::to_string(counter) : identifier(inst->name) + "_" + std::to_string(counter);
+            locals.push_back(inst);
+        }
+    }
+
+    // The body goes to its own stream first, labels nothing jumps to are dropped once it is complete
+    std::ostringstream file;
+    file.swap(out);
+    out << "\n"
+        << prototype(target) << "\n{\n";
+    // Everything is declared at the top, a label can not be followed by a declaration
+    for (auto inst : locals)
+    {
+        out << "    " << declaration(inst->scalar(), names[inst]) << ";\n";
+    }
+    if (!locals.empty())
+        out << "\n";
+
+    for (size_t i = 0; i < target->blocks.size(); ++i)
+    {
+        BasicBlock *block = target->blocks[i];
+        BasicBlock *next = i + 1 < target->blocks.size() ? target->blocks[i + 1] : nullptr;
+        if (labels.count(block))
+            out << labels[block] << ":\n";
+        for (auto inst : block->instructions)
+        {
+            emitInstruction(inst, next);
+        }
+    }
+    out << "}\n";
+
+    std::string body = out.str();
+    file.swap(out);
+    for (auto &[block, label] : labels)
+    {
+        if (body.find("goto " + label + ";") == std::string::npos)
+            body.erase(body.find("\n" + label + ":\n") + 1, label.size() + 2);
+    }
+    out << body;
+}
+
+// The C entry point runs the top level statements and then the program's main when it has one
+void CEmitter::emitEntryPoint()
+{
+    out << "\nint main(void)\n{\n";
+    if (collector)
+    {
+        out << "    iron_gc_init();\n";
+        for (auto global : module.globals)
+        {
+            if (global->type->scalar == TypeSystem::STRING)
+                out << "    iron_gc_root(&" << identifier(global->name) << ", &" << cardName(global) << ");\n";
+        }
+    }
+    Function *programMain = nullptr;
+    for (auto fn : module.functions)
+    {
+        if (fn->isTopLevel)
+            out << "    " << symbolName(fn) << "();\n";
+        else if (fn->name == "main" && fn->arguments.empty())
+            programMain = fn;
+    }
+    if (programMain && programMain->returnType->scalar == TypeSystem::INTEGER)
+    {
+        out << "    return (int)" << symbolName(programMain) << "();\n";
+    }
+    else
+    {
+        if (programMain)
+            out << "    " << symbolName(programMain) << "();\n";
+        out << "    return 0;\n";
+    }
+    out << "}\n";
+}
+
+void CEmitter::emitInstruction(Instruction *inst, BasicBlock *next)
+{
+    BasicBlock *block = inst->parent;
+    switch (inst->op)
+    {
+    case Opcode::PHI:
+        return; // Written by the predecessors
+    case Opcode::STORE_GLOBAL:
+        out << "    " << identifier(inst->global->name) << " = " << operand(inst->operands[0]) << ";\n";
+        if (collector && inst->global->type->scalar == TypeSystem::STRING)
+            out << "    " << cardName(inst->global) << " = 1;\n";
+        return;
+    case Opcode::BR:
+        emitEdge(block, inst->targets[0], next, "    ");
+        return;
+    case Opcode::RET:
+        if (inst->operands.empty())
+            out << "    return;\n";
+        else
+            out << "    return " << operand(inst->operands[0]) << ";\n";
+        return;
+    case Opcode::CONDBR:
+    {
+        auto compare = dynamic_cast<Instruction *>(inst->operands[0]);
+        std::string condition = compare && feedsBranchOnly(compare) ? expression(compare) : operand(inst->operands[0]);
+        BasicBlock *ifTrue = inst->targets[0];
+        BasicBlock *ifFalse = inst->targets[1];
+        auto hasPhis = [](BasicBlock *target)
+        { return !target->instructions.empty() && target->instructions.front()->isPhi(); };
+
+        if (ifTrue == next && !hasPhis(ifTrue) && !hasPhis(ifFalse))
+        {
+            out << "    if (!(" << condition << "))\n        goto " << labels[ifFalse] << ";\n";
+            return;
+        }
+        if (hasPhis(ifTrue))
+        {
+            out << "    if (" << condition << ")\n    {\n";
+            emitEdge(block, ifTrue, nullptr, "        ");
+            out << "    }\n";
+        }
+        else
+        {
+            out << "    if (" << condition << ")\n        goto " << labels[ifTrue] << ";\n";
+        }
+        emitEdge(block, ifFalse, next, "    ");
+        return;
+    }
+    default:
+        break;
+    }
+
+    if (feedsBranchOnly(inst))
+        return;
+    auto name = names.find(inst);
+    if (name == names.end())
+    {
+        // Unused results only matter for their side effects, or for the panic of a division that may hit zero
+        if (inst->op == Opcode::SPAWN)
+            out << "    " << spawn(inst) << ";\n";
+        else if (inst->op == Opcode::ZONE_ENTER)
+            out << "    iron_zone_enter();\n";
+        else if (inst->hasSideEffects() || mayTrap(inst))
+            out << "    " << expression(inst) << ";\n";
+        return;
+    }
+    out << "    " << name->second << " = " << expression(inst) << ";\n";
+}
+
+// Phis read all their inputs at once, when one of them is overwritten before another reads it the inputs go
+// through temporaries first
+void CEmitter::emitEdge(BasicBlock *from, BasicBlock *to, BasicBlock *next, const std::string &indent)
+{
+    std::vector<std::pair<Instruction *, Value *>> moves;
+    for (auto inst : to->instructions)
+    {
+        if (!inst->isPhi())
+            break;
+        for (size_t i = 0; i < inst->operands.size(); ++i)
+        {
+            if (inst->targets[i] == from && inst->operands[i] != inst && names.count(inst))
+                moves.push_back({inst, inst->operands[i]});
+            if (inst->targets[i] == from)
+                break;
+        }
+    }
+
+    bool overlapping = false;
+    for (auto &move : moves)
+    {
+        for (auto &other : moves)
+        {
+            overlapping |= &move != &other && move.second == other.first;
+        }
+    }
+    if (overlapping)
+    {
+        out << indent << "{\n";
+        for (size_t i = 0; i < moves.size(); ++i)
+        {
+            out << indent << "    " << declaration(moves[i].first->scalar(), "p" + std::to_string(i)) << " = " << operand(moves[i].second) << ";\n";
+        }
+        for (size_t i = 0; i < moves.size(); ++i)
+        {
+            out << indent << "    " << names[moves[i].first] << " = p" << i << ";\n";
+        }
+        out << indent << "}\n";
+    }
+    else
+    {
+        for (auto &[phi, value] : moves)
+        {
+            out << indent << names[phi] << " = " << operand(value) << ";\n";
+        }
+    }
+    if (to != next)
+        out << indent << "goto " << labels[to] << ";\n";
+}
+
+std::string CEmitter::expression(Instruction *inst)
+{
+    auto arg = [&](size_t index)
+    { return operand(inst->operands[index]); };
+    bool isFloat = inst->scalar() == TypeSystem::FLOAT;
+
+    switch (inst->op)
+    {
+    case Opcode::ADD:
+        return isFloat ? arg(0) + " + " + arg(1) : "iron_add(" + arg(0) + ", " + arg(1) + ")";
+    case Opcode::SUB:
+        return isFloat ? arg(0) + " - " + arg(1) : "iron_sub(" + arg(0) + ", " + arg(1) + ")";
+    case Opcode::MUL:
+        return isFloat ? arg(0) + " * " + arg(1) : "iron_mul(" + arg(0) + ", " + arg(1) + ")";
+    case Opcode::DIV:
+        return isFloat ? arg(0) + " / " + arg(1) : integerDivision(inst);
+    case Opcode::MOD:
+        return isFloat ? "fmod(" + arg(0) + ", " + arg(1) + ")" : integerDivision(inst);
+    case Opcode::NEG:
+        return isFloat ? "-" + arg(0) : "iron_neg(" + arg(0) + ")";
+    case Opcode::EQ:
+    case Opcode::NE:
+    case Opcode::LT:
+    case Opcode::GT:
+    case Opcode::LE:
+    case Opcode::GE:
+        return comparison(inst);
+    case Opcode::NOT:
+        return "!" + arg(0);
+    case Opcode::CONCAT:
+        if (inst->collected)
+            return "iron_gc_concat(" + arg(0) + ", " + arg(1) + ")";
+        if (inst->operands.size() == 3)
+            return "iron_zone_concat(" + arg(0) + ", " + arg(1) + ", (IronZone *)(intptr_t)" + arg(2) + ")";
+        return "iron_string_concat(" + arg(0) + ", " + arg(1) + ")";
+    case Opcode::ZONE_ENTER:
+        return "(int64_t)(intptr_t)iron_zone_enter()";
+    case Opcode::ZONE_EXIT:
+        return "iron_zone_exit((IronZone *)(intptr_t)" + arg(0) + ")";
+    case Opcode::ITOF:
+        return "(double)" + arg(0);
+    case Opcode::CALL:
+    {
+        std::string call = symbolName(inst->callee) + "(";
+        for (size_t i = 0; i < inst->operands.size(); ++i)
+        {
+            call += (i ? ", " : "") + arg(i);
+        }
+        return call + ")";
+    }
+    case Opcode::SPAWN:
+        return "(int64_t)(intptr_t)" + spawn(inst);
+    case Opcode::JOIN:
+        return join(inst);
+    case Opcode::DETACH:
+        return "iron_task_detach((IronTask *)(intptr_t)" + arg(0) + ")";
+    case Opcode::LOAD_GLOBAL:
+        return identifier(inst->global->name);
+    case Opcode::ALLOC:
+        return "iron_alloc(sizeof(" + typeName(inst->type->element->scalar) + ") * " + arg(0) + ")";
+    case Opcode::FREE:
+        return "iron_free(" + arg(0) + ")";
+    case Opcode::LOAD:
+        return "*(" + typeName(inst->scalar()) + " *)" + arg(0);
+    case Opcode::STORE:
+        return "*(" + typeName(inst->operands[1]->scalar()) + " *)" + arg(0) + " = " + arg(1);
+    case Opcode::NEW_ARRAY:
+        return "iron_array_new(" + arg(0) + ", sizeof(" + typeName(inst->type->element->scalar) + "))";
+    case Opcode::LENGTH:
+        return "*(int64_t *)" + arg(0);
+    case Opcode::ELEMENT:
+        // The elements start after the length
+        return "(void *)((" + typeName(inst->type->element->scalar) + " *)((int64_t *)" + arg(0) + " + 1) + " + arg(1) + ")";
+    case Opcode::CHECK_BOUNDS:
+        return "iron_check_index(" + arg(0) + ", " + arg(1) + ", " + stringLiteral("Index out of bounds in '" + function->name + "'") + ")";
+    default:
+        throw std::runtime_error("Cannot write '" + opcodeName(inst->op) + "' as C");
+    }
+}
+
+// The slots are a compound literal, the runtime copies them before the statement ends
+std::string CEmitter::spawn(Instruction *inst)
+{
+    std::string slots = "0";
+    if (!inst->operands.empty())
+    {
+        slots = "(const uint64_t[]){";
+        for (size_t i = 0; i < inst->operands.size(); ++i)
+        {
+            slots += (i ? ", " : "") + toBits(inst->operands[i]->scalar(), operand(inst->operands[i]));
+        }
+        slots += "}";
+    }
+    return "iron_task_spawn(" + thunkName(inst->callee) + ", " + slots + ", " + std::to_string(inst->operands.size()) + ")";
+}
+
+std::string CEmitter::join(Instruction *inst)
+{
+    std::string wait = "iron_task_wait((IronTask *)(intptr_t)" + operand(inst->operands[0]) + ")";
+    if (inst->scalar() == TypeSystem::VOID)
+        return wait;
+    return fromBits(inst->scalar(), wait);
+}
+
+// Constant divisors other than 0 and -1 can not trap or overflow, they stay plain C so the compiler can strength reduce them
+std::string CEmitter::integerDivision(Instruction *inst)
+{
+    bool isDivision = inst->op == Opcode::DIV;
+    auto divisor = dynamic_cast<Constant *>(inst->operands[1]);
+    if (divisor && divisor->value.type == TypeSystem::INTEGER && divisor->value.intValue != 0 && divisor->value.intValue != -1)
+        return operand(inst->operands[0]) + (isDivision ? " / " : " % ") + operand(inst->operands[1]);
+    return std::string(isDivision ? "iron_div(" : "iron_mod(") + operand(inst->operands[0]) + ", " + operand(inst->operands[1]) + ")";
+}
+
+// C's float operators already fail every ordering on NaN and pass != like the other backends
+std::string CEmitter::comparison(Instruction *inst)
+{
+    static const char *operators[] = {" == ", " != ", " < ", " > ", " <= ", " >= "};
+    const char *op = operators[static_cast<int>(inst->op) - static_cast<int>(Opcode::EQ)];
+    if (inst->operands[0]->scalar() == TypeSystem::STRING)
+        return "strcmp(" + operand(inst->operands[0]) + ", " + operand(inst->operands[1]) + ")" + op + "0";
+    return operand(inst->operands[0]) + op + operand(inst->operands[1]);
+}
+
+//---------HELPER FUNCTIONS----------
+std::string CEmitter::operand(Value *value)
+{
+    if (auto constantValue = dynamic_cast<Constant *>(value))
+        return constant(constantValue);
+    if (auto arg = dynamic_cast<Argument *>(value))
+        return identifier(arg->name);
+    auto it = names.find(value);
+    if (it == names.end())
+        throw std::runtime_error("Value " + valueName(value) + " has no C name in '" + function->name + "'");
+    return it->second;
+}
+
+// Negative numbers are parenthesized so they can follow any operator
+std::string CEmitter::constant(Constant *value)
+{
+    switch (value->value.type)
+    {
+    case TypeSystem::INTEGER:
+    {
+        int64_t number = value->value.intValue;
+        if (number == INT64_MIN)
+            return "INT64_MIN";
+        return number < 0 ? "(" + std::to_string(number) + ")" : std::to_string(number);
+    }
+    case TypeSystem::FLOAT:
+    {
+        double number = value->value.floatValue;
+        if (std::isnan(number))
+            return "__builtin_nan(\"\")";
+        if (std::isinf(number))
+            return number < 0 ? "(-__builtin_inf())" : "__builtin_inf()";
+        std::string text = floatLiteral(number);
+        return std::signbit(number) ? "(" + text + ")" : text;
+    }
+    case TypeSystem::BOOLEAN:
+        return value->value.boolValue ? "true" : "false";
+    case TypeSystem::CHAR:
+    {
+        char c = value->value.charValue;
+        if (c >= 32 && c < 127 && c != '\'' && c != '\\')
+            return std::string("'") + c + "'";
+        return "(" + std::to_string(static_cast<int>(c)) + ")";
+    }
+    case TypeSystem::STRING:
+        return stringLiteral(value->value.stringValue);
+    default:
+        return value->scalar() == TypeSystem::STRING ? "\"\"" : "0"; // undef
+    }
+}
+
+std::string CEmitter::prototype(Function *fn)
+{
+    std::string text = declaration(fn->returnType->scalar, symbolName(fn)) + "(";
+    for (size_t i = 0; i < fn->arguments.size(); ++i)
+    {
+        // Loads and stores cast the pointer, restrict still covers them since they are based on it
+        std::string name = (fn->arguments[i]->noalias ? "restrict " : "") + identifier(fn->arguments[i]->name);
+        text += (i ? ", " : "") + declaration(fn->arguments[i]->scalar(), name);
+    }
+    return text + (fn->arguments.empty() ? "void)" : ")");
+}
+
+// Same symbols as the template and LLVM backends, so objects of every backend link the same way
+std::string CEmitter::symbolName(Function *fn) const
+{
+    if (fn->isTopLevel)
+        return X86CodeGenerator::ENTRY_NAME;
+    if (fn->name == "main")
+        return X86CodeGenerator::MAIN_NAME;
+    return identifier(fn->name);
+}
+
+std::string CEmitter::toBits(TypeSystem scalar, const std::string &value)
+{
+    switch (scalar)
+    {
+    case TypeSystem::FLOAT:
+        return "iron_float_bits(" + value + ")";
+    case TypeSystem::STRING:
+    case TypeSystem::POINTER:
+        return "(uint64_t)(uintptr_t)" + value;
+    default:
+        return "(uint64_t)" + value; // Sign extends chars like the registers of the template backend
+    }
+}
+
+std::string CEmitter::fromBits(TypeSystem scalar, const std::string &bits)
+{
+    switch (scalar)
+    {
+    case TypeSystem::FLOAT:
+        return "iron_bits_float(" + bits + ")";
+    case TypeSystem::STRING:
+        return "(const char *)(uintptr_t)" + bits;
+    case TypeSystem::POINTER:
+        return "(void *)(uintptr_t)" + bits;
+    default:
+        return "(" + typeName(scalar) + ")" + bits;
+    }
+}
+
+std::string CEmitter::typeName(TypeSystem scalar)
+{
+    switch (scalar)
+    {
+    case TypeSystem::INTEGER:
+        return "int64_t";
+    case TypeSystem::FLOAT:
+        return "double";
+    case TypeSystem::BOOLEAN:
+        return "bool";
+    case TypeSystem::CHAR:
+        return "signed char"; // Plain char is unsigned on some targets, the language compares chars signed
+    case TypeSystem::STRING:
+        return "const char *";
+    case TypeSystem::POINTER:
+        return "void *"; // Loads and stores cast to the pointee, the IR already checked it
+    case TypeSystem::VOID:
+        return "void";
+    default:
+        throw std::runtime_error("The C backend can not represent an unknown type");
+    }
+}
+
+std::string CEmitter::declaration(TypeSystem scalar, const std::string &name)
+{
+    std::string type = typeName(scalar);
+    return type.back() == '*' ? type + name : type + " " + name;
+}
+
+std::string CEmitter::identifier(const std::string &name)
+{
+    if (RESERVED_NAMES.count(name) || name.rfind("iron_", 0) == 0)
+        return name + "_";
+    return name;
+}
+
+// Octal escapes always take three digits so the character after them can never be read as part of the escape
+std::string CEmitter::stringLiteral(const std::string &text)
+{
+    std::string literal = "\"";
+    for (char c : text)
+    {
+        switch (c)
+        {
+        case '\n':
+            literal += "\\n";
+            break;
+        case '\t':
+            literal += "\\t";
+            break;
+        case '"':
+            literal += "\\\"";
+            break;
+        case '\\':
+            literal += "\\\\";
+            break;
+        default:
+            if (c >= 32 && c < 127)
+            {
+                literal += c;
+            }
+            else
+            {
+                char escape[5];
+                snprintf(escape, sizeof(escape), "\\%03o", static_cast<unsigned char>(c));
+                literal += escape;
+            }
+        }
+    }
+    return literal + "\"";
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ir/ir.hpp"
+
+// Portable backend, writes the SSA IR out as one C11 translation unit that any C compiler can optimize.
+// Every work becomes a C function, ints are int64_t, floats double, strings const char * handled by
+// runtime/runtime.c. Control flow is gotos between the blocks, phis become plain locals written on the edges.
+// A task handle is kept in an int64_t like the other backends keep it in a word, started works get a thunk
+// that unpacks the argument slots for runtime/tasks.c
+class CEmitter
+{
+    Module &module;
+    std::string sourceName;
+    std::ostringstream out;
+    std::vector<Function *> spawned; // Works started as tasks somewhere, each one gets a thunk
+    bool collector = false;          // Strings are built for gc variables, string globals then get a card each
+
+    // State of the function being written
+    Function *function = nullptr;
+    std::unordered_map<Value *, std::string> names;
+    std::unordered_map<BasicBlock *, std::string> labels;
+
+public:
+    CEmitter(Module &module, const std::string &sourceName);
+    std::string emit();
+
+private:
+    void emitGlobals();
+    void emitPrototypes();
+    void emitThunks();
+    void emitFunction(Function *target);
+    void emitEntryPoint();
+    void emitInstruction(Instruction *inst, BasicBlock *next);
+    void emitEdge(BasicBlock *from, BasicBlock *to, BasicBlock *next, const std::string &indent);
+    std::string expression(Instruction *inst);
+    std::string integerDivision(Instruction *inst);
+    std::string comparison(Instruction *inst);
+    std::string spawn(Instruction *inst);
+    std::string join(Instruction *inst);
+
+    //---------HELPER FUNCTIONS----------
+    std::string operand(Value *value);
+    std::string constant(Constant *value);
+    std::string prototype(Function *fn);
+    std::string symbolName(Function *fn) const;
+    std::string thunkName(Function *fn) const { return "iron_thunk_" + symbolName(fn); }
+    static std::string cardName(GlobalVariable *global) { return "iron_card_" + identifier(global->name); }
+    static std::string toBits(TypeSystem scalar, const std::string &value);   // Value to the uint64_t of a task slot
+    static std::string fromBits(TypeSystem scalar, const std::string &bits); // And back
+    static std::string typeName(TypeSystem scalar);
+    static std::string declaration(TypeSystem scalar, const std::string &name); // "const char *name"
+    static std::string identifier(const std::string &name); // Renames source names that C reserves
+    static std::string stringLiteral(const std::string &text);
+};
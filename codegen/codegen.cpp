@@ -0,0 +1,971 @@
+#include "codegen.hpp"
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+static const Reg INT_ARGUMENTS[] = {RDI, RSI, RDX, RCX, R8, R9};
+static const size_t FLOAT_ARGUMENTS = 8; // xmm0 to xmm7
+
+X86CodeGenerator::X86CodeGenerator(Module &module, const std::string &sourceName)
+    : module(module), object(sourceName), assembler(object.text) {}
+
+bool X86CodeGenerator::isCall(Instruction *inst)
+{
+    switch (inst->op)
+    {
+    case Opcode::CALL:
+    case Opcode::SPAWN:
+    case Opcode::JOIN:
+    case Opcode::DETACH:
+    case Opcode::CONCAT:
+    case Opcode::ZONE_ENTER:
+    case Opcode::ZONE_EXIT:
+    case Opcode::ALLOC:
+    case Opcode::FREE:
+    case Opcode::NEW_ARRAY:
+        return true;
+    case Opcode::MOD:
+        return inst->scalar() == TypeSystem::FLOAT; // fmod
+    case Opcode::EQ:
+    case Opcode::NE:
+    case Opcode::LT:
+    case Opcode::GT:
+    case Opcode::LE:
+    case Opcode::GE:
+        return inst->operands[0]->scalar() == TypeSystem::STRING; // strcmp
+    default:
+        return false;
+    }
+}
+
+const ObjectFile &X86CodeGenerator::generate()
+{
+    declareGlobals();
+    for (auto fn : module.functions)
+    {
+        functionSymbols[fn] = object.addSymbol({symbolName(fn), ObjectSection::TEXT, 0, 0, true, true});
+    }
+    for (auto fn : module.functions)
+    {
+        generateFunction(fn);
+    }
+    for (auto fn : thunkOrder)
+    {
+        generateThunk(fn);
+    }
+    generateEntryPoint();
+    if (!assembler.resolveLabels())
+        throw std::runtime_error("Jump to a label that was never placed");
+    return object;
+}
+
+// Every global takes 8 bytes of .data, strings hold a pointer that the linker fills in
+void X86CodeGenerator::declareGlobals()
+{
+    for (auto global : module.globals)
+    {
+        Constant *initial = global->initializer ? module.constant(*global->initializer) : module.zeroOf(global->type);
+        uint64_t offset = object.data.size();
+        uint64_t bits = 0;
+        switch (initial->scalar())
+        {
+        case TypeSystem::INTEGER:
+            bits = initial->value.intValue;
+            break;
+        case TypeSystem::FLOAT:
+            std::memcpy(&bits, &initial->value.floatValue, sizeof(bits));
+            break;
+        case TypeSystem::BOOLEAN:
+            bits = initial->value.boolValue;
+            break;
+        case TypeSystem::CHAR:
+            bits = static_cast<int64_t>(initial->value.charValue);
+            break;
+        case TypeSystem::STRING:
+            object.dataRelocations.push_back({offset, object.sectionSymbol(ObjectSection::RODATA), R_X86_64_64, static_cast<int64_t>(rodataOffset(initial))});
+            break;
+        default:
+            break;
+        }
+        for (int i = 0; i < 8; ++i)
+        {
+            object.data.push_back(bits >> (8 * i));
+        }
+        globalOffsets[global] = offset;
+        object.addSymbol({global->name, ObjectSection::DATA, offset, 8, true, false});
+    }
+
+    // A string global can point into the nursery once it was stored to, its card tells the next minor collection
+    if (!module.usesCollector())
+        return;
+    for (auto global : module.globals)
+    {
+        if (global->type->scalar != TypeSystem::STRING)
+            continue;
+        cardOffsets[global] = object.data.size();
+        object.data.insert(object.data.end(), 8, 0);
+    }
+}
+
+void X86CodeGenerator::generateFunction(Function *target)
+{
+    function = target;
+    allocation = std::make_unique<LinearScanAllocator>(target, isCall);
+    allocation->run();
+    blockLabels.clear();
+    fusedCompares.clear();
+    stubs.clear();
+
+    while (object.text.size() % 16)
+    {
+        object.text.push_back(0x90); // nop padding keeps every function aligned
+    }
+    uint32_t symbol = functionSymbols[target]; // By index, calls to new external symbols grow the table
+    object.symbols[symbol].offset = object.text.size();
+
+    for (auto block : target->blocks)
+    {
+        blockLabels[block] = assembler.newLabel();
+        Instruction *term = block->terminator();
+        if (term && term->op == Opcode::CONDBR)
+        {
+            if (Instruction *compare = fusableCompare(term))
+                fusedCompares.insert(compare);
+        }
+    }
+
+    // Prologue, rsp stays 16 byte aligned at every call so the saved registers and the spill slots are padded together
+    assembler.push(RBP);
+    assembler.mov(RBP, RSP);
+    for (auto reg : allocation->usedCalleeSaved())
+    {
+        assembler.push(reg);
+    }
+    size_t slots = allocation->spillSlotCount();
+    if ((slots + allocation->usedCalleeSaved().size()) % 2)
+        ++slots;
+    if (slots)
+        assembler.aluImmediate(AluOp::SUB, RSP, 8 * slots);
+
+    // Incoming arguments go through the stack so they can move to their locations in any order
+    size_t intIndex = 0, floatIndex = 0;
+    std::vector<Argument *> incoming;
+    for (auto arg : target->arguments)
+    {
+        if (isFloat(arg) ? floatIndex >= FLOAT_ARGUMENTS : intIndex >= std::size(INT_ARGUMENTS))
+            throw std::runtime_error("'" + target->name + "' has more arguments than the native backend passes in registers");
+        if (isFloat(arg))
+        {
+            assembler.movqFromXmm(RAX, static_cast<Xmm>(floatIndex++));
+            assembler.push(RAX);
+        }
+        else
+        {
+            assembler.push(INT_ARGUMENTS[intIndex++]);
+        }
+        incoming.push_back(arg);
+    }
+    for (auto it = incoming.rbegin(); it != incoming.rend(); ++it)
+    {
+        assembler.pop(RAX);
+        storeBits(*it, RAX);
+    }
+
+    for (size_t i = 0; i < target->blocks.size(); ++i)
+    {
+        generateBlock(target->blocks[i], i + 1 < target->blocks.size() ? target->blocks[i + 1] : nullptr);
+    }
+    for (size_t i = 0; i < stubs.size(); ++i)
+    {
+        Stub stub = stubs[i];
+        assembler.bind(stub.label);
+        generateMoves(stub.from, stub.to);
+        assembler.jmp(blockLabels[stub.to]);
+    }
+    object.symbols[symbol].size = object.text.size() - object.symbols[symbol].offset;
+}
+
+// The C entry point runs the top level statements and then the program's main when it has one
+void X86CodeGenerator::generateEntryPoint()
+{
+    while (object.text.size() % 16)
+    {
+        object.text.push_back(0x90);
+    }
+    uint32_t entry = object.addSymbol({"main", ObjectSection::TEXT, object.text.size(), 0, true, true});
+    assembler.push(RBP);
+    assembler.mov(RBP, RSP);
+
+    if (module.usesCollector())
+    {
+        callSymbol(externalSymbol("iron_gc_init"));
+        for (auto global : module.globals)
+        {
+            if (!cardOffsets.count(global))
+                continue;
+            relocateRip(assembler.leaRip(RDI), ObjectSection::DATA, globalOffsets[global]);
+            relocateRip(assembler.leaRip(RSI), ObjectSection::DATA, cardOffsets[global]);
+            callSymbol(externalSymbol("iron_gc_root"));
+        }
+    }
+
+    Function *programMain = nullptr;
+    for (auto fn : module.functions)
+    {
+        if (fn->isTopLevel)
+            callSymbol(functionSymbols[fn]);
+        else if (fn->name == "main" && fn->arguments.empty())
+            programMain = fn;
+    }
+    if (programMain)
+    {
+        callSymbol(functionSymbols[programMain]);
+        if (programMain->returnType->scalar != TypeSystem::INTEGER)
+            assembler.movImmediate(RAX, 0);
+    }
+    else
+    {
+        assembler.movImmediate(RAX, 0);
+    }
+    assembler.pop(RBP);
+    assembler.ret();
+    object.symbols[entry].size = object.text.size() - object.symbols[entry].offset;
+}
+
+// A task starts in a thunk that gets the argument slots copied at the spawn and calls the function the normal way.
+// The slot pointer moves to rax since rdi is the first integer argument
+void X86CodeGenerator::generateThunk(Function *target)
+{
+    while (object.text.size() % 16)
+    {
+        object.text.push_back(0x90);
+    }
+    uint32_t symbol = thunkSymbols[target];
+    object.symbols[symbol].offset = object.text.size();
+    assembler.push(RBP);
+    assembler.mov(RBP, RSP);
+    assembler.mov(RAX, RDI);
+    size_t floatIndex = 0;
+    for (size_t i = 0; i < target->arguments.size(); ++i)
+    {
+        if (isFloat(target->arguments[i]))
+            assembler.loadsd(static_cast<Xmm>(floatIndex++), RAX, 8 * static_cast<int32_t>(i));
+    }
+    size_t intIndex = 0;
+    for (size_t i = 0; i < target->arguments.size(); ++i)
+    {
+        if (!isFloat(target->arguments[i]))
+            assembler.load(INT_ARGUMENTS[intIndex++], RAX, 8 * static_cast<int32_t>(i));
+    }
+    callSymbol(functionSymbols[target]);
+    if (target->returnType->scalar == TypeSystem::FLOAT)
+        assembler.movqFromXmm(RAX, XMM0);
+    assembler.pop(RBP);
+    assembler.ret();
+    object.symbols[symbol].size = object.text.size() - object.symbols[symbol].offset;
+}
+
+void X86CodeGenerator::generateBlock(BasicBlock *block, BasicBlock *next)
+{
+    assembler.bind(blockLabels[block]);
+    for (auto inst : block->instructions)
+    {
+        if (inst->isPhi() || fusedCompares.count(inst))
+            continue;
+
+        switch (inst->op)
+        {
+        case Opcode::BR:
+            generateEdge(block, inst->targets[0], next);
+            break;
+        case Opcode::CONDBR:
+            generateBranch(inst, next);
+            break;
+        case Opcode::RET:
+            generateReturn(inst);
+            break;
+        default:
+            generateInstruction(inst);
+        }
+    }
+}
+
+static Cond conditionOf(Opcode op)
+{
+    switch (op)
+    {
+    case Opcode::EQ:
+        return Cond::E;
+    case Opcode::NE:
+        return Cond::NE;
+    case Opcode::LT:
+        return Cond::L;
+    case Opcode::GT:
+        return Cond::G;
+    case Opcode::LE:
+        return Cond::LE;
+    default:
+        return Cond::GE;
+    }
+}
+
+void X86CodeGenerator::generateInstruction(Instruction *inst)
+{
+    switch (inst->op)
+    {
+    case Opcode::ADD:
+    case Opcode::SUB:
+    case Opcode::MUL:
+    {
+        if (isFloat(inst))
+        {
+            loadFloat(XMM0, inst->operands[0]);
+            loadFloat(XMM1, inst->operands[1]);
+            assembler.sse(inst->op == Opcode::ADD ? SseOp::ADD : inst->op == Opcode::SUB ? SseOp::SUB : SseOp::MUL, XMM0, XMM1);
+            storeFloat(inst, XMM0);
+            break;
+        }
+        loadBits(RAX, inst->operands[0]);
+        auto constant = dynamic_cast<Constant *>(inst->operands[1]);
+        if (constant && inst->op != Opcode::MUL && constant->value.intValue >= INT32_MIN && constant->value.intValue <= INT32_MAX)
+        {
+            assembler.aluImmediate(inst->op == Opcode::ADD ? AluOp::ADD : AluOp::SUB, RAX, constant->value.intValue);
+        }
+        else
+        {
+            loadBits(RCX, inst->operands[1]);
+            if (inst->op == Opcode::MUL)
+                assembler.imul(RAX, RCX);
+            else
+                assembler.alu(inst->op == Opcode::ADD ? AluOp::ADD : AluOp::SUB, RAX, RCX);
+        }
+        storeBits(inst, RAX);
+        break;
+    }
+    case Opcode::DIV:
+        if (isFloat(inst))
+        {
+            loadFloat(XMM0, inst->operands[0]);
+            loadFloat(XMM1, inst->operands[1]);
+            assembler.sse(SseOp::DIV, XMM0, XMM1);
+            storeFloat(inst, XMM0);
+        }
+        else
+        {
+            generateIntegerDivision(inst);
+        }
+        break;
+    case Opcode::MOD:
+        if (isFloat(inst))
+            generateCall(externalSymbol("fmod"), inst->operands, inst);
+        else
+            generateIntegerDivision(inst);
+        break;
+    case Opcode::NEG:
+        loadBits(RAX, inst->operands[0]);
+        if (isFloat(inst))
+        {
+            // Flipping the sign bit, no constant needed
+            assembler.movImmediate(RCX, INT64_MIN);
+            assembler.alu(AluOp::XOR, RAX, RCX);
+        }
+        else
+        {
+            assembler.neg(RAX);
+        }
+        storeBits(inst, RAX);
+        break;
+    case Opcode::EQ:
+    case Opcode::NE:
+    case Opcode::LT:
+    case Opcode::GT:
+    case Opcode::LE:
+    case Opcode::GE:
+        if (isFloat(inst->operands[0]))
+        {
+            generateFloatCompare(inst);
+        }
+        else if (isString(inst->operands[0]))
+        {
+            generateStringCompare(inst);
+        }
+        else
+        {
+            loadBits(RAX, inst->operands[0]);
+            loadBits(RCX, inst->operands[1]);
+            assembler.alu(AluOp::CMP, RAX, RCX);
+            assembler.setcc(conditionOf(inst->op), RAX);
+            assembler.movzxByte(RAX, RAX);
+            storeBits(inst, RAX);
+        }
+        break;
+    case Opcode::NOT:
+        loadBits(RAX, inst->operands[0]);
+        assembler.aluImmediate(AluOp::XOR, RAX, 1);
+        storeBits(inst, RAX);
+        break;
+    case Opcode::CONCAT:
+        // The zone goes last so the runtime functions all take the strings in the same registers
+        if (inst->collected)
+            generateCall(externalSymbol("iron_gc_concat"), inst->operands, inst);
+        else
+            generateCall(externalSymbol(inst->operands.size() == 3 ? "iron_zone_concat" : "iron_string_concat"), inst->operands, inst);
+        break;
+    case Opcode::ZONE_ENTER:
+        generateCall(externalSymbol("iron_zone_enter"), {}, inst);
+        break;
+    case Opcode::ZONE_EXIT:
+        generateCall(externalSymbol("iron_zone_exit"), inst->operands, inst);
+        break;
+    case Opcode::ITOF:
+        loadBits(RAX, inst->operands[0]);
+        assembler.cvtsi2sd(XMM0, RAX);
+        storeFloat(inst, XMM0);
+        break;
+    case Opcode::CALL:
+        generateCall(functionSymbols[inst->callee], inst->operands, inst);
+        break;
+    case Opcode::SPAWN:
+        generateSpawn(inst);
+        break;
+    case Opcode::JOIN:
+        loadBits(RDI, inst->operands[0]);
+        callSymbol(externalSymbol("iron_task_wait"));
+        if (inst->scalar() != TypeSystem::VOID)
+            storeBits(inst, RAX); // Floats come back as their bits from the thunk
+        break;
+    case Opcode::DETACH:
+        loadBits(RDI, inst->operands[0]);
+        callSymbol(externalSymbol("iron_task_detach"));
+        break;
+    case Opcode::LOAD_GLOBAL:
+        relocateRip(assembler.loadRip(RAX), ObjectSection::DATA, globalOffsets[inst->global]);
+        storeBits(inst, RAX);
+        break;
+    case Opcode::STORE_GLOBAL:
+        loadBits(RAX, inst->operands[0]);
+        relocateRip(assembler.storeRip(RAX), ObjectSection::DATA, globalOffsets[inst->global]);
+        if (cardOffsets.count(inst->global))
+        {
+            // Write barrier
+            assembler.movImmediate(RAX, 1);
+            relocateRip(assembler.storeRip(RAX), ObjectSection::DATA, cardOffsets[inst->global]);
+        }
+        break;
+    case Opcode::ALLOC:
+        // Every cell takes 8 bytes like a global
+        loadBits(RDI, inst->operands[0]);
+        assembler.movImmediate(RCX, 8);
+        assembler.imul(RDI, RCX);
+        callSymbol(externalSymbol("iron_alloc"));
+        storeBits(inst, RAX);
+        break;
+    case Opcode::FREE:
+        generateCall(externalSymbol("iron_free"), inst->operands, inst);
+        break;
+    case Opcode::LOAD:
+        loadBits(RAX, inst->operands[0]);
+        assembler.load(RAX, RAX, 0);
+        storeBits(inst, RAX);
+        break;
+    case Opcode::STORE:
+        loadBits(RAX, inst->operands[0]);
+        loadBits(RCX, inst->operands[1]);
+        assembler.store(RAX, 0, RCX);
+        break;
+    case Opcode::NEW_ARRAY:
+        generateCall(externalSymbol("iron_array_new"), {inst->operands[0], module.constantInt(8)}, inst);
+        break;
+    case Opcode::LENGTH:
+        loadBits(RAX, inst->operands[0]);
+        assembler.load(RAX, RAX, 0);
+        storeBits(inst, RAX);
+        break;
+    case Opcode::ELEMENT:
+        // The elements follow the length, 8 bytes each
+        loadBits(RAX, inst->operands[0]);
+        loadBits(RCX, inst->operands[1]);
+        assembler.shl(RCX, 3);
+        assembler.alu(AluOp::ADD, RAX, RCX);
+        assembler.lea(RAX, RAX, 8);
+        storeBits(inst, RAX);
+        break;
+    case Opcode::CHECK_BOUNDS:
+    {
+        // Unsigned, so a negative index fails too. The panic never returns so no register has to be saved for it
+        Label inRange = assembler.newLabel();
+        loadBits(RAX, inst->operands[0]);
+        loadBits(RCX, inst->operands[1]);
+        assembler.alu(AluOp::CMP, RAX, RCX);
+        assembler.jcc(Cond::B, inRange);
+        loadBits(RDI, module.constantString("Index out of bounds in '" + function->name + "'"));
+        callSymbol(externalSymbol("iron_panic"));
+        assembler.bind(inRange);
+        break;
+    }
+    default:
+        throw std::runtime_error("Cannot generate code for '" + opcodeName(inst->op) + "'");
+    }
+}
+
+// idiv faults on INT64_MIN / -1, the language wraps instead so -1 gets its own path.
+// A zero divisor panics like in the other backends instead of raising SIGFPE
+void X86CodeGenerator::generateIntegerDivision(Instruction *inst)
+{
+    Label nonZero = assembler.newLabel();
+    Label normal = assembler.newLabel();
+    Label done = assembler.newLabel();
+    loadBits(RCX, inst->operands[1]);
+    assembler.test(RCX, RCX);
+    assembler.jcc(Cond::NE, nonZero);
+    loadBits(RDI, module.constantString("Division by zero in '" + function->name + "'"));
+    callSymbol(externalSymbol("iron_panic"));
+    assembler.bind(nonZero);
+    loadBits(RAX, inst->operands[0]);
+    assembler.aluImmediate(AluOp::CMP, RCX, -1);
+    assembler.jcc(Cond::NE, normal);
+    if (inst->op == Opcode::DIV)
+        assembler.neg(RAX);
+    else
+        assembler.movImmediate(RAX, 0);
+    assembler.jmp(done);
+    assembler.bind(normal);
+    assembler.cqo();
+    assembler.idiv(RCX);
+    if (inst->op == Opcode::MOD)
+        assembler.mov(RAX, RDX);
+    assembler.bind(done);
+    storeBits(inst, RAX);
+}
+
+// ucomisd sets the parity flag for NaN, equality has to rule it out and inequality has to accept it.
+// Less than swaps the operands so every ordering test is an unsigned above check that NaN fails
+void X86CodeGenerator::generateFloatCompare(Instruction *inst)
+{
+    bool swap = inst->op == Opcode::LT || inst->op == Opcode::LE;
+    loadFloat(XMM0, inst->operands[swap ? 1 : 0]);
+    loadFloat(XMM1, inst->operands[swap ? 0 : 1]);
+    assembler.ucomisd(XMM0, XMM1);
+    switch (inst->op)
+    {
+    case Opcode::EQ:
+    case Opcode::NE:
+    {
+        bool equal = inst->op == Opcode::EQ;
+        assembler.setcc(equal ? Cond::E : Cond::NE, RAX);
+        assembler.setcc(equal ? Cond::NP : Cond::P, RCX);
+        assembler.movzxByte(RAX, RAX);
+        assembler.movzxByte(RCX, RCX);
+        assembler.alu(equal ? AluOp::AND : AluOp::OR, RAX, RCX);
+        break;
+    }
+    case Opcode::GT:
+    case Opcode::LT:
+        assembler.setcc(Cond::A, RAX);
+        assembler.movzxByte(RAX, RAX);
+        break;
+    default:
+        assembler.setcc(Cond::AE, RAX);
+        assembler.movzxByte(RAX, RAX);
+    }
+    storeBits(inst, RAX);
+}
+
+void X86CodeGenerator::generateStringCompare(Instruction *inst)
+{
+    generateCall(externalSymbol("strcmp"), inst->operands, nullptr);
+    assembler.movsxd(RAX, RAX);
+    assembler.aluImmediate(AluOp::CMP, RAX, 0);
+    assembler.setcc(conditionOf(inst->op), RAX);
+    assembler.movzxByte(RAX, RAX);
+    storeBits(inst, RAX);
+}
+
+// Every argument is pushed before the first argument register is written, so filling rdi can not clobber
+// a value another argument still has to be read from
+void X86CodeGenerator::generateCall(uint32_t symbol, const std::vector<Value *> &args, Instruction *result)
+{
+    struct Slot
+    {
+        bool isFloat;
+        uint8_t reg;
+    };
+    std::vector<Slot> slots;
+    size_t intIndex = 0, floatIndex = 0;
+    for (auto arg : args)
+    {
+        if (isFloat(arg) ? floatIndex >= FLOAT_ARGUMENTS : intIndex >= std::size(INT_ARGUMENTS))
+            throw std::runtime_error("A call in '" + function->name + "' has more arguments than the native backend passes in registers");
+        slots.push_back(isFloat(arg) ? Slot{true, static_cast<uint8_t>(floatIndex++)} : Slot{false, INT_ARGUMENTS[intIndex++]});
+        loadBits(RAX, arg);
+        assembler.push(RAX);
+    }
+    for (auto it = slots.rbegin(); it != slots.rend(); ++it)
+    {
+        if (it->isFloat)
+        {
+            assembler.pop(RAX);
+            assembler.movqToXmm(static_cast<Xmm>(it->reg), RAX);
+        }
+        else
+        {
+            assembler.pop(static_cast<Reg>(it->reg));
+        }
+    }
+    callSymbol(symbol);
+
+    if (!result || result->scalar() == TypeSystem::VOID)
+        return;
+    if (isFloat(result))
+        storeFloat(result, XMM0);
+    else
+        storeBits(result, RAX);
+}
+
+// The argument slots are pushed last to first so they lie in order at rsp, iron_task_spawn copies them into the task
+void X86CodeGenerator::generateSpawn(Instruction *spawn)
+{
+    size_t count = spawn->operands.size();
+    size_t intCount = 0, floatCount = 0;
+    for (auto arg : spawn->operands)
+    {
+        (isFloat(arg) ? floatCount : intCount)++;
+    }
+    if (floatCount > FLOAT_ARGUMENTS || intCount > std::size(INT_ARGUMENTS))
+        throw std::runtime_error("A task started in '" + function->name + "' has more arguments than the native backend passes in registers");
+
+    size_t padding = count % 2; // rsp has to stay 16 byte aligned at the call
+    if (padding)
+        assembler.aluImmediate(AluOp::SUB, RSP, 8);
+    for (auto it = spawn->operands.rbegin(); it != spawn->operands.rend(); ++it)
+    {
+        loadBits(RAX, *it);
+        assembler.push(RAX);
+    }
+    assembler.mov(RSI, RSP);
+    assembler.movImmediate(RDX, count);
+    size_t at = assembler.leaRip(RDI);
+    object.textRelocations.push_back({at, thunkSymbol(spawn->callee), R_X86_64_PC32, -4});
+    callSymbol(externalSymbol("iron_task_spawn"));
+    if (count + padding)
+        assembler.aluImmediate(AluOp::ADD, RSP, 8 * static_cast<int32_t>(count + padding));
+    storeBits(spawn, RAX);
+}
+
+void X86CodeGenerator::generateReturn(Instruction *ret)
+{
+    if (!ret->operands.empty())
+    {
+        if (isFloat(ret->operands[0]))
+            loadFloat(XMM0, ret->operands[0]);
+        else
+            loadBits(RAX, ret->operands[0]);
+    }
+    // Epilogue, short enough to repeat at every return
+    const auto &saved = allocation->usedCalleeSaved();
+    assembler.lea(RSP, RBP, -8 * static_cast<int32_t>(saved.size()));
+    for (auto it = saved.rbegin(); it != saved.rend(); ++it)
+    {
+        assembler.pop(*it);
+    }
+    assembler.pop(RBP);
+    assembler.ret();
+}
+
+void X86CodeGenerator::generateBranch(Instruction *condbr, BasicBlock *next)
+{
+    BasicBlock *block = condbr->parent;
+    BasicBlock *ifTrue = condbr->targets[0];
+    BasicBlock *ifFalse = condbr->targets[1];
+    auto compare = dynamic_cast<Instruction *>(condbr->operands[0]);
+    Cond cond = Cond::NE;
+    if (compare && fusedCompares.count(compare))
+    {
+        loadBits(RAX, compare->operands[0]);
+        loadBits(RCX, compare->operands[1]);
+        assembler.alu(AluOp::CMP, RAX, RCX);
+        cond = conditionOf(compare->op);
+    }
+    else
+    {
+        loadBits(RAX, condbr->operands[0]);
+        assembler.test(RAX, RAX);
+    }
+
+    auto stubFor = [&](BasicBlock *to)
+    {
+        Label label = assembler.newLabel();
+        stubs.push_back({label, block, to});
+        return label;
+    };
+    auto hasPhis = [](BasicBlock *target)
+    { return !target->instructions.empty() && target->instructions.front()->isPhi(); };
+
+    bool truePhis = hasPhis(ifTrue);
+    bool falsePhis = hasPhis(ifFalse);
+    if (!truePhis && ifTrue == next)
+    {
+        assembler.jcc(invert(cond), falsePhis ? stubFor(ifFalse) : blockLabels[ifFalse]);
+    }
+    else if (!truePhis)
+    {
+        assembler.jcc(cond, blockLabels[ifTrue]);
+        generateEdge(block, ifFalse, next);
+    }
+    else if (!falsePhis)
+    {
+        assembler.jcc(invert(cond), blockLabels[ifFalse]);
+        generateEdge(block, ifTrue, next);
+    }
+    else
+    {
+        assembler.jcc(cond, stubFor(ifTrue));
+        generateEdge(block, ifFalse, next);
+    }
+}
+
+void X86CodeGenerator::generateEdge(BasicBlock *from, BasicBlock *to, BasicBlock *next)
+{
+    generateMoves(from, to);
+    if (to != next)
+        assembler.jmp(blockLabels[to]);
+}
+
+// Phis read all their inputs at once, with more than one move every source goes on the stack first
+void X86CodeGenerator::generateMoves(BasicBlock *from, BasicBlock *to)
+{
+    std::vector<std::pair<Instruction *, Value *>> moves;
+    for (auto inst : to->instructions)
+    {
+        if (!inst->isPhi())
+            break;
+        for (size_t i = 0; i < inst->operands.size(); ++i)
+        {
+            if (inst->targets[i] != from)
+                continue;
+            Location dst = allocation->location(inst);
+            if (dst.kind != LocationKind::NONE && (inst->operands[i]->kind == ValueKind::CONSTANT || !(allocation->location(inst->operands[i]) == dst)))
+                moves.push_back({inst, inst->operands[i]});
+            break;
+        }
+    }
+
+    if (moves.size() == 1)
+    {
+        loadBits(RAX, moves[0].second);
+        storeBits(moves[0].first, RAX);
+        return;
+    }
+    for (auto &[phi, src] : moves)
+    {
+        loadBits(RAX, src);
+        assembler.push(RAX);
+    }
+    for (auto it = moves.rbegin(); it != moves.rend(); ++it)
+    {
+        assembler.pop(RAX);
+        storeBits(it->first, RAX);
+    }
+}
+
+//---------OPERANDS----------
+void X86CodeGenerator::loadBits(Reg dst, Value *value)
+{
+    if (auto constant = dynamic_cast<Constant *>(value))
+    {
+        switch (constant->scalar())
+        {
+        case TypeSystem::INTEGER:
+            assembler.movImmediate(dst, constant->value.intValue);
+            break;
+        case TypeSystem::BOOLEAN:
+            assembler.movImmediate(dst, constant->value.boolValue);
+            break;
+        case TypeSystem::CHAR:
+            assembler.movImmediate(dst, constant->value.charValue);
+            break;
+        case TypeSystem::FLOAT:
+            relocateRip(assembler.loadRip(dst), ObjectSection::RODATA, rodataOffset(constant));
+            break;
+        case TypeSystem::STRING:
+            relocateRip(assembler.leaRip(dst), ObjectSection::RODATA, rodataOffset(constant));
+            break;
+        default:
+            assembler.movImmediate(dst, 0);
+        }
+        return;
+    }
+
+    Location location = allocation->location(value);
+    switch (location.kind)
+    {
+    case LocationKind::REGISTER:
+        if (location.reg != dst)
+            assembler.mov(dst, static_cast<Reg>(location.reg));
+        break;
+    case LocationKind::XMM:
+        assembler.movqFromXmm(dst, static_cast<Xmm>(location.reg));
+        break;
+    case LocationKind::STACK:
+        assembler.load(dst, RBP, location.offset);
+        break;
+    case LocationKind::NONE:
+        throw std::runtime_error("Value " + valueName(value) + " has no location in '" + function->name + "'");
+    }
+}
+
+void X86CodeGenerator::storeBits(Value *value, Reg src)
+{
+    Location location = allocation->location(value);
+    switch (location.kind)
+    {
+    case LocationKind::REGISTER:
+        if (location.reg != src)
+            assembler.mov(static_cast<Reg>(location.reg), src);
+        break;
+    case LocationKind::XMM:
+        assembler.movqToXmm(static_cast<Xmm>(location.reg), src);
+        break;
+    case LocationKind::STACK:
+        assembler.store(RBP, location.offset, src);
+        break;
+    case LocationKind::NONE:
+        break; // Never read
+    }
+}
+
+void X86CodeGenerator::loadFloat(Xmm dst, Value *value)
+{
+    if (auto constant = dynamic_cast<Constant *>(value))
+    {
+        relocateRip(assembler.loadsdRip(dst), ObjectSection::RODATA, rodataOffset(constant));
+        return;
+    }
+    Location location = allocation->location(value);
+    switch (location.kind)
+    {
+    case LocationKind::XMM:
+        if (location.reg != dst)
+            assembler.movsd(dst, static_cast<Xmm>(location.reg));
+        break;
+    case LocationKind::STACK:
+        assembler.loadsd(dst, RBP, location.offset);
+        break;
+    default:
+        loadBits(RAX, value);
+        assembler.movqToXmm(dst, RAX);
+    }
+}
+
+void X86CodeGenerator::storeFloat(Value *value, Xmm src)
+{
+    Location location = allocation->location(value);
+    switch (location.kind)
+    {
+    case LocationKind::XMM:
+        if (location.reg != src)
+            assembler.movsd(static_cast<Xmm>(location.reg), src);
+        break;
+    case LocationKind::STACK:
+        assembler.storesd(RBP, location.offset, src);
+        break;
+    case LocationKind::REGISTER:
+        assembler.movqFromXmm(static_cast<Reg>(location.reg), src);
+        break;
+    case LocationKind::NONE:
+        break;
+    }
+}
+
+//---------HELPER FUNCTIONS----------
+// Floats and strings live in .rodata, each constant once per object
+uint64_t X86CodeGenerator::rodataOffset(Constant *constant)
+{
+    auto it = constantOffsets.find(constant);
+    if (it != constantOffsets.end())
+        return it->second;
+
+    auto &rodata = object.rodata;
+    uint64_t offset;
+    if (constant->scalar() == TypeSystem::STRING)
+    {
+        offset = rodata.size();
+        rodata.insert(rodata.end(), constant->value.stringValue.begin(), constant->value.stringValue.end());
+        rodata.push_back(0);
+    }
+    else
+    {
+        while (rodata.size() % 8)
+        {
+            rodata.push_back(0);
+        }
+        offset = rodata.size();
+        uint64_t bits;
+        std::memcpy(&bits, &constant->value.floatValue, sizeof(bits));
+        for (int i = 0; i < 8; ++i)
+        {
+            rodata.push_back(bits >> (8 * i));
+        }
+    }
+    constantOffsets[constant] = offset;
+    return offset;
+}
+
+// The displacement is the last field of the instruction, so the cpu adds it to the address 4 bytes further on
+void X86CodeGenerator::relocateRip(size_t at, ObjectSection section, uint64_t offset)
+{
+    object.textRelocations.push_back({at, object.sectionSymbol(section), R_X86_64_PC32, static_cast<int64_t>(offset) - 4});
+}
+
+void X86CodeGenerator::callSymbol(uint32_t symbol)
+{
+    size_t at = assembler.call();
+    object.textRelocations.push_back({at, symbol, R_X86_64_PLT32, -4});
+}
+
+uint32_t X86CodeGenerator::externalSymbol(const std::string &name)
+{
+    auto it = externalSymbols.find(name);
+    if (it != externalSymbols.end())
+        return it->second;
+    uint32_t symbol = object.addSymbol({name, ObjectSection::UNDEFINED, 0, 0, true, false});
+    externalSymbols[name] = symbol;
+    return symbol;
+}
+
+// Thunks are local to the object, the body is generated once every function is done
+uint32_t X86CodeGenerator::thunkSymbol(Function *fn)
+{
+    auto it = thunkSymbols.find(fn);
+    if (it != thunkSymbols.end())
+        return it->second;
+    uint32_t symbol = object.addSymbol({"iron_thunk_" + symbolName(fn), ObjectSection::TEXT, 0, 0, false, true});
+    thunkSymbols[fn] = symbol;
+    thunkOrder.push_back(fn);
+    return symbol;
+}
+
+std::string X86CodeGenerator::symbolName(Function *fn) const
+{
+    if (fn->isTopLevel)
+        return ENTRY_NAME;
+    if (fn->name == "main")
+        return MAIN_NAME;
+    return fn->name;
+}
+
+// Only integer like compares fuse, float compares need the parity flag on top
+Instruction *X86CodeGenerator::fusableCompare(Instruction *condbr) const
+{
+    auto compare = dynamic_cast<Instruction *>(condbr->operands[0]);
+    if (!compare || compare->parent != condbr->parent || compare->users.size() != 1)
+        return nullptr;
+    if (compare->op < Opcode::EQ || compare->op > Opcode::GE)
+        return nullptr;
+    if (isString(compare->operands[0]) || isFloat(compare->operands[0]))
+        return nullptr;
+    auto &instructions = condbr->parent->instructions;
+    if (instructions.size() < 2 || instructions[instructions.size() - 2] != compare)
+        return nullptr;
+    return compare;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "elf.hpp"
+#include "ir/ir.hpp"
+#include "regalloc.hpp"
+#include "x86_64.hpp"
+
+// Single pass template code generator from the SSA IR to x86-64 for debug builds.
+// Every instruction expands to a fixed sequence that goes through rax, rcx and rdx (xmm0 and xmm1 for floats),
+// the values themselves live where the linear scan allocator put them. Follows the System V calling convention.
+// Strings are pointers to NUL terminated bytes, concatenation calls iron_string_concat from runtime/runtime.c.
+// Started tasks go through iron_task_spawn and iron_task_wait from runtime/tasks.c
+class X86CodeGenerator
+{
+    Module &module;
+    ObjectFile object;
+    Assembler assembler;
+    std::unordered_map<Function *, uint32_t> functionSymbols;
+    std::unordered_map<GlobalVariable *, uint64_t> globalOffsets; // Offset in .data
+    std::unordered_map<GlobalVariable *, uint64_t> cardOffsets;   // Card of every string global in .data, only when the collector runs
+    std::unordered_map<Constant *, uint64_t> constantOffsets;     // Offset in .rodata
+    std::unordered_map<std::string, uint32_t> externalSymbols;
+    std::unordered_map<Function *, uint32_t> thunkSymbols;        // Entry points of started tasks, see generateThunk
+    std::vector<Function *> thunkOrder;
+
+    // State of the function being generated
+    Function *function = nullptr;
+    std::unique_ptr<LinearScanAllocator> allocation;
+    std::unordered_map<BasicBlock *, Label> blockLabels;
+    std::unordered_set<Instruction *> fusedCompares;
+    struct Stub
+    {
+        Label label;
+        BasicBlock *from;
+        BasicBlock *to;
+    };
+    std::vector<Stub> stubs; // Edges that need their phi moves out of line
+
+public:
+    static constexpr const char *ENTRY_NAME = "__iron_toplevel"; // Symbol of the top level statements
+    static constexpr const char *MAIN_NAME = "iron_main";        // Symbol of the program's own main, "main" is the C entry point
+
+    X86CodeGenerator(Module &module, const std::string &sourceName);
+    const ObjectFile &generate();
+
+    static bool isCall(Instruction *inst); // Instructions that become a call and clobber the caller saved registers
+
+private:
+    void declareGlobals();
+    void generateFunction(Function *target);
+    void generateEntryPoint();
+    void generateThunk(Function *target);
+    void generateBlock(BasicBlock *block, BasicBlock *next);
+    void generateInstruction(Instruction *inst);
+    void generateBranch(Instruction *condbr, BasicBlock *next);
+    void generateEdge(BasicBlock *from, BasicBlock *to, BasicBlock *next);
+    void generateMoves(BasicBlock *from, BasicBlock *to);
+    void generateCall(uint32_t symbol, const std::vector<Value *> &args, Instruction *result);
+    void generateSpawn(Instruction *spawn);
+    void generateReturn(Instruction *ret);
+    void generateIntegerDivision(Instruction *inst);
+    void generateFloatCompare(Instruction *inst);
+    void generateStringCompare(Instruction *inst);
+
+    //---------OPERANDS----------
+    void loadBits(Reg dst, Value *value); // Raw 64 bits of any value
+    void storeBits(Value *value, Reg src);
+    void loadFloat(Xmm dst, Value *value);
+    void storeFloat(Value *value, Xmm src);
+
+    //---------HELPER FUNCTIONS----------
+    uint64_t rodataOffset(Constant *constant);
+    void relocateRip(size_t at, ObjectSection section, uint64_t offset); // rip relative operand pointing into a section
+    void callSymbol(uint32_t symbol);
+    uint32_t externalSymbol(const std::string &name);
+    uint32_t thunkSymbol(Function *fn);
+    std::string symbolName(Function *fn) const;
+    bool isFloat(const Value *value) const { return value->scalar() == TypeSystem::FLOAT; }
+    bool isString(const Value *value) const { return value->scalar() == TypeSystem::STRING; }
+    Instruction *fusableCompare(Instruction *condbr) const;
+};
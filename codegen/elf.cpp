@@ -0,0 +1,194 @@
+#include "elf.hpp"
+#include <fstream>
+
+// Section header indices of the object, the order never changes
+enum SectionIndex : uint16_t
+{
+    SEC_NULL,
+    SEC_TEXT,
+    SEC_DATA,
+    SEC_RODATA,
+    SEC_RELA_TEXT,
+    SEC_RELA_DATA,
+    SEC_SYMTAB,
+    SEC_STRTAB,
+    SEC_SHSTRTAB,
+    SEC_NOTE_STACK,
+    SEC_COUNT,
+};
+
+ObjectFile::ObjectFile(std::string sourceName) : sourceName(std::move(sourceName))
+{
+    symbols.push_back({}); // The null symbol
+    symbols.push_back({this->sourceName, ObjectSection::UNDEFINED});
+    sectionSymbols[static_cast<int>(ObjectSection::TEXT)] = addSymbol({".text", ObjectSection::TEXT, 0, 0, false, false, true});
+    sectionSymbols[static_cast<int>(ObjectSection::DATA)] = addSymbol({".data", ObjectSection::DATA, 0, 0, false, false, true});
+    sectionSymbols[static_cast<int>(ObjectSection::RODATA)] = addSymbol({".rodata", ObjectSection::RODATA, 0, 0, false, false, true});
+}
+
+uint32_t ObjectFile::addSymbol(ObjectSymbol symbol)
+{
+    symbols.push_back(std::move(symbol));
+    return symbols.size() - 1;
+}
+
+uint32_t ObjectFile::sectionSymbol(ObjectSection section) const
+{
+    return sectionSymbols[static_cast<int>(section)];
+}
+
+// Little endian writers, the object is always for x86-64 whatever the host is
+static void put(std::vector<uint8_t> &out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+    {
+        out.push_back(value >> (8 * i));
+    }
+}
+
+static void align(std::vector<uint8_t> &out, size_t alignment)
+{
+    while (out.size() % alignment)
+    {
+        out.push_back(0);
+    }
+}
+
+static uint32_t addString(std::vector<uint8_t> &table, const std::string &text)
+{
+    uint32_t at = table.size();
+    table.insert(table.end(), text.begin(), text.end());
+    table.push_back(0);
+    return at;
+}
+
+void ObjectFile::write(std::ostream &out) const
+{
+    // ELF wants every local symbol before the first global one
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> finalIndex(symbols.size());
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (uint32_t i = 0; i < symbols.size(); ++i)
+        {
+            if (symbols[i].isGlobal == (pass == 1))
+            {
+                finalIndex[i] = order.size();
+                order.push_back(i);
+            }
+        }
+    }
+    uint32_t firstGlobal = 0;
+    while (firstGlobal < order.size() && !symbols[order[firstGlobal]].isGlobal)
+    {
+        ++firstGlobal;
+    }
+
+    std::vector<uint8_t> strtab = {0};
+    std::vector<uint8_t> symtab;
+    for (uint32_t position = 0; position < order.size(); ++position)
+    {
+        const ObjectSymbol &symbol = symbols[order[position]];
+        uint8_t type = position == 1 ? 4 /* FILE */ : symbol.isSection ? 3 /* SECTION */ : symbol.isFunction ? 2 /* FUNC */ : symbol.section == ObjectSection::UNDEFINED ? 0 : 1 /* OBJECT */;
+        uint16_t shndx = position == 1 ? 0xFFF1 /* ABS */ : static_cast<uint16_t>(symbol.section); // ObjectSection matches the header index
+        put(symtab, position == 0 || symbol.isSection ? 0 : addString(strtab, symbol.name), 4);
+        put(symtab, position == 0 ? 0 : (symbol.isGlobal << 4) | type, 1);
+        put(symtab, 0, 1);
+        put(symtab, position == 0 ? 0 : shndx, 2);
+        put(symtab, symbol.offset, 8);
+        put(symtab, symbol.size, 8);
+    }
+
+    auto relocations = [&](const std::vector<ObjectRelocation> &list)
+    {
+        std::vector<uint8_t> bytes;
+        for (const auto &reloc : list)
+        {
+            put(bytes, reloc.offset, 8);
+            put(bytes, (static_cast<uint64_t>(finalIndex[reloc.symbol]) << 32) | reloc.type, 8);
+            put(bytes, static_cast<uint64_t>(reloc.addend), 8);
+        }
+        return bytes;
+    };
+    std::vector<uint8_t> relaText = relocations(textRelocations);
+    std::vector<uint8_t> relaData = relocations(dataRelocations);
+
+    std::vector<uint8_t> shstrtab = {0};
+    struct Header
+    {
+        uint32_t name = 0;
+        uint32_t type = 0;
+        uint64_t flags = 0;
+        const std::vector<uint8_t> *contents = nullptr;
+        uint32_t link = 0;
+        uint32_t info = 0;
+        uint64_t alignment = 1;
+        uint64_t entrySize = 0;
+        uint64_t offset = 0;
+    };
+    std::vector<uint8_t> none;
+    Header headers[SEC_COUNT];
+    headers[SEC_TEXT] = {addString(shstrtab, ".text"), 1, 2 | 4, &text, 0, 0, 16};
+    headers[SEC_DATA] = {addString(shstrtab, ".data"), 1, 1 | 2, &data, 0, 0, 8};
+    headers[SEC_RODATA] = {addString(shstrtab, ".rodata"), 1, 2, &rodata, 0, 0, 8};
+    headers[SEC_RELA_TEXT] = {addString(shstrtab, ".rela.text"), 4, 0x40, &relaText, SEC_SYMTAB, SEC_TEXT, 8, 24};
+    headers[SEC_RELA_DATA] = {addString(shstrtab, ".rela.data"), 4, 0x40, &relaData, SEC_SYMTAB, SEC_DATA, 8, 24};
+    headers[SEC_SYMTAB] = {addString(shstrtab, ".symtab"), 2, 0, &symtab, SEC_STRTAB, firstGlobal, 8, 24};
+    headers[SEC_STRTAB] = {addString(shstrtab, ".strtab"), 3, 0, &strtab};
+    headers[SEC_NOTE_STACK] = {addString(shstrtab, ".note.GNU-stack"), 1, 0, &none}; // Asks the linker for a non executable stack
+    headers[SEC_SHSTRTAB] = {addString(shstrtab, ".shstrtab"), 3, 0, &shstrtab};
+
+    std::vector<uint8_t> file(64, 0);
+    for (int i = 1; i < SEC_COUNT; ++i)
+    {
+        align(file, headers[i].alignment);
+        headers[i].offset = file.size();
+        file.insert(file.end(), headers[i].contents->begin(), headers[i].contents->end());
+    }
+    align(file, 8);
+    uint64_t sectionHeaders = file.size();
+    file.resize(file.size() + 64, 0); // The null section header
+    for (int i = 1; i < SEC_COUNT; ++i)
+    {
+        const Header &header = headers[i];
+        put(file, header.name, 4);
+        put(file, header.type, 4);
+        put(file, header.flags, 8);
+        put(file, 0, 8); // Address, always zero in a relocatable object
+        put(file, header.offset, 8);
+        put(file, header.contents->size(), 8);
+        put(file, header.link, 4);
+        put(file, header.info, 4);
+        put(file, header.alignment, 8);
+        put(file, header.entrySize, 8);
+    }
+
+    std::vector<uint8_t> elfHeader;
+    const uint8_t ident[16] = {0x7F, 'E', 'L', 'F', 2 /* 64 bit */, 1 /* little endian */, 1 /* version */};
+    elfHeader.insert(elfHeader.end(), ident, ident + 16);
+    put(elfHeader, 1, 2);  // ET_REL
+    put(elfHeader, 62, 2); // EM_X86_64
+    put(elfHeader, 1, 4);
+    put(elfHeader, 0, 8); // Entry
+    put(elfHeader, 0, 8); // Program headers
+    put(elfHeader, sectionHeaders, 8);
+    put(elfHeader, 0, 4);
+    put(elfHeader, 64, 2);
+    put(elfHeader, 0, 2);
+    put(elfHeader, 0, 2);
+    put(elfHeader, 64, 2);
+    put(elfHeader, SEC_COUNT, 2);
+    put(elfHeader, SEC_SHSTRTAB, 2);
+    std::copy(elfHeader.begin(), elfHeader.end(), file.begin());
+
+    out.write(reinterpret_cast<const char *>(file.data()), file.size());
+}
+
+bool ObjectFile::writeFile(const std::string &path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return false;
+    write(file);
+    return static_cast<bool>(file);
+}
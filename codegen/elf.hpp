@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Relocatable ELF64 object for x86-64, written straight from memory without going through an assembler.
+// The sections are fixed: .text, .data and .rodata plus the relocation and symbol tables that go with them
+
+enum class ObjectSection : uint8_t
+{
+    UNDEFINED,
+    TEXT,
+    DATA,
+    RODATA,
+};
+
+// Relocation types of the x86-64 psABI that the code generator uses
+inline constexpr uint32_t R_X86_64_64 = 1;
+inline constexpr uint32_t R_X86_64_PC32 = 2;
+inline constexpr uint32_t R_X86_64_PLT32 = 4;
+
+struct ObjectSymbol
+{
+    std::string name;
+    ObjectSection section;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    bool isGlobal = false;
+    bool isFunction = false;
+    bool isSection = false; // Section symbols are what relocations into .data and .rodata point at
+};
+
+struct ObjectRelocation
+{
+    uint64_t offset;
+    uint32_t symbol; // Index into ObjectFile::symbols
+    uint32_t type;
+    int64_t addend;
+};
+
+class ObjectFile
+{
+public:
+    std::string sourceName;
+    std::vector<uint8_t> text;
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> rodata;
+    std::vector<ObjectSymbol> symbols;
+    std::vector<ObjectRelocation> textRelocations;
+    std::vector<ObjectRelocation> dataRelocations;
+
+    explicit ObjectFile(std::string sourceName);
+
+    uint32_t addSymbol(ObjectSymbol symbol);
+    uint32_t sectionSymbol(ObjectSection section) const; // Index of the symbol standing for the whole section
+    void write(std::ostream &out) const;                  // Locals are moved in front of the globals as ELF wants
+    bool writeFile(const std::string &path) const;
+
+private:
+    uint32_t sectionSymbols[4] = {0, 0, 0, 0};
+};
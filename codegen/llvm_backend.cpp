@@ -0,0 +1,739 @@
+#include "llvm_backend.hpp"
+#include <stdexcept>
+
+LLVMCodeGenerator::LLVMCodeGenerator(Module &module, const std::string &sourceName, int optLevel)
+    : module(module), sourceName(sourceName), optLevel(optLevel)
+{
+    if (optLevel < 0 || optLevel > 3)
+        throw std::runtime_error("Unknown optimization level -O" + std::to_string(optLevel));
+}
+
+#ifdef IRON_HAVE_LLVM
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <llvm/Analysis/CGSCCPassManager.h>
+#include <llvm/Analysis/LoopAnalysisManager.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/OptimizationLevel.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include "codegen.hpp"
+
+namespace
+{
+    // One pass over the module, every IR value maps to exactly one LLVM value.
+    // int is i64, float is double, bool is i1, char is i8 and strings are i8* like in the template backend
+    class ModuleTranslator
+    {
+        Module &module;
+        llvm::LLVMContext &context;
+        llvm::Module &target;
+        llvm::IRBuilder<> builder;
+        std::unordered_map<Function *, llvm::Function *> functions;
+        std::unordered_map<GlobalVariable *, llvm::GlobalVariable *> globals;
+        std::unordered_map<GlobalVariable *, llvm::GlobalVariable *> cards; // String globals, only when the collector runs
+        std::unordered_map<Constant *, llvm::Constant *> strings;
+        llvm::FunctionCallee concat, compare, panic, spawnTask, waitTask, detachTask, zoneEnter, zoneExit, zoneConcat, gcInit, gcRoot, gcConcat, allocate, release, arrayNew;
+        std::unordered_map<Function *, llvm::Function *> thunks; // Entry points of started tasks
+
+        // State of the function being translated
+        Function *function = nullptr;
+        llvm::Function *current = nullptr;
+        std::unordered_map<Value *, llvm::Value *> values;
+        std::unordered_map<BasicBlock *, llvm::BasicBlock *> blocks;
+        std::unordered_map<BasicBlock *, llvm::BasicBlock *> exits; // Where the terminator landed, divisions split blocks
+        std::unordered_map<Opcode, llvm::BasicBlock *> panicBlocks;
+
+    public:
+        ModuleTranslator(Module &module, llvm::Module &target)
+            : module(module), context(target.getContext()), target(target), builder(target.getContext()) {}
+
+        void translate()
+        {
+            declareRuntime();
+            for (auto global : module.globals)
+            {
+                Constant *initial = global->initializer ? module.constant(*global->initializer) : module.zeroOf(global->type);
+                globals[global] = new llvm::GlobalVariable(target, typeOf(global->type->scalar), false, llvm::GlobalValue::ExternalLinkage,
+                                                           constantOf(initial), global->name);
+                if (module.usesCollector() && global->type->scalar == TypeSystem::STRING)
+                    cards[global] = new llvm::GlobalVariable(target, builder.getInt64Ty(), false, llvm::GlobalValue::InternalLinkage,
+                                                             builder.getInt64(0), "iron.card." + global->name);
+            }
+            for (auto fn : module.functions)
+            {
+                declareFunction(fn);
+            }
+            for (auto fn : module.functions)
+            {
+                translateFunction(fn);
+            }
+            defineEntryPoint();
+        }
+
+    private:
+        llvm::Type *typeOf(TypeSystem scalar)
+        {
+            switch (scalar)
+            {
+            case TypeSystem::INTEGER:
+                return builder.getInt64Ty();
+            case TypeSystem::FLOAT:
+                return builder.getDoubleTy();
+            case TypeSystem::BOOLEAN:
+                return builder.getInt1Ty();
+            case TypeSystem::CHAR:
+                return builder.getInt8Ty();
+            case TypeSystem::STRING:
+            case TypeSystem::POINTER: // Loads and stores cast to the pointee
+                return builder.getInt8PtrTy();
+            case TypeSystem::VOID:
+                return builder.getVoidTy();
+            default:
+                throw std::runtime_error("The LLVM backend can not represent an unknown type");
+            }
+        }
+
+        // System V wants bools and chars widened by whoever produces them
+        static llvm::Attribute::AttrKind extensionOf(TypeSystem scalar)
+        {
+            if (scalar == TypeSystem::BOOLEAN)
+                return llvm::Attribute::ZExt;
+            if (scalar == TypeSystem::CHAR)
+                return llvm::Attribute::SExt;
+            return llvm::Attribute::None;
+        }
+
+        void declareRuntime()
+        {
+            llvm::Type *text = builder.getInt8PtrTy();
+            concat = target.getOrInsertFunction("iron_string_concat", llvm::FunctionType::get(text, {text, text}, false));
+            compare = target.getOrInsertFunction("strcmp", llvm::FunctionType::get(builder.getInt32Ty(), {text, text}, false));
+            panic = target.getOrInsertFunction("iron_panic", llvm::FunctionType::get(builder.getVoidTy(), {text}, false));
+            auto panicFunction = llvm::cast<llvm::Function>(panic.getCallee());
+            panicFunction->setDoesNotReturn();
+            panicFunction->setDoesNotThrow();
+            panicFunction->addFnAttr(llvm::Attribute::Cold);
+            llvm::cast<llvm::Function>(concat.getCallee())->setDoesNotThrow();
+            llvm::cast<llvm::Function>(compare.getCallee())->setDoesNotThrow();
+            llvm::cast<llvm::Function>(compare.getCallee())->setOnlyReadsMemory();
+
+            // Task handles are kept as i64 like the other backends keep them in a word
+            llvm::Type *slots = builder.getInt64Ty()->getPointerTo();
+            llvm::Type *entry = llvm::FunctionType::get(builder.getInt64Ty(), {slots}, false)->getPointerTo();
+            spawnTask = target.getOrInsertFunction("iron_task_spawn", llvm::FunctionType::get(text, {entry, slots, builder.getInt32Ty()}, false));
+            waitTask = target.getOrInsertFunction("iron_task_wait", llvm::FunctionType::get(builder.getInt64Ty(), {text}, false));
+            detachTask = target.getOrInsertFunction("iron_task_detach", llvm::FunctionType::get(builder.getVoidTy(), {text}, false));
+
+            // Zone handles are words too, the zone goes after the strings like in the runtime
+            zoneEnter = target.getOrInsertFunction("iron_zone_enter", llvm::FunctionType::get(text, {}, false));
+            zoneExit = target.getOrInsertFunction("iron_zone_exit", llvm::FunctionType::get(builder.getVoidTy(), {text}, false));
+            zoneConcat = target.getOrInsertFunction("iron_zone_concat", llvm::FunctionType::get(text, {text, text, text}, false));
+            llvm::cast<llvm::Function>(zoneConcat.getCallee())->setDoesNotThrow();
+
+            gcInit = target.getOrInsertFunction("iron_gc_init", llvm::FunctionType::get(builder.getVoidTy(), {}, false));
+            gcRoot = target.getOrInsertFunction("iron_gc_root", llvm::FunctionType::get(builder.getVoidTy(), {text->getPointerTo(), slots}, false));
+            gcConcat = target.getOrInsertFunction("iron_gc_concat", llvm::FunctionType::get(text, {text, text}, false));
+            llvm::cast<llvm::Function>(gcConcat.getCallee())->setDoesNotThrow();
+
+            allocate = target.getOrInsertFunction("iron_alloc", llvm::FunctionType::get(text, {builder.getInt64Ty()}, false));
+            release = target.getOrInsertFunction("iron_free", llvm::FunctionType::get(builder.getVoidTy(), {text}, false));
+            auto allocateFunction = llvm::cast<llvm::Function>(allocate.getCallee());
+            allocateFunction->setDoesNotThrow();
+            allocateFunction->addRetAttr(llvm::Attribute::NoAlias); // Every call hands out fresh memory
+            llvm::cast<llvm::Function>(release.getCallee())->setDoesNotThrow();
+            arrayNew = target.getOrInsertFunction("iron_array_new", llvm::FunctionType::get(text, {builder.getInt64Ty(), builder.getInt64Ty()}, false));
+            auto arrayFunction = llvm::cast<llvm::Function>(arrayNew.getCallee());
+            arrayFunction->setDoesNotThrow();
+            arrayFunction->addRetAttr(llvm::Attribute::NoAlias);
+        }
+
+        // A task starts in a thunk that turns its argument slots back into a normal call
+        llvm::Function *thunkOf(Function *fn)
+        {
+            auto &thunk = thunks[fn];
+            if (thunk)
+                return thunk;
+            auto type = llvm::FunctionType::get(builder.getInt64Ty(), {builder.getInt64Ty()->getPointerTo()}, false);
+            thunk = llvm::Function::Create(type, llvm::GlobalValue::InternalLinkage, "iron_thunk_" + functions[fn]->getName(), target);
+            thunk->setDoesNotThrow();
+            llvm::IRBuilder<> body(llvm::BasicBlock::Create(context, "entry", thunk));
+            std::vector<llvm::Value *> args;
+            for (auto arg : fn->arguments)
+            {
+                llvm::Value *slot = body.CreateConstInBoundsGEP1_64(body.getInt64Ty(), thunk->getArg(0), arg->index);
+                args.push_back(fromBits(body, body.CreateLoad(body.getInt64Ty(), slot), arg->scalar()));
+            }
+            auto call = body.CreateCall(functions[fn], args);
+            call->setAttributes(functions[fn]->getAttributes());
+            if (fn->returnType->scalar == TypeSystem::VOID)
+                body.CreateRet(body.getInt64(0));
+            else
+                body.CreateRet(toBits(body, call, fn->returnType->scalar));
+            return thunk;
+        }
+
+        llvm::Value *toBits(llvm::IRBuilder<> &b, llvm::Value *value, TypeSystem scalar)
+        {
+            switch (scalar)
+            {
+            case TypeSystem::FLOAT:
+                return b.CreateBitCast(value, b.getInt64Ty());
+            case TypeSystem::STRING:
+            case TypeSystem::POINTER:
+                return b.CreatePtrToInt(value, b.getInt64Ty());
+            case TypeSystem::BOOLEAN:
+                return b.CreateZExt(value, b.getInt64Ty());
+            case TypeSystem::CHAR:
+                return b.CreateSExt(value, b.getInt64Ty());
+            default:
+                return value;
+            }
+        }
+
+        llvm::Value *fromBits(llvm::IRBuilder<> &b, llvm::Value *bits, TypeSystem scalar)
+        {
+            switch (scalar)
+            {
+            case TypeSystem::FLOAT:
+                return b.CreateBitCast(bits, b.getDoubleTy());
+            case TypeSystem::STRING:
+            case TypeSystem::POINTER:
+                return b.CreateIntToPtr(bits, b.getInt8PtrTy());
+            case TypeSystem::BOOLEAN:
+            case TypeSystem::CHAR:
+                return b.CreateTrunc(bits, typeOf(scalar));
+            default:
+                return bits;
+            }
+        }
+
+        // The slots live in one entry block alloca per spawn so a spawn in a loop does not grow the stack,
+        // the runtime copies them before it returns
+        llvm::Value *spawn(Instruction *inst)
+        {
+            llvm::Value *slots = llvm::ConstantPointerNull::get(builder.getInt64Ty()->getPointerTo());
+            if (!inst->operands.empty())
+            {
+                llvm::BasicBlock &entry = current->getEntryBlock();
+                llvm::IRBuilder<> top(&entry, entry.begin());
+                auto array = top.CreateAlloca(builder.getInt64Ty(), builder.getInt32(inst->operands.size()), "slots");
+                for (size_t i = 0; i < inst->operands.size(); ++i)
+                {
+                    llvm::Value *slot = builder.CreateConstInBoundsGEP1_64(builder.getInt64Ty(), array, i);
+                    builder.CreateStore(toBits(builder, valueOf(inst->operands[i]), inst->operands[i]->scalar()), slot);
+                }
+                slots = array;
+            }
+            llvm::Value *task = builder.CreateCall(spawnTask, {thunkOf(inst->callee), slots, builder.getInt32(inst->operands.size())});
+            return builder.CreatePtrToInt(task, builder.getInt64Ty());
+        }
+
+        void declareFunction(Function *fn)
+        {
+            std::vector<llvm::Type *> parameters;
+            for (auto arg : fn->arguments)
+            {
+                parameters.push_back(typeOf(arg->scalar()));
+            }
+            auto type = llvm::FunctionType::get(typeOf(fn->returnType->scalar), parameters, false);
+            std::string name = fn->isTopLevel ? X86CodeGenerator::ENTRY_NAME : fn->name == "main" ? X86CodeGenerator::MAIN_NAME : fn->name;
+            auto declared = llvm::Function::Create(type, llvm::GlobalValue::ExternalLinkage, name, target);
+            declared->setDoesNotThrow();
+            for (auto arg : fn->arguments)
+            {
+                declared->getArg(arg->index)->setName(arg->name);
+                if (extensionOf(arg->scalar()) != llvm::Attribute::None)
+                    declared->addParamAttr(arg->index, extensionOf(arg->scalar()));
+                if (arg->noalias)
+                    declared->addParamAttr(arg->index, llvm::Attribute::NoAlias);
+            }
+            if (extensionOf(fn->returnType->scalar) != llvm::Attribute::None)
+                declared->addRetAttr(extensionOf(fn->returnType->scalar));
+            functions[fn] = declared;
+        }
+
+        // The C entry point runs the top level statements and then the program's main when it has one
+        void defineEntryPoint()
+        {
+            auto entry = llvm::Function::Create(llvm::FunctionType::get(builder.getInt32Ty(), false), llvm::GlobalValue::ExternalLinkage, "main", target);
+            entry->setDoesNotThrow();
+            builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", entry));
+            if (module.usesCollector())
+            {
+                builder.CreateCall(gcInit);
+                for (auto global : module.globals)
+                {
+                    if (cards.count(global))
+                        builder.CreateCall(gcRoot, {globals[global], cards[global]});
+                }
+            }
+            Function *programMain = nullptr;
+            for (auto fn : module.functions)
+            {
+                if (fn->isTopLevel)
+                    builder.CreateCall(functions[fn]);
+                else if (fn->name == "main" && fn->arguments.empty())
+                    programMain = fn;
+            }
+            llvm::Value *status = builder.getInt32(0);
+            if (programMain)
+            {
+                llvm::Value *result = builder.CreateCall(functions[programMain]);
+                if (programMain->returnType->scalar == TypeSystem::INTEGER)
+                    status = builder.CreateTrunc(result, builder.getInt32Ty());
+            }
+            builder.CreateRet(status);
+        }
+
+        void translateFunction(Function *fn)
+        {
+            function = fn;
+            current = functions[fn];
+            values.clear();
+            blocks.clear();
+            exits.clear();
+            panicBlocks.clear();
+
+            for (auto arg : fn->arguments)
+            {
+                values[arg] = current->getArg(arg->index);
+            }
+            for (auto block : fn->blocks)
+            {
+                blocks[block] = llvm::BasicBlock::Create(context, block->label, current);
+            }
+
+            // Blocks are in reverse post order so every operand except a phi input is already translated
+            for (auto block : fn->blocks)
+            {
+                builder.SetInsertPoint(blocks[block]);
+                for (auto inst : block->instructions)
+                {
+                    if (inst->isTerminator())
+                        exits[block] = builder.GetInsertBlock();
+                    translateInstruction(inst);
+                }
+            }
+
+            for (auto block : fn->blocks)
+            {
+                for (auto inst : block->instructions)
+                {
+                    if (!inst->isPhi())
+                        break;
+                    auto phi = llvm::cast<llvm::PHINode>(values[inst]);
+                    for (size_t i = 0; i < inst->operands.size(); ++i)
+                    {
+                        phi->addIncoming(valueOf(inst->operands[i]), exits[inst->targets[i]]);
+                    }
+                }
+            }
+        }
+
+        void translateInstruction(Instruction *inst)
+        {
+            llvm::Value *result = nullptr;
+            auto operand = [&](size_t index)
+            { return valueOf(inst->operands[index]); };
+            bool isFloat = inst->scalar() == TypeSystem::FLOAT;
+
+            switch (inst->op)
+            {
+            case Opcode::ADD:
+                result = isFloat ? builder.CreateFAdd(operand(0), operand(1)) : builder.CreateAdd(operand(0), operand(1));
+                break;
+            case Opcode::SUB:
+                result = isFloat ? builder.CreateFSub(operand(0), operand(1)) : builder.CreateSub(operand(0), operand(1));
+                break;
+            case Opcode::MUL:
+                result = isFloat ? builder.CreateFMul(operand(0), operand(1)) : builder.CreateMul(operand(0), operand(1));
+                break;
+            case Opcode::DIV:
+                result = isFloat ? builder.CreateFDiv(operand(0), operand(1)) : integerDivision(inst);
+                break;
+            case Opcode::MOD:
+                result = isFloat ? builder.CreateFRem(operand(0), operand(1)) : integerDivision(inst);
+                break;
+            case Opcode::NEG:
+                result = isFloat ? builder.CreateFNeg(operand(0)) : builder.CreateNeg(operand(0));
+                break;
+            case Opcode::EQ:
+            case Opcode::NE:
+            case Opcode::LT:
+            case Opcode::GT:
+            case Opcode::LE:
+            case Opcode::GE:
+                result = comparison(inst);
+                break;
+            case Opcode::NOT:
+                result = builder.CreateNot(operand(0));
+                break;
+            case Opcode::CONCAT:
+                if (inst->collected)
+                    result = builder.CreateCall(gcConcat, {operand(0), operand(1)});
+                else if (inst->operands.size() == 3)
+                    result = builder.CreateCall(zoneConcat, {operand(0), operand(1), builder.CreateIntToPtr(operand(2), builder.getInt8PtrTy())});
+                else
+                    result = builder.CreateCall(concat, {operand(0), operand(1)});
+                break;
+            case Opcode::ZONE_ENTER:
+                result = builder.CreatePtrToInt(builder.CreateCall(zoneEnter), builder.getInt64Ty());
+                break;
+            case Opcode::ZONE_EXIT:
+                builder.CreateCall(zoneExit, {builder.CreateIntToPtr(operand(0), builder.getInt8PtrTy())});
+                break;
+            case Opcode::ITOF:
+                result = builder.CreateSIToFP(operand(0), builder.getDoubleTy());
+                break;
+            case Opcode::CALL:
+            {
+                std::vector<llvm::Value *> args;
+                for (size_t i = 0; i < inst->operands.size(); ++i)
+                {
+                    args.push_back(operand(i));
+                }
+                auto call = builder.CreateCall(functions[inst->callee], args);
+                call->setAttributes(functions[inst->callee]->getAttributes());
+                if (inst->scalar() != TypeSystem::VOID)
+                    result = call;
+                break;
+            }
+            case Opcode::SPAWN:
+                result = spawn(inst);
+                break;
+            case Opcode::JOIN:
+            {
+                llvm::Value *bits = builder.CreateCall(waitTask, {builder.CreateIntToPtr(operand(0), builder.getInt8PtrTy())});
+                if (inst->scalar() != TypeSystem::VOID)
+                    result = fromBits(builder, bits, inst->scalar());
+                break;
+            }
+            case Opcode::DETACH:
+                builder.CreateCall(detachTask, {builder.CreateIntToPtr(operand(0), builder.getInt8PtrTy())});
+                break;
+            case Opcode::PHI:
+                result = builder.CreatePHI(typeOf(inst->scalar()), inst->operands.size()); // Inputs are added once every block exists
+                break;
+            case Opcode::LOAD_GLOBAL:
+                result = builder.CreateLoad(typeOf(inst->global->type->scalar), globals[inst->global]);
+                break;
+            case Opcode::STORE_GLOBAL:
+                builder.CreateStore(operand(0), globals[inst->global]);
+                if (cards.count(inst->global))
+                    builder.CreateStore(builder.getInt64(1), cards[inst->global]); // Write barrier
+                break;
+            case Opcode::ALLOC:
+            {
+                llvm::Type *element = typeOf(inst->type->element->scalar);
+                llvm::Value *size = builder.CreateMul(operand(0), builder.getInt64(target.getDataLayout().getTypeAllocSize(element)));
+                result = builder.CreateCall(allocate, {size});
+                break;
+            }
+            case Opcode::FREE:
+                builder.CreateCall(release, {operand(0)});
+                break;
+            case Opcode::LOAD:
+            {
+                llvm::Type *type = typeOf(inst->scalar());
+                result = builder.CreateLoad(type, builder.CreateBitCast(operand(0), type->getPointerTo()));
+                break;
+            }
+            case Opcode::STORE:
+                builder.CreateStore(operand(1), builder.CreateBitCast(operand(0), operand(1)->getType()->getPointerTo()));
+                break;
+            case Opcode::NEW_ARRAY:
+            {
+                llvm::Type *element = typeOf(inst->type->element->scalar);
+                result = builder.CreateCall(arrayNew, {operand(0), builder.getInt64(target.getDataLayout().getTypeAllocSize(element))});
+                break;
+            }
+            case Opcode::LENGTH:
+                result = builder.CreateLoad(builder.getInt64Ty(), builder.CreateBitCast(operand(0), builder.getInt64Ty()->getPointerTo()));
+                break;
+            case Opcode::ELEMENT:
+            {
+                // The elements start one word in, after the length
+                llvm::Type *element = typeOf(inst->type->element->scalar);
+                llvm::Value *first = builder.CreateConstInBoundsGEP1_64(builder.getInt64Ty(), builder.CreateBitCast(operand(0), builder.getInt64Ty()->getPointerTo()), 1);
+                llvm::Value *address = builder.CreateInBoundsGEP(element, builder.CreateBitCast(first, element->getPointerTo()), operand(1));
+                result = builder.CreateBitCast(address, builder.getInt8PtrTy());
+                break;
+            }
+            case Opcode::CHECK_BOUNDS:
+            {
+                // Unsigned, so a negative index fails too
+                auto rest = llvm::BasicBlock::Create(context, "", current);
+                builder.CreateCondBr(builder.CreateICmpULT(operand(0), operand(1)), rest, panicBlock(inst->op));
+                builder.SetInsertPoint(rest);
+                break;
+            }
+            case Opcode::BR:
+                builder.CreateBr(blocks[inst->targets[0]]);
+                break;
+            case Opcode::CONDBR:
+                builder.CreateCondBr(operand(0), blocks[inst->targets[0]], blocks[inst->targets[1]]);
+                break;
+            case Opcode::RET:
+                if (inst->operands.empty())
+                    builder.CreateRetVoid();
+                else
+                    builder.CreateRet(operand(0));
+                break;
+            }
+
+            if (result)
+            {
+                if (!inst->name.empty())
+                    result->setName(inst->name);
+                values[inst] = result;
+            }
+        }
+
+        llvm::Value *comparison(Instruction *inst)
+        {
+            llvm::Value *left = valueOf(inst->operands[0]);
+            llvm::Value *right = valueOf(inst->operands[1]);
+            int index = static_cast<int>(inst->op) - static_cast<int>(Opcode::EQ); // EQ NE LT GT LE GE
+            switch (inst->operands[0]->scalar())
+            {
+            case TypeSystem::FLOAT:
+            {
+                // Ordered so NaN fails every test except !=, like the VM and the template backend
+                static const llvm::CmpInst::Predicate predicates[] = {llvm::CmpInst::FCMP_OEQ, llvm::CmpInst::FCMP_UNE, llvm::CmpInst::FCMP_OLT,
+                                                                      llvm::CmpInst::FCMP_OGT, llvm::CmpInst::FCMP_OLE, llvm::CmpInst::FCMP_OGE};
+                return builder.CreateFCmp(predicates[index], left, right);
+            }
+            case TypeSystem::STRING:
+                left = builder.CreateCall(compare, {left, right});
+                right = builder.getInt32(0);
+                break;
+            case TypeSystem::BOOLEAN:
+            {
+                static const llvm::CmpInst::Predicate predicates[] = {llvm::CmpInst::ICMP_EQ, llvm::CmpInst::ICMP_NE, llvm::CmpInst::ICMP_ULT,
+                                                                      llvm::CmpInst::ICMP_UGT, llvm::CmpInst::ICMP_ULE, llvm::CmpInst::ICMP_UGE};
+                return builder.CreateICmp(predicates[index], left, right);
+            }
+            default:
+                break;
+            }
+            static const llvm::CmpInst::Predicate predicates[] = {llvm::CmpInst::ICMP_EQ, llvm::CmpInst::ICMP_NE, llvm::CmpInst::ICMP_SLT,
+                                                                  llvm::CmpInst::ICMP_SGT, llvm::CmpInst::ICMP_SLE, llvm::CmpInst::ICMP_SGE};
+            return builder.CreateICmp(predicates[index], left, right);
+        }
+
+        // sdiv is undefined for a zero divisor and for INT64_MIN / -1. Zero stops the program like the VM does,
+        // -1 divides by 1 instead and negates so the result wraps. Constant divisors need neither check
+        llvm::Value *integerDivision(Instruction *inst)
+        {
+            bool isDivision = inst->op == Opcode::DIV;
+            llvm::Value *left = valueOf(inst->operands[0]);
+            llvm::Value *right = valueOf(inst->operands[1]);
+            auto constant = dynamic_cast<Constant *>(inst->operands[1]);
+            if (constant && constant->value.type == TypeSystem::INTEGER && constant->value.intValue != 0)
+            {
+                if (constant->value.intValue == -1)
+                    return isDivision ? builder.CreateNeg(left) : static_cast<llvm::Value *>(builder.getInt64(0));
+                return isDivision ? builder.CreateSDiv(left, right) : builder.CreateSRem(left, right);
+            }
+
+            auto rest = llvm::BasicBlock::Create(context, "", current);
+            builder.CreateCondBr(builder.CreateICmpEQ(right, builder.getInt64(0)), panicBlock(inst->op), rest);
+            builder.SetInsertPoint(rest);
+            llvm::Value *minusOne = builder.CreateICmpEQ(right, builder.getInt64(-1));
+            llvm::Value *divisor = builder.CreateSelect(minusOne, builder.getInt64(1), right);
+            if (isDivision)
+                return builder.CreateSelect(minusOne, builder.CreateNeg(left), builder.CreateSDiv(left, divisor));
+            return builder.CreateSelect(minusOne, builder.getInt64(0), builder.CreateSRem(left, divisor));
+        }
+
+        // One cold block per function and operator that reports the error and never returns
+        llvm::BasicBlock *panicBlock(Opcode op)
+        {
+            auto &block = panicBlocks[op];
+            if (block)
+                return block;
+            block = llvm::BasicBlock::Create(context, "panic", current);
+            llvm::IRBuilder<> cold(block);
+            std::string message = op == Opcode::CHECK_BOUNDS ? "Index out of bounds" : std::string(op == Opcode::DIV ? "Division" : "Modulo") + " by zero";
+            message += " in '" + function->name + "'";
+            cold.CreateCall(panic, {cold.CreateGlobalStringPtr(message)});
+            cold.CreateUnreachable();
+            return block;
+        }
+
+        llvm::Value *valueOf(Value *value)
+        {
+            if (auto constant = dynamic_cast<Constant *>(value))
+                return constantOf(constant);
+            auto it = values.find(value);
+            if (it == values.end())
+                throw std::runtime_error("Value " + valueName(value) + " used before it was translated in '" + function->name + "'");
+            return it->second;
+        }
+
+        llvm::Constant *constantOf(Constant *constant)
+        {
+            if (constant->value.type == TypeSystem::UNKNOWN)
+                return llvm::UndefValue::get(typeOf(constant->scalar()));
+            switch (constant->value.type)
+            {
+            case TypeSystem::INTEGER:
+                return builder.getInt64(constant->value.intValue);
+            case TypeSystem::FLOAT:
+                return llvm::ConstantFP::get(builder.getDoubleTy(), constant->value.floatValue);
+            case TypeSystem::BOOLEAN:
+                return builder.getInt1(constant->value.boolValue);
+            case TypeSystem::CHAR:
+                return builder.getInt8(constant->value.charValue);
+            case TypeSystem::STRING:
+                return stringOf(constant);
+            default:
+                return llvm::UndefValue::get(typeOf(constant->scalar()));
+            }
+        }
+
+        // Every string constant becomes one private NUL terminated array
+        llvm::Constant *stringOf(Constant *constant)
+        {
+            auto &slot = strings[constant];
+            if (slot)
+                return slot;
+            auto data = llvm::ConstantDataArray::getString(context, constant->value.stringValue, true);
+            auto storage = new llvm::GlobalVariable(target, data->getType(), true, llvm::GlobalValue::PrivateLinkage, data, ".str");
+            storage->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+            storage->setAlignment(llvm::Align(1));
+            llvm::Constant *zero = builder.getInt64(0);
+            slot = llvm::ConstantExpr::getInBoundsGetElementPtr(data->getType(), storage, llvm::ArrayRef<llvm::Constant *>{zero, zero});
+            return slot;
+        }
+    };
+
+    std::unique_ptr<llvm::TargetMachine> createTargetMachine(int optLevel)
+    {
+        static std::once_flag initialized;
+        std::call_once(initialized, []
+                       {
+                           llvm::InitializeNativeTarget();
+                           llvm::InitializeNativeTargetAsmPrinter(); });
+
+        std::string triple = llvm::sys::getDefaultTargetTriple();
+        std::string error;
+        const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, error);
+        if (!target)
+            throw std::runtime_error("LLVM has no target for " + triple + ": " + error);
+        static const llvm::CodeGenOpt::Level levels[] = {llvm::CodeGenOpt::None, llvm::CodeGenOpt::Less, llvm::CodeGenOpt::Default, llvm::CodeGenOpt::Aggressive};
+        std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(triple, "generic", "", llvm::TargetOptions(), llvm::Reloc::PIC_, llvm::None, levels[optLevel]));
+        if (!machine)
+            throw std::runtime_error("LLVM could not create a target machine for " + triple);
+        return machine;
+    }
+
+    // Translates, verifies and runs the pipeline of the level, shared by both outputs
+    std::unique_ptr<llvm::Module> optimizedModule(Module &module, const std::string &sourceName, int optLevel,
+                                                  llvm::LLVMContext &context, llvm::TargetMachine &machine)
+    {
+        auto target = std::make_unique<llvm::Module>(sourceName, context);
+        target->setTargetTriple(machine.getTargetTriple().str());
+        target->setDataLayout(machine.createDataLayout());
+        ModuleTranslator(module, *target).translate();
+
+        // A broken module is a bug in the translator, LLVM would only crash further on
+        std::string problems;
+        llvm::raw_string_ostream problemStream(problems);
+        if (llvm::verifyModule(*target, &problemStream))
+            throw std::runtime_error("LLVM rejected the translated module: " + problemStream.str());
+
+        llvm::LoopAnalysisManager loops;
+        llvm::FunctionAnalysisManager functions;
+        llvm::CGSCCAnalysisManager sccs;
+        llvm::ModuleAnalysisManager modules;
+        llvm::PassBuilder passBuilder(&machine);
+        passBuilder.registerModuleAnalyses(modules);
+        passBuilder.registerCGSCCAnalyses(sccs);
+        passBuilder.registerFunctionAnalyses(functions);
+        passBuilder.registerLoopAnalyses(loops);
+        passBuilder.crossRegisterProxies(loops, functions, sccs, modules);
+
+        static const llvm::OptimizationLevel levels[] = {llvm::OptimizationLevel::O0, llvm::OptimizationLevel::O1, llvm::OptimizationLevel::O2, llvm::OptimizationLevel::O3};
+        llvm::ModulePassManager passes = optLevel == 0 ? passBuilder.buildO0DefaultPipeline(levels[0]) : passBuilder.buildPerModuleDefaultPipeline(levels[optLevel]);
+        passes.run(*target, modules);
+        return target;
+    }
+}
+
+bool LLVMCodeGenerator::isAvailable()
+{
+    return true;
+}
+
+void LLVMCodeGenerator::writeObject(const std::string &path)
+{
+    using Clock = std::chrono::steady_clock;
+    llvm::LLVMContext context;
+    auto machine = createTargetMachine(optLevel);
+    auto optimizeStart = Clock::now();
+    auto target = optimizedModule(module, sourceName, optLevel, context, *machine);
+    optimizeSeconds = std::chrono::duration<double>(Clock::now() - optimizeStart).count();
+    llvmInstructions = target->getInstructionCount();
+
+    std::error_code error;
+    llvm::raw_fd_ostream out(path, error, llvm::sys::fs::OF_None);
+    if (error)
+        throw std::runtime_error("Failed to write " + path + ": " + error.message());
+    auto emitStart = Clock::now();
+    llvm::legacy::PassManager emitter;
+    if (machine->addPassesToEmitFile(emitter, out, nullptr, llvm::CGFT_ObjectFile))
+        throw std::runtime_error("LLVM can not emit object files for " + machine->getTargetTriple().str());
+    emitter.run(*target);
+    out.flush();
+    emitSeconds = std::chrono::duration<double>(Clock::now() - emitStart).count();
+}
+
+void LLVMCodeGenerator::writeIR(const std::string &path)
+{
+    using Clock = std::chrono::steady_clock;
+    llvm::LLVMContext context;
+    auto machine = createTargetMachine(optLevel);
+    auto optimizeStart = Clock::now();
+    auto target = optimizedModule(module, sourceName, optLevel, context, *machine);
+    optimizeSeconds = std::chrono::duration<double>(Clock::now() - optimizeStart).count();
+    llvmInstructions = target->getInstructionCount();
+
+    std::error_code error;
+    llvm::raw_fd_ostream out(path, error, llvm::sys::fs::OF_None);
+    if (error)
+        throw std::runtime_error("Failed to write " + path + ": " + error.message());
+    target->print(out, nullptr);
+}
+
+#else
+
+bool LLVMCodeGenerator::isAvailable()
+{
+    return false;
+}
+
+void LLVMCodeGenerator::writeObject(const std::string &)
+{
+    throw std::runtime_error("This iron was built without LLVM, rebuild it with -DIRON_HAVE_LLVM to use -O");
+}
+
+void LLVMCodeGenerator::writeIR(const std::string &)
+{
+    throw std::runtime_error("This iron was built without LLVM, rebuild it with -DIRON_HAVE_LLVM to use -O");
+}
+
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include "ir/ir.hpp"
+
+// Release backend, translates the SSA IR to LLVM IR and runs LLVM's own pipelines on it.
+// Only built when the compiler is compiled with IRON_HAVE_LLVM, the header stays free of LLVM so the rest
+// of the compiler never needs its includes. Symbols, calling convention and runtime are the same as the
+// template backend so objects from both link with runtime/runtime.c the same way
+class LLVMCodeGenerator
+{
+    Module &module;
+    std::string sourceName;
+    int optLevel; // 0 to 3, picks the new pass manager pipeline and the code generator level
+
+public:
+    // Stats of the last write, for the log
+    size_t llvmInstructions = 0; // After optimization
+    double optimizeSeconds = 0;
+    double emitSeconds = 0;
+
+    LLVMCodeGenerator(Module &module, const std::string &sourceName, int optLevel);
+
+    static bool isAvailable(); // False when the compiler was built without LLVM
+
+    void writeObject(const std::string &path);   // Throws when LLVM fails
+    void writeIR(const std::string &path);      // Optimized textual LLVM IR
+};
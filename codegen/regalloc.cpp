@@ -0,0 +1,244 @@
+#include "regalloc.hpp"
+#include <algorithm>
+#include "ir/liveness.hpp"
+
+// rax, rcx and rdx are left out, the instruction templates use them as scratch (idiv needs rdx anyway)
+static const std::vector<Reg> CALLER_SAVED = {RSI, RDI, R8, R9, R10, R11};
+static const std::vector<Reg> CALLEE_SAVED = {RBX, R12, R13, R14, R15};
+
+LinearScanAllocator::LinearScanAllocator(Function *function, std::function<bool(Instruction *)> isCall)
+    : function(function), isCall(std::move(isCall)) {}
+
+const std::vector<Reg> &LinearScanAllocator::allocatableRegisters()
+{
+    static const std::vector<Reg> all = []
+    {
+        std::vector<Reg> regs = CALLER_SAVED;
+        regs.insert(regs.end(), CALLEE_SAVED.begin(), CALLEE_SAVED.end());
+        return regs;
+    }();
+    return all;
+}
+
+void LinearScanAllocator::run()
+{
+    buildIntervals();
+
+    // Arguments first, then the instructions in layout order, so equal starts keep a stable order
+    std::vector<LiveInterval *> ints, floats;
+    auto collect = [&](Value *value)
+    {
+        LiveInterval &interval = intervals[value->id];
+        if (interval.value)
+            (interval.isFloat ? floats : ints).push_back(&interval);
+    };
+    for (auto arg : function->arguments)
+    {
+        collect(arg);
+    }
+    for (auto block : function->blocks)
+    {
+        for (auto inst : block->instructions)
+        {
+            collect(inst);
+        }
+    }
+    allocate(ints, false);
+    allocate(floats, true);
+
+    // Spill slots sit below the saved registers, only now is it known how many of those there are
+    int32_t savedBytes = 8 * calleeSaved.size();
+    for (auto &location : locations)
+    {
+        if (location.kind == LocationKind::STACK)
+            location.offset = -savedBytes - 8 * (location.offset + 1);
+    }
+}
+
+Location LinearScanAllocator::location(Value *value) const
+{
+    if (value->kind == ValueKind::CONSTANT || value->id >= locations.size())
+        return Location{};
+    return locations[value->id];
+}
+
+void LinearScanAllocator::buildIntervals()
+{
+    Liveness liveness(function);
+    size_t count = function->arguments.size();
+    for (auto block : function->blocks)
+    {
+        count += block->instructions.size();
+    }
+    positions.assign(count, 0);
+    intervals.assign(count, LiveInterval{nullptr, 0, 0, false});
+    locations.assign(count, Location{});
+
+    // Two positions per instruction so a block's start and end never coincide with a neighbour's
+    std::vector<std::pair<uint32_t, uint32_t>> ranges; // By block id
+    std::vector<uint32_t> callPositions;
+    uint32_t position = 2;
+    for (auto block : function->blocks)
+    {
+        uint32_t start = position;
+        for (auto inst : block->instructions)
+        {
+            positions[inst->id] = position;
+            if (isCall(inst))
+                callPositions.push_back(position);
+            position += 2;
+        }
+        ranges.push_back({start, position - 2});
+    }
+
+    auto extend = [&](Value *value, uint32_t at)
+    {
+        if (value->kind == ValueKind::CONSTANT || value->scalar() == TypeSystem::VOID || value->scalar() == TypeSystem::UNKNOWN)
+            return;
+        LiveInterval &interval = intervals[value->id];
+        if (!interval.value)
+        {
+            interval = LiveInterval{value, at, at, value->scalar() == TypeSystem::FLOAT};
+            return;
+        }
+        interval.start = std::min(interval.start, at);
+        interval.end = std::max(interval.end, at);
+    };
+
+    for (auto arg : function->arguments)
+    {
+        extend(arg, 0);
+    }
+    for (auto block : function->blocks)
+    {
+        auto [start, end] = ranges[block->id];
+        for (auto value : liveness.in(block))
+        {
+            extend(value, start);
+        }
+        for (auto value : liveness.out(block))
+        {
+            extend(value, end);
+        }
+        for (auto inst : block->instructions)
+        {
+            if (inst->isPhi())
+            {
+                // The phi is written by the moves at the end of every predecessor
+                extend(inst, start);
+                for (auto pred : block->predecessors)
+                {
+                    extend(inst, ranges[pred->id].second);
+                }
+                continue;
+            }
+            extend(inst, positions[inst->id]);
+            for (auto operand : inst->operands)
+            {
+                extend(operand, positions[inst->id]);
+            }
+        }
+    }
+
+    for (auto &interval : intervals)
+    {
+        if (!interval.value)
+            continue;
+        auto call = std::upper_bound(callPositions.begin(), callPositions.end(), interval.start);
+        interval.crossesCall = call != callPositions.end() && *call < interval.end;
+    }
+}
+
+void LinearScanAllocator::allocate(std::vector<LiveInterval *> &work, bool isFloat)
+{
+    std::stable_sort(work.begin(), work.end(), [](LiveInterval *a, LiveInterval *b)
+                     { return a->start < b->start; });
+
+    std::vector<uint8_t> callerPool, calleePool;
+    if (isFloat)
+    {
+        // Every xmm register is caller saved, xmm0 and xmm1 are scratch
+        for (uint8_t reg = XMM2; reg <= XMM15; ++reg)
+        {
+            callerPool.push_back(reg);
+        }
+    }
+    else
+    {
+        callerPool.assign(CALLER_SAVED.begin(), CALLER_SAVED.end());
+        calleePool.assign(CALLEE_SAVED.begin(), CALLEE_SAVED.end());
+    }
+    const LocationKind kind = isFloat ? LocationKind::XMM : LocationKind::REGISTER;
+
+    struct Active
+    {
+        LiveInterval *interval;
+        uint8_t reg;
+    };
+    std::vector<Active> active;
+    std::vector<bool> taken(16, false);
+    auto spill = [&](LiveInterval *interval)
+    { locations[interval->value->id] = Location{LocationKind::STACK, 0, static_cast<int32_t>(spillSlots++)}; };
+
+    for (auto interval : work)
+    {
+        // Values whose last use is where this one is defined give their register back, the templates read
+        // every operand before they write the result
+        for (size_t i = 0; i < active.size();)
+        {
+            if (active[i].interval->end <= interval->start)
+            {
+                taken[active[i].reg] = false;
+                active.erase(active.begin() + i);
+                continue;
+            }
+            ++i;
+        }
+
+        std::vector<uint8_t> candidates;
+        if (!interval->crossesCall)
+            candidates = callerPool;
+        candidates.insert(candidates.end(), calleePool.begin(), calleePool.end());
+
+        int chosen = -1;
+        for (auto reg : candidates)
+        {
+            if (!taken[reg])
+            {
+                chosen = reg;
+                break;
+            }
+        }
+
+        if (chosen < 0)
+        {
+            // Everything is taken, the interval that lives the longest goes to the stack
+            Active *victim = nullptr;
+            for (auto &entry : active)
+            {
+                if (std::find(candidates.begin(), candidates.end(), entry.reg) == candidates.end())
+                    continue;
+                if (!victim || entry.interval->end > victim->interval->end)
+                    victim = &entry;
+            }
+            if (!victim || victim->interval->end <= interval->end)
+            {
+                spill(interval);
+                continue;
+            }
+            chosen = victim->reg;
+            spill(victim->interval);
+            *victim = Active{interval, static_cast<uint8_t>(chosen)};
+            locations[interval->value->id] = Location{kind, static_cast<uint8_t>(chosen)};
+            continue;
+        }
+
+        taken[chosen] = true;
+        active.push_back({interval, static_cast<uint8_t>(chosen)});
+        locations[interval->value->id] = Location{kind, static_cast<uint8_t>(chosen)};
+        if (!isFloat && std::find(CALLEE_SAVED.begin(), CALLEE_SAVED.end(), chosen) != CALLEE_SAVED.end() &&
+            std::find(calleeSaved.begin(), calleeSaved.end(), chosen) == calleeSaved.end())
+            calleeSaved.push_back(static_cast<Reg>(chosen));
+    }
+    std::sort(calleeSaved.begin(), calleeSaved.end());
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <functional>
+#include <vector>
+#include "ir/ir.hpp"
+#include "x86_64.hpp"
+
+enum class LocationKind : uint8_t
+{
+    NONE,
+    REGISTER,
+    XMM,
+    STACK,
+};
+
+struct Location
+{
+    LocationKind kind = LocationKind::NONE;
+    uint8_t reg = 0;    // Reg or Xmm depending on the kind
+    int32_t offset = 0; // rbp relative, STACK only
+
+    bool operator==(const Location &other) const { return kind == other.kind && reg == other.reg && offset == other.offset; }
+};
+
+struct LiveInterval
+{
+    Value *value;
+    uint32_t start;
+    uint32_t end;
+    bool isFloat;
+    bool crossesCall = false;
+};
+
+// Linear scan register allocation after Poletto and Sarkar.
+// Every value gets one interval spanning from its first to its last live position in the block layout, holes included,
+// and keeps a single location for its whole life. Values that live across a call can only use callee saved registers
+class LinearScanAllocator
+{
+    Function *function;
+    std::function<bool(Instruction *)> isCall;
+    // All by value id, the liveness snapshot numbers the arguments and instructions densely
+    std::vector<uint32_t> positions;
+    std::vector<LiveInterval> intervals; // A null value means the id never got an interval
+    std::vector<Location> locations;
+    std::vector<Reg> calleeSaved; // The ones that got used, the prologue saves them
+    uint32_t spillSlots = 0;
+
+public:
+    // isCall tells which instructions end up as a call and clobber the caller saved registers
+    LinearScanAllocator(Function *function, std::function<bool(Instruction *)> isCall);
+    void run();
+
+    Location location(Value *value) const;
+    const std::vector<Reg> &usedCalleeSaved() const { return calleeSaved; }
+    uint32_t spillSlotCount() const { return spillSlots; }
+
+    static const std::vector<Reg> &allocatableRegisters();
+
+private:
+    void buildIntervals();
+    void allocate(std::vector<LiveInterval *> &work, bool isFloat);
+};
@@ -0,0 +1,367 @@
+#include "x86_64.hpp"
+
+// Condition codes come in pairs that only differ in the lowest bit
+Cond invert(Cond cond)
+{
+    return static_cast<Cond>(static_cast<uint8_t>(cond) ^ 1);
+}
+
+void Assembler::emit32(uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        emit8(value >> (8 * i));
+    }
+}
+
+void Assembler::emit64(uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        emit8(value >> (8 * i));
+    }
+}
+
+void Assembler::rex(bool wide, uint8_t reg, uint8_t rm, bool force)
+{
+    uint8_t byte = 0x40 | (wide << 3) | ((reg >> 3) << 2) | (rm >> 3);
+    if (byte != 0x40 || force)
+        emit8(byte);
+}
+
+void Assembler::modrmDirect(uint8_t reg, uint8_t rm)
+{
+    emit8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// Always the disp32 form, rsp and r12 as base need a SIB byte
+void Assembler::modrmMemory(uint8_t reg, uint8_t base, int32_t disp)
+{
+    emit8(0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP)
+        emit8(0x24);
+    emit32(disp);
+}
+
+size_t Assembler::modrmRip(uint8_t reg)
+{
+    emit8(0x05 | ((reg & 7) << 3));
+    size_t at = code.size();
+    emit32(0);
+    return at;
+}
+
+//---------LABELS----------
+Label Assembler::newLabel()
+{
+    labelOffsets.push_back(-1);
+    return Label{static_cast<int>(labelOffsets.size() - 1)};
+}
+
+void Assembler::bind(Label label)
+{
+    labelOffsets[label.id] = code.size();
+}
+
+void Assembler::labelReference(Label label)
+{
+    labelFixups.push_back({code.size(), label.id});
+    emit32(0);
+}
+
+bool Assembler::resolveLabels()
+{
+    for (auto [at, id] : labelFixups)
+    {
+        if (labelOffsets[id] < 0)
+            return false;
+        int32_t rel = static_cast<int32_t>(labelOffsets[id] - static_cast<int64_t>(at + 4));
+        for (int i = 0; i < 4; ++i)
+        {
+            code[at + i] = static_cast<uint32_t>(rel) >> (8 * i);
+        }
+    }
+    labelFixups.clear();
+    return true;
+}
+
+//---------MOVES----------
+void Assembler::mov(Reg dst, Reg src)
+{
+    rex(true, src, dst);
+    emit8(0x89);
+    modrmDirect(src, dst);
+}
+
+void Assembler::movImmediate(Reg dst, int64_t value)
+{
+    if (value == 0)
+    {
+        rex(false, dst, dst);
+        emit8(0x31); // xor r32, r32
+        modrmDirect(dst, dst);
+    }
+    else if (value >= INT32_MIN && value <= INT32_MAX)
+    {
+        rex(true, 0, dst);
+        emit8(0xC7);
+        modrmDirect(0, dst);
+        emit32(value);
+    }
+    else if (value > 0 && value <= UINT32_MAX)
+    {
+        rex(false, 0, dst); // mov r32 zero extends
+        emit8(0xB8 + (dst & 7));
+        emit32(value);
+    }
+    else
+    {
+        rex(true, 0, dst);
+        emit8(0xB8 + (dst & 7));
+        emit64(value);
+    }
+}
+
+void Assembler::load(Reg dst, Reg base, int32_t disp)
+{
+    rex(true, dst, base);
+    emit8(0x8B);
+    modrmMemory(dst, base, disp);
+}
+
+void Assembler::store(Reg base, int32_t disp, Reg src)
+{
+    rex(true, src, base);
+    emit8(0x89);
+    modrmMemory(src, base, disp);
+}
+
+size_t Assembler::loadRip(Reg dst)
+{
+    rex(true, dst, 0);
+    emit8(0x8B);
+    return modrmRip(dst);
+}
+
+size_t Assembler::storeRip(Reg src)
+{
+    rex(true, src, 0);
+    emit8(0x89);
+    return modrmRip(src);
+}
+
+size_t Assembler::leaRip(Reg dst)
+{
+    rex(true, dst, 0);
+    emit8(0x8D);
+    return modrmRip(dst);
+}
+
+void Assembler::lea(Reg dst, Reg base, int32_t disp)
+{
+    rex(true, dst, base);
+    emit8(0x8D);
+    modrmMemory(dst, base, disp);
+}
+
+void Assembler::push(Reg reg)
+{
+    rex(false, 0, reg);
+    emit8(0x50 + (reg & 7));
+}
+
+void Assembler::pop(Reg reg)
+{
+    rex(false, 0, reg);
+    emit8(0x58 + (reg & 7));
+}
+
+//---------INTEGER ARITHMETIC----------
+void Assembler::alu(AluOp op, Reg dst, Reg src)
+{
+    rex(true, src, dst);
+    emit8(static_cast<uint8_t>(op));
+    modrmDirect(src, dst);
+}
+
+void Assembler::aluImmediate(AluOp op, Reg dst, int32_t value)
+{
+    rex(true, 0, dst);
+    emit8(0x81);
+    modrmDirect(static_cast<uint8_t>(op) >> 3, dst); // The /digit of the 0x81 group matches the opcode row
+    emit32(value);
+}
+
+void Assembler::imul(Reg dst, Reg src)
+{
+    rex(true, dst, src);
+    emit8(0x0F);
+    emit8(0xAF);
+    modrmDirect(dst, src);
+}
+
+void Assembler::idiv(Reg divisor)
+{
+    rex(true, 0, divisor);
+    emit8(0xF7);
+    modrmDirect(7, divisor);
+}
+
+void Assembler::cqo()
+{
+    emit8(0x48);
+    emit8(0x99);
+}
+
+void Assembler::neg(Reg reg)
+{
+    rex(true, 0, reg);
+    emit8(0xF7);
+    modrmDirect(3, reg);
+}
+
+void Assembler::shl(Reg reg, uint8_t count)
+{
+    rex(true, 0, reg);
+    emit8(0xC1);
+    modrmDirect(4, reg);
+    emit8(count);
+}
+
+void Assembler::test(Reg a, Reg b)
+{
+    rex(true, b, a);
+    emit8(0x85);
+    modrmDirect(b, a);
+}
+
+void Assembler::setcc(Cond cond, Reg dst)
+{
+    emit8(0x0F);
+    emit8(0x90 | static_cast<uint8_t>(cond));
+    modrmDirect(0, dst);
+}
+
+void Assembler::movzxByte(Reg dst, Reg src)
+{
+    rex(false, dst, src);
+    emit8(0x0F);
+    emit8(0xB6);
+    modrmDirect(dst, src);
+}
+
+void Assembler::movsxd(Reg dst, Reg src)
+{
+    rex(true, dst, src);
+    emit8(0x63);
+    modrmDirect(dst, src);
+}
+
+//---------FLOATING POINT----------
+void Assembler::movsd(Xmm dst, Xmm src)
+{
+    emit8(0xF2);
+    rex(false, dst, src);
+    emit8(0x0F);
+    emit8(0x10);
+    modrmDirect(dst, src);
+}
+
+void Assembler::loadsd(Xmm dst, Reg base, int32_t disp)
+{
+    emit8(0xF2);
+    rex(false, dst, base);
+    emit8(0x0F);
+    emit8(0x10);
+    modrmMemory(dst, base, disp);
+}
+
+void Assembler::storesd(Reg base, int32_t disp, Xmm src)
+{
+    emit8(0xF2);
+    rex(false, src, base);
+    emit8(0x0F);
+    emit8(0x11);
+    modrmMemory(src, base, disp);
+}
+
+size_t Assembler::loadsdRip(Xmm dst)
+{
+    emit8(0xF2);
+    rex(false, dst, 0);
+    emit8(0x0F);
+    emit8(0x10);
+    return modrmRip(dst);
+}
+
+void Assembler::sse(SseOp op, Xmm dst, Xmm src)
+{
+    emit8(0xF2);
+    rex(false, dst, src);
+    emit8(0x0F);
+    emit8(static_cast<uint8_t>(op));
+    modrmDirect(dst, src);
+}
+
+void Assembler::ucomisd(Xmm a, Xmm b)
+{
+    emit8(0x66);
+    rex(false, a, b);
+    emit8(0x0F);
+    emit8(0x2E);
+    modrmDirect(a, b);
+}
+
+void Assembler::cvtsi2sd(Xmm dst, Reg src)
+{
+    emit8(0xF2);
+    rex(true, dst, src);
+    emit8(0x0F);
+    emit8(0x2A);
+    modrmDirect(dst, src);
+}
+
+void Assembler::movqToXmm(Xmm dst, Reg src)
+{
+    emit8(0x66);
+    rex(true, dst, src);
+    emit8(0x0F);
+    emit8(0x6E);
+    modrmDirect(dst, src);
+}
+
+void Assembler::movqFromXmm(Reg dst, Xmm src)
+{
+    emit8(0x66);
+    rex(true, src, dst);
+    emit8(0x0F);
+    emit8(0x7E);
+    modrmDirect(src, dst);
+}
+
+//---------CONTROL FLOW----------
+void Assembler::jmp(Label label)
+{
+    emit8(0xE9);
+    labelReference(label);
+}
+
+void Assembler::jcc(Cond cond, Label label)
+{
+    emit8(0x0F);
+    emit8(0x80 | static_cast<uint8_t>(cond));
+    labelReference(label);
+}
+
+size_t Assembler::call()
+{
+    emit8(0xE8);
+    size_t at = code.size();
+    emit32(0);
+    return at;
+}
+
+void Assembler::ret()
+{
+    emit8(0xC3);
+}
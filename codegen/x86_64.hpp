@@ -0,0 +1,160 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Minimal x86-64 encoder, only the forms the code generator needs.
+// Memory operands are either [base + disp32] or [rip + disp32], the latter leave their displacement to a relocation
+
+enum Reg : uint8_t
+{
+    RAX,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
+};
+
+enum Xmm : uint8_t
+{
+    XMM0,
+    XMM1,
+    XMM2,
+    XMM3,
+    XMM4,
+    XMM5,
+    XMM6,
+    XMM7,
+    XMM8,
+    XMM9,
+    XMM10,
+    XMM11,
+    XMM12,
+    XMM13,
+    XMM14,
+    XMM15,
+};
+
+// Condition codes as they appear in the low nibble of jcc and setcc
+enum class Cond : uint8_t
+{
+    O = 0x0,
+    B = 0x2, // Unsigned below, used after ucomisd
+    AE = 0x3,
+    E = 0x4,
+    NE = 0x5,
+    BE = 0x6,
+    A = 0x7,
+    P = 0xA,
+    NP = 0xB,
+    L = 0xC,
+    GE = 0xD,
+    LE = 0xE,
+    G = 0xF,
+};
+
+Cond invert(Cond cond);
+
+// Arithmetic group that shares the "op r/m64, r64" encoding
+enum class AluOp : uint8_t
+{
+    ADD = 0x01,
+    OR = 0x09,
+    AND = 0x21,
+    SUB = 0x29,
+    XOR = 0x31,
+    CMP = 0x39,
+};
+
+enum class SseOp : uint8_t
+{
+    ADD = 0x58,
+    MUL = 0x59,
+    SUB = 0x5C,
+    DIV = 0x5E,
+};
+
+struct Label
+{
+    int id = -1;
+};
+
+class Assembler
+{
+    std::vector<uint8_t> &code;
+    std::vector<int64_t> labelOffsets;               // -1 until the label is bound
+    std::vector<std::pair<size_t, int>> labelFixups; // rel32 field and the label it points at
+
+public:
+    explicit Assembler(std::vector<uint8_t> &code) : code(code) {};
+
+    size_t offset() const { return code.size(); }
+
+    //---------LABELS----------
+    Label newLabel();
+    void bind(Label label);
+    bool resolveLabels(); // Patches every jump, false when a label was never bound
+
+    //---------MOVES----------
+    void mov(Reg dst, Reg src);
+    void movImmediate(Reg dst, int64_t value);
+    void load(Reg dst, Reg base, int32_t disp);
+    void store(Reg base, int32_t disp, Reg src);
+    size_t loadRip(Reg dst);  // Returns the offset of the displacement
+    size_t storeRip(Reg src); // Returns the offset of the displacement
+    size_t leaRip(Reg dst);   // Returns the offset of the displacement
+    void lea(Reg dst, Reg base, int32_t disp);
+    void push(Reg reg);
+    void pop(Reg reg);
+
+    //---------INTEGER ARITHMETIC----------
+    void alu(AluOp op, Reg dst, Reg src);
+    void aluImmediate(AluOp op, Reg dst, int32_t value);
+    void imul(Reg dst, Reg src);
+    void idiv(Reg divisor); // rdx:rax / divisor
+    void cqo();
+    void neg(Reg reg);
+    void shl(Reg reg, uint8_t count);
+    void test(Reg a, Reg b);
+    void setcc(Cond cond, Reg dst); // Only the low byte, dst must be one of rax to rbx
+    void movzxByte(Reg dst, Reg src);
+    void movsxd(Reg dst, Reg src); // Sign extends the low 32 bits of src, C functions return int in eax
+
+    //---------FLOATING POINT----------
+    void movsd(Xmm dst, Xmm src);
+    void loadsd(Xmm dst, Reg base, int32_t disp);
+    void storesd(Reg base, int32_t disp, Xmm src);
+    size_t loadsdRip(Xmm dst); // Returns the offset of the displacement
+    void sse(SseOp op, Xmm dst, Xmm src);
+    void ucomisd(Xmm a, Xmm b);
+    void cvtsi2sd(Xmm dst, Reg src);
+    void movqToXmm(Xmm dst, Reg src);
+    void movqFromXmm(Reg dst, Xmm src);
+
+    //---------CONTROL FLOW----------
+    void jmp(Label label);
+    void jcc(Cond cond, Label label);
+    size_t call(); // Returns the offset of the rel32 for the relocation
+    void ret();
+
+private:
+    void emit8(uint8_t byte) { code.push_back(byte); }
+    void emit32(uint32_t value);
+    void emit64(uint64_t value);
+    void rex(bool wide, uint8_t reg, uint8_t rm, bool force = false);
+    void modrmDirect(uint8_t reg, uint8_t rm);
+    void modrmMemory(uint8_t reg, uint8_t base, int32_t disp);
+    size_t modrmRip(uint8_t reg);
+    void labelReference(Label label);
+};
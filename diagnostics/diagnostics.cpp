@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <cstdio>
+#include <unordered_map>
+#include "diagnostics.hpp"
+
+namespace
+{
+    std::atomic<uint64_t> nextEngineId{1};
+
+    std::string severityString(Severity severity)
+    {
+        switch (severity)
+        {
+        case Severity::NOTE:
+            return "note";
+        case Severity::WARNING:
+            return "warning";
+        default:
+            return "error";
+        }
+    }
+
+    // The first letter of the code tells which phase reported the diagnostic
+    std::string phaseString(const std::string &code)
+    {
+        switch (code.empty() ? '\0' : code[0])
+        {
+        case 'L':
+            return "TOKEN";
+        case 'P':
+            return "PARSER";
+        case 'S':
+            return "SEMANTIC";
+        case 'I':
+            return "IR";
+        default:
+            return "COMPILER";
+        }
+    }
+
+    std::string escapeJson(const std::string &text)
+    {
+        std::string escaped;
+        escaped.reserve(text.size());
+        for (char c : text)
+        {
+            switch (c)
+            {
+            case '"':
+                escaped += "\\\"";
+                break;
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            case '\t':
+                escaped += "\\t";
+                break;
+            case '\r':
+                escaped += "\\r";
+                break;
+            default:
+                if ((unsigned char)c < 0x20)
+                {
+                    char unicode[8];
+                    snprintf(unicode, sizeof(unicode), "\\u%04x", c);
+                    escaped += unicode;
+                }
+                else
+                {
+                    escaped += c;
+                }
+            }
+        }
+        return escaped;
+    }
+}
+
+Diagnostics::Diagnostics(size_t errorLimit) : engineId(nextEngineId++), errorLimit(errorLimit) {};
+
+void Diagnostics::report(const std::string &code, Severity severity, const SourceRange &range, const std::string &message)
+{
+    // Every record is kept, which errors fall over the limit is only known once render has sorted them.
+    // The count just tells the phases when to stop
+    if (severity == Severity::ERROR)
+    {
+        errorCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    else if (severity == Severity::WARNING)
+    {
+        warningCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    DiagnosticBuffer &buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.records.push_back(Diagnostic{code, severity, range, message});
+}
+
+void Diagnostics::error(const std::string &code, const SourceRange &range, const std::string &message)
+{
+    report(code, Severity::ERROR, range, message);
+}
+
+void Diagnostics::warning(const std::string &code, const SourceRange &range, const std::string &message)
+{
+    report(code, Severity::WARNING, range, message);
+}
+
+bool Diagnostics::shouldAbort() const
+{
+    if (errorLimit == 0 || errorCount.load(std::memory_order_relaxed) < errorLimit)
+        return false;
+    aborted.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+bool Diagnostics::hasErrors() const
+{
+    return errorCount.load(std::memory_order_relaxed) > 0;
+}
+
+size_t Diagnostics::errors() const
+{
+    return errorCount.load(std::memory_order_relaxed);
+}
+
+void Diagnostics::setErrorLimit(size_t limit)
+{
+    errorLimit = limit;
+}
+
+void Diagnostics::render(std::ostream &out, DiagnosticFormat format)
+{
+    std::vector<Diagnostic> records = collect();
+
+    // The errors over the limit are dropped after sorting so the ones shown are the first in the source,
+    // whichever worker happened to report them first
+    std::string rendered;
+    size_t shown = 0;
+    size_t suppressed = 0;
+    for (const auto &record : records)
+    {
+        if (record.severity == Severity::ERROR && errorLimit != 0 && shown++ >= errorLimit)
+        {
+            suppressed++;
+            continue;
+        }
+        rendered += format == DiagnosticFormat::JSON ? renderJson(record) : renderText(record);
+        rendered += '\n';
+    }
+
+    // Stopping at the limit hides the errors later code would have given, so the notice shows even when none were dropped
+    bool stopped = suppressed > 0 || aborted.load(std::memory_order_relaxed);
+    if (stopped && format == DiagnosticFormat::TEXT)
+    {
+        rendered += "[ERROR]: Too many errors, stopped after " + std::to_string(errorLimit);
+        if (suppressed > 0)
+            rendered += " (" + std::to_string(suppressed) + " more not shown)";
+        rendered += "\n";
+    }
+    else if (stopped)
+    {
+        rendered += "{\"code\":\"E0000\",\"severity\":\"error\",\"message\":\"too many errors\",\"limit\":" + std::to_string(errorLimit) +
+                    ",\"suppressed\":" + std::to_string(suppressed) + "}\n";
+    }
+
+    out.write(rendered.data(), rendered.size());
+    out.flush();
+}
+
+SourceRange Diagnostics::rangeOf(const Token &token)
+{
+    int length = std::max<int>(1, token.TokenLiteral.size());
+    return SourceRange{token.line, token.column, token.line, token.column + length};
+}
+
+// Finding the calling thread's buffer, the cache is keyed by engine id so an engine that reuses
+// the address of a dead one never sees its stale buffers
+DiagnosticBuffer &Diagnostics::threadBuffer()
+{
+    thread_local std::unordered_map<uint64_t, DiagnosticBuffer *> cache;
+    auto cached = cache.find(engineId);
+    if (cached != cache.end())
+    {
+        return *cached->second;
+    }
+
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    buffers.push_back(std::make_unique<DiagnosticBuffer>());
+    DiagnosticBuffer *buffer = buffers.back().get();
+    cache[engineId] = buffer;
+    return *buffer;
+}
+
+// Taking every record out of the thread buffers in a deterministic order
+std::vector<Diagnostic> Diagnostics::collect()
+{
+    std::vector<Diagnostic> records;
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        for (auto &buffer : buffers)
+        {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            records.insert(records.end(), std::make_move_iterator(buffer->records.begin()), std::make_move_iterator(buffer->records.end()));
+            buffer->records.clear();
+        }
+    }
+
+    // Records without a location go last, the remaining keys only matter for records at the same position
+    std::sort(records.begin(), records.end(), [](const Diagnostic &a, const Diagnostic &b)
+              {
+        bool aUnknown = a.range.line < 0;
+        bool bUnknown = b.range.line < 0;
+        if (aUnknown != bUnknown)
+            return bUnknown;
+        if (a.range.line != b.range.line)
+            return a.range.line < b.range.line;
+        if (a.range.column != b.range.column)
+            return a.range.column < b.range.column;
+        if (a.code != b.code)
+            return a.code < b.code;
+        return a.message < b.message; });
+    return records;
+}
+
+std::string Diagnostics::renderText(const Diagnostic &diagnostic)
+{
+    std::string severity = severityString(diagnostic.severity);
+    std::transform(severity.begin(), severity.end(), severity.begin(), ::toupper);
+
+    std::string text = "[" + phaseString(diagnostic.code) + " " + severity + "] " + diagnostic.code + ": " + diagnostic.message;
+    if (diagnostic.range.line < 0)
+    {
+        return text + " (at unknown location)";
+    }
+    return text + " (line: " + std::to_string(diagnostic.range.line) + ", column: " + std::to_string(diagnostic.range.column) + ")";
+}
+
+std::string Diagnostics::renderJson(const Diagnostic &diagnostic)
+{
+    const SourceRange &range = diagnostic.range;
+    return "{\"code\":\"" + diagnostic.code +
+           "\",\"severity\":\"" + severityString(diagnostic.severity) +
+           "\",\"line\":" + std::to_string(range.line) +
+           ",\"column\":" + std::to_string(range.column) +
+           ",\"endLine\":" + std::to_string(range.endLine) +
+           ",\"endColumn\":" + std::to_string(range.endColumn) +
+           ",\"message\":\"" + escapeJson(diagnostic.message) + "\"}";
+}
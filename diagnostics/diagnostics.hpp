@@ -0,0 +1,121 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "token/token.hpp"
+
+enum class Severity
+{
+    NOTE,
+    WARNING,
+    ERROR,
+};
+
+enum class DiagnosticFormat
+{
+    TEXT,
+    JSON, // One JSON object per line
+};
+
+// Codes attached to every diagnostic, the letter tells which phase reported it
+namespace DiagnosticCode
+{
+    // Lexer
+    inline constexpr const char *UNEXPECTED_CHARACTER = "L0001";
+    inline constexpr const char *INVALID_ESCAPE = "L0002";
+    inline constexpr const char *UNTERMINATED_STRING = "L0003";
+    inline constexpr const char *MISSING_QUOTE = "L0004";
+
+    // Parser
+    inline constexpr const char *SYNTAX_ERROR = "P0001";
+    inline constexpr const char *EXPECTED_SEMICOLON = "P0002";
+    inline constexpr const char *UNEXPECTED_TOKEN = "P0003";
+
+    // Semantic analyzer
+    inline constexpr const char *SEMANTIC_ERROR = "S0001";
+    inline constexpr const char *UNDECLARED_IDENTIFIER = "S0002";
+    inline constexpr const char *TYPE_MISMATCH = "S0003";
+    inline constexpr const char *INVALID_OPERATOR = "S0004";
+    inline constexpr const char *FIXED_ASSIGNMENT = "S0005";
+    inline constexpr const char *CONSTANT_FOLDING = "S0006";
+    inline constexpr const char *ARGUMENT_MISMATCH = "S0007";
+    inline constexpr const char *REDEFINITION = "S0008";
+    inline constexpr const char *INVALID_SIGNAL = "S0009";
+    inline constexpr const char *DATA_RACE = "S0010";
+    inline constexpr const char *ZONE_ESCAPE = "S0011";
+    inline constexpr const char *USE_AFTER_MOVE = "S0012";
+    inline constexpr const char *POINTER_ACCESS = "S0013";
+    inline constexpr const char *INDEX_OUT_OF_BOUNDS = "S0014";
+
+    // Internal checks of the intermediate representation
+    inline constexpr const char *IR_VERIFIER = "I0001";
+}
+
+// Position of the diagnostic in the source, the end column is exclusive
+struct SourceRange
+{
+    int line = -1;
+    int column = -1;
+    int endLine = -1;
+    int endColumn = -1;
+};
+
+struct Diagnostic
+{
+    std::string code;
+    Severity severity;
+    SourceRange range;
+    std::string message;
+};
+
+// Diagnostics buffer owned by a single thread, the mutex is only ever contended while rendering
+struct DiagnosticBuffer
+{
+    std::mutex mutex;
+    std::vector<Diagnostic> records;
+};
+
+// Diagnostics engine shared by the lexer, parser and semantic analyzer.
+// Every thread reports into its own buffer and the records are sorted and rendered in one batch at the end
+class Diagnostics
+{
+    uint64_t engineId; // Used to find this engine's buffer in the thread local cache
+    std::mutex buffersMutex;
+    std::vector<std::unique_ptr<DiagnosticBuffer>> buffers;
+
+    std::atomic<size_t> errorCount{0};
+    std::atomic<size_t> warningCount{0};
+    mutable std::atomic<bool> aborted{false}; // A phase stopped early because the limit was reached
+    size_t errorLimit = 0; // 0 means no limit
+
+public:
+    Diagnostics(size_t errorLimit = 0);
+
+    Diagnostics(const Diagnostics &) = delete;
+    Diagnostics &operator=(const Diagnostics &) = delete;
+
+    void report(const std::string &code, Severity severity, const SourceRange &range, const std::string &message);
+    void error(const std::string &code, const SourceRange &range, const std::string &message);
+    void warning(const std::string &code, const SourceRange &range, const std::string &message);
+
+    // Set once the error limit was reached, the phases check it to stop early
+    bool shouldAbort() const;
+    bool hasErrors() const;
+    size_t errors() const;
+    void setErrorLimit(size_t limit);
+
+    // Sorts every buffered record by source position and writes them in one go
+    void render(std::ostream &out, DiagnosticFormat format);
+
+    static SourceRange rangeOf(const Token &token);
+
+private:
+    DiagnosticBuffer &threadBuffer();
+    std::vector<Diagnostic> collect();
+    std::string renderText(const Diagnostic &diagnostic);
+    std::string renderJson(const Diagnostic &diagnostic);
+};
@@ -0,0 +1,108 @@
+#include "callgraph.hpp"
+#include <algorithm>
+
+CallGraph::CallGraph(Module &module)
+{
+    for (auto fn : module.functions)
+    {
+        auto &sites = callSites[fn];
+        for (auto block : fn->blocks)
+        {
+            for (auto inst : block->instructions)
+            {
+                if ((inst->op != Opcode::CALL && inst->op != Opcode::SPAWN) || !inst->callee)
+                    continue;
+                if (inst->op == Opcode::SPAWN)
+                {
+                    spawned[fn].push_back(inst->callee);
+                }
+                else
+                {
+                    sites.push_back(inst);
+                    callerCounts[inst->callee]++;
+                }
+                if (inst->callee == fn)
+                    selfCalls[fn] = true;
+            }
+        }
+    }
+
+    std::unordered_map<Function *, int> index, low;
+    std::unordered_map<Function *, bool> onStack;
+    std::vector<Function *> stack;
+    int counter = 0;
+    for (auto fn : module.functions)
+    {
+        if (!index.count(fn))
+            visit(fn, index, low, stack, onStack, counter);
+    }
+}
+
+// Recursion only goes as deep as the longest call chain, the graphs are small
+void CallGraph::visit(Function *fn, std::unordered_map<Function *, int> &index, std::unordered_map<Function *, int> &low,
+                      std::vector<Function *> &stack, std::unordered_map<Function *, bool> &onStack, int &counter)
+{
+    index[fn] = low[fn] = counter++;
+    stack.push_back(fn);
+    onStack[fn] = true;
+
+    std::vector<Function *> callees = spawned[fn];
+    for (auto call : callSites[fn])
+    {
+        callees.push_back(call->callee);
+    }
+    for (auto callee : callees)
+    {
+        if (!index.count(callee))
+        {
+            visit(callee, index, low, stack, onStack, counter);
+            low[fn] = std::min(low[fn], low[callee]);
+        }
+        else if (onStack[callee])
+        {
+            low[fn] = std::min(low[fn], index[callee]);
+        }
+    }
+
+    // A component is finished once its root is, and Tarjan finishes callees first
+    if (low[fn] != index[fn])
+        return;
+    std::vector<Function *> component;
+    Function *member;
+    do
+    {
+        member = stack.back();
+        stack.pop_back();
+        onStack[member] = false;
+        componentIndex[member] = components.size();
+        component.push_back(member);
+    } while (member != fn);
+    components.push_back(std::move(component));
+}
+
+const std::vector<Instruction *> &CallGraph::calls(Function *caller) const
+{
+    auto it = callSites.find(caller);
+    return it == callSites.end() ? none : it->second;
+}
+
+size_t CallGraph::callerCount(Function *callee) const
+{
+    auto it = callerCounts.find(callee);
+    return it == callerCounts.end() ? 0 : it->second;
+}
+
+bool CallGraph::sameSCC(Function *a, Function *b) const
+{
+    auto first = componentIndex.find(a);
+    auto second = componentIndex.find(b);
+    return first != componentIndex.end() && second != componentIndex.end() && first->second == second->second;
+}
+
+bool CallGraph::isRecursive(Function *fn) const
+{
+    auto it = componentIndex.find(fn);
+    if (it == componentIndex.end())
+        return false;
+    return components[it->second].size() > 1 || selfCalls.count(fn);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include "ir.hpp"
+
+// Who calls whom in a module, read off the CALL instructions. The strongly connected components come out of
+// Tarjan's algorithm bottom up, so every function is listed after everything it calls unless they are in the same
+// cycle. Task starts are edges of the components too but not call sites, nothing can inline a SPAWN.
+// Like the dominator tree it is a snapshot, inlining adds call sites it does not know about
+class CallGraph
+{
+    std::unordered_map<Function *, std::vector<Instruction *>> callSites; // Calls made by each function, in layout order
+    std::unordered_map<Function *, size_t> callerCounts;                  // Calls that target each function
+    std::unordered_map<Function *, std::vector<Function *>> spawned;      // Works each function starts as tasks
+    std::vector<std::vector<Function *>> components;
+    std::unordered_map<Function *, size_t> componentIndex;
+    std::unordered_map<Function *, bool> selfCalls;
+    std::vector<Instruction *> none;
+
+public:
+    explicit CallGraph(Module &module);
+
+    const std::vector<Instruction *> &calls(Function *caller) const;
+    size_t callerCount(Function *callee) const;
+    const std::vector<std::vector<Function *>> &bottomUpSCCs() const { return components; }
+    bool sameSCC(Function *a, Function *b) const;
+    bool isRecursive(Function *fn) const; // Calls or starts itself, directly or through its component
+
+private:
+    void visit(Function *fn, std::unordered_map<Function *, int> &index, std::unordered_map<Function *, int> &low,
+               std::vector<Function *> &stack, std::unordered_map<Function *, bool> &onStack, int &counter);
+};
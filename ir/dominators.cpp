@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <unordered_set>
+#include "dominators.hpp"
+
+DominatorTree::DominatorTree(Function *function)
+{
+    BasicBlock *entry = function->entry();
+    if (!entry)
+        return;
+
+    // Iterative depth first search for the post order, recursion would overflow on huge functions
+    std::unordered_set<BasicBlock *> visited = {entry};
+    std::vector<std::pair<BasicBlock *, size_t>> stack = {{entry, 0}};
+    while (!stack.empty())
+    {
+        auto &[block, next] = stack.back();
+        auto succs = block->successors();
+        if (next < succs.size())
+        {
+            BasicBlock *succ = succs[next++];
+            if (visited.insert(succ).second)
+            {
+                stack.push_back({succ, 0});
+            }
+            continue;
+        }
+        postOrderIndex[block] = postOrder.size();
+        postOrder.push_back(block);
+        stack.pop_back();
+    }
+
+    idoms[entry] = entry;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto it = postOrder.rbegin(); it != postOrder.rend(); ++it)
+        {
+            BasicBlock *block = *it;
+            if (block == entry)
+                continue;
+
+            BasicBlock *newIdom = nullptr;
+            for (auto pred : block->predecessors)
+            {
+                if (!idoms.count(pred))
+                    continue;
+                newIdom = newIdom ? intersect(pred, newIdom) : pred;
+            }
+            if (newIdom && idoms[block] != newIdom)
+            {
+                idoms[block] = newIdom;
+                changed = true;
+            }
+        }
+    }
+
+    for (auto &[block, dom] : idoms)
+    {
+        if (block != entry)
+            childBlocks[dom].push_back(block);
+    }
+    // Keeping the children in layout order so walks over the tree are deterministic
+    for (auto &[block, kids] : childBlocks)
+    {
+        std::sort(kids.begin(), kids.end(), [this](BasicBlock *a, BasicBlock *b)
+                  { return postOrderIndex.at(a) > postOrderIndex.at(b); });
+    }
+    idoms[entry] = nullptr;
+}
+
+BasicBlock *DominatorTree::intersect(BasicBlock *a, BasicBlock *b) const
+{
+    while (a != b)
+    {
+        while (postOrderIndex.at(a) < postOrderIndex.at(b))
+            a = idoms.at(a);
+        while (postOrderIndex.at(b) < postOrderIndex.at(a))
+            b = idoms.at(b);
+    }
+    return a;
+}
+
+BasicBlock *DominatorTree::idom(BasicBlock *block) const
+{
+    auto it = idoms.find(block);
+    return it == idoms.end() ? nullptr : it->second;
+}
+
+bool DominatorTree::dominates(BasicBlock *a, BasicBlock *b) const
+{
+    if (!isReachable(b))
+        return true; // Everything dominates unreachable code
+    if (!isReachable(a))
+        return false;
+    for (BasicBlock *block = b; block; block = idom(block))
+    {
+        if (block == a)
+            return true;
+    }
+    return false;
+}
+
+bool DominatorTree::dominates(Instruction *def, Instruction *use) const
+{
+    if (def->parent != use->parent)
+        return dominates(def->parent, use->parent);
+    const auto &insts = def->parent->instructions;
+    auto defIt = std::find(insts.begin(), insts.end(), def);
+    auto useIt = std::find(insts.begin(), insts.end(), use);
+    return defIt < useIt;
+}
+
+const std::vector<BasicBlock *> &DominatorTree::children(BasicBlock *block) const
+{
+    static const std::vector<BasicBlock *> none;
+    auto it = childBlocks.find(block);
+    return it == childBlocks.end() ? none : it->second;
+}
+
+std::vector<BasicBlock *> DominatorTree::reversePostOrder() const
+{
+    return std::vector<BasicBlock *>(postOrder.rbegin(), postOrder.rend());
+}
+
+// Cooper, Harvey and Kennedy again, a join point is in the frontier of every block on the way up from each of its
+// predecessors to its immediate dominator
+std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> DominatorTree::frontiers() const
+{
+    std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> result;
+    for (auto block : postOrder)
+    {
+        if (block->predecessors.size() < 2)
+            continue;
+        for (auto pred : block->predecessors)
+        {
+            if (!isReachable(pred))
+                continue;
+            for (BasicBlock *runner = pred; runner && runner != idom(block); runner = idom(runner))
+            {
+                auto &frontier = result[runner];
+                if (std::find(frontier.begin(), frontier.end(), block) == frontier.end())
+                    frontier.push_back(block);
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include "ir.hpp"
+
+// Dominator tree of a function built with the Cooper, Harvey and Kennedy iterative algorithm.
+// It is a snapshot, passes that change the CFG have to build a new one
+class DominatorTree
+{
+    std::vector<BasicBlock *> postOrder;
+    std::unordered_map<BasicBlock *, int> postOrderIndex; // Only reachable blocks have an index
+    std::unordered_map<BasicBlock *, BasicBlock *> idoms;
+    std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> childBlocks;
+
+public:
+    explicit DominatorTree(Function *function);
+
+    BasicBlock *idom(BasicBlock *block) const; // nullptr for the entry and unreachable blocks
+    bool dominates(BasicBlock *a, BasicBlock *b) const;
+    bool dominates(Instruction *def, Instruction *use) const; // Phi uses count at the end of the incoming block instead
+    bool isReachable(BasicBlock *block) const { return postOrderIndex.count(block) != 0; }
+    const std::vector<BasicBlock *> &children(BasicBlock *block) const;
+    std::vector<BasicBlock *> reversePostOrder() const;
+    std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> frontiers() const; // Where the dominance of every block ends, reachable blocks only
+
+private:
+    BasicBlock *intersect(BasicBlock *a, BasicBlock *b) const;
+};
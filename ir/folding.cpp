@@ -0,0 +1,193 @@
+#include <cmath>
+#include <cstdint>
+#include "folding.hpp"
+
+static int64_t wrap(uint64_t value) { return static_cast<int64_t>(value); }
+
+template <typename T>
+static bool compare(Opcode op, const T &a, const T &b)
+{
+    switch (op)
+    {
+    case Opcode::EQ:
+        return a == b;
+    case Opcode::NE:
+        return a != b;
+    case Opcode::LT:
+        return a < b;
+    case Opcode::GT:
+        return a > b;
+    case Opcode::LE:
+        return a <= b;
+    default:
+        return a >= b;
+    }
+}
+
+bool compareIntegers(Opcode op, int64_t a, int64_t b) { return compare(op, a, b); }
+
+std::optional<int64_t> integerConstant(Value *value)
+{
+    if (value->kind != ValueKind::CONSTANT)
+        return std::nullopt;
+    const ConstantValue &constant = static_cast<Constant *>(value)->value;
+    if (constant.type != TypeSystem::INTEGER)
+        return std::nullopt;
+    return constant.intValue;
+}
+
+Opcode swappedComparison(Opcode op)
+{
+    switch (op)
+    {
+    case Opcode::LT:
+        return Opcode::GT;
+    case Opcode::GT:
+        return Opcode::LT;
+    case Opcode::LE:
+        return Opcode::GE;
+    case Opcode::GE:
+        return Opcode::LE;
+    default:
+        return op;
+    }
+}
+
+Opcode negatedComparison(Opcode op)
+{
+    switch (op)
+    {
+    case Opcode::EQ:
+        return Opcode::NE;
+    case Opcode::NE:
+        return Opcode::EQ;
+    case Opcode::LT:
+        return Opcode::GE;
+    case Opcode::GT:
+        return Opcode::LE;
+    case Opcode::LE:
+        return Opcode::GT;
+    default:
+        return Opcode::LT;
+    }
+}
+
+bool mayTrap(Instruction *inst)
+{
+    if (inst->op == Opcode::CHECK_BOUNDS)
+    {
+        auto index = integerConstant(inst->operands[0]);
+        auto length = integerConstant(inst->operands[1]);
+        return !index || !length || *index < 0 || *index >= *length;
+    }
+    if ((inst->op != Opcode::DIV && inst->op != Opcode::MOD) || inst->scalar() != TypeSystem::INTEGER)
+        return false;
+    auto divisor = integerConstant(inst->operands[1]);
+    return !divisor || *divisor == 0;
+}
+
+static Constant *foldInteger(Module &module, Opcode op, int64_t a, int64_t b)
+{
+    uint64_t x = static_cast<uint64_t>(a), y = static_cast<uint64_t>(b);
+    switch (op)
+    {
+    case Opcode::ADD:
+        return module.constantInt(wrap(x + y));
+    case Opcode::SUB:
+        return module.constantInt(wrap(x - y));
+    case Opcode::MUL:
+        return module.constantInt(wrap(x * y));
+    case Opcode::DIV:
+    case Opcode::MOD:
+        if (b == 0)
+            return nullptr; // Runtime error, stays in the program
+        if (b == -1)
+            return module.constantInt(op == Opcode::DIV ? wrap(0 - x) : 0);
+        return module.constantInt(op == Opcode::DIV ? a / b : a % b);
+    default:
+        return module.constantBool(compare(op, a, b));
+    }
+}
+
+static Constant *foldFloat(Module &module, Opcode op, double a, double b)
+{
+    switch (op)
+    {
+    case Opcode::ADD:
+        return module.constantFloat(a + b);
+    case Opcode::SUB:
+        return module.constantFloat(a - b);
+    case Opcode::MUL:
+        return module.constantFloat(a * b);
+    case Opcode::DIV:
+        return module.constantFloat(a / b);
+    case Opcode::MOD:
+        return module.constantFloat(std::fmod(a, b));
+    default:
+        return module.constantBool(compare(op, a, b));
+    }
+}
+
+Constant *foldConstant(Module &module, Opcode op, const std::vector<Value *> &operands)
+{
+    for (auto operand : operands)
+    {
+        if (operand->kind != ValueKind::CONSTANT || static_cast<Constant *>(operand)->value.type == TypeSystem::UNKNOWN)
+            return nullptr; // Undefined values have nothing to fold
+    }
+    auto value = [&](size_t i) -> const ConstantValue & { return static_cast<Constant *>(operands[i])->value; };
+
+    switch (op)
+    {
+    case Opcode::NEG:
+        if (value(0).type == TypeSystem::INTEGER)
+            return module.constantInt(wrap(0 - static_cast<uint64_t>(value(0).intValue)));
+        return value(0).type == TypeSystem::FLOAT ? module.constantFloat(-value(0).floatValue) : nullptr;
+    case Opcode::NOT:
+        return value(0).type == TypeSystem::BOOLEAN ? module.constantBool(!value(0).boolValue) : nullptr;
+    case Opcode::ITOF:
+        return value(0).type == TypeSystem::INTEGER ? module.constantFloat(static_cast<double>(value(0).intValue)) : nullptr;
+    case Opcode::CONCAT:
+        if (value(0).type != TypeSystem::STRING || value(1).type != TypeSystem::STRING)
+            return nullptr;
+        return module.constantString(value(0).stringValue + value(1).stringValue);
+    case Opcode::ADD:
+    case Opcode::SUB:
+    case Opcode::MUL:
+    case Opcode::DIV:
+    case Opcode::MOD:
+    case Opcode::EQ:
+    case Opcode::NE:
+    case Opcode::LT:
+    case Opcode::GT:
+    case Opcode::LE:
+    case Opcode::GE:
+        break;
+    default:
+        return nullptr;
+    }
+
+    const ConstantValue &a = value(0), &b = value(1);
+    if (a.type != b.type)
+        return nullptr;
+    switch (a.type)
+    {
+    case TypeSystem::INTEGER:
+        return foldInteger(module, op, a.intValue, b.intValue);
+    case TypeSystem::FLOAT:
+        return foldFloat(module, op, a.floatValue, b.floatValue);
+    case TypeSystem::CHAR:
+        return op >= Opcode::EQ && op <= Opcode::GE ? module.constantBool(compare(op, a.charValue, b.charValue)) : nullptr;
+    case TypeSystem::BOOLEAN:
+        return op == Opcode::EQ || op == Opcode::NE ? module.constantBool(compare(op, a.boolValue, b.boolValue)) : nullptr;
+    case TypeSystem::STRING:
+        return op >= Opcode::EQ && op <= Opcode::GE ? module.constantBool(compare(op, a.stringValue, b.stringValue)) : nullptr;
+    default:
+        return nullptr;
+    }
+}
+
+Constant *foldInstruction(Module &module, Instruction *inst)
+{
+    return foldConstant(module, inst->op, inst->operands);
+}
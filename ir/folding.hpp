@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "ir.hpp"
+
+// Constant folding of single IR instructions with the semantics the backends have at runtime: integer
+// arithmetic wraps, comparisons give bools and strings compare by their bytes. Anything that would trap,
+// like an integer division by zero, is left for the program to report
+Constant *foldConstant(Module &module, Opcode op, const std::vector<Value *> &operands);
+Constant *foldInstruction(Module &module, Instruction *inst); // nullptr unless every operand is a constant
+
+// Helpers for passes that reason about integer values, like loop bounds
+bool compareIntegers(Opcode op, int64_t a, int64_t b);
+std::optional<int64_t> integerConstant(Value *value); // The value of an int constant, nothing for anything else
+Opcode swappedComparison(Opcode op);                  // a < b is b > a
+Opcode negatedComparison(Opcode op);                  // !(a < b) is a >= b
+bool mayTrap(Instruction *inst);                      // Integer division or modulo by something not known to be nonzero, or a bounds check not known to pass
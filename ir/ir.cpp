@@ -0,0 +1,844 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+#include "ir.hpp"
+
+//---------VALUES----------
+void Value::replaceAllUsesWith(Value *replacement)
+{
+    if (replacement == this)
+        return;
+    // Copying since setOperand edits the users list we are walking
+    std::vector<Instruction *> currentUsers = users;
+    for (auto user : currentUsers)
+    {
+        for (size_t i = 0; i < user->operands.size(); ++i)
+        {
+            if (user->operands[i] == this)
+            {
+                user->setOperand(i, replacement);
+            }
+        }
+    }
+}
+
+namespace
+{
+    void removeUser(Value *value, Instruction *user)
+    {
+        auto it = std::find(value->users.begin(), value->users.end(), user);
+        if (it != value->users.end())
+        {
+            value->users.erase(it);
+        }
+    }
+}
+
+void Instruction::addOperand(Value *value)
+{
+    operands.push_back(value);
+    if (value)
+        value->users.push_back(this);
+}
+
+void Instruction::setOperand(size_t index, Value *value)
+{
+    if (operands[index])
+        removeUser(operands[index], this);
+    operands[index] = value;
+    if (value)
+        value->users.push_back(this);
+}
+
+void Instruction::removeOperand(size_t index)
+{
+    if (operands[index])
+        removeUser(operands[index], this);
+    operands.erase(operands.begin() + index);
+    if (op == Opcode::PHI)
+    {
+        targets.erase(targets.begin() + index);
+    }
+}
+
+void Instruction::dropOperands()
+{
+    for (auto operand : operands)
+    {
+        if (operand)
+            removeUser(operand, this);
+    }
+    operands.clear();
+}
+
+void Instruction::addIncoming(Value *value, BasicBlock *block)
+{
+    addOperand(value);
+    targets.push_back(block);
+}
+
+bool Instruction::hasSideEffects() const
+{
+    return op == Opcode::CALL || op == Opcode::SPAWN || op == Opcode::JOIN || op == Opcode::DETACH || op == Opcode::ZONE_ENTER || op == Opcode::ZONE_EXIT ||
+           op == Opcode::STORE_GLOBAL || op == Opcode::ALLOC || op == Opcode::FREE || op == Opcode::STORE || op == Opcode::NEW_ARRAY ||
+           op == Opcode::CHECK_BOUNDS || isTerminator();
+}
+
+//---------BLOCKS----------
+Instruction *BasicBlock::terminator() const
+{
+    if (instructions.empty() || !instructions.back()->isTerminator())
+        return nullptr;
+    return instructions.back();
+}
+
+std::vector<BasicBlock *> BasicBlock::successors() const
+{
+    auto term = terminator();
+    if (!term)
+        return {};
+    return term->targets;
+}
+
+void BasicBlock::append(Instruction *inst)
+{
+    inst->parent = this;
+    instructions.push_back(inst);
+}
+
+void BasicBlock::insertBefore(Instruction *position, Instruction *inst)
+{
+    inst->parent = this;
+    auto it = std::find(instructions.begin(), instructions.end(), position);
+    instructions.insert(it, inst);
+}
+
+void BasicBlock::insertPhi(Instruction *phi)
+{
+    phi->parent = this;
+    auto it = std::find_if(instructions.begin(), instructions.end(), [](Instruction *inst)
+                           { return !inst->isPhi(); });
+    instructions.insert(it, phi);
+}
+
+void BasicBlock::remove(Instruction *inst)
+{
+    auto it = std::find(instructions.begin(), instructions.end(), inst);
+    if (it != instructions.end())
+    {
+        instructions.erase(it);
+    }
+    inst->parent = nullptr;
+}
+
+void BasicBlock::erase(Instruction *inst)
+{
+    remove(inst);
+    inst->dropOperands();
+}
+
+void BasicBlock::jumpTo(BasicBlock *target)
+{
+    Instruction *term = terminator();
+    if (term)
+    {
+        for (auto succ : term->targets)
+        {
+            if (succ == target)
+                continue;
+            for (auto phi : succ->instructions)
+            {
+                if (!phi->isPhi())
+                    break;
+                for (size_t i = phi->operands.size(); i-- > 0;)
+                {
+                    if (phi->targets[i] == this)
+                        phi->removeOperand(i);
+                }
+            }
+        }
+        erase(term);
+    }
+    Module *module = parent->parent;
+    Instruction *jump = module->createInstruction(Opcode::BR, module->types.scalar(TypeSystem::VOID));
+    jump->targets.push_back(target);
+    append(jump);
+}
+
+//---------FUNCTIONS----------
+void Function::recomputePredecessors()
+{
+    for (auto block : blocks)
+    {
+        block->predecessors.clear();
+    }
+    for (auto block : blocks)
+    {
+        for (auto succ : block->successors())
+        {
+            // A conditional branch with both targets equal still only counts once
+            if (std::find(succ->predecessors.begin(), succ->predecessors.end(), block) == succ->predecessors.end())
+            {
+                succ->predecessors.push_back(block);
+            }
+        }
+    }
+}
+
+// Dropping the blocks that can not be reached from the entry and the phi inputs that came from them
+void Function::removeUnreachableBlocks()
+{
+    if (blocks.empty())
+        return;
+
+    std::unordered_set<BasicBlock *> reachable;
+    std::vector<BasicBlock *> worklist = {entry()};
+    reachable.insert(entry());
+    while (!worklist.empty())
+    {
+        BasicBlock *block = worklist.back();
+        worklist.pop_back();
+        for (auto succ : block->successors())
+        {
+            if (reachable.insert(succ).second)
+            {
+                worklist.push_back(succ);
+            }
+        }
+    }
+
+    if (reachable.size() == blocks.size())
+        return;
+
+    std::vector<BasicBlock *> kept;
+    for (auto block : blocks)
+    {
+        if (reachable.count(block))
+        {
+            kept.push_back(block);
+            continue;
+        }
+        for (auto inst : block->instructions)
+        {
+            inst->dropOperands();
+            inst->parent = nullptr;
+        }
+        block->instructions.clear();
+    }
+    blocks = std::move(kept);
+
+    for (auto block : blocks)
+    {
+        for (size_t i = 0; i < block->instructions.size() && block->instructions[i]->isPhi(); ++i)
+        {
+            Instruction *phi = block->instructions[i];
+            for (size_t j = phi->operands.size(); j-- > 0;)
+            {
+                if (!reachable.count(phi->targets[j]))
+                {
+                    phi->removeOperand(j);
+                }
+            }
+        }
+    }
+    recomputePredecessors();
+}
+
+// Appends a block to its only predecessor when that one jumps nowhere else
+bool Function::mergeIntoPredecessor(BasicBlock *block)
+{
+    if (block->predecessors.size() != 1)
+        return false;
+    BasicBlock *pred = block->predecessors[0];
+    Instruction *term = pred->terminator();
+    if (pred == block || !term || term->op != Opcode::BR)
+        return false;
+
+    // With one predecessor every phi has a single input
+    while (!block->instructions.empty() && block->instructions.front()->isPhi())
+    {
+        Instruction *phi = block->instructions.front();
+        phi->replaceAllUsesWith(phi->operands[0]);
+        block->erase(phi);
+    }
+    pred->erase(term);
+    for (auto inst : block->instructions)
+    {
+        pred->append(inst);
+    }
+    block->instructions.clear();
+    for (auto succ : pred->successors())
+    {
+        for (auto inst : succ->instructions)
+        {
+            if (!inst->isPhi())
+                break;
+            std::replace(inst->targets.begin(), inst->targets.end(), block, pred);
+        }
+    }
+
+    blocks.erase(std::find(blocks.begin(), blocks.end(), block));
+    recomputePredecessors();
+    return true;
+}
+
+// Laying out the blocks in reverse post order, the successors are visited last to first so the
+// fall through successor (then branch, loop body) ends up right after its block
+void Function::sortBlocks()
+{
+    if (blocks.empty())
+        return;
+    std::vector<BasicBlock *> postOrder;
+    std::unordered_set<BasicBlock *> visited = {entry()};
+    std::vector<std::pair<BasicBlock *, std::vector<BasicBlock *>>> stack;
+    stack.push_back({entry(), entry()->successors()});
+    while (!stack.empty())
+    {
+        auto &pending = stack.back().second;
+        if (!pending.empty())
+        {
+            BasicBlock *succ = pending.back();
+            pending.pop_back();
+            if (visited.insert(succ).second)
+            {
+                stack.push_back({succ, succ->successors()});
+            }
+            continue;
+        }
+        postOrder.push_back(stack.back().first);
+        stack.pop_back();
+    }
+    // Unreachable blocks keep their relative order at the end
+    for (auto block : blocks)
+    {
+        if (!visited.count(block))
+            postOrder.insert(postOrder.begin(), block);
+    }
+    blocks.assign(postOrder.rbegin(), postOrder.rend());
+}
+
+void Function::renumber()
+{
+    uint32_t nextId = 0;
+    for (auto arg : arguments)
+    {
+        arg->id = nextId++;
+    }
+    uint32_t blockId = 0;
+    for (auto block : blocks)
+    {
+        block->id = blockId++;
+        for (auto inst : block->instructions)
+        {
+            inst->id = nextId++;
+        }
+    }
+}
+
+size_t Function::instructionCount() const
+{
+    size_t count = 0;
+    for (auto block : blocks)
+    {
+        count += block->instructions.size();
+    }
+    return count;
+}
+
+//---------MODULE----------
+Function *Module::createFunction(const std::string &name, const Type *signature)
+{
+    const Type *returnType = signature ? signature->element : types.scalar(TypeSystem::VOID);
+    Function *function = arena.make<Function>(name, signature, returnType, this);
+    if (signature)
+    {
+        for (uint32_t i = 0; i < signature->parameters.size(); ++i)
+        {
+            function->arguments.push_back(arena.make<Argument>(signature->parameters[i], function, i, "arg" + std::to_string(i)));
+        }
+    }
+    functions.push_back(function);
+    return function;
+}
+
+Function *Module::findFunction(const std::string &name) const
+{
+    for (auto function : functions)
+    {
+        if (function->name == name)
+            return function;
+    }
+    return nullptr;
+}
+
+GlobalVariable *Module::createGlobal(const std::string &name, const Type *type)
+{
+    GlobalVariable *global = arena.make<GlobalVariable>();
+    global->name = name;
+    global->type = type;
+    globals.push_back(global);
+    return global;
+}
+
+GlobalVariable *Module::findGlobal(const std::string &name) const
+{
+    for (auto global : globals)
+    {
+        if (global->name == name)
+            return global;
+    }
+    return nullptr;
+}
+
+bool Module::usesCollector() const
+{
+    for (auto function : functions)
+    {
+        for (auto block : function->blocks)
+        {
+            for (auto inst : block->instructions)
+            {
+                if (inst->collected)
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool Module::usesAllocator() const
+{
+    for (auto function : functions)
+    {
+        for (auto block : function->blocks)
+        {
+            for (auto inst : block->instructions)
+            {
+                if (inst->op == Opcode::ALLOC || inst->op == Opcode::FREE || inst->op == Opcode::NEW_ARRAY)
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+BasicBlock *Module::createBlock(Function *function, const std::string &label)
+{
+    BasicBlock *block = arena.make<BasicBlock>(function, label);
+    block->id = function->blocks.size();
+    function->blocks.push_back(block);
+    return block;
+}
+
+Instruction *Module::createInstruction(Opcode op, const Type *type)
+{
+    return arena.make<Instruction>(op, type);
+}
+
+Constant *Module::constant(const ConstantValue &value)
+{
+    switch (value.type)
+    {
+    case TypeSystem::INTEGER:
+        return constantInt(value.intValue);
+    case TypeSystem::FLOAT:
+        return constantFloat(value.floatValue);
+    case TypeSystem::BOOLEAN:
+        return constantBool(value.boolValue);
+    case TypeSystem::CHAR:
+        return constantChar(value.charValue);
+    case TypeSystem::STRING:
+        return constantString(value.stringValue);
+    default:
+        return zeroOf(types.scalar(value.type));
+    }
+}
+
+Constant *Module::constantInt(int64_t value)
+{
+    auto &slot = intConstants[value];
+    if (!slot)
+        slot = arena.make<Constant>(types.scalar(TypeSystem::INTEGER), ConstantValue{.type = TypeSystem::INTEGER, .intValue = value});
+    return slot;
+}
+
+Constant *Module::constantFloat(double value)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    auto &slot = floatConstants[bits];
+    if (!slot)
+        slot = arena.make<Constant>(types.scalar(TypeSystem::FLOAT), ConstantValue{.type = TypeSystem::FLOAT, .floatValue = value});
+    return slot;
+}
+
+Constant *Module::constantBool(bool value)
+{
+    auto &slot = boolConstants[value ? 1 : 0];
+    if (!slot)
+        slot = arena.make<Constant>(types.scalar(TypeSystem::BOOLEAN), ConstantValue{.type = TypeSystem::BOOLEAN, .boolValue = value});
+    return slot;
+}
+
+Constant *Module::constantChar(char value)
+{
+    auto &slot = charConstants[value];
+    if (!slot)
+        slot = arena.make<Constant>(types.scalar(TypeSystem::CHAR), ConstantValue{.type = TypeSystem::CHAR, .charValue = value});
+    return slot;
+}
+
+Constant *Module::constantString(const std::string &value)
+{
+    auto &slot = stringConstants[value];
+    if (!slot)
+        slot = arena.make<Constant>(types.scalar(TypeSystem::STRING), ConstantValue{.type = TypeSystem::STRING, .stringValue = value});
+    return slot;
+}
+
+Constant *Module::zeroOf(const Type *type)
+{
+    switch (type ? type->scalar : TypeSystem::UNKNOWN)
+    {
+    case TypeSystem::INTEGER:
+        return constantInt(0);
+    case TypeSystem::FLOAT:
+        return constantFloat(0.0);
+    case TypeSystem::BOOLEAN:
+        return constantBool(false);
+    case TypeSystem::CHAR:
+        return constantChar('\0');
+    case TypeSystem::STRING:
+        return constantString("");
+    default:
+    {
+        auto &slot = undefConstants[type];
+        if (!slot)
+            slot = arena.make<Constant>(type, ConstantValue{});
+        return slot;
+    }
+    }
+}
+
+//---------PRINTING----------
+// Shortest text that reads back as the same double, always with a dot so it does not look like an int
+std::string floatLiteral(double value)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.17g", value);
+    for (int precision = 1; precision < 17; ++precision)
+    {
+        char shorter[32];
+        snprintf(shorter, sizeof(shorter), "%.*g", precision, value);
+        if (std::strtod(shorter, nullptr) == value)
+        {
+            snprintf(buffer, sizeof(buffer), "%s", shorter);
+            break;
+        }
+    }
+    std::string text = buffer;
+    if (text.find_first_of(".eni") == std::string::npos)
+        text += ".0";
+    return text;
+}
+
+std::string escapeText(const std::string &text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        switch (c)
+        {
+        case '\n':
+            escaped += "\\n";
+            break;
+        case '\t':
+            escaped += "\\t";
+            break;
+        case '\r':
+            escaped += "\\r";
+            break;
+        case '\0':
+            escaped += "\\0";
+            break;
+        case '"':
+            escaped += "\\\"";
+            break;
+        case '\'':
+            escaped += "\\'";
+            break;
+        case '\\':
+            escaped += "\\\\";
+            break;
+        default:
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+std::string opcodeName(Opcode op)
+{
+    switch (op)
+    {
+    case Opcode::ADD:
+        return "add";
+    case Opcode::SUB:
+        return "sub";
+    case Opcode::MUL:
+        return "mul";
+    case Opcode::DIV:
+        return "div";
+    case Opcode::MOD:
+        return "mod";
+    case Opcode::NEG:
+        return "neg";
+    case Opcode::EQ:
+        return "eq";
+    case Opcode::NE:
+        return "ne";
+    case Opcode::LT:
+        return "lt";
+    case Opcode::GT:
+        return "gt";
+    case Opcode::LE:
+        return "le";
+    case Opcode::GE:
+        return "ge";
+    case Opcode::NOT:
+        return "not";
+    case Opcode::CONCAT:
+        return "concat";
+    case Opcode::ITOF:
+        return "itof";
+    case Opcode::CALL:
+        return "call";
+    case Opcode::SPAWN:
+        return "spawn";
+    case Opcode::JOIN:
+        return "join";
+    case Opcode::DETACH:
+        return "detach";
+    case Opcode::ZONE_ENTER:
+        return "zone.enter";
+    case Opcode::ZONE_EXIT:
+        return "zone.exit";
+    case Opcode::PHI:
+        return "phi";
+    case Opcode::LOAD_GLOBAL:
+        return "load";
+    case Opcode::STORE_GLOBAL:
+        return "store";
+    case Opcode::ALLOC:
+        return "alloc";
+    case Opcode::FREE:
+        return "free";
+    case Opcode::LOAD:
+        return "load.ptr";
+    case Opcode::STORE:
+        return "store.ptr";
+    case Opcode::NEW_ARRAY:
+        return "array.new";
+    case Opcode::LENGTH:
+        return "length";
+    case Opcode::ELEMENT:
+        return "element";
+    case Opcode::CHECK_BOUNDS:
+        return "check.bounds";
+    case Opcode::BR:
+        return "br";
+    case Opcode::CONDBR:
+        return "condbr";
+    case Opcode::RET:
+        return "ret";
+    }
+    return "unknown";
+}
+
+// Two different allocations never share a cell, and nothing but a noalias argument itself reaches its cell.
+// An allocation may have been stored somewhere, so any other pointer could still lead to it. Elements are
+// judged by their array, two elements of one array may be the same one
+bool mayAlias(const Value *a, const Value *b)
+{
+    auto arrayOf = [](const Value *value)
+    {
+        while (value->kind == ValueKind::INSTRUCTION && static_cast<const Instruction *>(value)->op == Opcode::ELEMENT)
+            value = static_cast<const Instruction *>(value)->operands[0];
+        return value;
+    };
+    a = arrayOf(a);
+    b = arrayOf(b);
+    if (a == b)
+        return true;
+    auto isNoalias = [](const Value *value)
+    { return value->kind == ValueKind::ARGUMENT && static_cast<const Argument *>(value)->noalias; };
+    auto isCell = [&isNoalias](const Value *value)
+    {
+        if (isNoalias(value) || value->kind != ValueKind::INSTRUCTION)
+            return isNoalias(value);
+        Opcode op = static_cast<const Instruction *>(value)->op;
+        return op == Opcode::ALLOC || op == Opcode::NEW_ARRAY;
+    };
+    if (isCell(a) && isCell(b))
+        return false;
+    return !isNoalias(a) && !isNoalias(b);
+}
+
+std::string valueName(const Value *value)
+{
+    if (!value)
+        return "<null>";
+    switch (value->kind)
+    {
+    case ValueKind::CONSTANT:
+    {
+        auto constant = static_cast<const Constant *>(value);
+        if (constant->value.type == TypeSystem::UNKNOWN)
+            return "undef";
+        switch (constant->value.type)
+        {
+        case TypeSystem::INTEGER:
+            return std::to_string(constant->value.intValue);
+        case TypeSystem::FLOAT:
+            return floatLiteral(constant->value.floatValue);
+        case TypeSystem::BOOLEAN:
+            return constant->value.boolValue ? "true" : "false";
+        case TypeSystem::CHAR:
+            return "'" + escapeText(std::string(1, constant->value.charValue)) + "'";
+        case TypeSystem::STRING:
+            return "\"" + escapeText(constant->value.stringValue) + "\"";
+        default:
+            return "undef";
+        }
+    }
+    case ValueKind::ARGUMENT:
+        return "%" + static_cast<const Argument *>(value)->name;
+    case ValueKind::INSTRUCTION:
+    {
+        auto inst = static_cast<const Instruction *>(value);
+        if (!inst->name.empty())
+            return "%" + inst->name + "." + std::to_string(inst->id);
+        return "%" + std::to_string(inst->id);
+    }
+    }
+    return "<unknown>";
+}
+
+namespace
+{
+    std::string blockName(const BasicBlock *block)
+    {
+        return block ? block->label + "." + std::to_string(block->id) : "<null>";
+    }
+
+    void printInstruction(Instruction *inst, std::ostream &out)
+    {
+        out << "    ";
+        bool producesValue = inst->scalar() != TypeSystem::VOID && inst->op != Opcode::STORE_GLOBAL && !inst->isTerminator();
+        if (producesValue)
+        {
+            out << valueName(inst) << " = ";
+        }
+        out << opcodeName(inst->op) << (inst->collected ? ".gc" : "");
+        if (producesValue || inst->op == Opcode::RET)
+        {
+            if (inst->op != Opcode::RET || !inst->operands.empty())
+                out << " " << TypeContext::toString(inst->type);
+        }
+
+        switch (inst->op)
+        {
+        case Opcode::PHI:
+            for (size_t i = 0; i < inst->operands.size(); ++i)
+            {
+                out << (i == 0 ? " " : ", ") << "[" << valueName(inst->operands[i]) << ", " << blockName(inst->targets[i]) << "]";
+            }
+            break;
+        case Opcode::CALL:
+        case Opcode::SPAWN:
+            out << " @" << (inst->callee ? inst->callee->name : "<null>") << "(";
+            for (size_t i = 0; i < inst->operands.size(); ++i)
+            {
+                out << (i == 0 ? "" : ", ") << valueName(inst->operands[i]);
+            }
+            out << ")";
+            break;
+        case Opcode::LOAD_GLOBAL:
+            out << " @" << (inst->global ? inst->global->name : "<null>");
+            break;
+        case Opcode::STORE_GLOBAL:
+            out << " @" << (inst->global ? inst->global->name : "<null>") << ", " << valueName(inst->operands.empty() ? nullptr : inst->operands[0]);
+            break;
+        case Opcode::BR:
+            out << " " << blockName(inst->targets.empty() ? nullptr : inst->targets[0]);
+            break;
+        case Opcode::CONDBR:
+            out << " " << valueName(inst->operands.empty() ? nullptr : inst->operands[0]);
+            for (auto target : inst->targets)
+            {
+                out << ", " << blockName(target);
+            }
+            break;
+        default:
+            for (size_t i = 0; i < inst->operands.size(); ++i)
+            {
+                out << (i == 0 ? " " : ", ") << valueName(inst->operands[i]);
+            }
+        }
+        out << "\n";
+    }
+}
+
+void printFunction(Function *function, std::ostream &out)
+{
+    function->renumber();
+    out << "work @" << function->name << "(";
+    for (size_t i = 0; i < function->arguments.size(); ++i)
+    {
+        out << (i == 0 ? "" : ", ") << (function->arguments[i]->noalias ? "noalias " : "") << TypeContext::toString(function->arguments[i]->type) << " "
+            << valueName(function->arguments[i]);
+    }
+    out << "): " << TypeContext::toString(function->returnType) << "\n{\n";
+    for (auto block : function->blocks)
+    {
+        out << blockName(block) << ":";
+        if (!block->predecessors.empty())
+        {
+            out << "    ; preds:";
+            for (auto pred : block->predecessors)
+            {
+                out << " " << blockName(pred);
+            }
+        }
+        out << "\n";
+        for (auto inst : block->instructions)
+        {
+            printInstruction(inst, out);
+        }
+    }
+    out << "}\n";
+}
+
+void Module::print(std::ostream &out)
+{
+    for (auto global : globals)
+    {
+        out << "global @" << global->name << ": " << TypeContext::toString(global->type);
+        if (global->initializer)
+        {
+            out << " = " << valueName(constant(*global->initializer));
+        }
+        out << "\n";
+    }
+    if (!globals.empty())
+    {
+        out << "\n";
+    }
+    for (auto function : functions)
+    {
+        printFunction(function, out);
+        out << "\n";
+    }
+}
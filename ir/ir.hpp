@@ -0,0 +1,225 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "semantic analyzer/semantics.hpp"
+#include "semantic analyzer/types.hpp"
+#include "utils/arena.hpp"
+
+// In house SSA intermediate representation.
+// Every object of a module lives in the module's arena and is referenced by raw pointers,
+// nothing is freed until the module itself goes away
+
+struct Instruction;
+struct BasicBlock;
+struct Function;
+struct GlobalVariable;
+class Module;
+
+enum class ValueKind : uint8_t
+{
+    CONSTANT,
+    ARGUMENT,
+    INSTRUCTION,
+};
+
+enum class Opcode : uint8_t
+{
+    // Arithmetic, integer or float depending on the type of the instruction
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    MOD,
+    NEG,
+
+    // Comparisons, both operands have the same type and the result is a bool
+    EQ,
+    NE,
+    LT,
+    GT,
+    LE,
+    GE,
+    NOT,
+
+    CONCAT, // string + string, inside a zone operand 2 is the ZONE_ENTER it allocates from
+    ITOF,   // int to float promotion
+
+    CALL,
+    SPAWN, // Starts the callee as a task, the result is the future<T> handle
+    JOIN,  // Waits on the SPAWN in operand 0 and gives the result of its task
+    DETACH, // The signal of the SPAWN in operand 0 went out of scope, its record is reused once the task finished
+    ZONE_ENTER, // Opens the region of a zone block, the result is its handle
+    ZONE_EXIT,  // Frees the region of the ZONE_ENTER in operand 0
+    PHI,
+    LOAD_GLOBAL,
+    STORE_GLOBAL,
+    ALLOC, // Allocator cells for operand 0 values of the pointee, the result is the pointer. The memory is not cleared
+    FREE,  // Gives the cells of the pointer in operand 0 back
+    LOAD,  // Reads the value operand 0 points at
+    STORE, // Writes operand 1 where operand 0 points
+    NEW_ARRAY,    // Array of operand 0 zeroed elements on the allocator heap, the length is kept in front of them
+    LENGTH,       // Element count of the array in operand 0
+    ELEMENT,      // Pointer to the element operand 1 of the array in operand 0, nothing checks the index
+    CHECK_BOUNDS, // Stops the program unless 0 <= operand 0 < operand 1
+
+    // Terminators
+    BR,
+    CONDBR,
+    RET,
+};
+
+// Anything an instruction can use as an operand
+struct Value
+{
+    ValueKind kind;
+    const Type *type;
+    uint32_t id = 0;                  // Number used by the dump, unique inside a function
+    std::vector<Instruction *> users; // One entry per use so an instruction using a value twice appears twice
+
+    Value(ValueKind kind, const Type *type) : kind(kind), type(type) {};
+    virtual ~Value() = default;
+
+    TypeSystem scalar() const { return type ? type->scalar : TypeSystem::UNKNOWN; }
+    void replaceAllUsesWith(Value *replacement);
+};
+
+// Constants are interned per module so two equal constants are the same value
+struct Constant : Value
+{
+    ConstantValue value;
+    Constant(const Type *type, ConstantValue value) : Value(ValueKind::CONSTANT, type), value(std::move(value)) {};
+};
+
+struct Argument : Value
+{
+    Function *parent;
+    uint32_t index;
+    std::string name;
+    bool noalias = false; // A write parameter, no other pointer of the call reaches its cell
+    Argument(const Type *type, Function *parent, uint32_t index, std::string name) : Value(ValueKind::ARGUMENT, type), parent(parent), index(index), name(std::move(name)) {};
+};
+
+struct Instruction : Value
+{
+    Opcode op;
+    BasicBlock *parent = nullptr;
+    std::vector<Value *> operands;
+    std::vector<BasicBlock *> targets;  // Branch targets, or the incoming block of every phi operand
+    Function *callee = nullptr;         // CALL and SPAWN only
+    GlobalVariable *global = nullptr;   // LOAD_GLOBAL and STORE_GLOBAL only
+    std::string name;                   // Source variable the value was written to, only used by the dump
+    bool raceFree = false;              // SPAWN only, the semantic check proved the task can not race the code before its wait
+    bool collected = false;             // CONCAT only, the string is built for a gc variable and goes to the collected heap
+
+    Instruction(Opcode op, const Type *type) : Value(ValueKind::INSTRUCTION, type), op(op) {};
+
+    void addOperand(Value *value);
+    void setOperand(size_t index, Value *value);
+    void removeOperand(size_t index); // Also drops the incoming block of phis
+    void dropOperands();              // Unlinks the instruction from the values it uses before it is deleted
+
+    void addIncoming(Value *value, BasicBlock *block); // PHI only
+
+    bool isTerminator() const { return op == Opcode::BR || op == Opcode::CONDBR || op == Opcode::RET; }
+    bool isPhi() const { return op == Opcode::PHI; }
+    bool hasSideEffects() const; // Calls, tasks, stores and terminators can never be removed just because they are unused
+};
+
+struct BasicBlock
+{
+    uint32_t id = 0;
+    std::string label;
+    Function *parent;
+    std::vector<Instruction *> instructions; // Phis first, the terminator last
+    std::vector<BasicBlock *> predecessors;
+
+    BasicBlock(Function *parent, std::string label) : label(std::move(label)), parent(parent) {};
+
+    Instruction *terminator() const;
+    std::vector<BasicBlock *> successors() const;
+    void append(Instruction *inst);
+    void insertBefore(Instruction *position, Instruction *inst);
+    void insertPhi(Instruction *phi);
+    void remove(Instruction *inst); // Takes the instruction out of the block without touching its operands
+    void erase(Instruction *inst);  // Removes the instruction and unlinks it from its operands
+    void jumpTo(BasicBlock *target); // Swaps the terminator for a plain jump, the dropped successors forget this block in their phis
+};
+
+struct GlobalVariable
+{
+    std::string name;
+    const Type *type;
+    std::optional<ConstantValue> initializer; // Set when the initial value was known at compile time
+    bool isMutable = true;
+};
+
+struct Function
+{
+    std::string name;
+    const Type *signature;
+    const Type *returnType;
+    Module *parent;
+    std::vector<Argument *> arguments;
+    std::vector<BasicBlock *> blocks; // The first block is the entry
+    bool isTopLevel = false;          // The synthetic function holding the top level statements
+
+    Function(std::string name, const Type *signature, const Type *returnType, Module *parent) : name(std::move(name)), signature(signature), returnType(returnType), parent(parent) {};
+
+    BasicBlock *entry() const { return blocks.empty() ? nullptr : blocks.front(); }
+    void recomputePredecessors();
+    void removeUnreachableBlocks();
+    bool mergeIntoPredecessor(BasicBlock *block); // Folds a block into its only predecessor when that one jumps nowhere else
+    void sortBlocks(); // Reverse post order layout
+    void renumber(); // Gives the blocks and values dense ids in layout order
+    size_t instructionCount() const;
+};
+
+class Module
+{
+    Arena arena;
+    std::unordered_map<int64_t, Constant *> intConstants;
+    std::unordered_map<uint64_t, Constant *> floatConstants; // Keyed by the bits so -0.0 and NaN stay distinct
+    std::unordered_map<char, Constant *> charConstants;
+    std::unordered_map<std::string, Constant *> stringConstants;
+    Constant *boolConstants[2] = {nullptr, nullptr};
+    std::unordered_map<const Type *, Constant *> undefConstants;
+
+public:
+    TypeContext &types;
+    std::vector<Function *> functions;
+    std::vector<GlobalVariable *> globals;
+
+    explicit Module(TypeContext &types) : types(types) {};
+    Module(const Module &) = delete;
+    Module &operator=(const Module &) = delete;
+
+    Function *createFunction(const std::string &name, const Type *signature);
+    Function *findFunction(const std::string &name) const;
+    GlobalVariable *createGlobal(const std::string &name, const Type *type);
+    GlobalVariable *findGlobal(const std::string &name) const;
+    BasicBlock *createBlock(Function *function, const std::string &label);
+    Instruction *createInstruction(Opcode op, const Type *type);
+
+    Constant *constant(const ConstantValue &value);
+    Constant *constantInt(int64_t value);
+    Constant *constantFloat(double value);
+    Constant *constantBool(bool value);
+    Constant *constantChar(char value);
+    Constant *constantString(const std::string &value);
+    Constant *zeroOf(const Type *type); // Value of a variable that was declared without an initializer
+    bool usesCollector() const;         // Some string is built for a gc variable, native code then starts the collector
+    bool usesAllocator() const;         // Something is allocated or freed, native code then links alloc.c
+
+    Arena &memory() { return arena; }
+    void print(std::ostream &out);
+};
+
+std::string opcodeName(Opcode op);
+std::string valueName(const Value *value);
+bool mayAlias(const Value *a, const Value *b); // False when two pointers can never reach the same cell
+std::string floatLiteral(double value);
+std::string escapeText(const std::string &text); // Escapes like the lexer reads them back
+void printFunction(Function *function, std::ostream &out);
@@ -0,0 +1,116 @@
+#include "liveness.hpp"
+
+Liveness::Liveness(Function *function, std::function<bool(Value *)> filter)
+{
+    function->renumber();
+    size_t count = function->arguments.size();
+    for (auto block : function->blocks)
+    {
+        count += block->instructions.size();
+    }
+    values.assign(count, nullptr);
+    auto track = [&](Value *value)
+    {
+        if (!filter || filter(value))
+            values[value->id] = value;
+    };
+    for (auto arg : function->arguments)
+    {
+        track(arg);
+    }
+    for (auto block : function->blocks)
+    {
+        for (auto inst : block->instructions)
+        {
+            track(inst);
+        }
+    }
+    auto tracked = [&](Value *value)
+    { return value->kind != ValueKind::CONSTANT && value->id < values.size() && values[value->id] == value; };
+
+    // Upward exposed uses and the definitions of every block, phi operands count at the end of their incoming block
+    words = (count + 63) / 64;
+    size_t total = function->blocks.size() * words;
+    std::vector<uint64_t> uses(total), defs(total), phiUses(total);
+    auto set = [this](std::vector<uint64_t> &bits, BasicBlock *block, uint32_t id)
+    { bits[block->id * words + id / 64] |= uint64_t(1) << (id % 64); };
+    for (auto block : function->blocks)
+    {
+        for (auto inst : block->instructions)
+        {
+            for (size_t i = 0; i < inst->operands.size(); ++i)
+            {
+                Value *operand = inst->operands[i];
+                if (!tracked(operand))
+                    continue;
+                if (inst->isPhi())
+                    set(phiUses, inst->targets[i], operand->id);
+                else if (!(defs[block->id * words + operand->id / 64] >> (operand->id % 64) & 1))
+                    set(uses, block, operand->id);
+            }
+            if (tracked(inst))
+                set(defs, block, inst->id);
+        }
+    }
+
+    liveIn.assign(total, 0);
+    liveOut.assign(total, 0);
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto it = function->blocks.rbegin(); it != function->blocks.rend(); ++it)
+        {
+            size_t base = (*it)->id * words;
+            Instruction *term = (*it)->terminator();
+            for (size_t w = 0; w < words; ++w)
+            {
+                uint64_t out = phiUses[base + w];
+                if (term)
+                {
+                    for (auto succ : term->targets)
+                    {
+                        out |= liveIn[succ->id * words + w];
+                    }
+                }
+                uint64_t in = uses[base + w] | (out & ~defs[base + w]);
+                // The sets only ever grow so a difference anywhere means another round
+                changed |= in != liveIn[base + w] || out != liveOut[base + w];
+                liveIn[base + w] = in;
+                liveOut[base + w] = out;
+            }
+        }
+    }
+}
+
+std::vector<Value *> Liveness::in(BasicBlock *block) const
+{
+    return members(liveIn, block);
+}
+
+std::vector<Value *> Liveness::out(BasicBlock *block) const
+{
+    return members(liveOut, block);
+}
+
+bool Liveness::test(const std::vector<uint64_t> &sets, Value *value, BasicBlock *block) const
+{
+    if ((block->id + 1) * words > sets.size() || value->id >= values.size() || values[value->id] != value)
+        return false;
+    return sets[block->id * words + value->id / 64] >> (value->id % 64) & 1;
+}
+
+std::vector<Value *> Liveness::members(const std::vector<uint64_t> &sets, BasicBlock *block) const
+{
+    std::vector<Value *> result;
+    if ((block->id + 1) * words > sets.size())
+        return result;
+    for (size_t w = 0; w < words; ++w)
+    {
+        for (uint64_t word = sets[block->id * words + w]; word; word &= word - 1)
+        {
+            result.push_back(values[w * 64 + __builtin_ctzll(word)]);
+        }
+    }
+    return result;
+}
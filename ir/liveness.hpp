@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "ir.hpp"
+
+// Block level liveness of the values of a function, solved backwards until nothing changes.
+// Phi operands are live at the end of their incoming block instead of at the start of the phi's block,
+// constants are never tracked. Like the dominator tree it is a snapshot of the function, it renumbers the
+// function and keeps one bit per value and block so big functions stay cheap
+class Liveness
+{
+    std::vector<Value *> values; // By id, nullptr for the ones that are not tracked
+    size_t words = 0;            // Per block, each block's bits start at block id * words
+    std::vector<uint64_t> liveIn;
+    std::vector<uint64_t> liveOut;
+
+public:
+    // Only values the filter accepts are tracked, no filter tracks every argument and instruction
+    explicit Liveness(Function *function, std::function<bool(Value *)> filter = nullptr);
+
+    std::vector<Value *> in(BasicBlock *block) const; // In id order, arguments first
+    std::vector<Value *> out(BasicBlock *block) const;
+    bool isLiveOut(Value *value, BasicBlock *block) const { return test(liveOut, value, block); }
+    bool isLiveIn(Value *value, BasicBlock *block) const { return test(liveIn, value, block); }
+
+private:
+    bool test(const std::vector<uint64_t> &sets, Value *value, BasicBlock *block) const;
+    std::vector<Value *> members(const std::vector<uint64_t> &sets, BasicBlock *block) const;
+};
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include "loops.hpp"
+#include "folding.hpp"
+
+bool Loop::isInvariant(Value *value) const
+{
+    if (value->kind != ValueKind::INSTRUCTION)
+        return true;
+    auto inst = static_cast<Instruction *>(value);
+    return !inst->parent || !contains(inst->parent);
+}
+
+BasicBlock *Loop::preheader() const
+{
+    BasicBlock *candidate = nullptr;
+    for (auto pred : header->predecessors)
+    {
+        if (contains(pred))
+            continue;
+        if (candidate && candidate != pred)
+            return nullptr;
+        candidate = pred;
+    }
+    if (!candidate || candidate->successors().size() != 1)
+        return nullptr;
+    return candidate;
+}
+
+std::vector<BasicBlock *> Loop::exitingBlocks() const
+{
+    std::vector<BasicBlock *> exiting;
+    for (auto block : blocks)
+    {
+        for (auto succ : block->successors())
+        {
+            if (!contains(succ))
+            {
+                exiting.push_back(block);
+                break;
+            }
+        }
+    }
+    return exiting;
+}
+
+std::vector<InductionVariable> Loop::inductionVariables() const
+{
+    std::vector<InductionVariable> variables;
+    BasicBlock *entering = preheader();
+    if (!entering || latches.size() != 1)
+        return variables;
+    BasicBlock *latch = latches[0];
+
+    for (auto phi : header->instructions)
+    {
+        if (!phi->isPhi())
+            break;
+        if (phi->scalar() != TypeSystem::INTEGER || phi->operands.size() != 2)
+            continue;
+        Value *start = nullptr, *next = nullptr;
+        for (size_t i = 0; i < 2; ++i)
+        {
+            if (phi->targets[i] == entering)
+                start = phi->operands[i];
+            else if (phi->targets[i] == latch)
+                next = phi->operands[i];
+        }
+        if (!start || !next || next->kind != ValueKind::INSTRUCTION)
+            continue;
+
+        auto increment = static_cast<Instruction *>(next);
+        if (!increment->parent || !contains(increment->parent))
+            continue;
+        std::optional<int64_t> step;
+        if (increment->op == Opcode::ADD && increment->operands[0] == phi)
+            step = integerConstant(increment->operands[1]);
+        else if (increment->op == Opcode::ADD && increment->operands[1] == phi)
+            step = integerConstant(increment->operands[0]);
+        else if (increment->op == Opcode::SUB && increment->operands[0] == phi && integerConstant(increment->operands[1]))
+            step = static_cast<int64_t>(0 - static_cast<uint64_t>(*integerConstant(increment->operands[1])));
+        if (step)
+            variables.push_back({phi, start, increment, *step});
+    }
+    return variables;
+}
+
+size_t Loop::instructionCount() const
+{
+    size_t count = 0;
+    for (auto block : blocks)
+    {
+        count += block->instructions.size();
+    }
+    return count;
+}
+
+LoopInfo::LoopInfo(Function *function, const DominatorTree &dominators)
+{
+    std::vector<BasicBlock *> order = dominators.reversePostOrder();
+    for (auto header : order)
+    {
+        std::vector<BasicBlock *> latches;
+        for (auto pred : header->predecessors)
+        {
+            if (dominators.isReachable(pred) && dominators.dominates(header, pred))
+                latches.push_back(pred);
+        }
+        if (latches.empty())
+            continue;
+
+        auto loop = std::make_unique<Loop>(header);
+        loop->latches = latches;
+        loop->members.insert(header);
+        // Walking backwards from the latches stops at the header since it is already a member. Predecessors the
+        // header does not dominate only show up in irreducible flow and are left out
+        std::vector<BasicBlock *> worklist = latches;
+        while (!worklist.empty())
+        {
+            BasicBlock *block = worklist.back();
+            worklist.pop_back();
+            if (!loop->members.insert(block).second)
+                continue;
+            for (auto pred : block->predecessors)
+            {
+                if (dominators.isReachable(pred) && dominators.dominates(header, pred))
+                    worklist.push_back(pred);
+            }
+        }
+        loop->blocks.push_back(header);
+        for (auto block : function->blocks)
+        {
+            if (block != header && loop->contains(block))
+                loop->blocks.push_back(block);
+        }
+        loops.push_back(std::move(loop));
+    }
+
+    // Natural loops either nest or are disjoint, the parent is the smallest other loop holding the header
+    for (auto &loop : loops)
+    {
+        for (auto &other : loops)
+        {
+            if (other == loop || !other->contains(loop->header) || other->members.size() <= loop->members.size())
+                continue;
+            if (!loop->parent || other->members.size() < loop->parent->members.size())
+                loop->parent = other.get();
+        }
+        if (loop->parent)
+            loop->parent->children.push_back(loop.get());
+    }
+    // Outer loops come first, so the depth of a parent is known before its children's
+    for (auto &loop : loops)
+    {
+        loop->depth = loop->parent ? loop->parent->depth + 1 : 1;
+        for (auto block : loop->blocks)
+        {
+            innermost[block] = loop.get();
+        }
+    }
+}
+
+Loop *LoopInfo::loopFor(BasicBlock *block) const
+{
+    auto it = innermost.find(block);
+    return it == innermost.end() ? nullptr : it->second;
+}
+
+std::vector<Loop *> LoopInfo::innermostFirst() const
+{
+    std::vector<Loop *> order;
+    for (auto &loop : loops)
+    {
+        order.push_back(loop.get());
+    }
+    std::stable_sort(order.begin(), order.end(), [](Loop *a, Loop *b) { return a->depth > b->depth; });
+    return order;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "dominators.hpp"
+#include "ir.hpp"
+
+// An integer phi of the header that moves by a constant step every trip
+struct InductionVariable
+{
+    Instruction *phi;
+    Value *start;           // Value entering from the preheader
+    Instruction *increment; // phi + step, the value coming back from the latch
+    int64_t step;
+};
+
+// A natural loop: the header dominates every block of the loop and each latch jumps back to it
+struct Loop
+{
+    BasicBlock *header;
+    std::vector<BasicBlock *> blocks; // Layout order with the header first
+    std::unordered_set<BasicBlock *> members;
+    std::vector<BasicBlock *> latches; // Blocks with a back edge to the header
+    Loop *parent = nullptr;
+    std::vector<Loop *> children;
+    int depth = 1;
+
+    explicit Loop(BasicBlock *header) : header(header) {};
+
+    bool contains(BasicBlock *block) const { return members.count(block) != 0; }
+    bool isInvariant(Value *value) const; // Constants, arguments and instructions defined outside the loop
+    BasicBlock *preheader() const;        // The only block entering the loop, when it jumps nowhere else
+    std::vector<BasicBlock *> exitingBlocks() const; // Blocks of the loop with a successor outside of it
+    std::vector<InductionVariable> inductionVariables() const; // Needs a preheader and a single latch, empty otherwise
+    size_t instructionCount() const;
+};
+
+// Natural loops of a function, found from the back edges of the dominator tree. An edge whose target dominates
+// its source closes a loop made of every block that reaches the source without going through the target, back
+// edges to the same header make one loop. Like the dominator tree it is a snapshot
+class LoopInfo
+{
+    std::vector<std::unique_ptr<Loop>> loops; // Headers in reverse post order, so outer loops come first
+    std::unordered_map<BasicBlock *, Loop *> innermost;
+
+public:
+    LoopInfo(Function *function, const DominatorTree &dominators);
+
+    size_t size() const { return loops.size(); }
+    Loop *loopFor(BasicBlock *block) const; // Innermost loop holding the block, nullptr outside of loops
+    std::vector<Loop *> innermostFirst() const; // Every loop comes after the loops nested in it
+};
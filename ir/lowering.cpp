@@ -0,0 +1,1117 @@
+#include <iostream>
+#include "lowering.hpp"
+
+IRLowering::IRLowering(Semantics &semantics, Module &module) : semantics(semantics), module(module) {};
+
+void IRLowering::lower(const std::vector<std::unique_ptr<Node>> &program)
+{
+    // Declaring everything first since functions can use globals and functions that come later in the file
+    Function *topLevel = module.createFunction(TOP_LEVEL_NAME, module.types.function(module.types.scalar(TypeSystem::VOID), {}));
+    topLevel->isTopLevel = true;
+    std::vector<FunctionExpression *> functions;
+    for (const auto &node : program)
+    {
+        if (auto funcStmt = dynamic_cast<FunctionStatement *>(node.get()))
+        {
+            if (auto funcExpr = dynamic_cast<FunctionExpression *>(funcStmt->funcExpr.get()))
+            {
+                declareFunction(funcExpr);
+                functions.push_back(funcExpr);
+            }
+        }
+        else if (auto letStmt = dynamic_cast<LetStatement *>(node.get()))
+        {
+            declareGlobal(letStmt);
+        }
+    }
+
+    for (auto funcExpr : functions)
+    {
+        lowerFunction(funcExpr);
+    }
+
+    beginFunction(topLevel);
+    for (const auto &node : program)
+    {
+        if (dynamic_cast<FunctionStatement *>(node.get()))
+            continue;
+        if (isTerminated())
+            break;
+        if (auto stmt = dynamic_cast<Statement *>(node.get()))
+        {
+            lowerStatement(stmt);
+        }
+    }
+    finishFunction();
+}
+
+//---------DECLARATIONS----------
+void IRLowering::declareGlobal(LetStatement *letStmt)
+{
+    std::string name = letStmt->ident_token.TokenLiteral;
+    GlobalVariable *global = module.createGlobal(name, typeOf(letStmt));
+    global->isMutable = !letStmt->fixed_token.has_value();
+    // Constant initializers are stored in the global itself so the top level code does not have to write them
+    if (letStmt->value)
+    {
+        global->initializer = semantics.constantOf(letStmt->value.get());
+    }
+    else if (fixedLength(letStmt) == 0)
+    {
+        global->initializer = module.zeroOf(global->type)->value;
+    }
+}
+
+void IRLowering::declareFunction(FunctionExpression *funcExpr)
+{
+    std::vector<const Type *> params;
+    for (const auto &param : funcExpr->call)
+    {
+        if (auto letParam = dynamic_cast<LetStatement *>(param.get()))
+        {
+            params.push_back(typeFromString(letParam->data_type_token.TokenLiteral));
+        }
+        else if (auto assignParam = dynamic_cast<AssignmentStatement *>(param.get()))
+        {
+            params.push_back(typeOf(assignParam->value.get()));
+        }
+        else
+        {
+            params.push_back(module.types.scalar(TypeSystem::UNKNOWN));
+        }
+    }
+
+    const Type *returnType = module.types.scalar(TypeSystem::VOID);
+    if (auto retType = dynamic_cast<ReturnTypeExpression *>(funcExpr->return_type.get()))
+    {
+        returnType = typeFromString(retType->typeToken.TokenLiteral);
+    }
+
+    Function *declared = module.createFunction(funcExpr->func_name.TokenLiteral, module.types.function(returnType, params));
+    for (size_t i = 0; i < funcExpr->call.size(); ++i)
+    {
+        if (auto letParam = dynamic_cast<LetStatement *>(funcExpr->call[i].get()))
+        {
+            declared->arguments[i]->name = letParam->ident_token.TokenLiteral;
+            // checkPointerAccess proved every caller hands write parameters a cell nothing else reaches
+            declared->arguments[i]->noalias = letParam->access_token && letParam->access_token->type == TokenType::WRITE;
+        }
+        else if (auto assignParam = dynamic_cast<AssignmentStatement *>(funcExpr->call[i].get()))
+            declared->arguments[i]->name = assignParam->ident_token.TokenLiteral;
+    }
+}
+
+void IRLowering::lowerFunction(FunctionExpression *funcExpr)
+{
+    Function *target = module.findFunction(funcExpr->func_name.TokenLiteral);
+    if (!target)
+        return;
+    beginFunction(target);
+
+    for (size_t i = 0; i < function->arguments.size(); ++i)
+    {
+        Argument *arg = function->arguments[i];
+        int variable = declareVariable(arg->name, arg->type);
+        writeVariable(variable, currentBlock, arg);
+        if (i < funcExpr->call.size())
+            ownedVariables[funcExpr->call[i].get()] = variable;
+    }
+
+    // The body gets its own scope so a local can shadow a parameter like in any other block
+    if (auto body = dynamic_cast<BlockExpression *>(funcExpr->block.get()))
+    {
+        scopes.push_back({});
+        lowerStatements(body->statements);
+        // A trailing expression without a semicolon is the value of the function
+        Value *value = nullptr;
+        if (!isTerminated() && body->finalexpr.has_value() && body->finalexpr.value())
+            value = lowerExpression(body->finalexpr.value().get());
+        dropOwned(body);
+        if (value && function->returnType->scalar != TypeSystem::VOID && value->type == function->returnType)
+        {
+            emit(Opcode::RET, function->returnType, {value});
+        }
+        scopes.pop_back();
+    }
+    finishFunction();
+}
+
+void IRLowering::beginFunction(Function *target)
+{
+    function = target;
+    variableTypes.clear();
+    variableNames.clear();
+    scopes.clear();
+    scopes.push_back({});
+    currentDef.clear();
+    incompletePhis.clear();
+    sealedBlocks.clear();
+    replacedPhis.clear();
+    loops.clear();
+    zones.clear();
+    ownedVariables.clear();
+
+    currentBlock = newBlock("entry");
+    sealBlock(currentBlock);
+}
+
+void IRLowering::finishFunction()
+{
+    // Falling off the end returns, functions that should return a value give back the zero value
+    if (!isTerminated())
+    {
+        if (function->returnType->scalar == TypeSystem::VOID)
+            emit(Opcode::RET, function->returnType);
+        else
+            emit(Opcode::RET, function->returnType, {module.zeroOf(function->returnType)});
+    }
+    function->removeUnreachableBlocks();
+    function->sortBlocks();
+    function->renumber();
+    function = nullptr;
+    currentBlock = nullptr;
+}
+
+//---------STATEMENTS----------
+void IRLowering::lowerStatements(const std::vector<std::unique_ptr<Statement>> &statements)
+{
+    for (const auto &stmt : statements)
+    {
+        // Nothing after a return, break or continue can run
+        if (isTerminated())
+            return;
+        lowerStatement(stmt.get());
+    }
+}
+
+void IRLowering::lowerStatement(Statement *stmt)
+{
+    if (!stmt)
+        return;
+
+    if (auto letStmt = dynamic_cast<LetStatement *>(stmt))
+    {
+        lowerLetStatement(letStmt);
+    }
+    else if (auto assignStmt = dynamic_cast<AssignmentStatement *>(stmt))
+    {
+        Value *value = lowerValue(assignStmt->value.get(), assignStmt);
+        dropOwned(assignStmt); // The cell a unique pointer owned until now
+        lowerAssignment(assignStmt->ident_token.TokenLiteral, value, assignStmt);
+    }
+    else if (auto exprStmt = dynamic_cast<ExpressionStatement *>(stmt))
+    {
+        if (exprStmt->expression)
+            lowerExpression(exprStmt->expression.get());
+    }
+    else if (auto ifStmt = dynamic_cast<ifStatement *>(stmt))
+    {
+        lowerIfStatement(ifStmt);
+    }
+    else if (auto whileStmt = dynamic_cast<WhileStatement *>(stmt))
+    {
+        lowerWhileStatement(whileStmt);
+    }
+    else if (auto forStmt = dynamic_cast<ForStatement *>(stmt))
+    {
+        lowerForStatement(forStmt);
+    }
+    else if (dynamic_cast<BreakStatement *>(stmt))
+    {
+        if (!loops.empty())
+        {
+            dropOwned(stmt);
+            exitZones(loops.back().zoneCount);
+            branch(loops.back().breakTarget);
+        }
+    }
+    else if (dynamic_cast<ContinueStatement *>(stmt))
+    {
+        if (!loops.empty())
+        {
+            dropOwned(stmt);
+            exitZones(loops.back().zoneCount);
+            branch(loops.back().continueTarget);
+        }
+    }
+    else if (auto retStmt = dynamic_cast<ReturnStatement *>(stmt))
+    {
+        lowerReturnStatement(retStmt);
+    }
+    else if (auto signalStmt = dynamic_cast<SignalStatement *>(stmt))
+    {
+        lowerSignalStatement(signalStmt);
+    }
+    else if (auto waitStmt = dynamic_cast<WaitStatement *>(stmt))
+    {
+        lowerWaitStatement(waitStmt);
+    }
+    else if (auto zoneStmt = dynamic_cast<ZoneStatement *>(stmt))
+    {
+        lowerZoneStatement(zoneStmt);
+    }
+    else if (auto unsafeStmt = dynamic_cast<UnsafeStatement *>(stmt))
+    {
+        unsafeDepth++;
+        lowerBlock(unsafeStmt->body.get());
+        unsafeDepth--;
+    }
+    else if (auto freeStmt = dynamic_cast<FreeStatement *>(stmt))
+    {
+        emit(Opcode::FREE, module.types.scalar(TypeSystem::VOID), {lowerExpression(freeStmt->value.get())});
+    }
+    else if (dynamic_cast<BlockStatement *>(stmt))
+    {
+        lowerBlock(stmt);
+    }
+    else
+    {
+        std::cout << "[IR LOG]: Statement is not lowered yet: " << stmt->toString() << "\n";
+    }
+}
+
+void IRLowering::lowerLetStatement(LetStatement *letStmt)
+{
+    std::string name = letStmt->ident_token.TokenLiteral;
+    const Type *type = typeOf(letStmt);
+
+    // Top level variables outside of any block are globals
+    if (function->isTopLevel && scopes.size() == 1)
+    {
+        GlobalVariable *global = module.findGlobal(name);
+        if (!global || global->initializer)
+            return;
+        Value *value = letStmt->value ? convert(lowerValue(letStmt->value.get(), letStmt), type)
+                                      : emit(Opcode::NEW_ARRAY, type, {module.constantInt(fixedLength(letStmt))});
+        Instruction *store = emit(Opcode::STORE_GLOBAL, module.types.scalar(TypeSystem::VOID), {value});
+        store->global = global;
+        return;
+    }
+
+    // The value is lowered before the name is declared so int x = x + 1 still reads the outer x. A fixed size
+    // array declared without one gets its zeroed elements here
+    Value *value;
+    if (letStmt->value)
+        value = convert(lowerValue(letStmt->value.get(), letStmt), type);
+    else if (size_t length = fixedLength(letStmt))
+        value = emit(Opcode::NEW_ARRAY, type, {module.constantInt(length)});
+    else
+        value = module.zeroOf(type);
+    int variable = declareVariable(name, type);
+    writeVariable(variable, currentBlock, value);
+    if (letStmt->unique_token)
+        ownedVariables[letStmt] = variable;
+}
+
+void IRLowering::lowerAssignment(const std::string &name, Value *value, Node *node)
+{
+    int variable = lookupVariable(name);
+    if (variable >= 0)
+    {
+        writeVariable(variable, currentBlock, convert(value, variableTypes[variable]));
+        return;
+    }
+    if (GlobalVariable *global = module.findGlobal(name))
+    {
+        Instruction *store = emit(Opcode::STORE_GLOBAL, module.types.scalar(TypeSystem::VOID), {convert(value, global->type)});
+        store->global = global;
+        return;
+    }
+    std::cout << "[IR LOG]: Assignment to unknown variable '" << name << "' at line " << (node ? node->token.line : -1) << "\n";
+}
+
+Value *IRLowering::lowerValue(Expression *value, Node *owner)
+{
+    auto info = semantics.getAnnotation(owner);
+    bool saved = collecting;
+    collecting = collecting || (info && info->isGc);
+    Value *lowered = lowerExpression(value);
+    collecting = saved;
+    return lowered;
+}
+
+void IRLowering::lowerIfStatement(ifStatement *ifStmt)
+{
+    BasicBlock *merge = newBlock("if.end");
+    BasicBlock *thenBlock = newBlock("if.then");
+
+    // Where control goes when the first condition is false
+    BasicBlock *elseIfBlock = ifStmt->elseif_condition.has_value() && *ifStmt->elseif_condition ? newBlock("elseif.cond") : nullptr;
+    BasicBlock *elseBlock = ifStmt->else_result.has_value() && *ifStmt->else_result ? newBlock("if.else") : nullptr;
+    BasicBlock *afterElseIf = elseBlock ? elseBlock : merge;
+
+    Value *condition = lowerExpression(ifStmt->condition.get());
+    conditionalBranch(condition, thenBlock, elseIfBlock ? elseIfBlock : afterElseIf);
+    sealBlock(thenBlock);
+
+    currentBlock = thenBlock;
+    lowerBlock(ifStmt->if_result.get());
+    branch(merge);
+
+    if (elseIfBlock)
+    {
+        sealBlock(elseIfBlock);
+        currentBlock = elseIfBlock;
+        BasicBlock *elseIfThen = newBlock("elseif.then");
+        Value *elseIfCondition = lowerExpression(ifStmt->elseif_condition->get());
+        conditionalBranch(elseIfCondition, elseIfThen, afterElseIf);
+        sealBlock(elseIfThen);
+
+        currentBlock = elseIfThen;
+        if (ifStmt->elseif_result.has_value())
+            lowerBlock(ifStmt->elseif_result->get());
+        branch(merge);
+    }
+
+    if (elseBlock)
+    {
+        sealBlock(elseBlock);
+        currentBlock = elseBlock;
+        lowerBlock(ifStmt->else_result->get());
+        branch(merge);
+    }
+
+    sealBlock(merge);
+    currentBlock = merge;
+}
+
+void IRLowering::lowerWhileStatement(WhileStatement *whileStmt)
+{
+    BasicBlock *header = newBlock("while.cond");
+    BasicBlock *body = newBlock("while.body");
+    BasicBlock *exit = newBlock("while.end");
+
+    // The header stays unsealed until the back edge is known
+    branch(header);
+    currentBlock = header;
+    Value *condition = lowerExpression(whileStmt->condition.get());
+    conditionalBranch(condition, body, exit);
+    sealBlock(body);
+
+    loops.push_back({header, exit, zones.size()});
+    currentBlock = body;
+    lowerBlock(whileStmt->loop.get());
+    branch(header);
+    loops.pop_back();
+
+    sealBlock(header);
+    sealBlock(exit);
+    currentBlock = exit;
+}
+
+void IRLowering::lowerForStatement(ForStatement *forStmt)
+{
+    // The loop variable lives in its own scope around the whole loop
+    scopes.push_back({});
+    lowerStatement(forStmt->initializer.get());
+
+    BasicBlock *header = newBlock("for.cond");
+    BasicBlock *body = newBlock("for.body");
+    BasicBlock *step = newBlock("for.step");
+    BasicBlock *exit = newBlock("for.end");
+
+    branch(header);
+    currentBlock = header;
+    if (forStmt->condition)
+    {
+        Value *condition = lowerExpression(forStmt->condition.get());
+        conditionalBranch(condition, body, exit);
+    }
+    else
+    {
+        branch(body);
+    }
+    sealBlock(body);
+
+    loops.push_back({step, exit, zones.size()});
+    currentBlock = body;
+    lowerBlock(forStmt->body.get());
+    branch(step);
+    loops.pop_back();
+
+    sealBlock(step);
+    currentBlock = step;
+    if (forStmt->step)
+    {
+        lowerExpression(forStmt->step.get());
+    }
+    branch(header);
+
+    sealBlock(header);
+    sealBlock(exit);
+    currentBlock = exit;
+    scopes.pop_back();
+}
+
+void IRLowering::lowerReturnStatement(ReturnStatement *retStmt)
+{
+    Value *value = retStmt->return_value ? lowerExpression(retStmt->return_value.get()) : nullptr;
+    dropOwned(retStmt);
+    exitZones(0);
+    if (function->returnType->scalar == TypeSystem::VOID || !value)
+    {
+        // The top level has no return type so its return values are evaluated and dropped
+        if (function->returnType->scalar == TypeSystem::VOID)
+            emit(Opcode::RET, function->returnType);
+        else
+            emit(Opcode::RET, function->returnType, {module.zeroOf(function->returnType)});
+        return;
+    }
+    emit(Opcode::RET, function->returnType, {convert(value, function->returnType)});
+}
+
+// The signal is an ordinary SSA variable holding the task handle, even at the top level, since only the
+// top level code is allowed to wait on it
+void IRLowering::lowerSignalStatement(SignalStatement *signalStmt)
+{
+    auto ident = dynamic_cast<Identifier *>(signalStmt->identifier.get());
+    auto call = dynamic_cast<CallExpression *>(signalStmt->func_arg.get());
+    if (!ident || !call)
+        return;
+    Function *callee = call->function_identifier ? module.findFunction(call->function_identifier->token.TokenLiteral) : nullptr;
+    if (!callee || callee->isTopLevel)
+    {
+        std::cout << "[IR LOG]: Start of unknown function " << call->toString() << "\n";
+        return;
+    }
+
+    std::vector<Value *> args;
+    for (size_t i = 0; i < call->parameters.size(); ++i)
+    {
+        Value *arg = lowerExpression(call->parameters[i].get());
+        args.push_back(i < callee->arguments.size() ? convert(arg, callee->arguments[i]->type) : arg);
+    }
+    const Type *future = module.types.futureOf(callee->returnType);
+    Instruction *spawn = emit(Opcode::SPAWN, future, args);
+    spawn->callee = callee;
+    auto info = semantics.getAnnotation(signalStmt);
+    spawn->raceFree = info && info->isRaceFree;
+    int variable = declareVariable(ident->identifier.TokenLiteral, future);
+    writeVariable(variable, currentBlock, spawn);
+    ownedVariables[signalStmt] = variable;
+}
+
+void IRLowering::lowerWaitStatement(WaitStatement *waitStmt)
+{
+    if (auto ident = dynamic_cast<Identifier *>(waitStmt->arg.get()))
+        lowerIdentifier(ident->identifier.TokenLiteral, ident);
+}
+
+// Every way out of the block frees the zone, falling through here and break, continue and return where they are lowered
+void IRLowering::lowerZoneStatement(ZoneStatement *zoneStmt)
+{
+    if (isTerminated())
+        return;
+    Instruction *enter = emit(Opcode::ZONE_ENTER, module.types.scalar(TypeSystem::INTEGER));
+    zones.push_back(enter);
+    lowerBlock(zoneStmt->body.get());
+    zones.pop_back();
+    if (!isTerminated())
+        emit(Opcode::ZONE_EXIT, module.types.scalar(TypeSystem::VOID), {enter});
+}
+
+void IRLowering::exitZones(size_t keep)
+{
+    for (size_t i = zones.size(); i > keep && !isTerminated(); --i)
+    {
+        emit(Opcode::ZONE_EXIT, module.types.scalar(TypeSystem::VOID), {zones[i - 1]});
+    }
+}
+
+void IRLowering::lowerBlock(Node *block)
+{
+    if (!block || isTerminated())
+        return;
+    scopes.push_back({});
+    if (auto blockStmt = dynamic_cast<BlockStatement *>(block))
+    {
+        lowerStatements(blockStmt->statements);
+    }
+    else if (auto blockExpr = dynamic_cast<BlockExpression *>(block))
+    {
+        lowerStatements(blockExpr->statements);
+        if (!isTerminated() && blockExpr->finalexpr.has_value() && blockExpr->finalexpr.value())
+            lowerExpression(blockExpr->finalexpr.value().get());
+    }
+    else if (auto stmt = dynamic_cast<Statement *>(block))
+    {
+        lowerStatement(stmt);
+    }
+    dropOwned(block);
+    scopes.pop_back();
+}
+
+void IRLowering::dropOwned(Node *node)
+{
+    for (auto declaration : semantics.dropsAt(node))
+    {
+        auto owned = ownedVariables.find(declaration);
+        if (owned == ownedVariables.end() || isTerminated())
+            continue;
+        Opcode drop = variableTypes[owned->second]->kind == TypeKind::FUTURE ? Opcode::DETACH : Opcode::FREE;
+        emit(drop, module.types.scalar(TypeSystem::VOID), {readVariable(owned->second, currentBlock)});
+    }
+}
+
+//---------EXPRESSIONS----------
+Value *IRLowering::lowerExpression(Expression *expr)
+{
+    if (!expr)
+        return module.zeroOf(module.types.scalar(TypeSystem::UNKNOWN));
+
+    // Everything the analyzer folded is already a constant
+    if (auto folded = semantics.constantOf(expr))
+    {
+        return module.constant(*folded);
+    }
+
+    if (auto intLit = dynamic_cast<IntegerLiteral *>(expr))
+    {
+        return module.constantInt(std::stoll(intLit->int_token.TokenLiteral));
+    }
+    if (auto fltLit = dynamic_cast<FloatLiteral *>(expr))
+    {
+        return module.constantFloat(std::stod(fltLit->float_token.TokenLiteral));
+    }
+    if (auto boolLit = dynamic_cast<BooleanLiteral *>(expr))
+    {
+        return module.constantBool(boolLit->boolean_token.TokenLiteral == "true");
+    }
+    if (auto charLit = dynamic_cast<CharLiteral *>(expr))
+    {
+        const std::string &text = charLit->char_token.TokenLiteral;
+        return module.constantChar(text.empty() ? '\0' : text[0]);
+    }
+    if (auto strLit = dynamic_cast<StringLiteral *>(expr))
+    {
+        return module.constantString(strLit->string_token.TokenLiteral);
+    }
+    if (auto ident = dynamic_cast<Identifier *>(expr))
+    {
+        return lowerIdentifier(ident->identifier.TokenLiteral, ident);
+    }
+    if (auto infix = dynamic_cast<InfixExpression *>(expr))
+    {
+        return lowerInfix(infix);
+    }
+    if (auto prefix = dynamic_cast<PrefixExpression *>(expr))
+    {
+        return lowerPrefix(prefix);
+    }
+    if (auto call = dynamic_cast<CallExpression *>(expr))
+    {
+        return lowerCall(call);
+    }
+    if (auto alloc = dynamic_cast<AllocExpression *>(expr))
+    {
+        return lowerAlloc(alloc);
+    }
+    if (auto literal = dynamic_cast<ArrayLiteral *>(expr))
+    {
+        return lowerArrayLiteral(literal);
+    }
+    if (auto index = dynamic_cast<IndexExpression *>(expr))
+    {
+        Value *element = lowerElement(index);
+        return emit(Opcode::LOAD, element->type->element, {element});
+    }
+    if (auto blockExpr = dynamic_cast<BlockExpression *>(expr))
+    {
+        lowerBlock(blockExpr);
+        return module.zeroOf(module.types.scalar(TypeSystem::VOID));
+    }
+
+    std::cout << "[IR LOG]: Expression is not lowered yet: " << expr->toString() << "\n";
+    return module.zeroOf(typeOf(expr));
+}
+
+Value *IRLowering::lowerInfix(InfixExpression *infix)
+{
+    TokenType op = infix->operat.type;
+
+    if (op == TokenType::ASSIGN)
+    {
+        auto target = dynamic_cast<Identifier *>(infix->left_operand.get());
+        if (Value *pointer = addressOf(infix->left_operand.get()))
+        {
+            // *p = v and a[i] = v write through the pointer
+            Value *value = convert(lowerExpression(infix->right_operand.get()), pointer->type->element);
+            emit(Opcode::STORE, module.types.scalar(TypeSystem::VOID), {pointer, value});
+            return value;
+        }
+        Value *value = lowerExpression(infix->right_operand.get());
+        if (target)
+            lowerAssignment(target->identifier.TokenLiteral, value, infix);
+        return value;
+    }
+
+    if (op == TokenType::AND || op == TokenType::OR)
+    {
+        return lowerShortCircuit(infix);
+    }
+
+    Value *left = lowerExpression(infix->left_operand.get());
+    Value *right = lowerExpression(infix->right_operand.get());
+    const Type *resultType = typeOf(infix);
+    const Type *floatType = module.types.scalar(TypeSystem::FLOAT);
+
+    switch (op)
+    {
+    case TokenType::PLUS:
+        if (resultType->scalar == TypeSystem::STRING && collecting)
+        {
+            Instruction *concat = emit(Opcode::CONCAT, resultType, {left, right});
+            concat->collected = true;
+            return concat;
+        }
+        if (resultType->scalar == TypeSystem::STRING && !zones.empty())
+            return emit(Opcode::CONCAT, resultType, {left, right, zones.back()});
+        if (resultType->scalar == TypeSystem::STRING)
+            return emit(Opcode::CONCAT, resultType, {left, right});
+        return emit(Opcode::ADD, resultType, {convert(left, resultType), convert(right, resultType)});
+    case TokenType::MINUS:
+        return emit(Opcode::SUB, resultType, {convert(left, resultType), convert(right, resultType)});
+    case TokenType::ASTERISK:
+        return emit(Opcode::MUL, resultType, {convert(left, resultType), convert(right, resultType)});
+    case TokenType::DIVIDE:
+        return emit(Opcode::DIV, resultType, {convert(left, resultType), convert(right, resultType)});
+    case TokenType::MODULUS:
+        return emit(Opcode::MOD, resultType, {convert(left, resultType), convert(right, resultType)});
+    default:
+        break;
+    }
+
+    Opcode compare;
+    switch (op)
+    {
+    case TokenType::EQUALS:
+        compare = Opcode::EQ;
+        break;
+    case TokenType::NOT_EQUALS:
+        compare = Opcode::NE;
+        break;
+    case TokenType::LESS_THAN:
+        compare = Opcode::LT;
+        break;
+    case TokenType::GREATER_THAN:
+        compare = Opcode::GT;
+        break;
+    case TokenType::LT_OR_EQ:
+        compare = Opcode::LE;
+        break;
+    case TokenType::GT_OR_EQ:
+        compare = Opcode::GE;
+        break;
+    default:
+        std::cout << "[IR LOG]: Operator is not lowered yet: " << infix->operat.TokenLiteral << "\n";
+        return module.zeroOf(resultType);
+    }
+
+    // Comparing an int with a float compares them as floats
+    if (left->type != right->type && (left->scalar() == TypeSystem::FLOAT || right->scalar() == TypeSystem::FLOAT))
+    {
+        left = convert(left, floatType);
+        right = convert(right, floatType);
+    }
+    return emit(compare, module.types.scalar(TypeSystem::BOOLEAN), {left, right});
+}
+
+// a && b and a || b only evaluate b when a did not decide the result already
+Value *IRLowering::lowerShortCircuit(InfixExpression *infix)
+{
+    bool isAnd = infix->operat.type == TokenType::AND;
+    const Type *boolType = module.types.scalar(TypeSystem::BOOLEAN);
+
+    Value *left = lowerExpression(infix->left_operand.get());
+    BasicBlock *leftEnd = currentBlock;
+    BasicBlock *rightBlock = newBlock(isAnd ? "and.rhs" : "or.rhs");
+    BasicBlock *end = newBlock(isAnd ? "and.end" : "or.end");
+
+    if (isAnd)
+        conditionalBranch(left, rightBlock, end);
+    else
+        conditionalBranch(left, end, rightBlock);
+    sealBlock(rightBlock);
+
+    currentBlock = rightBlock;
+    Value *right = lowerExpression(infix->right_operand.get());
+    BasicBlock *rightEnd = currentBlock;
+    branch(end);
+    sealBlock(end);
+
+    currentBlock = end;
+    Instruction *phi = module.createInstruction(Opcode::PHI, boolType);
+    end->insertPhi(phi);
+    for (auto pred : end->predecessors)
+    {
+        if (pred == leftEnd)
+            phi->addIncoming(module.constantBool(!isAnd), pred);
+        else if (pred == rightEnd)
+            phi->addIncoming(right, pred);
+    }
+    return phi;
+}
+
+Value *IRLowering::lowerPrefix(PrefixExpression *prefix)
+{
+    TokenType op = prefix->operat.type;
+    const Type *resultType = typeOf(prefix);
+
+    if (op == TokenType::PLUS_PLUS || op == TokenType::MINUS_MINUS)
+    {
+        // ++x and --x write the new value back and evaluate to it, ++*p and ++a[i] write through the pointer
+        auto target = dynamic_cast<Identifier *>(prefix->operand.get());
+        Value *pointer = addressOf(prefix->operand.get());
+        Value *current = pointer ? emit(Opcode::LOAD, pointer->type->element, {pointer}) : lowerExpression(prefix->operand.get());
+        Value *one = current->scalar() == TypeSystem::FLOAT ? (Value *)module.constantFloat(1.0) : (Value *)module.constantInt(1);
+        Value *updated = emit(op == TokenType::PLUS_PLUS ? Opcode::ADD : Opcode::SUB, current->type, {current, one});
+        if (target)
+            lowerAssignment(target->identifier.TokenLiteral, updated, prefix);
+        else if (pointer)
+            emit(Opcode::STORE, module.types.scalar(TypeSystem::VOID), {pointer, updated});
+        return updated;
+    }
+
+    Value *operand = lowerExpression(prefix->operand.get());
+    if (op == TokenType::ASTERISK)
+        return emit(Opcode::LOAD, resultType, {operand});
+    if (op == TokenType::BANG)
+        return emit(Opcode::NOT, resultType, {operand});
+    if (op == TokenType::MINUS)
+        return emit(Opcode::NEG, operand->type, {operand});
+    if (op == TokenType::ELEVATE)
+        return operand; // Only changes what the semantic check allows
+    if (op == TokenType::LENGTH)
+        return emit(Opcode::LENGTH, resultType, {operand}); // Fixed lengths were folded by the semantic pass
+
+    std::cout << "[IR LOG]: Prefix operator is not lowered yet: " << prefix->operat.TokenLiteral << "\n";
+    return operand;
+}
+
+// alloc(T) stores a zero into the new cell, make(value) the value, the allocator itself does not clear memory.
+// The elements of alloc(T, n) are cleared when the array is made
+Value *IRLowering::lowerAlloc(AllocExpression *alloc)
+{
+    const Type *type = typeOf(alloc);
+    if (alloc->count)
+        return emit(Opcode::NEW_ARRAY, type, {lowerExpression(alloc->count.get())});
+    const Type *pointee = type->kind == TypeKind::POINTER ? type->element : module.types.scalar(TypeSystem::UNKNOWN);
+    Value *value = alloc->value ? convert(lowerExpression(alloc->value.get()), pointee) : module.zeroOf(pointee);
+    Instruction *cell = emit(Opcode::ALLOC, type, {module.constantInt(1)});
+    emit(Opcode::STORE, module.types.scalar(TypeSystem::VOID), {cell, value});
+    return cell;
+}
+
+Value *IRLowering::lowerArrayLiteral(ArrayLiteral *literal)
+{
+    const Type *type = typeOf(literal);
+    Instruction *array = emit(Opcode::NEW_ARRAY, type, {module.constantInt(literal->elements.size())});
+    const Type *elementPointer = module.types.pointerTo(type->element);
+    for (size_t i = 0; i < literal->elements.size(); ++i)
+    {
+        Value *value = convert(lowerExpression(literal->elements[i].get()), type->element);
+        Instruction *element = emit(Opcode::ELEMENT, elementPointer, {array, module.constantInt(i)});
+        emit(Opcode::STORE, module.types.scalar(TypeSystem::VOID), {element, value});
+    }
+    return array;
+}
+
+Value *IRLowering::lowerElement(IndexExpression *index)
+{
+    Value *array = lowerExpression(index->array.get());
+    Value *position = lowerExpression(index->index.get());
+    if (unsafeDepth == 0)
+    {
+        size_t length = fixedLength(index->array.get());
+        Value *bound = length ? (Value *)module.constantInt(length) : emit(Opcode::LENGTH, module.types.scalar(TypeSystem::INTEGER), {array});
+        emit(Opcode::CHECK_BOUNDS, module.types.scalar(TypeSystem::VOID), {position, bound});
+    }
+    return emit(Opcode::ELEMENT, module.types.pointerTo(array->type->element), {array, position});
+}
+
+Value *IRLowering::addressOf(Expression *expr)
+{
+    if (auto index = dynamic_cast<IndexExpression *>(expr))
+        return lowerElement(index);
+    if (auto deref = dynamic_cast<PrefixExpression *>(expr); deref && deref->operat.type == TokenType::ASTERISK)
+        return lowerExpression(deref->operand.get());
+    return nullptr;
+}
+
+Value *IRLowering::lowerCall(CallExpression *call)
+{
+    std::vector<Value *> args;
+    for (const auto &param : call->parameters)
+    {
+        args.push_back(lowerExpression(param.get()));
+    }
+
+    Function *callee = call->function_identifier ? module.findFunction(call->function_identifier->token.TokenLiteral) : nullptr;
+    if (!callee || callee->isTopLevel)
+    {
+        std::cout << "[IR LOG]: Call to unknown function " << call->toString() << "\n";
+        return module.zeroOf(typeOf(call));
+    }
+
+    for (size_t i = 0; i < args.size() && i < callee->arguments.size(); ++i)
+    {
+        args[i] = convert(args[i], callee->arguments[i]->type);
+    }
+    Instruction *inst = emit(Opcode::CALL, callee->returnType, args);
+    inst->callee = callee;
+    return inst;
+}
+
+Value *IRLowering::lowerIdentifier(const std::string &name, Node *node)
+{
+    int variable = lookupVariable(name);
+    if (variable >= 0)
+    {
+        // Reading a signal waits for its task
+        if (variableTypes[variable]->kind == TypeKind::FUTURE)
+        {
+            Instruction *join = emit(Opcode::JOIN, variableTypes[variable]->element, {readVariable(variable, currentBlock)});
+            join->name = name;
+            return join;
+        }
+        return readVariable(variable, currentBlock);
+    }
+    if (GlobalVariable *global = module.findGlobal(name))
+    {
+        // Fixed globals with a known value never need a load
+        if (!global->isMutable && global->initializer)
+            return module.constant(*global->initializer);
+        Instruction *load = emit(Opcode::LOAD_GLOBAL, global->type);
+        load->global = global;
+        load->name = name;
+        return load;
+    }
+    std::cout << "[IR LOG]: Use of unknown variable '" << name << "' at line " << (node ? node->token.line : -1) << "\n";
+    return module.zeroOf(typeOf(node));
+}
+
+//---------SSA CONSTRUCTION----------
+int IRLowering::declareVariable(const std::string &name, const Type *type)
+{
+    int variable = variableTypes.size();
+    variableTypes.push_back(type);
+    variableNames.push_back(name);
+    scopes.back()[name] = variable;
+    return variable;
+}
+
+int IRLowering::lookupVariable(const std::string &name)
+{
+    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it)
+    {
+        auto found = it->find(name);
+        if (found != it->end())
+            return found->second;
+    }
+    return -1;
+}
+
+void IRLowering::writeVariable(int variable, BasicBlock *block, Value *value)
+{
+    if (value->kind == ValueKind::INSTRUCTION && static_cast<Instruction *>(value)->name.empty())
+        static_cast<Instruction *>(value)->name = variableNames[variable];
+    currentDef[block][variable] = value;
+}
+
+Value *IRLowering::readVariable(int variable, BasicBlock *block)
+{
+    auto blockDefs = currentDef.find(block);
+    if (blockDefs != currentDef.end())
+    {
+        auto def = blockDefs->second.find(variable);
+        if (def != blockDefs->second.end())
+        {
+            return resolve(def->second);
+        }
+    }
+    return readVariableRecursive(variable, block);
+}
+
+Value *IRLowering::readVariableRecursive(int variable, BasicBlock *block)
+{
+    const Type *type = variableTypes[variable];
+    Value *value;
+    if (!sealedBlocks.count(block))
+    {
+        // Not every predecessor is known yet, the operands are filled in when the block is sealed
+        Instruction *phi = module.createInstruction(Opcode::PHI, type);
+        block->insertPhi(phi);
+        incompletePhis[block].push_back({variable, phi});
+        value = phi;
+    }
+    else if (block->predecessors.empty())
+    {
+        value = module.zeroOf(type);
+    }
+    else if (block->predecessors.size() == 1)
+    {
+        value = readVariable(variable, block->predecessors.front());
+    }
+    else
+    {
+        // Writing the phi before reading the operands breaks the cycles through loops
+        Instruction *phi = module.createInstruction(Opcode::PHI, type);
+        block->insertPhi(phi);
+        writeVariable(variable, block, phi);
+        value = addPhiOperands(variable, phi);
+    }
+    writeVariable(variable, block, value);
+    return value;
+}
+
+Value *IRLowering::addPhiOperands(int variable, Instruction *phi)
+{
+    for (auto pred : phi->parent->predecessors)
+    {
+        phi->addIncoming(readVariable(variable, pred), pred);
+    }
+    return tryRemoveTrivialPhi(phi);
+}
+
+// A phi whose operands are all the same value (or itself) is replaced by that value
+Value *IRLowering::tryRemoveTrivialPhi(Instruction *phi)
+{
+    if (!phi->parent)
+        return resolve(phi);
+    // Phis of unsealed blocks are still missing operands
+    if (!sealedBlocks.count(phi->parent))
+        return phi;
+
+    Value *same = nullptr;
+    for (auto operand : phi->operands)
+    {
+        if (operand == same || operand == phi)
+            continue;
+        if (same)
+            return phi;
+        same = operand;
+    }
+    if (!same)
+    {
+        same = module.zeroOf(phi->type); // The phi is unreachable or in a block without a definition
+    }
+
+    std::vector<Instruction *> phiUsers;
+    for (auto user : phi->users)
+    {
+        if (user != phi)
+            phiUsers.push_back(user);
+    }
+
+    phi->replaceAllUsesWith(same);
+    replacedPhis[phi] = same;
+    phi->parent->erase(phi);
+
+    // Removing this phi can make the phis that used it trivial as well
+    for (auto user : phiUsers)
+    {
+        if (user->isPhi())
+            tryRemoveTrivialPhi(user);
+    }
+    return resolve(same);
+}
+
+Value *IRLowering::resolve(Value *value)
+{
+    auto it = replacedPhis.find(value);
+    while (it != replacedPhis.end())
+    {
+        value = it->second;
+        it = replacedPhis.find(value);
+    }
+    return value;
+}
+
+void IRLowering::sealBlock(BasicBlock *block)
+{
+    sealedBlocks.insert(block);
+    auto pending = incompletePhis.find(block);
+    if (pending != incompletePhis.end())
+    {
+        auto phis = std::move(pending->second);
+        incompletePhis.erase(pending);
+        for (auto &[variable, phi] : phis)
+        {
+            addPhiOperands(variable, phi);
+        }
+    }
+}
+
+//---------HELPER FUNCTIONS----------
+BasicBlock *IRLowering::newBlock(const std::string &label)
+{
+    return module.createBlock(function, label);
+}
+
+Instruction *IRLowering::emit(Opcode op, const Type *type, std::vector<Value *> operands)
+{
+    Instruction *inst = module.createInstruction(op, type);
+    for (auto operand : operands)
+    {
+        inst->addOperand(operand);
+    }
+    currentBlock->append(inst);
+    return inst;
+}
+
+void IRLowering::branch(BasicBlock *target)
+{
+    if (isTerminated())
+        return;
+    Instruction *br = emit(Opcode::BR, module.types.scalar(TypeSystem::VOID));
+    br->targets.push_back(target);
+    target->predecessors.push_back(currentBlock);
+}
+
+void IRLowering::conditionalBranch(Value *condition, BasicBlock *ifTrue, BasicBlock *ifFalse)
+{
+    if (isTerminated())
+        return;
+    Instruction *condbr = emit(Opcode::CONDBR, module.types.scalar(TypeSystem::VOID), {condition});
+    condbr->targets = {ifTrue, ifFalse};
+    ifTrue->predecessors.push_back(currentBlock);
+    if (ifFalse != ifTrue)
+        ifFalse->predecessors.push_back(currentBlock);
+}
+
+bool IRLowering::isTerminated() const
+{
+    return currentBlock && currentBlock->terminator() != nullptr;
+}
+
+Value *IRLowering::convert(Value *value, const Type *target)
+{
+    if (value->type == target || !target)
+        return value;
+    if (value->scalar() == TypeSystem::INTEGER && target->scalar == TypeSystem::FLOAT)
+    {
+        if (value->kind == ValueKind::CONSTANT)
+            return module.constantFloat((double)static_cast<Constant *>(value)->value.intValue);
+        return emit(Opcode::ITOF, target, {value});
+    }
+    return value;
+}
+
+const Type *IRLowering::typeOf(Node *node)
+{
+    auto info = node ? semantics.getAnnotation(node) : nullptr;
+    if (info && info->type)
+        return module.types.withoutLengths(info->type); // The IR keeps lengths in the blocks, fixed ones only matter to the checks
+    return module.types.scalar(info ? info->nodeType : TypeSystem::UNKNOWN);
+}
+
+const Type *IRLowering::typeFromString(const std::string &typeName)
+{
+    return module.types.withoutLengths(semantics.resolveType(typeName));
+}
+
+size_t IRLowering::fixedLength(Node *node)
+{
+    auto info = node ? semantics.getAnnotation(node) : nullptr;
+    return info && info->type && info->type->kind == TypeKind::ARRAY ? info->type->length : 0;
+}
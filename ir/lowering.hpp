@@ -0,0 +1,107 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ast.hpp"
+#include "ir.hpp"
+#include "semantic analyzer/semantics.hpp"
+
+// Lowers the annotated AST to SSA form in a single walk.
+// Local variables never get a memory slot, the SSA values are built on the fly with the algorithm of
+// Braun et al. (read/write per block, phis added lazily and removed again when they turn out trivial).
+// Top level variables become module globals and the top level statements go into a synthetic function
+class IRLowering
+{
+    Semantics &semantics;
+    Module &module;
+
+    // State of the function being lowered
+    Function *function = nullptr;
+    BasicBlock *currentBlock = nullptr;
+    std::vector<const Type *> variableTypes;                        // Indexed by variable id
+    std::vector<std::string> variableNames;                         // Only used to name the values in the dump
+    std::vector<std::unordered_map<std::string, int>> scopes;       // Source name to variable id
+    std::unordered_map<BasicBlock *, std::unordered_map<int, Value *>> currentDef;
+    std::unordered_map<BasicBlock *, std::vector<std::pair<int, Instruction *>>> incompletePhis;
+    std::unordered_set<BasicBlock *> sealedBlocks;
+    std::unordered_map<Value *, Value *> replacedPhis; // Trivial phis that were removed and what replaced them
+
+    struct LoopTargets
+    {
+        BasicBlock *continueTarget;
+        BasicBlock *breakTarget;
+        size_t zoneCount; // Zones already open when the loop started, break and continue leave the others
+    };
+    std::vector<LoopTargets> loops;
+    std::vector<Instruction *> zones; // ZONE_ENTER of every zone block around the current statement
+    bool collecting = false;          // Lowering the value of a gc variable, its concatenations go to the collected heap
+    int unsafeDepth = 0;              // Unsafe blocks around the current statement, their array indexes are not checked
+    std::unordered_map<Node *, int> ownedVariables; // Declaration of every unique pointer and signal to its variable
+
+public:
+    static constexpr const char *TOP_LEVEL_NAME = "__toplevel";
+
+    IRLowering(Semantics &semantics, Module &module);
+    void lower(const std::vector<std::unique_ptr<Node>> &program);
+
+private:
+    //---------DECLARATIONS----------
+    void declareGlobal(LetStatement *letStmt);
+    void declareFunction(FunctionExpression *funcExpr);
+    void lowerFunction(FunctionExpression *funcExpr);
+    void beginFunction(Function *target);
+    void finishFunction();
+
+    //---------STATEMENTS----------
+    void lowerStatement(Statement *stmt);
+    void lowerStatements(const std::vector<std::unique_ptr<Statement>> &statements);
+    void lowerLetStatement(LetStatement *letStmt);
+    void lowerAssignment(const std::string &name, Value *value, Node *node);
+    Value *lowerValue(Expression *value, Node *owner); // Value of a let or assignment, collected for gc variables
+    void lowerIfStatement(ifStatement *ifStmt);
+    void lowerWhileStatement(WhileStatement *whileStmt);
+    void lowerForStatement(ForStatement *forStmt);
+    void lowerReturnStatement(ReturnStatement *retStmt);
+    void lowerSignalStatement(SignalStatement *signalStmt);
+    void lowerWaitStatement(WaitStatement *waitStmt);
+    void lowerZoneStatement(ZoneStatement *zoneStmt);
+    void exitZones(size_t keep); // Frees the zones opened after the first keep ones, for jumps out of them
+    void lowerBlock(Node *block); // BlockStatement or BlockExpression, opens a scope
+    void dropOwned(Node *node);   // Frees the cells of the unique pointers and detaches the signals the semantic pass drops at the node
+
+    //---------EXPRESSIONS----------
+    Value *lowerExpression(Expression *expr);
+    Value *lowerInfix(InfixExpression *infix);
+    Value *lowerShortCircuit(InfixExpression *infix);
+    Value *lowerPrefix(PrefixExpression *prefix);
+    Value *lowerAlloc(AllocExpression *alloc);
+    Value *lowerArrayLiteral(ArrayLiteral *literal);
+    Value *lowerElement(IndexExpression *index); // Pointer to the element, checked against the length outside unsafe blocks
+    Value *addressOf(Expression *expr);          // Pointer behind *p and a[i], nullptr for anything else
+    Value *lowerCall(CallExpression *call);
+    Value *lowerIdentifier(const std::string &name, Node *node);
+
+    //---------SSA CONSTRUCTION----------
+    int declareVariable(const std::string &name, const Type *type);
+    int lookupVariable(const std::string &name);
+    void writeVariable(int variable, BasicBlock *block, Value *value);
+    Value *readVariable(int variable, BasicBlock *block);
+    Value *readVariableRecursive(int variable, BasicBlock *block);
+    Value *addPhiOperands(int variable, Instruction *phi);
+    Value *tryRemoveTrivialPhi(Instruction *phi);
+    Value *resolve(Value *value);
+    void sealBlock(BasicBlock *block);
+
+    //---------HELPER FUNCTIONS----------
+    BasicBlock *newBlock(const std::string &label);
+    Instruction *emit(Opcode op, const Type *type, std::vector<Value *> operands = {});
+    void branch(BasicBlock *target);
+    void conditionalBranch(Value *condition, BasicBlock *ifTrue, BasicBlock *ifFalse);
+    bool isTerminated() const;
+    Value *convert(Value *value, const Type *target); // Int to float promotion where the language allows it
+    const Type *typeOf(Node *node);
+    const Type *typeFromString(const std::string &typeName);
+    size_t fixedLength(Node *node); // Length of a fixed size array value, 0 when it is only known at run time
+};
@@ -0,0 +1,104 @@
+#include "purity.hpp"
+#include <algorithm>
+#include "callgraph.hpp"
+#include "dominators.hpp"
+#include "folding.hpp"
+
+// Every cycle of the CFG has an edge going back to a block that comes no later in reverse post order
+static bool hasLoop(Function *fn)
+{
+    std::vector<BasicBlock *> order = DominatorTree(fn).reversePostOrder();
+    std::unordered_map<BasicBlock *, size_t> position;
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        position[order[i]] = i;
+    }
+    for (auto block : order)
+    {
+        for (auto succ : block->successors())
+        {
+            if (position.at(succ) <= position.at(block))
+                return true;
+        }
+    }
+    return false;
+}
+
+PurityAnalysis::PurityAnalysis(Module &module)
+{
+    CallGraph graph(module);
+    for (const auto &component : graph.bottomUpSCCs())
+    {
+        // Start from the best case and let every instruction of the component weaken it
+        FunctionEffects result{Purity::PURE, !graph.isRecursive(component.front())};
+        for (auto fn : component)
+        {
+            if (fn->isTopLevel || fn->blocks.empty())
+            {
+                result = FunctionEffects{};
+                break;
+            }
+            if (result.alwaysReturns && hasLoop(fn))
+                result.alwaysReturns = false;
+
+            for (auto block : fn->blocks)
+            {
+                for (auto inst : block->instructions)
+                {
+                    if (mayTrap(inst))
+                        result.alwaysReturns = false;
+                    Function *task = raceFreeTask(inst);
+                    if (inst->op == Opcode::STORE_GLOBAL || ((inst->op == Opcode::SPAWN || inst->op == Opcode::JOIN) && !task))
+                        result.purity = Purity::IMPURE; // An unproven task runs alongside the caller, what it does is never ordered against a call
+                    else if (inst->op == Opcode::ALLOC || inst->op == Opcode::FREE || inst->op == Opcode::STORE || inst->op == Opcode::NEW_ARRAY)
+                        result.purity = Purity::IMPURE; // Every alloc gives a new cell, two calls never give the same pointer
+                    else if (inst->op == Opcode::LOAD_GLOBAL || inst->op == Opcode::LOAD || inst->op == Opcode::LENGTH)
+                        result.purity = std::max(result.purity, Purity::READONLY);
+                    else if ((inst->op == Opcode::CALL || task) && !graph.sameSCC(fn, inst->op == Opcode::CALL ? inst->callee : task))
+                    {
+                        // A proven task does nothing the caller could tell apart from calling the work at its wait
+                        const FunctionEffects &callee = of(inst->op == Opcode::CALL ? inst->callee : task);
+                        result.purity = std::max(result.purity, callee.purity);
+                        result.alwaysReturns = result.alwaysReturns && callee.alwaysReturns;
+                    }
+                }
+            }
+        }
+        for (auto fn : component)
+        {
+            effects[fn] = result;
+        }
+    }
+}
+
+const FunctionEffects &PurityAnalysis::of(Function *fn) const
+{
+    auto it = effects.find(fn);
+    return it == effects.end() ? unknown : it->second;
+}
+
+// The task of a proven spawn only touches globals the code before its wait leaves alone, so the spawn orders
+// nothing and the wait is where its stores become visible, like a call
+bool PurityAnalysis::writesMemory(Instruction *inst) const
+{
+    if (Function *task = raceFreeTask(inst))
+        return inst->op == Opcode::JOIN && purity(task) == Purity::IMPURE;
+    if (inst->op == Opcode::STORE_GLOBAL || inst->op == Opcode::SPAWN || inst->op == Opcode::JOIN || inst->op == Opcode::STORE || inst->op == Opcode::FREE)
+        return true;
+    return inst->op == Opcode::CALL && purity(inst->callee) == Purity::IMPURE;
+}
+
+Function *PurityAnalysis::raceFreeTask(Instruction *inst)
+{
+    Instruction *spawn = inst;
+    if (inst->op == Opcode::JOIN && !inst->operands.empty() && inst->operands[0]->kind == ValueKind::INSTRUCTION)
+        spawn = static_cast<Instruction *>(inst->operands[0]);
+    if (spawn->op != Opcode::SPAWN || !spawn->raceFree)
+        return nullptr;
+    return spawn->callee;
+}
+
+size_t PurityAnalysis::count(Purity purity) const
+{
+    return std::count_if(effects.begin(), effects.end(), [purity](const auto &entry) { return entry.second.purity == purity; });
+}
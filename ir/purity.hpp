@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include "ir.hpp"
+
+// What a call to a function can do besides giving back its result, from the weakest guarantee to the strongest
+enum class Purity : uint8_t
+{
+    PURE,     // The result only depends on the arguments, two calls with the same arguments give the same value
+    READONLY, // Reads globals, so the result may change after something stores to them
+    IMPURE,   // Stores to globals or calls something that does
+};
+
+struct FunctionEffects
+{
+    Purity purity = Purity::IMPURE;
+    bool alwaysReturns = false; // No loops, recursion or possible traps, so running a call early or dropping it is unnoticeable
+};
+
+// Side effects of every function in a module. Functions are visited bottom up over the strongly connected components
+// of the call graph so a function is never purer than the functions it calls, and a component shares one result since
+// its members can reach each other. Like the call graph it is a snapshot, passes that add stores or calls need a new one
+class PurityAnalysis
+{
+    std::unordered_map<Function *, FunctionEffects> effects;
+    FunctionEffects unknown;
+
+public:
+    explicit PurityAnalysis(Module &module);
+
+    const FunctionEffects &of(Function *fn) const;
+    Purity purity(Function *fn) const { return of(fn).purity; }
+    bool alwaysReturns(Function *fn) const { return of(fn).alwaysReturns; }
+    bool writesMemory(Instruction *inst) const; // Stores, calls that may store and unproven tasks, anything a global load can not be moved across
+    static Function *raceFreeTask(Instruction *inst); // Work of a SPAWN or JOIN whose task was proven race free, null otherwise
+    size_t count(Purity purity) const;
+};
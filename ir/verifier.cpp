@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <unordered_set>
+#include "verifier.hpp"
+#include "dominators.hpp"
+
+namespace
+{
+    class FunctionVerifier
+    {
+        Function *function;
+        std::vector<std::string> &errors;
+        std::unordered_set<BasicBlock *> blocks;
+
+    public:
+        FunctionVerifier(Function *function, std::vector<std::string> &errors) : function(function), errors(errors)
+        {
+            blocks.insert(function->blocks.begin(), function->blocks.end());
+        }
+
+        void run()
+        {
+            if (function->blocks.empty())
+            {
+                fail("function has no blocks");
+                return;
+            }
+            function->renumber();
+            if (!function->entry()->predecessors.empty())
+            {
+                fail("the entry block can not have predecessors");
+            }
+
+            for (auto block : function->blocks)
+            {
+                checkBlock(block);
+            }
+
+            // Dominance is only meaningful once the CFG itself is sound
+            if (errors.empty())
+            {
+                DominatorTree domTree(function);
+                for (auto block : function->blocks)
+                {
+                    for (auto inst : block->instructions)
+                    {
+                        checkDominance(domTree, inst);
+                    }
+                }
+            }
+        }
+
+    private:
+        void fail(const std::string &message)
+        {
+            errors.push_back("@" + function->name + ": " + message);
+        }
+
+        void fail(Instruction *inst, const std::string &message)
+        {
+            std::string where = inst->parent ? inst->parent->label + "." + std::to_string(inst->parent->id) : "<detached>";
+            fail(where + ": " + valueName(inst) + " (" + opcodeName(inst->op) + "): " + message);
+        }
+
+        void checkBlock(BasicBlock *block)
+        {
+            std::string name = block->label + "." + std::to_string(block->id);
+            if (block->parent != function)
+                fail(name + ": block belongs to another function");
+            if (!block->terminator())
+            {
+                fail(name + ": block does not end with a terminator");
+            }
+
+            // The stored predecessors have to match the branches
+            std::vector<BasicBlock *> expected;
+            for (auto other : function->blocks)
+            {
+                auto succs = other->successors();
+                if (std::find(succs.begin(), succs.end(), block) != succs.end())
+                    expected.push_back(other);
+            }
+            auto actual = block->predecessors;
+            std::sort(expected.begin(), expected.end());
+            std::sort(actual.begin(), actual.end());
+            if (expected != actual)
+            {
+                fail(name + ": predecessor list does not match the branches");
+            }
+
+            bool seenNonPhi = false;
+            for (size_t i = 0; i < block->instructions.size(); ++i)
+            {
+                Instruction *inst = block->instructions[i];
+                if (inst->parent != block)
+                    fail(inst, "parent does not point at its block");
+                if (inst->isTerminator() && i + 1 != block->instructions.size())
+                    fail(inst, "terminator in the middle of a block");
+                if (inst->isPhi() && seenNonPhi)
+                    fail(inst, "phi after a non phi instruction");
+                if (!inst->isPhi())
+                    seenNonPhi = true;
+                checkOperands(inst);
+                checkTypes(inst);
+            }
+        }
+
+        void checkOperands(Instruction *inst)
+        {
+            for (auto operand : inst->operands)
+            {
+                if (!operand)
+                {
+                    fail(inst, "null operand");
+                    continue;
+                }
+                size_t uses = std::count(inst->operands.begin(), inst->operands.end(), operand);
+                size_t recorded = std::count(operand->users.begin(), operand->users.end(), inst);
+                if (uses != recorded)
+                    fail(inst, "use list of " + valueName(operand) + " is out of date");
+
+                if (operand->kind == ValueKind::ARGUMENT && static_cast<Argument *>(operand)->parent != function)
+                    fail(inst, "uses an argument of another function");
+                if (operand->kind == ValueKind::INSTRUCTION)
+                {
+                    auto def = static_cast<Instruction *>(operand);
+                    if (!def->parent || !blocks.count(def->parent))
+                        fail(inst, "uses " + valueName(def) + " which is not in this function");
+                }
+            }
+            for (auto target : inst->targets)
+            {
+                if (!target || !blocks.count(target))
+                    fail(inst, "refers to a block that is not in this function");
+            }
+        }
+
+        void checkDominance(const DominatorTree &domTree, Instruction *inst)
+        {
+            for (size_t i = 0; i < inst->operands.size(); ++i)
+            {
+                if (!inst->operands[i] || inst->operands[i]->kind != ValueKind::INSTRUCTION)
+                    continue;
+                auto def = static_cast<Instruction *>(inst->operands[i]);
+                bool dominated = inst->isPhi() ? domTree.dominates(def->parent, inst->targets[i]) : domTree.dominates(def, inst);
+                if (!dominated)
+                    fail(inst, "use of " + valueName(def) + " is not dominated by its definition");
+            }
+        }
+
+        bool expectOperands(Instruction *inst, size_t count)
+        {
+            if (inst->operands.size() != count)
+            {
+                fail(inst, "expected " + std::to_string(count) + " operands but found " + std::to_string(inst->operands.size()));
+                return false;
+            }
+            return true;
+        }
+
+        bool isZone(Value *value)
+        {
+            auto enter = dynamic_cast<Instruction *>(value);
+            return enter && enter->op == Opcode::ZONE_ENTER;
+        }
+
+        bool isNumeric(const Type *type)
+        {
+            return type && type->kind == TypeKind::SCALAR && (type->scalar == TypeSystem::INTEGER || type->scalar == TypeSystem::FLOAT);
+        }
+
+        void checkTypes(Instruction *inst)
+        {
+            const Type *boolType = function->parent->types.scalar(TypeSystem::BOOLEAN);
+            switch (inst->op)
+            {
+            case Opcode::ADD:
+            case Opcode::SUB:
+            case Opcode::MUL:
+            case Opcode::DIV:
+            case Opcode::MOD:
+                if (!expectOperands(inst, 2))
+                    return;
+                if (!isNumeric(inst->type) || inst->operands[0]->type != inst->type || inst->operands[1]->type != inst->type)
+                    fail(inst, "arithmetic needs numeric operands of the result type");
+                break;
+            case Opcode::NEG:
+                if (expectOperands(inst, 1) && (!isNumeric(inst->type) || inst->operands[0]->type != inst->type))
+                    fail(inst, "negation needs a numeric operand of the result type");
+                break;
+            case Opcode::EQ:
+            case Opcode::NE:
+            case Opcode::LT:
+            case Opcode::GT:
+            case Opcode::LE:
+            case Opcode::GE:
+                if (!expectOperands(inst, 2))
+                    return;
+                if (inst->type != boolType || inst->operands[0]->type != inst->operands[1]->type)
+                    fail(inst, "comparison needs operands of the same type and a bool result");
+                break;
+            case Opcode::NOT:
+                if (expectOperands(inst, 1) && (inst->type != boolType || inst->operands[0]->type != boolType))
+                    fail(inst, "not needs a bool operand");
+                break;
+            case Opcode::CONCAT:
+                if (inst->operands.size() == 3 && !isZone(inst->operands[2]))
+                    fail(inst, "the third operand of a concat has to be a zone");
+                else if (inst->operands.size() != 3 && !expectOperands(inst, 2))
+                    return;
+                if (inst->scalar() != TypeSystem::STRING || inst->operands[0]->type != inst->type || inst->operands[1]->type != inst->type)
+                    fail(inst, "concat needs string operands");
+                break;
+            case Opcode::ZONE_ENTER:
+                if (expectOperands(inst, 0) && inst->scalar() != TypeSystem::INTEGER)
+                    fail(inst, "zone.enter gives the handle of the zone as an int");
+                break;
+            case Opcode::ZONE_EXIT:
+                if (expectOperands(inst, 1) && !isZone(inst->operands[0]))
+                    fail(inst, "zone.exit needs the zone.enter of its block");
+                break;
+            case Opcode::ITOF:
+                if (expectOperands(inst, 1) && (inst->scalar() != TypeSystem::FLOAT || inst->operands[0]->scalar() != TypeSystem::INTEGER))
+                    fail(inst, "itof converts an int to a float");
+                break;
+            case Opcode::CALL:
+            case Opcode::SPAWN:
+            {
+                if (!inst->callee)
+                {
+                    fail(inst, opcodeName(inst->op) + " without a callee");
+                    return;
+                }
+                const auto &params = inst->callee->signature->parameters;
+                if (!expectOperands(inst, params.size()))
+                    return;
+                for (size_t i = 0; i < params.size(); ++i)
+                {
+                    if (inst->operands[i]->type != params[i])
+                        fail(inst, "argument " + std::to_string(i) + " does not match the parameter type");
+                }
+                if (inst->op == Opcode::SPAWN)
+                {
+                    if (inst->type != function->parent->types.futureOf(inst->callee->returnType))
+                        fail(inst, "spawn type is not a future of the return type of @" + inst->callee->name);
+                }
+                else if (inst->type != inst->callee->returnType)
+                    fail(inst, "call type does not match the return type of @" + inst->callee->name);
+                break;
+            }
+            case Opcode::JOIN:
+            {
+                if (!expectOperands(inst, 1))
+                    return;
+                auto spawn = dynamic_cast<Instruction *>(inst->operands[0]);
+                if (!spawn || spawn->op != Opcode::SPAWN)
+                    fail(inst, "join needs the spawn of a task");
+                else if (inst->type != spawn->type->element)
+                    fail(inst, "join type does not match the result of the task");
+                break;
+            }
+            case Opcode::DETACH:
+            {
+                if (!expectOperands(inst, 1))
+                    return;
+                auto spawn = dynamic_cast<Instruction *>(inst->operands[0]);
+                if (!spawn || spawn->op != Opcode::SPAWN)
+                    fail(inst, "detach needs the spawn of a task");
+                break;
+            }
+            case Opcode::PHI:
+                if (inst->operands.size() != inst->targets.size())
+                {
+                    fail(inst, "phi has a different number of values and incoming blocks");
+                    return;
+                }
+                if (inst->operands.size() != inst->parent->predecessors.size())
+                    fail(inst, "phi does not have one value per predecessor");
+                for (size_t i = 0; i < inst->operands.size(); ++i)
+                {
+                    const auto &preds = inst->parent->predecessors;
+                    if (std::find(preds.begin(), preds.end(), inst->targets[i]) == preds.end())
+                        fail(inst, "phi has an incoming block that is not a predecessor");
+                    if (std::count(inst->targets.begin(), inst->targets.end(), inst->targets[i]) != 1)
+                        fail(inst, "phi lists the same incoming block twice");
+                    if (inst->operands[i] && inst->operands[i]->type != inst->type)
+                        fail(inst, "phi value " + std::to_string(i) + " has a different type");
+                }
+                break;
+            case Opcode::LOAD_GLOBAL:
+                if (!inst->global)
+                    fail(inst, "load without a global");
+                else if (inst->type != inst->global->type)
+                    fail(inst, "load type does not match @" + inst->global->name);
+                break;
+            case Opcode::STORE_GLOBAL:
+                if (!inst->global)
+                    fail(inst, "store without a global");
+                else if (expectOperands(inst, 1) && inst->operands[0]->type != inst->global->type)
+                    fail(inst, "stored value does not match the type of @" + inst->global->name);
+                break;
+            case Opcode::ALLOC:
+                if (expectOperands(inst, 1) && (inst->type->kind != TypeKind::POINTER || inst->operands[0]->scalar() != TypeSystem::INTEGER))
+                    fail(inst, "alloc needs an int count and gives a pointer");
+                break;
+            case Opcode::FREE:
+                if (expectOperands(inst, 1) && inst->operands[0]->type->kind != TypeKind::POINTER && inst->operands[0]->type->kind != TypeKind::ARRAY)
+                    fail(inst, "free needs a pointer or an array");
+                break;
+            case Opcode::NEW_ARRAY:
+                if (expectOperands(inst, 1) && (inst->type->kind != TypeKind::ARRAY || inst->type->length != 0 || inst->operands[0]->scalar() != TypeSystem::INTEGER))
+                    fail(inst, "array.new needs an int length and gives a dynamic array");
+                break;
+            case Opcode::LENGTH:
+                if (expectOperands(inst, 1) && (inst->operands[0]->type->kind != TypeKind::ARRAY || inst->scalar() != TypeSystem::INTEGER))
+                    fail(inst, "length needs an array and gives an int");
+                break;
+            case Opcode::ELEMENT:
+                if (expectOperands(inst, 2) && (inst->operands[0]->type->kind != TypeKind::ARRAY || inst->operands[1]->scalar() != TypeSystem::INTEGER ||
+                                                inst->type->kind != TypeKind::POINTER || inst->type->element != inst->operands[0]->type->element))
+                    fail(inst, "element needs an array and an int index and gives a pointer to the element");
+                break;
+            case Opcode::CHECK_BOUNDS:
+                if (expectOperands(inst, 2) && (inst->operands[0]->scalar() != TypeSystem::INTEGER || inst->operands[1]->scalar() != TypeSystem::INTEGER))
+                    fail(inst, "check.bounds needs an int index and an int length");
+                break;
+            case Opcode::LOAD:
+                if (expectOperands(inst, 1) && (inst->operands[0]->type->kind != TypeKind::POINTER || inst->operands[0]->type->element != inst->type))
+                    fail(inst, "load.ptr type does not match what its pointer points at");
+                break;
+            case Opcode::STORE:
+                if (expectOperands(inst, 2) && (inst->operands[0]->type->kind != TypeKind::POINTER || inst->operands[0]->type->element != inst->operands[1]->type))
+                    fail(inst, "stored value does not match what the pointer points at");
+                break;
+            case Opcode::BR:
+                expectOperands(inst, 0);
+                if (inst->targets.size() != 1)
+                    fail(inst, "br needs exactly one target");
+                break;
+            case Opcode::CONDBR:
+                if (expectOperands(inst, 1) && inst->operands[0]->type != boolType)
+                    fail(inst, "condbr needs a bool condition");
+                if (inst->targets.size() != 2)
+                    fail(inst, "condbr needs two targets");
+                break;
+            case Opcode::RET:
+                if (function->returnType->scalar == TypeSystem::VOID)
+                    expectOperands(inst, 0);
+                else if (expectOperands(inst, 1) && inst->operands[0]->type != function->returnType)
+                    fail(inst, "returned value does not match the return type");
+                break;
+            }
+        }
+    };
+}
+
+std::vector<std::string> verifyFunction(Function *function)
+{
+    std::vector<std::string> errors;
+    FunctionVerifier(function, errors).run();
+    return errors;
+}
+
+std::vector<std::string> verifyModule(Module &module)
+{
+    std::vector<std::string> errors;
+    for (auto function : module.functions)
+    {
+        auto functionErrors = verifyFunction(function);
+        errors.insert(errors.end(), functionErrors.begin(), functionErrors.end());
+    }
+    return errors;
+}
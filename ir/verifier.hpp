@@ -0,0 +1,9 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "ir.hpp"
+
+// Structural and type checks of the IR, every pass is expected to leave the module in a state that passes them.
+// The returned messages are empty when the IR is well formed
+std::vector<std::string> verifyFunction(Function *function);
+std::vector<std::string> verifyModule(Module &module);
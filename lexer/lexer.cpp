@@ -9,7 +9,7 @@ using namespace std;
     int tokenLine = line; \
     int tokenColumn = column;
 
-Lexer::Lexer(const string &sourceCode) : input(sourceCode), currentPosition(0), nextPosition(1), line(1), column(0) {};
+Lexer::Lexer(const string &sourceCode, Diagnostics &diagnostics) : input(sourceCode), currentPosition(0), nextPosition(1), line(1), column(0), diagnostics(diagnostics) {};
 
 // Lexer advance function
 void Lexer::advance()
@@ -175,7 +175,7 @@ Token Lexer::readString()
                 value += '\0';
                 break;
             default:
-                logError("Invalid escape sequence", tokenLine, tokenColumn);
+                logError("Invalid escape sequence", tokenLine, tokenColumn, DiagnosticCode::INVALID_ESCAPE);
                 return Token{"Invalid escape sequence", TokenType::ILLEGAL, tokenLine, tokenColumn};
             }
 
@@ -187,7 +187,7 @@ Token Lexer::readString()
         }
         advance();
     }
-    logError("Unterminated string", tokenLine, tokenColumn);
+    logError("Unterminated string", tokenLine, tokenColumn, DiagnosticCode::UNTERMINATED_STRING);
     return Token{"Unterminated string", TokenType::ILLEGAL, tokenLine, tokenColumn};
 }
 
@@ -226,19 +226,19 @@ Token Lexer::readChar()
             unescaped = '\\';
             break;
         default:
-            logError("Invalid escape", tokenLine, tokenColumn);
+            logError("Invalid escape", tokenLine, tokenColumn, DiagnosticCode::INVALID_ESCAPE);
             return Token{"Invalid escape", TokenType::ILLEGAL, tokenLine, tokenColumn};
         }
 
         advance();
         if (currentChar() != '\'')
         {
-            logError("Missing closing quote", tokenLine, tokenColumn);
+            logError("Missing closing quote", tokenLine, tokenColumn, DiagnosticCode::MISSING_QUOTE);
             return Token{"Missing closing quote", TokenType::ILLEGAL, tokenLine, tokenColumn};
         }
 
         advance();
-        return Token{std::string(1, unescaped), TokenType::CHAR};
+        return Token{std::string(1, unescaped), TokenType::CHAR, tokenLine, tokenColumn};
     }
 
     char value = currentChar();
@@ -246,11 +246,12 @@ Token Lexer::readChar()
 
     if (currentChar() != '\'')
     {
-        return Token{"Missing closing quote", TokenType::ILLEGAL};
+        logError("Missing closing quote", tokenLine, tokenColumn, DiagnosticCode::MISSING_QUOTE);
+        return Token{"Missing closing quote", TokenType::ILLEGAL, tokenLine, tokenColumn};
     }
 
     advance();
-    return Token{std::string(1, value), TokenType::CHAR};
+    return Token{std::string(1, value), TokenType::CHAR, tokenLine, tokenColumn};
 }
 
 Token Lexer::tokenize()
@@ -340,6 +341,12 @@ Token Lexer::tokenize()
         advance();
         return Token{"/", TokenType::DIVIDE, tokenLine, tokenColumn};
     }
+    case '%':
+    {
+        CAPTURE_POS;
+        advance();
+        return Token{"%", TokenType::MODULUS, tokenLine, tokenColumn};
+    }
     case '&':
     {
         CAPTURE_POS;
@@ -480,7 +487,7 @@ Token Lexer::tokenize()
     {
         CAPTURE_POS;
         advance();
-        logError("Unexpected character: ", tokenLine, tokenColumn);
+        logError("Unexpected character: " + string(1, character), tokenLine, tokenColumn, DiagnosticCode::UNEXPECTED_CHARACTER);
         return Token{string(1, character), TokenType::ILLEGAL, tokenLine, tokenColumn};
     }
     }
@@ -491,6 +498,12 @@ void Lexer::updateTokenList()
     token_list.clear();
     while (true)
     {
+        // Once the error limit is reached the rest of the file is not worth scanning
+        if (diagnostics.shouldAbort())
+        {
+            token_list.push_back(Token{"", TokenType::END, line, column});
+            break;
+        }
         Token tok = tokenize();
         token_list.push_back(tok);
         if (tok.type == TokenType::END)
@@ -500,7 +513,7 @@ void Lexer::updateTokenList()
     }
 }
 
-void Lexer::logError(const std::string &message, int line, int column)
+void Lexer::logError(const std::string &message, int line, int column, const char *code)
 {
-    std::cerr << "[TOKEN ERROR]: At line " << line << " column " << column << " : " << message << "\n";
+    diagnostics.error(code, SourceRange{line, column, line, column + 1}, message);
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "token/token.hpp"
+#include "diagnostics/diagnostics.hpp"
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -11,6 +12,7 @@ class Lexer
     std::string input;
     int line=1;
     int column=0;
+    Diagnostics &diagnostics;
 
     std::unordered_map<std::string, TokenType> keywords = {
         {"auto", TokenType::AUTO},
@@ -44,6 +46,7 @@ class Lexer
         {"false", TokenType::FALSE},
         {"bool",TokenType::BOOL_KEYWORD},
         {"arr", TokenType::ARRAY},
+        {"len", TokenType::LENGTH},
 
         {"zone", TokenType::ZONE},
         {"unique", TokenType::UNIQUE},
@@ -62,7 +65,7 @@ class Lexer
     };
 
 public:
-    Lexer(const std::string& sourceCode);
+    Lexer(const std::string& sourceCode, Diagnostics &diagnostics);
     Token tokenize();
     std::vector<Token> outputTokens;
 
@@ -81,5 +84,5 @@ private:
     Token readIdentifiers();
     Token readString();
     Token readChar();
-    void logError(const std::string& message,int line,int column);
+    void logError(const std::string& message,int line,int column,const char *code);
 };
\ No newline at end of file
@@ -4,10 +4,27 @@
 #include <memory>
 #include <fstream>
 #include <sstream>
+#include <chrono>
+#include <algorithm>
 #include "lexer/lexer.hpp"
 #include "token/token.hpp"
 #include "parser/parser.hpp"
 #include "semantic analyzer/semantics.hpp"
+#include "optimizer/constant_propagation.hpp"
+#include "optimizer/deadcode.hpp"
+#include "optimizer/escape_analysis.hpp"
+#include "optimizer/inliner.hpp"
+#include "optimizer/loop_optimizer.hpp"
+#include "optimizer/value_numbering.hpp"
+#include "optimizer/interleaver.hpp"
+#include "diagnostics/diagnostics.hpp"
+#include "ir/lowering.hpp"
+#include "ir/verifier.hpp"
+#include "codegen/c_emitter.hpp"
+#include "codegen/codegen.hpp"
+#include "codegen/llvm_backend.hpp"
+#include "vm/compiler.hpp"
+#include "vm/vm.hpp"
 
 std::string readFileToString(const std::string &filepath)
 {
@@ -21,26 +38,291 @@ std::string readFileToString(const std::string &filepath)
     return buffer.str();
 }
 
+// What gets written next to the source once it compiled
+enum class EmitKind
+{
+    NONE,
+    OBJECT,  // Relocatable object, from the template backend or from LLVM with -O
+    LLVM_IR, // Optimized LLVM IR as text
+    C,       // C11 source for any C compiler
+};
+
+// foo/bar.unn -> foo/bar.o
+std::string replaceExtension(const std::string &path, const std::string &extension)
+{
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path + extension;
+    return path.substr(0, dot) + extension;
+}
+
+// Options given on the command line
+struct CompilerOptions
+{
+    std::string filepath;
+    DiagnosticFormat diagnosticFormat = DiagnosticFormat::TEXT;
+    size_t errorLimit = 0;
+    bool run = false;   // Execute the program on the VM
+    bool bench = false; // Time every bench* function on the VM
+    EmitKind emit = EmitKind::NONE;
+    int optLevel = -1;      // -O0 to -O3 go through LLVM, -1 keeps the template backend
+    std::string outputPath; // Defaults to the source path with the extension of the output
+    int inlineThreshold = Inliner::DEFAULT_THRESHOLD; // Negative turns the inliner off
+    bool inlineReport = false;
+    bool escapeAnalysis = true;
+    bool escapeReport = false;
+    bool constantPropagation = true;
+    bool valueNumbering = true;
+    bool loopOptimizations = true;
+    LoopOptions loops; // Single loop transformations, only looked at when loopOptimizations is set
+    int interleaveLanes = LoopInterleaver::DEFAULT_LANES; // Below 2 turns the interleaver off
+    bool interleaveReport = false;
+};
+
+void printUsage()
+{
+    std::cerr << "Usage: iron [options] <source-file.unn>\n"
+              << "Options:\n"
+              << "  --diagnostics=text|json   Format of the reported errors (json prints one object per line)\n"
+              << "  --error-limit=<n>         Stop compiling after n errors (0 means no limit)\n"
+              << "  --run                     Run the program on the bytecode VM and print the globals it ends with\n"
+              << "  --bench                   Run every bench* function without parameters on the VM and report ns/op\n"
+              << "  --emit=obj                Write an x86-64 ELF object, link it with runtime/runtime.c and -lm (tasks.c -pthread with tasks, gc.c with gc variables, alloc.c with alloc, make and arrays)\n"
+              << "  --emit=llvm               Write the optimized LLVM IR\n"
+              << "  --emit=c                  Write portable C11, build it with runtime/runtime.c -Iruntime -lm (tasks.c -pthread with tasks, gc.c with gc variables, alloc.c with alloc, make and arrays)\n"
+              << "  -O0 -O1 -O2 -O3           Build an object through LLVM with its pipeline for that level\n"
+              << "  -o <path>                 Where --emit writes its output\n"
+              << "  --inline-threshold=<n>    Largest cost of a call the inliner accepts (default " << Inliner::DEFAULT_THRESHOLD << ", negative disables it)\n"
+              << "  --inline-report           Print every call site with the inliner's decision and why\n"
+              << "  --no-escape               Keep every alloc and make on the heap even when the cell never leaves its work\n"
+              << "  --escape-report           Print every allocation site with the escape analysis' decision and why\n"
+              << "  --no-sccp                 Skip constant propagation across functions and the folding of constant branches\n"
+              << "  --no-gvn                  Keep redundant computations and repeated calls to pure functions\n"
+              << "  --no-loop-opts            Leave every loop as it was lowered\n"
+              << "  --no-licm                 Keep loop invariant code inside its loop\n"
+              << "  --no-indvars              Skip merging, folding and removing induction variables\n"
+              << "  --strength-reduction      Turn multiplies of induction variables into additions\n"
+              << "  --no-unroll               Never unroll loops with a short constant trip count\n"
+              << "  --no-bounds-elim          Keep every bounds check of array indexes, even those the loop test proves\n"
+              << "  --interleave=<n>          Iterations of a reduction loop the interleaver runs at once (default " << LoopInterleaver::DEFAULT_LANES << ", below 2 disables it)\n"
+              << "  --interleave-report       Print every loop with the interleaver's decision and why\n";
+}
+
+bool parseArguments(int argc, char **argv, CompilerOptions &options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--diagnostics=text")
+        {
+            options.diagnosticFormat = DiagnosticFormat::TEXT;
+        }
+        else if (arg == "--diagnostics=json")
+        {
+            options.diagnosticFormat = DiagnosticFormat::JSON;
+        }
+        else if (arg.rfind("--error-limit=", 0) == 0)
+        {
+            options.errorLimit = std::stoul(arg.substr(std::string("--error-limit=").size()));
+        }
+        else if (arg == "--run")
+        {
+            options.run = true;
+        }
+        else if (arg == "--bench")
+        {
+            options.bench = true;
+        }
+        else if (arg == "--emit=obj")
+        {
+            options.emit = EmitKind::OBJECT;
+        }
+        else if (arg == "--emit=c")
+        {
+            options.emit = EmitKind::C;
+        }
+        else if (arg == "--emit=llvm")
+        {
+            options.emit = EmitKind::LLVM_IR;
+        }
+        else if (arg.size() == 3 && arg.rfind("-O", 0) == 0 && arg[2] >= '0' && arg[2] <= '3')
+        {
+            options.optLevel = arg[2] - '0';
+        }
+        else if (arg.rfind("--inline-threshold=", 0) == 0)
+        {
+            options.inlineThreshold = std::stoi(arg.substr(std::string("--inline-threshold=").size()));
+        }
+        else if (arg == "--inline-report")
+        {
+            options.inlineReport = true;
+        }
+        else if (arg == "--no-escape")
+        {
+            options.escapeAnalysis = false;
+        }
+        else if (arg == "--escape-report")
+        {
+            options.escapeReport = true;
+        }
+        else if (arg == "--no-sccp")
+        {
+            options.constantPropagation = false;
+        }
+        else if (arg == "--no-gvn")
+        {
+            options.valueNumbering = false;
+        }
+        else if (arg == "--no-loop-opts")
+        {
+            options.loopOptimizations = false;
+        }
+        else if (arg == "--no-licm")
+        {
+            options.loops.licm = false;
+        }
+        else if (arg == "--no-indvars")
+        {
+            options.loops.inductionVariables = false;
+        }
+        else if (arg == "--strength-reduction")
+        {
+            options.loops.strengthReduction = true;
+        }
+        else if (arg == "--no-unroll")
+        {
+            options.loops.unroll = false;
+        }
+        else if (arg == "--no-bounds-elim")
+        {
+            options.loops.boundsChecks = false;
+        }
+        else if (arg.rfind("--interleave=", 0) == 0)
+        {
+            options.interleaveLanes = std::stoi(arg.substr(std::string("--interleave=").size()));
+        }
+        else if (arg == "--interleave-report")
+        {
+            options.interleaveReport = true;
+        }
+        else if (arg == "-o" && i + 1 < argc)
+        {
+            options.outputPath = argv[++i];
+        }
+        else if (arg.rfind("--", 0) == 0)
+        {
+            std::cerr << "[ERROR] Unknown option: " << arg << "\n";
+            return false;
+        }
+        else
+        {
+            options.filepath = arg;
+        }
+    }
+    // -O alone means a release object, LLVM IR is only ever written by the LLVM backend
+    if (options.optLevel >= 0 && options.emit == EmitKind::NONE)
+        options.emit = EmitKind::OBJECT;
+    if (options.emit == EmitKind::LLVM_IR && options.optLevel < 0)
+        options.optLevel = 0;
+    return !options.filepath.empty();
+}
+
+// Keeps running a function until enough time has passed to trust the average
+void benchmarkFunction(VM &vm, const BytecodeProgram &program, int index)
+{
+    using Clock = std::chrono::steady_clock;
+    const BytecodeFunction &function = program.functions[index];
+    auto runOnce = [&]()
+    {
+        Slot result = vm.execute(index);
+        if (function.returnsString)
+            VM::release(result.s);
+    };
+
+    runOnce(); // Warm up
+    size_t runs = 0;
+    auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    while (elapsed < std::chrono::milliseconds(500) || runs < 5)
+    {
+        runOnce();
+        ++runs;
+        elapsed = Clock::now() - start;
+    }
+    double nsPerOp = std::chrono::duration<double, std::nano>(elapsed).count() / runs;
+    std::cout << "[VM LOG]: " << function.name << ": " << static_cast<uint64_t>(nsPerOp) << " ns/op (" << runs << " runs)\n";
+}
+
+void runProgram(const BytecodeProgram &program, const CompilerOptions &options)
+{
+    std::cout << "\n--- VM ---\n";
+    VM vm(program);
+    auto start = std::chrono::steady_clock::now();
+    if (program.entry >= 0)
+        vm.execute(program.entry);
+
+    int mainIndex = program.findFunction("main");
+    if (options.run && mainIndex >= 0 && program.functions[mainIndex].paramCount == 0)
+    {
+        const BytecodeFunction &mainFunction = program.functions[mainIndex];
+        Slot result = vm.execute(mainIndex);
+        if (mainFunction.returnTypeName != "void")
+            std::cout << "main returned " << VM::format(result, mainFunction.returnTypeName) << "\n";
+        if (mainFunction.returnsString)
+            VM::release(result.s);
+    }
+    auto runTime = std::chrono::steady_clock::now() - start;
+
+    if (options.run)
+    {
+        for (size_t i = 0; i < program.globals.size(); ++i)
+        {
+            std::cout << program.globals[i].name << " = " << VM::format(vm.global(i), program.globals[i].typeName) << "\n";
+        }
+        std::cout << "[VM LOG]: Ran in " << std::chrono::duration_cast<std::chrono::microseconds>(runTime).count() << "us\n";
+    }
+
+    if (options.bench)
+    {
+        for (size_t i = 0; i < program.functions.size(); ++i)
+        {
+            const BytecodeFunction &function = program.functions[i];
+            if (function.name.rfind("bench", 0) == 0 && function.paramCount == 0)
+                benchmarkFunction(vm, program, i);
+        }
+    }
+}
+
 int main(int argc, char **argv)
 {
-    if (argc < 2)
+    CompilerOptions options;
+    if (!parseArguments(argc, argv, options))
     {
-        std::cerr << "Usage: iron <source-file.unn>\n";
+        printUsage();
         return 1;
     }
 
-    std::string filepath = argv[1];
+    std::string filepath = options.filepath;
 
     if (filepath.substr(filepath.find_last_of('.') + 1) != "unn")
     {
         std::cerr << "[WARNING] File doesn't have .unn extension. Continuing anyway...\n";
     }
 
+    Diagnostics diagnostics(options.errorLimit);
+    // Prints every buffered diagnostic in one batch, the phases never write errors themselves
+    auto finish = [&diagnostics, &options](int status)
+    {
+        diagnostics.render(std::cerr, options.diagnosticFormat);
+        return diagnostics.hasErrors() ? 1 : status;
+    };
+
     try
     {
         std::string code = readFileToString(filepath);
 
-        Lexer lexer(code);
+        Lexer lexer(code, diagnostics);
         lexer.updateTokenList();
         std::vector<Token> tokens = lexer.token_list;
 
@@ -50,29 +332,229 @@ int main(int argc, char **argv)
             std::cout << "  Type: " << TokenTypeToLiteral(token.type)
                       << ", Literal: \"" << token.TokenLiteral << "\"\n";
         }
+        if (diagnostics.shouldAbort())
+        {
+            return finish(1);
+        }
 
-        Parser parser(tokens);
+        Parser parser(tokens, diagnostics);
 
+        auto parseStart = std::chrono::steady_clock::now();
         std::vector<std::unique_ptr<Node>> nodes = parser.parseProgram();
+        auto parseTime = std::chrono::steady_clock::now() - parseStart;
 
         std::cout << "\n--- AST ---\n";
         for (const auto &node : nodes)
         {
             std::cout << " Node ->  " << node->toString() << "\n";
         }
+        // The analyzer expects a well formed tree so syntax errors end the compilation here
+        if (diagnostics.hasErrors())
+        {
+            return finish(1);
+        }
 
         std::cout << "\n--- Semantic Analysis ---\n";
-        Semantics analyzer;
-        for (const auto &node : nodes)
+        TypeContext types;
+        Semantics analyzer(types, diagnostics);
+        analyzer.analyzeProgram(nodes);
+        if (!diagnostics.hasErrors())
+        {
+            analyzer.checkTaskRaces(nodes);
+            analyzer.checkZoneEscapes(nodes);
+            analyzer.checkOwnership(nodes);
+            analyzer.checkPointerAccess(nodes);
+        }
+        if (diagnostics.hasErrors())
+        {
+            return finish(1);
+        }
+
+        std::cout << "\n--- Dead Code Elimination ---\n";
+        DeadCodeEliminator eliminator(analyzer);
+        eliminator.eliminate(nodes);
+        eliminator.printSummary();
+
+        std::cout << "\n--- IR ---\n";
+        Module module(types);
+        IRLowering lowering(analyzer, module);
+        auto lowerStart = std::chrono::steady_clock::now();
+        lowering.lower(nodes);
+        auto lowerTime = std::chrono::steady_clock::now() - lowerStart;
+        module.print(std::cout);
+
+        size_t instructionCount = 0;
+        for (auto function : module.functions)
+        {
+            instructionCount += function->instructionCount();
+        }
+        std::cout << "[IR LOG]: Lowered " << module.functions.size() << " functions (" << instructionCount << " instructions) in "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(lowerTime).count() << "us, parsing took "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(parseTime).count() << "us\n";
+
+        // A verifier failure is a compiler bug, not a problem in the program
+        auto verify = [&module, &diagnostics]()
+        {
+            for (const auto &error : verifyModule(module))
+            {
+                diagnostics.error(DiagnosticCode::IR_VERIFIER, SourceRange{}, error);
+            }
+            return !diagnostics.hasErrors();
+        };
+        if (!verify())
+        {
+            return finish(1);
+        }
+
+        if (options.inlineThreshold >= 0)
+        {
+            std::cout << "\n--- Inlining ---\n";
+            Inliner inliner(module, options.inlineThreshold);
+            bool changed = inliner.run();
+            if (options.inlineReport)
+                inliner.printReport();
+            inliner.printSummary();
+            if (changed)
+                module.print(std::cout);
+            if (!verify())
+            {
+                return finish(1);
+            }
+        }
+
+        if (options.escapeAnalysis)
+        {
+            std::cout << "\n--- Escape Analysis ---\n";
+            EscapeAnalysis escape(module);
+            bool changed = escape.run();
+            if (options.escapeReport)
+                escape.printReport();
+            escape.printSummary();
+            if (changed)
+                module.print(std::cout);
+            if (!verify())
+            {
+                return finish(1);
+            }
+        }
+
+        if (options.constantPropagation)
+        {
+            std::cout << "\n--- Constant Propagation ---\n";
+            ConstantPropagation propagation(module);
+            bool changed = propagation.run();
+            propagation.printSummary();
+            if (changed)
+                module.print(std::cout);
+            if (!verify())
+            {
+                return finish(1);
+            }
+        }
+
+        if (options.valueNumbering)
+        {
+            std::cout << "\n--- Value Numbering ---\n";
+            ValueNumbering numbering(module);
+            bool changed = numbering.run();
+            numbering.printSummary();
+            if (changed)
+                module.print(std::cout);
+            if (!verify())
+            {
+                return finish(1);
+            }
+        }
+
+        if (options.loopOptimizations)
+        {
+            std::cout << "\n--- Loop Optimization ---\n";
+            LoopOptimizer optimizer(module, options.loops);
+            bool changed = optimizer.run();
+            optimizer.printSummary();
+            if (changed)
+                module.print(std::cout);
+            if (!verify())
+            {
+                return finish(1);
+            }
+        }
+
+        if (options.interleaveLanes >= 2)
+        {
+            std::cout << "\n--- Interleaving ---\n";
+            LoopInterleaver interleaver(module, options.interleaveLanes);
+            bool changed = interleaver.run();
+            if (options.interleaveReport)
+                interleaver.printReport();
+            interleaver.printSummary();
+            if (changed)
+                module.print(std::cout);
+            if (!verify())
+            {
+                return finish(1);
+            }
+        }
+
+        if (options.emit == EmitKind::C)
+        {
+            std::string outputPath = options.outputPath.empty() ? replaceExtension(filepath, ".c") : options.outputPath;
+            auto emitStart = std::chrono::steady_clock::now();
+            std::string source = CEmitter(module, filepath).emit();
+            auto emitTime = std::chrono::steady_clock::now() - emitStart;
+            std::ofstream file(outputPath);
+            if (!(file << source))
+            {
+                throw std::runtime_error("Failed to write " + outputPath);
+            }
+            std::cout << "[CODEGEN LOG]: Wrote " << outputPath << " (" << std::count(source.begin(), source.end(), '\n') << " lines of C) in "
+                      << std::chrono::duration_cast<std::chrono::microseconds>(emitTime).count() << "us\n";
+        }
+        else if (options.optLevel >= 0)
+        {
+            bool writeIR = options.emit == EmitKind::LLVM_IR;
+            std::string outputPath = options.outputPath.empty() ? replaceExtension(filepath, writeIR ? ".ll" : ".o") : options.outputPath;
+            LLVMCodeGenerator generator(module, filepath, options.optLevel);
+            if (writeIR)
+                generator.writeIR(outputPath);
+            else
+                generator.writeObject(outputPath);
+            std::cout << "[CODEGEN LOG]: Wrote " << outputPath << " at -O" << options.optLevel << " (" << generator.llvmInstructions
+                      << " LLVM instructions), optimizing took " << static_cast<uint64_t>(generator.optimizeSeconds * 1e6) << "us, emitting "
+                      << static_cast<uint64_t>(generator.emitSeconds * 1e6) << "us\n";
+        }
+        else if (options.emit == EmitKind::OBJECT)
+        {
+            std::string outputPath = options.outputPath.empty() ? replaceExtension(filepath, ".o") : options.outputPath;
+            auto codegenStart = std::chrono::steady_clock::now();
+            X86CodeGenerator generator(module, filepath);
+            const ObjectFile &object = generator.generate();
+            auto codegenTime = std::chrono::steady_clock::now() - codegenStart;
+            if (!object.writeFile(outputPath))
+            {
+                throw std::runtime_error("Failed to write " + outputPath);
+            }
+            double seconds = std::chrono::duration<double>(codegenTime).count();
+            std::cout << "[CODEGEN LOG]: Wrote " << outputPath << " (" << object.text.size() << " bytes of code) in "
+                      << std::chrono::duration_cast<std::chrono::microseconds>(codegenTime).count() << "us, "
+                      << (seconds > 0 ? code.size() / seconds / 1e6 : 0) << " MB/s of source\n";
+        }
+
+        if (options.run || options.bench)
         {
-            analyzer.analyzer(node.get());
+            std::cout << "\n--- Bytecode ---\n";
+            BytecodeCompiler compiler(module);
+            BytecodeProgram program = compiler.compile();
+            program.print(std::cout);
+            runProgram(program, options);
         }
     }
     catch (const std::exception &e)
     {
+        diagnostics.render(std::cerr, options.diagnosticFormat);
         std::cerr << "[FATAL] " << e.what() << "\n";
         return 1;
     }
 
-    return 0;
+    return finish(0);
 }
@@ -0,0 +1,417 @@
+#include "constant_propagation.hpp"
+#include <algorithm>
+#include <iostream>
+#include "ir/folding.hpp"
+
+ConstantPropagation::ConstantPropagation(Module &module) : module(module), purity(module) {}
+
+bool ConstantPropagation::run()
+{
+    Function *topLevel = nullptr;
+    for (auto fn : module.functions)
+    {
+        if (fn->isTopLevel)
+            topLevel = fn;
+        for (auto block : fn->blocks)
+        {
+            for (auto inst : block->instructions)
+            {
+                if (inst->op == Opcode::CALL)
+                    callSites[inst->callee].push_back(inst);
+                else if (inst->op == Opcode::JOIN)
+                    callSites[static_cast<Instruction *>(inst->operands[0])->callee].push_back(inst); // Gets the result like a call
+                else if (inst->op == Opcode::LOAD_GLOBAL)
+                    loads[inst->global].push_back(inst);
+            }
+        }
+    }
+
+    // A global starts with its initializer, or reads as zero until the top level code stores its value
+    for (auto global : module.globals)
+    {
+        if (global->initializer)
+            lower(globals[global], latticeOf(module.constant(*global->initializer)));
+        else if (initialValueVisible(global, topLevel))
+            lower(globals[global], latticeOf(module.zeroOf(global->type)));
+    }
+
+    for (auto fn : module.functions)
+    {
+        if (fn->isTopLevel || fn->arguments.empty())
+            markFunction(fn);
+    }
+    // A branch on a value that stayed undefined can not run, but picking a side for it keeps every block that is
+    // still reachable in the CFG analyzed
+    bool resolved = true;
+    while (resolved)
+    {
+        solve();
+        std::vector<Instruction *> undecided;
+        for (auto block : executableBlocks)
+        {
+            Instruction *branch = block->terminator();
+            if (branch && branch->op == Opcode::CONDBR && !executableEdges.count({block, branch->targets[0]}) &&
+                !executableEdges.count({block, branch->targets[1]}))
+                undecided.push_back(branch);
+        }
+        for (auto branch : undecided)
+        {
+            markEdge(branch->parent, branch->targets[0]);
+            markEdge(branch->parent, branch->targets[1]);
+        }
+        resolved = !undecided.empty();
+    }
+
+    std::vector<Function *> kept;
+    for (auto fn : module.functions)
+    {
+        if (executableFunctions.count(fn))
+        {
+            rewrite(fn);
+            kept.push_back(fn);
+            continue;
+        }
+        for (auto block : fn->blocks)
+        {
+            for (auto inst : block->instructions)
+            {
+                inst->dropOperands();
+                inst->parent = nullptr;
+            }
+            block->instructions.clear();
+        }
+        removedFunctions++;
+    }
+    module.functions = std::move(kept);
+    for (auto fn : module.functions)
+    {
+        fn->renumber();
+    }
+    return replacedValues + specializedArguments + foldedBranches + removedBlocks + removedFunctions > 0;
+}
+
+void ConstantPropagation::printSummary()
+{
+    std::cout << "[OPTIMIZER LOG]: Constant propagation replaced " << replacedValues << " values and specialized " << specializedArguments
+              << " parameters with constants, folded " << foldedBranches << " branches, removed " << removedBlocks << " unreachable blocks and "
+              << removedFunctions << " functions that are never called\n";
+}
+
+// Values only move down the lattice so both worklists run dry after a few visits of every instruction
+void ConstantPropagation::solve()
+{
+    while (!blockWorklist.empty() || !instructionWorklist.empty())
+    {
+        while (!instructionWorklist.empty())
+        {
+            Instruction *inst = instructionWorklist.back();
+            instructionWorklist.pop_back();
+            if (inst->parent && executableBlocks.count(inst->parent))
+                visit(inst);
+        }
+        while (!blockWorklist.empty())
+        {
+            BasicBlock *block = blockWorklist.back();
+            blockWorklist.pop_back();
+            for (auto inst : block->instructions)
+            {
+                visit(inst);
+            }
+        }
+    }
+}
+
+void ConstantPropagation::visit(Instruction *inst)
+{
+    BasicBlock *block = inst->parent;
+    switch (inst->op)
+    {
+    case Opcode::PHI:
+    {
+        // Edges that can not run yet say nothing about the value
+        Lattice merged;
+        for (size_t i = 0; i < inst->operands.size(); ++i)
+        {
+            if (executableEdges.count({inst->targets[i], block}))
+                lower(merged, latticeOf(inst->operands[i]));
+        }
+        update(inst, merged);
+        return;
+    }
+    case Opcode::BR:
+        markEdge(block, inst->targets[0]);
+        return;
+    case Opcode::CONDBR:
+    {
+        Lattice condition = latticeOf(inst->operands[0]);
+        if (condition.state == Lattice::UNDEFINED)
+            return;
+        if (condition.state == Lattice::CONSTANT && condition.constant->value.type == TypeSystem::BOOLEAN)
+        {
+            markEdge(block, inst->targets[condition.constant->value.boolValue ? 0 : 1]);
+            return;
+        }
+        markEdge(block, inst->targets[0]);
+        markEdge(block, inst->targets[1]);
+        return;
+    }
+    case Opcode::RET:
+        if (!inst->operands.empty() && lower(returns[block->parent], latticeOf(inst->operands[0])))
+        {
+            const auto &calls = callSites[block->parent];
+            instructionWorklist.insert(instructionWorklist.end(), calls.begin(), calls.end());
+        }
+        return;
+    case Opcode::STORE_GLOBAL:
+        if (lower(globals[inst->global], latticeOf(inst->operands[0])))
+        {
+            const auto &readers = loads[inst->global];
+            instructionWorklist.insert(instructionWorklist.end(), readers.begin(), readers.end());
+        }
+        return;
+    case Opcode::LOAD_GLOBAL:
+        update(inst, globals[inst->global]);
+        return;
+    case Opcode::CALL:
+    {
+        Function *callee = inst->callee;
+        if (callee->blocks.empty())
+        {
+            update(inst, Lattice{Lattice::OVERDEFINED});
+            return;
+        }
+        markFunction(callee);
+        for (size_t i = 0; i < inst->operands.size() && i < callee->arguments.size(); ++i)
+        {
+            Argument *argument = callee->arguments[i];
+            if (lower(values[argument], latticeOf(inst->operands[i])))
+                instructionWorklist.insert(instructionWorklist.end(), argument->users.begin(), argument->users.end());
+        }
+        if (callee->returnType->scalar != TypeSystem::VOID)
+            update(inst, returns[callee]);
+        return;
+    }
+    case Opcode::SPAWN:
+    {
+        // The task gets its arguments like a call does, the handle itself is never a constant
+        Function *callee = inst->callee;
+        update(inst, Lattice{Lattice::OVERDEFINED});
+        markFunction(callee);
+        for (size_t i = 0; i < inst->operands.size() && i < callee->arguments.size(); ++i)
+        {
+            Argument *argument = callee->arguments[i];
+            if (lower(values[argument], latticeOf(inst->operands[i])))
+                instructionWorklist.insert(instructionWorklist.end(), argument->users.begin(), argument->users.end());
+        }
+        return;
+    }
+    case Opcode::JOIN:
+    {
+        Function *callee = static_cast<Instruction *>(inst->operands[0])->callee;
+        if (callee->blocks.empty())
+            update(inst, Lattice{Lattice::OVERDEFINED});
+        else if (callee->returnType->scalar != TypeSystem::VOID)
+            update(inst, returns[callee]);
+        return;
+    }
+    default:
+        break;
+    }
+
+    // Arithmetic and comparisons fold once every operand is a constant
+    std::vector<Value *> constants;
+    for (auto operand : inst->operands)
+    {
+        Lattice lattice = latticeOf(operand);
+        if (lattice.state == Lattice::OVERDEFINED)
+        {
+            update(inst, lattice);
+            return;
+        }
+        if (lattice.state == Lattice::UNDEFINED)
+            return;
+        constants.push_back(lattice.constant);
+    }
+    Constant *folded = foldConstant(module, inst->op, constants);
+    update(inst, folded ? Lattice{Lattice::CONSTANT, folded} : Lattice{Lattice::OVERDEFINED});
+}
+
+void ConstantPropagation::rewrite(Function *function)
+{
+    for (auto block : function->blocks)
+    {
+        if (!executableBlocks.count(block))
+            continue;
+        std::vector<Instruction *> instructions = block->instructions;
+        for (auto inst : instructions)
+        {
+            auto it = values.find(inst);
+            if (it == values.end() || it->second.state != Lattice::CONSTANT)
+                continue;
+            inst->replaceAllUsesWith(it->second.constant);
+            replacedValues++;
+            // A call still has to run for what else it does, and a wait keeps ordering an unproven task before what follows
+            Function *task = PurityAnalysis::raceFreeTask(inst);
+            if (inst->op == Opcode::JOIN && !task)
+                continue;
+            Function *callee = inst->op == Opcode::CALL ? inst->callee : task;
+            if (!callee || (purity.purity(callee) != Purity::IMPURE && purity.alwaysReturns(callee)))
+                block->erase(inst);
+        }
+    }
+    for (auto argument : function->arguments)
+    {
+        auto it = values.find(argument);
+        if (it == values.end() || it->second.state != Lattice::CONSTANT || argument->users.empty())
+            continue;
+        argument->replaceAllUsesWith(it->second.constant);
+        specializedArguments++;
+    }
+
+    // Branches that can only go one way become jumps, what was only reached through the other way goes with it
+    int folded = 0;
+    for (auto block : function->blocks)
+    {
+        Instruction *branch = block->terminator();
+        if (!executableBlocks.count(block) || !branch || branch->op != Opcode::CONDBR)
+            continue;
+        bool first = executableEdges.count({block, branch->targets[0]});
+        bool second = executableEdges.count({block, branch->targets[1]});
+        if (first != second)
+        {
+            block->jumpTo(branch->targets[first ? 0 : 1]);
+            folded++;
+        }
+    }
+    if (folded == 0)
+        return;
+    foldedBranches += folded;
+
+    size_t before = function->blocks.size();
+    function->recomputePredecessors();
+    function->removeUnreachableBlocks();
+    for (auto block : function->blocks)
+    {
+        std::vector<Instruction *> instructions = block->instructions;
+        for (auto phi : instructions)
+        {
+            if (!phi->isPhi() || phi->operands.size() != 1)
+                continue;
+            phi->replaceAllUsesWith(phi->operands[0]);
+            block->erase(phi);
+        }
+    }
+    for (size_t i = 1; i < function->blocks.size();)
+    {
+        if (!function->mergeIntoPredecessor(function->blocks[i]))
+            ++i;
+    }
+    function->sortBlocks();
+    removedBlocks += before - function->blocks.size();
+}
+
+//---------HELPER FUNCTIONS----------
+ConstantPropagation::Lattice ConstantPropagation::latticeOf(Value *value)
+{
+    if (value->kind == ValueKind::CONSTANT)
+    {
+        auto constant = static_cast<Constant *>(value);
+        if (constant->value.type == TypeSystem::UNKNOWN)
+            return Lattice{Lattice::OVERDEFINED}; // Nothing is known about an undefined value, not even that it stays the same
+        return Lattice{Lattice::CONSTANT, constant};
+    }
+    auto it = values.find(value);
+    return it == values.end() ? Lattice{} : it->second;
+}
+
+bool ConstantPropagation::lower(Lattice &lattice, const Lattice &value)
+{
+    if (value.state == Lattice::UNDEFINED || lattice.state == Lattice::OVERDEFINED)
+        return false;
+    if (lattice.state == Lattice::UNDEFINED)
+    {
+        lattice = value;
+        return true;
+    }
+    if (value.state == Lattice::CONSTANT && value.constant == lattice.constant)
+        return false;
+    lattice = Lattice{Lattice::OVERDEFINED};
+    return true;
+}
+
+void ConstantPropagation::update(Instruction *inst, const Lattice &value)
+{
+    if (lower(values[inst], value))
+        instructionWorklist.insert(instructionWorklist.end(), inst->users.begin(), inst->users.end());
+}
+
+void ConstantPropagation::markEdge(BasicBlock *from, BasicBlock *to)
+{
+    if (!executableEdges.insert({from, to}).second)
+        return;
+    if (executableBlocks.insert(to).second)
+    {
+        blockWorklist.push_back(to);
+        return;
+    }
+    // The block already ran, only its phis see the new edge
+    for (auto inst : to->instructions)
+    {
+        if (!inst->isPhi())
+            break;
+        instructionWorklist.push_back(inst);
+    }
+}
+
+void ConstantPropagation::markFunction(Function *function)
+{
+    if (!executableFunctions.insert(function).second || function->blocks.empty())
+        return;
+    if (executableBlocks.insert(function->entry()).second)
+        blockWorklist.push_back(function->entry());
+}
+
+// The zero a global holds before the top level code stores its value can only be seen by a load that runs before
+// that store, either in the top level code itself or in a function it calls. Pure functions read no globals at all
+bool ConstantPropagation::initialValueVisible(GlobalVariable *global, Function *topLevel) const
+{
+    if (!topLevel || topLevel->blocks.empty())
+        return true;
+    std::unordered_set<BasicBlock *> visited = {topLevel->entry()};
+    std::vector<BasicBlock *> worklist = {topLevel->entry()};
+    while (!worklist.empty())
+    {
+        BasicBlock *block = worklist.back();
+        worklist.pop_back();
+        bool stored = false;
+        for (auto inst : block->instructions)
+        {
+            if (inst->op == Opcode::STORE_GLOBAL && inst->global == global)
+            {
+                stored = true;
+                break;
+            }
+            if (inst->op == Opcode::LOAD_GLOBAL && inst->global == global)
+                return true;
+            if (inst->op == Opcode::CALL && purity.purity(inst->callee) != Purity::PURE)
+                return true;
+            if (Function *task = PurityAnalysis::raceFreeTask(inst))
+            {
+                if (purity.purity(task) != Purity::PURE)
+                    return true;
+            }
+            else if (inst->op == Opcode::SPAWN || inst->op == Opcode::JOIN)
+                return true; // The task may load the global before the store
+            if (inst->op == Opcode::RET)
+                return true; // Whatever runs after the top level code sees the zero
+        }
+        if (stored)
+            continue;
+        for (auto succ : block->successors())
+        {
+            if (visited.insert(succ).second)
+                worklist.push_back(succ);
+        }
+    }
+    return false;
+}
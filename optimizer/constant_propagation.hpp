@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ir/ir.hpp"
+#include "ir/purity.hpp"
+
+// Interprocedural sparse conditional constant propagation on the SSA IR, after Wegman and Zadeck.
+// Every value starts out undefined and only moves down to a constant or to overdefined. Blocks only count once
+// an executable edge reaches them, so a branch on a constant never makes its other side look reachable.
+// Arguments take the meet of what every executable call passes, returns the meet of every executable ret and
+// globals the meet of their stores, which lets constants flow through calls and config style globals.
+// Only the top level code, main and functions without parameters are entered from outside, every other function
+// is only reached through its calls and goes away when none of them can run
+class ConstantPropagation
+{
+    Module &module;
+    PurityAnalysis purity;
+
+    struct Lattice
+    {
+        enum State : uint8_t
+        {
+            UNDEFINED,
+            CONSTANT,
+            OVERDEFINED,
+        } state = UNDEFINED;
+        Constant *constant = nullptr;
+    };
+
+    std::unordered_map<Value *, Lattice> values;             // Instructions and arguments
+    std::unordered_map<Function *, Lattice> returns;
+    std::unordered_map<GlobalVariable *, Lattice> globals;
+    std::unordered_map<Function *, std::vector<Instruction *>> callSites;
+    std::unordered_map<GlobalVariable *, std::vector<Instruction *>> loads;
+    std::unordered_set<Function *> executableFunctions;
+    std::unordered_set<BasicBlock *> executableBlocks;
+    std::set<std::pair<BasicBlock *, BasicBlock *>> executableEdges;
+    std::vector<BasicBlock *> blockWorklist;
+    std::vector<Instruction *> instructionWorklist;
+
+    // Statistics for the summary
+    int replacedValues = 0;
+    int specializedArguments = 0;
+    int foldedBranches = 0;
+    int removedBlocks = 0;
+    int removedFunctions = 0;
+
+public:
+    ConstantPropagation(Module &module);
+    bool run(); // True when anything changed
+    void printSummary();
+
+private:
+    void solve();
+    void visit(Instruction *inst);
+    void rewrite(Function *function);
+
+    //---------HELPER FUNCTIONS----------
+    Lattice latticeOf(Value *value);
+    bool lower(Lattice &lattice, const Lattice &value); // Meet of the two, true when the lattice moved
+    void update(Instruction *inst, const Lattice &value); // Lowers an instruction and revisits its users when it moved
+    void markEdge(BasicBlock *from, BasicBlock *to);
+    void markFunction(Function *function);
+    bool initialValueVisible(GlobalVariable *global, Function *topLevel) const;
+};
@@ -0,0 +1,475 @@
+#include <iostream>
+#include "deadcode.hpp"
+
+DeadCodeEliminator::DeadCodeEliminator(Semantics &semantics) : semantics(semantics) {};
+
+// Main pass function
+void DeadCodeEliminator::eliminate(std::vector<std::unique_ptr<Node>> &program)
+{
+    std::vector<std::unique_ptr<Node>> kept;
+    for (auto &node : program)
+    {
+        auto stmt = dynamic_cast<Statement *>(node.get());
+        if (!stmt)
+        {
+            kept.push_back(std::move(node));
+            continue;
+        }
+        node.release();
+        auto simplified = simplifyStatement(std::unique_ptr<Statement>(stmt));
+        if (simplified)
+        {
+            kept.push_back(std::move(simplified));
+        }
+    }
+    program = std::move(kept);
+}
+
+void DeadCodeEliminator::printSummary()
+{
+    std::cout << "[OPTIMIZER LOG]: Dead code elimination pruned " << prunedBranches << " branches, removed "
+              << removedLoops << " loops, " << unreachableStatements << " unreachable statements and "
+              << removedLets << " unused variables\n";
+}
+
+//---------REWRITING FUNCTIONS----------
+std::unique_ptr<Statement> DeadCodeEliminator::simplifyStatement(std::unique_ptr<Statement> stmt)
+{
+    if (!stmt)
+        return nullptr;
+
+    if (dynamic_cast<ifStatement *>(stmt.get()))
+    {
+        return simplifyIfStatement(std::unique_ptr<ifStatement>(static_cast<ifStatement *>(stmt.release())));
+    }
+
+    if (dynamic_cast<ForStatement *>(stmt.get()))
+    {
+        return simplifyForStatement(std::unique_ptr<ForStatement>(static_cast<ForStatement *>(stmt.release())));
+    }
+
+    if (auto whileStmt = dynamic_cast<WhileStatement *>(stmt.get()))
+    {
+        auto condition = constantCondition(whileStmt->condition.get());
+        if (condition.has_value() && !condition.value())
+        {
+            std::cout << "[OPTIMIZER LOG]: Removing while loop that never runs at line " << whileStmt->token.line << "\n";
+            removedLoops++;
+            forget(whileStmt);
+            return nullptr;
+        }
+        whileStmt->loop = simplifyStatement(std::move(whileStmt->loop));
+        return stmt;
+    }
+
+    if (auto blockStmt = dynamic_cast<BlockStatement *>(stmt.get()))
+    {
+        simplifyStatements(blockStmt->statements);
+        return stmt;
+    }
+
+    if (auto zoneStmt = dynamic_cast<ZoneStatement *>(stmt.get()))
+    {
+        zoneStmt->body = simplifyStatement(std::move(zoneStmt->body));
+        return stmt;
+    }
+
+    if (auto unsafeStmt = dynamic_cast<UnsafeStatement *>(stmt.get()))
+    {
+        unsafeStmt->body = simplifyStatement(std::move(unsafeStmt->body));
+        return stmt;
+    }
+
+    if (auto funcStmt = dynamic_cast<FunctionStatement *>(stmt.get()))
+    {
+        if (auto funcExpr = dynamic_cast<FunctionExpression *>(funcStmt->funcExpr.get()))
+        {
+            simplifyFunction(funcExpr);
+        }
+        return stmt;
+    }
+
+    return stmt;
+}
+
+std::unique_ptr<Statement> DeadCodeEliminator::simplifyIfStatement(std::unique_ptr<ifStatement> ifNode)
+{
+    ifNode->if_result = simplifyStatement(std::move(ifNode->if_result));
+    if (ifNode->elseif_result.has_value())
+    {
+        ifNode->elseif_result = simplifyStatement(std::move(ifNode->elseif_result.value()));
+    }
+    if (ifNode->else_result.has_value())
+    {
+        ifNode->else_result = simplifyStatement(std::move(ifNode->else_result.value()));
+    }
+
+    auto ifCondition = constantCondition(ifNode->condition.get());
+    std::optional<bool> elseifCondition;
+    if (ifNode->elseif_condition.has_value())
+    {
+        elseifCondition = constantCondition(ifNode->elseif_condition.value().get());
+    }
+
+    // The if arm always runs so it replaces the whole statement
+    if (ifCondition.has_value() && ifCondition.value())
+    {
+        std::cout << "[OPTIMIZER LOG]: If condition is always true at line " << ifNode->token.line << "\n";
+        prunedBranches++;
+        auto taken = std::move(ifNode->if_result);
+        forget(ifNode.get());
+        return taken;
+    }
+
+    // The if arm never runs so the elseif arm or else arm takes its place
+    if (ifCondition.has_value() && !ifCondition.value())
+    {
+        std::cout << "[OPTIMIZER LOG]: If condition is always false at line " << ifNode->token.line << "\n";
+        prunedBranches++;
+        if (ifNode->elseif_stmt.has_value() && !(elseifCondition.has_value() && !elseifCondition.value()))
+        {
+            if (elseifCondition.has_value())
+            {
+                auto taken = std::move(ifNode->elseif_result.value());
+                forget(ifNode.get());
+                return taken;
+            }
+
+            // The elseif arm becomes the new if statement and keeps the else arm
+            auto promoted = std::make_unique<ifStatement>(
+                ifNode->elseif_stmt.value(),
+                std::move(ifNode->elseif_condition.value()),
+                std::move(ifNode->elseif_result.value()),
+                std::nullopt,
+                std::nullopt,
+                std::nullopt,
+                ifNode->else_stmt,
+                std::move(ifNode->else_result));
+            forget(ifNode.get());
+            return promoted;
+        }
+
+        if (ifNode->elseif_stmt.has_value())
+        {
+            prunedBranches++;
+        }
+
+        std::unique_ptr<Statement> taken;
+        if (ifNode->else_result.has_value())
+        {
+            taken = std::move(ifNode->else_result.value());
+        }
+        forget(ifNode.get());
+        return taken;
+    }
+
+    // The if condition is only known at runtime but the elseif arm might still be decided
+    if (elseifCondition.has_value())
+    {
+        prunedBranches++;
+        if (elseifCondition.value())
+        {
+            // The elseif arm always runs when reached so it becomes the else arm
+            std::cout << "[OPTIMIZER LOG]: Elseif condition is always true at line " << ifNode->elseif_stmt->line << "\n";
+            if (ifNode->else_result.has_value())
+            {
+                forget(ifNode->else_result.value().get());
+            }
+            forget(ifNode->elseif_condition.value().get());
+            ifNode->else_stmt = ifNode->elseif_stmt;
+            ifNode->else_result = std::move(ifNode->elseif_result);
+        }
+        else
+        {
+            std::cout << "[OPTIMIZER LOG]: Elseif condition is always false at line " << ifNode->elseif_stmt->line << "\n";
+            forget(ifNode->elseif_condition.value().get());
+            if (ifNode->elseif_result.has_value())
+            {
+                forget(ifNode->elseif_result.value().get());
+            }
+        }
+        ifNode->elseif_stmt.reset();
+        ifNode->elseif_condition.reset();
+        ifNode->elseif_result.reset();
+    }
+
+    return ifNode;
+}
+
+std::unique_ptr<Statement> DeadCodeEliminator::simplifyForStatement(std::unique_ptr<ForStatement> forStmt)
+{
+    auto condition = constantCondition(forStmt->condition.get());
+    if (!condition.has_value())
+    {
+        condition = firstIterationCondition(forStmt.get());
+    }
+
+    if (condition.has_value() && !condition.value())
+    {
+        std::cout << "[OPTIMIZER LOG]: Removing for loop that never runs at line " << forStmt->token.line << "\n";
+        removedLoops++;
+
+        // The initializer still runs once so it is kept in its own block when it does something
+        std::unique_ptr<Statement> replacement;
+        if (forStmt->initializer && hasSideEffects(forStmt->initializer.get()))
+        {
+            std::vector<std::unique_ptr<Statement>> initializer;
+            initializer.push_back(std::move(forStmt->initializer));
+            replacement = std::make_unique<BlockStatement>(forStmt->for_key, std::move(initializer));
+        }
+        forget(forStmt.get());
+        return replacement;
+    }
+
+    forStmt->body = simplifyStatement(std::move(forStmt->body));
+    return forStmt;
+}
+
+// Simplifying a list of statements and cutting everything after a return, break or continue
+void DeadCodeEliminator::simplifyStatements(std::vector<std::unique_ptr<Statement>> &statements)
+{
+    std::vector<std::unique_ptr<Statement>> kept;
+    bool terminated = false;
+    for (auto &stmt : statements)
+    {
+        if (!stmt)
+            continue;
+        if (terminated)
+        {
+            unreachableStatements++;
+            forget(stmt.get());
+            continue;
+        }
+
+        auto simplified = simplifyStatement(std::move(stmt));
+        if (!simplified)
+            continue;
+        terminated = isTerminator(simplified.get());
+        kept.push_back(std::move(simplified));
+    }
+    statements = std::move(kept);
+}
+
+void DeadCodeEliminator::simplifyFunction(FunctionExpression *funcExpr)
+{
+    auto block = dynamic_cast<BlockExpression *>(funcExpr->block.get());
+    if (!block)
+        return;
+    simplifyStatements(block->statements);
+
+    // Removing one variable can leave the variables used by its initializer unused so this runs to a fixed point
+    while (true)
+    {
+        std::unordered_map<std::string, int> uses;
+        countUses(block, uses);
+        if (!removeUnusedLets(block->statements, uses))
+            break;
+    }
+}
+
+//---------UNUSED VARIABLES----------
+bool DeadCodeEliminator::removeUnusedLets(std::vector<std::unique_ptr<Statement>> &statements, const std::unordered_map<std::string, int> &uses)
+{
+    bool changed = false;
+    std::vector<std::unique_ptr<Statement>> kept;
+    for (auto &stmt : statements)
+    {
+        if (auto letStmt = dynamic_cast<LetStatement *>(stmt.get()))
+        {
+            bool used = uses.count(letStmt->ident_token.TokenLiteral) > 0;
+            if (!used && !hasSideEffects(letStmt->value.get()))
+            {
+                std::cout << "[OPTIMIZER LOG]: Removing unused variable '" << letStmt->ident_token.TokenLiteral << "'\n";
+                removedLets++;
+                changed = true;
+                forget(letStmt);
+                continue;
+            }
+        }
+        else if (stmt)
+        {
+            changed |= removeUnusedLetsInBranches(stmt.get(), uses);
+        }
+        kept.push_back(std::move(stmt));
+    }
+    statements = std::move(kept);
+    return changed;
+}
+
+bool DeadCodeEliminator::removeUnusedLetsInBranches(Node *node, const std::unordered_map<std::string, int> &uses)
+{
+    if (auto blockStmt = dynamic_cast<BlockStatement *>(node))
+    {
+        return removeUnusedLets(blockStmt->statements, uses);
+    }
+
+    bool changed = false;
+    if (auto ifNode = dynamic_cast<ifStatement *>(node))
+    {
+        changed |= removeUnusedLetsInBranches(ifNode->if_result.get(), uses);
+        if (ifNode->elseif_result.has_value())
+            changed |= removeUnusedLetsInBranches(ifNode->elseif_result.value().get(), uses);
+        if (ifNode->else_result.has_value())
+            changed |= removeUnusedLetsInBranches(ifNode->else_result.value().get(), uses);
+    }
+    else if (auto whileStmt = dynamic_cast<WhileStatement *>(node))
+    {
+        changed |= removeUnusedLetsInBranches(whileStmt->loop.get(), uses);
+    }
+    else if (auto zoneStmt = dynamic_cast<ZoneStatement *>(node))
+    {
+        changed |= removeUnusedLetsInBranches(zoneStmt->body.get(), uses);
+    }
+    else if (auto unsafeStmt = dynamic_cast<UnsafeStatement *>(node))
+    {
+        changed |= removeUnusedLetsInBranches(unsafeStmt->body.get(), uses);
+    }
+    else if (auto forStmt = dynamic_cast<ForStatement *>(node))
+    {
+        changed |= removeUnusedLetsInBranches(forStmt->body.get(), uses);
+    }
+    return changed;
+}
+
+// Counting the identifiers read or assigned by name, shadowed names are counted together which keeps this conservative
+void DeadCodeEliminator::countUses(Node *node, std::unordered_map<std::string, int> &uses)
+{
+    if (!node)
+        return;
+    if (auto ident = dynamic_cast<Identifier *>(node))
+    {
+        uses[ident->identifier.TokenLiteral]++;
+    }
+    else if (auto assignStmt = dynamic_cast<AssignmentStatement *>(node))
+    {
+        uses[assignStmt->ident_token.TokenLiteral]++;
+    }
+    forEachChild(node, [this, &uses](Node *child)
+                 { countUses(child, uses); });
+}
+
+//---------HELPER FUNCTIONS----------
+std::optional<bool> DeadCodeEliminator::constantCondition(Expression *condition)
+{
+    if (!condition)
+        return std::nullopt;
+    auto value = semantics.constantOf(condition);
+    if (!value || value->type != TypeSystem::BOOLEAN)
+        return std::nullopt;
+    return value->boolValue;
+}
+
+// Evaluating the loop condition right after the initializer ran, for (int i=10; i<5; ...) never iterates
+std::optional<bool> DeadCodeEliminator::firstIterationCondition(ForStatement *forStmt)
+{
+    auto letStmt = dynamic_cast<LetStatement *>(forStmt->initializer.get());
+    auto condition = dynamic_cast<InfixExpression *>(forStmt->condition.get());
+    if (!letStmt || !letStmt->value || !condition)
+        return std::nullopt;
+
+    auto initialValue = semantics.constantOf(letStmt->value.get());
+    if (!initialValue)
+        return std::nullopt;
+
+    const std::string &loopVar = letStmt->ident_token.TokenLiteral;
+    auto leftIdent = dynamic_cast<Identifier *>(condition->left_operand.get());
+    auto rightIdent = dynamic_cast<Identifier *>(condition->right_operand.get());
+
+    std::optional<ConstantValue> left;
+    std::optional<ConstantValue> right;
+    if (leftIdent && leftIdent->identifier.TokenLiteral == loopVar)
+    {
+        left = initialValue;
+        right = semantics.constantOf(condition->right_operand.get());
+    }
+    else if (rightIdent && rightIdent->identifier.TokenLiteral == loopVar)
+    {
+        left = semantics.constantOf(condition->left_operand.get());
+        right = initialValue;
+    }
+    if (!left || !right)
+        return std::nullopt;
+
+    auto result = semantics.foldInfix(condition, *left, *right);
+    if (!result || result->type != TypeSystem::BOOLEAN)
+        return std::nullopt;
+    return result->boolValue;
+}
+
+// Calls can do anything and assignments or ++/-- change state, a division by something that
+// is not a known non zero value or an index that may be out of bounds can trap so it is also kept
+bool DeadCodeEliminator::hasSideEffects(Node *node)
+{
+    if (!node)
+        return false;
+    if (dynamic_cast<CallExpression *>(node) || dynamic_cast<IndexExpression *>(node))
+        return true;
+    if (auto infix = dynamic_cast<InfixExpression *>(node))
+    {
+        TokenType op = infix->operat.type;
+        if (op == TokenType::ASSIGN)
+            return true;
+        if (op == TokenType::DIVIDE || op == TokenType::MODULUS)
+        {
+            auto divisor = semantics.constantOf(infix->right_operand.get());
+            bool safeDivisor = divisor && ((divisor->type == TypeSystem::INTEGER && divisor->intValue != 0 && divisor->intValue != -1) ||
+                                           (divisor->type == TypeSystem::FLOAT));
+            if (!safeDivisor)
+                return true;
+        }
+    }
+    if (auto prefix = dynamic_cast<PrefixExpression *>(node))
+    {
+        if (prefix->operat.type == TokenType::PLUS_PLUS || prefix->operat.type == TokenType::MINUS_MINUS)
+            return true;
+    }
+
+    bool sideEffects = false;
+    forEachChild(node, [this, &sideEffects](Node *child)
+                 { sideEffects = sideEffects || hasSideEffects(child); });
+    return sideEffects;
+}
+
+// A statement after which nothing in the same block can run
+bool DeadCodeEliminator::isTerminator(Statement *stmt)
+{
+    if (dynamic_cast<ReturnStatement *>(stmt) || dynamic_cast<BreakStatement *>(stmt) || dynamic_cast<ContinueStatement *>(stmt))
+        return true;
+
+    if (auto blockStmt = dynamic_cast<BlockStatement *>(stmt))
+    {
+        return !blockStmt->statements.empty() && isTerminator(blockStmt->statements.back().get());
+    }
+
+    if (auto zoneStmt = dynamic_cast<ZoneStatement *>(stmt))
+    {
+        return zoneStmt->body && isTerminator(zoneStmt->body.get());
+    }
+
+    if (auto unsafeStmt = dynamic_cast<UnsafeStatement *>(stmt))
+    {
+        return unsafeStmt->body && isTerminator(unsafeStmt->body.get());
+    }
+
+    // An if statement terminates when every arm including an else arm terminates
+    if (auto ifNode = dynamic_cast<ifStatement *>(stmt))
+    {
+        if (!ifNode->else_result.has_value() || !ifNode->else_result.value())
+            return false;
+        if (!ifNode->if_result || !isTerminator(ifNode->if_result.get()))
+            return false;
+        if (ifNode->elseif_stmt.has_value() && !(ifNode->elseif_result.value() && isTerminator(ifNode->elseif_result.value().get())))
+            return false;
+        return isTerminator(ifNode->else_result.value().get());
+    }
+    return false;
+}
+
+void DeadCodeEliminator::forget(Node *node)
+{
+    if (!node)
+        return;
+    semantics.forgetAnnotation(node);
+    forEachChild(node, [this](Node *child)
+                 { forget(child); });
+}
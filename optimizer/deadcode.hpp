@@ -0,0 +1,47 @@
+#pragma once
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast.hpp"
+#include "semantic analyzer/semantics.hpp"
+
+// Dead code elimination on the annotated AST, it uses the constants recorded by the semantic analyzer
+// to prune branches that can never run, loops that never iterate, statements after return/break/continue
+// and local variables that are never used
+class DeadCodeEliminator
+{
+    Semantics &semantics;
+
+    // Statistics for the summary
+    int prunedBranches = 0;
+    int removedLoops = 0;
+    int unreachableStatements = 0;
+    int removedLets = 0;
+
+public:
+    DeadCodeEliminator(Semantics &semantics);
+    void eliminate(std::vector<std::unique_ptr<Node>> &program); // Runs the pass over the whole program
+    void printSummary();
+
+private:
+    //---------REWRITING FUNCTIONS----------
+    std::unique_ptr<Statement> simplifyStatement(std::unique_ptr<Statement> stmt); // Returns the replacement or nullptr if the statement was removed
+    std::unique_ptr<Statement> simplifyIfStatement(std::unique_ptr<ifStatement> ifNode);
+    std::unique_ptr<Statement> simplifyForStatement(std::unique_ptr<ForStatement> forStmt);
+    void simplifyStatements(std::vector<std::unique_ptr<Statement>> &statements);
+    void simplifyFunction(FunctionExpression *funcExpr);
+
+    //---------UNUSED VARIABLES----------
+    bool removeUnusedLets(std::vector<std::unique_ptr<Statement>> &statements, const std::unordered_map<std::string, int> &uses);
+    bool removeUnusedLetsInBranches(Node *node, const std::unordered_map<std::string, int> &uses);
+    void countUses(Node *node, std::unordered_map<std::string, int> &uses);
+
+    //---------HELPER FUNCTIONS----------
+    std::optional<bool> constantCondition(Expression *condition);
+    std::optional<bool> firstIterationCondition(ForStatement *forStmt);
+    bool hasSideEffects(Node *node);
+    bool isTerminator(Statement *stmt);
+    void forget(Node *node); // Drops the annotations of a subtree that is about to be deleted
+};
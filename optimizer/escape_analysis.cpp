@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <iostream>
+#include <unordered_set>
+#include "escape_analysis.hpp"
+
+EscapeAnalysis::EscapeAnalysis(Module &module) : module(module) {};
+
+bool EscapeAnalysis::run()
+{
+    for (auto function : module.functions)
+    {
+        visit(function);
+        function->renumber();
+    }
+    return promotedSites > 0;
+}
+
+void EscapeAnalysis::printSummary()
+{
+    std::cout << "[OPTIMIZER LOG]: Escape analysis promoted " << promotedSites << " allocations to registers and kept " << keptSites
+              << ", removing " << removedLoads << " loads and " << removedFrees << " frees\n";
+}
+
+void EscapeAnalysis::printReport()
+{
+    for (const auto &decision : decisions)
+    {
+        std::cout << "[OPTIMIZER LOG]: " << (decision.promoted ? "Promoted " : "Kept ") << decision.site << " in " << decision.function << ": "
+                  << decision.reason << "\n";
+    }
+}
+
+// The CFG never changes here, only phis are added, so one dominator tree serves every round
+void EscapeAnalysis::visit(Function *function)
+{
+    std::vector<Instruction *> allocs;
+    auto findAllocs = [&]()
+    {
+        allocs.clear();
+        for (auto block : function->blocks)
+        {
+            for (auto inst : block->instructions)
+            {
+                if (inst->op == Opcode::ALLOC)
+                    allocs.push_back(inst);
+            }
+        }
+    };
+    findAllocs();
+    if (allocs.empty())
+        return;
+
+    function->removeUnreachableBlocks();
+    DominatorTree dominators(function);
+    auto frontiers = dominators.frontiers();
+    bool promotedAny = true;
+    while (promotedAny)
+    {
+        promotedAny = false;
+        findAllocs();
+        for (auto alloc : allocs)
+        {
+            if (!escapes(alloc).empty())
+                continue;
+            decisions.push_back({function->name, siteName(alloc), true, "never leaves the function, its cell lives in registers"});
+            promote(alloc, dominators, frontiers);
+            promotedSites++;
+            promotedAny = true;
+        }
+    }
+    for (auto alloc : allocs)
+    {
+        decisions.push_back({function->name, siteName(alloc), false, escapes(alloc)});
+        keptSites++;
+    }
+}
+
+std::string EscapeAnalysis::escapes(Instruction *alloc) const
+{
+    auto count = dynamic_cast<Constant *>(alloc->operands[0]);
+    if (!count || count->value.intValue != 1)
+        return "allocates a number of cells only known at run time";
+    for (auto user : alloc->users)
+    {
+        switch (user->op)
+        {
+        case Opcode::LOAD:
+        case Opcode::FREE:
+        case Opcode::EQ:
+        case Opcode::NE:
+            break;
+        case Opcode::STORE:
+            if (user->operands[1] == alloc)
+                return "stored through another pointer";
+            break;
+        case Opcode::CALL:
+            return "passed to '" + user->callee->name + "'";
+        case Opcode::SPAWN:
+            return "handed to a task of '" + user->callee->name + "'";
+        case Opcode::RET:
+            return "returned";
+        case Opcode::STORE_GLOBAL:
+            return "stored in the top level variable '" + user->global->name + "'";
+        case Opcode::PHI:
+            return "merged with other pointers in a phi";
+        default:
+            return "used by " + opcodeName(user->op);
+        }
+    }
+    return "";
+}
+
+// Classic SSA construction for the one cell. Phis go on the iterated dominance frontier of the blocks that store,
+// then a walk down the dominator tree carries the value the cell holds and rewrites every use on the way
+void EscapeAnalysis::promote(Instruction *alloc, const DominatorTree &dominators,
+                             const std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> &frontiers)
+{
+    const Type *pointee = alloc->type->element;
+    Value *initial = module.zeroOf(pointee); // The memory of an allocation is not cleared, any value will do
+
+    std::unordered_map<BasicBlock *, Instruction *> phis;
+    std::vector<BasicBlock *> pending;
+    std::unordered_set<BasicBlock *> storing;
+    for (auto user : alloc->users)
+    {
+        if (user->op == Opcode::STORE && storing.insert(user->parent).second)
+            pending.push_back(user->parent);
+    }
+    while (!pending.empty())
+    {
+        BasicBlock *block = pending.back();
+        pending.pop_back();
+        auto frontier = frontiers.find(block);
+        if (frontier == frontiers.end())
+            continue;
+        for (auto join : frontier->second)
+        {
+            if (phis.count(join))
+                continue;
+            Instruction *phi = module.createInstruction(Opcode::PHI, pointee);
+            phi->name = alloc->name;
+            join->insertPhi(phi);
+            phis[join] = phi;
+            pending.push_back(join);
+        }
+    }
+
+    // Iterative so deep dominator trees can not overflow the stack
+    std::unordered_map<BasicBlock *, Value *> outgoing;
+    std::vector<std::pair<BasicBlock *, Value *>> work = {{alloc->parent->parent->entry(), initial}};
+    while (!work.empty())
+    {
+        auto [block, current] = work.back();
+        work.pop_back();
+        if (auto phi = phis.find(block); phi != phis.end())
+            current = phi->second;
+
+        auto instructions = block->instructions;
+        for (auto inst : instructions)
+        {
+            if (inst == alloc)
+            {
+                current = initial;
+                continue;
+            }
+            if (inst->operands.empty() || (inst->operands[0] != alloc && (inst->operands.size() < 2 || inst->operands[1] != alloc)))
+                continue;
+            switch (inst->op)
+            {
+            case Opcode::STORE:
+                current = inst->operands[1];
+                block->erase(inst);
+                break;
+            case Opcode::LOAD:
+                inst->replaceAllUsesWith(current);
+                block->erase(inst);
+                removedLoads++;
+                break;
+            case Opcode::FREE:
+                block->erase(inst);
+                removedFrees++;
+                break;
+            case Opcode::EQ:
+            case Opcode::NE:
+            {
+                // A fresh cell only equals itself
+                bool same = inst->operands[0] == inst->operands[1];
+                inst->replaceAllUsesWith(module.constantBool(same == (inst->op == Opcode::EQ)));
+                block->erase(inst);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+        outgoing[block] = current;
+        for (auto child : dominators.children(block))
+        {
+            work.push_back({child, current});
+        }
+    }
+
+    for (auto &[block, phi] : phis)
+    {
+        for (auto pred : block->predecessors)
+        {
+            auto value = outgoing.find(pred);
+            phi->addIncoming(value == outgoing.end() ? initial : value->second, pred);
+        }
+    }
+    alloc->parent->erase(alloc);
+
+    // Joins the cell was never read after only kept each other alive
+    bool removed = true;
+    while (removed)
+    {
+        removed = false;
+        for (auto it = phis.begin(); it != phis.end();)
+        {
+            Instruction *phi = it->second;
+            bool unused = std::all_of(phi->users.begin(), phi->users.end(), [phi](Instruction *user)
+                                      { return user == phi; });
+            if (unused)
+            {
+                phi->parent->erase(phi);
+                it = phis.erase(it);
+                removed = true;
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+}
+
+//---------HELPER FUNCTIONS----------
+std::string EscapeAnalysis::siteName(Instruction *alloc)
+{
+    return alloc->name.empty() ? "allocation " + valueName(alloc) : "allocation of '" + alloc->name + "'";
+}
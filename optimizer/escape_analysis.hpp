@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ir/dominators.hpp"
+#include "ir/ir.hpp"
+
+// Escape analysis on the SSA IR. An allocation escapes when its pointer leaves the function or could be reached
+// through something else: passed to a call or a task, returned, stored in a global or through another pointer, or
+// merged with other pointers in a phi. Every other use reads, writes, frees or compares the one cell, so the cell
+// is replaced by SSA values like a local variable, the stores become definitions, the loads their uses and phis
+// go where the stores meet. Runs after inlining so cells handed to small helpers stay in the function.
+// A pointer stored in a promoted cell stops escaping once that cell is gone, so functions are visited until
+// nothing changes
+class EscapeAnalysis
+{
+    Module &module;
+
+    // What happened to every allocation site, for the report
+    struct Decision
+    {
+        std::string function;
+        std::string site;
+        bool promoted;
+        std::string reason;
+    };
+    std::vector<Decision> decisions;
+    int promotedSites = 0;
+    int keptSites = 0;
+    int removedLoads = 0;
+    int removedFrees = 0;
+
+public:
+    EscapeAnalysis(Module &module);
+    bool run(); // True when at least one allocation was promoted
+    void printSummary();
+    void printReport(); // One line per allocation site with the decision and its reason
+
+private:
+    void visit(Function *function);
+    std::string escapes(Instruction *alloc) const; // Empty when the cell never leaves the function, otherwise why it does
+    void promote(Instruction *alloc, const DominatorTree &dominators, const std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> &frontiers);
+
+    //---------HELPER FUNCTIONS----------
+    static std::string siteName(Instruction *alloc);
+};
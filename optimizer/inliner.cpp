@@ -0,0 +1,263 @@
+#include "inliner.hpp"
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+
+// Weights of the cost model, in instructions
+static constexpr int CALL_OVERHEAD = 4;     // The call, the return and saving what lives across them
+static constexpr int ARGUMENT_OVERHEAD = 1; // Moving one argument into place
+static constexpr int CONSTANT_USE = 1;      // Each use of an argument that becomes a constant
+static constexpr int CONSTANT_BRANCH = 4;   // A compare or branch on a constant argument, likely to fold with its whole arm
+
+Inliner::Inliner(Module &module, int threshold) : module(module), threshold(threshold) {}
+
+bool Inliner::run()
+{
+    CallGraph graph(module);
+    for (const auto &component : graph.bottomUpSCCs())
+    {
+        for (auto fn : component)
+        {
+            visit(fn, graph);
+        }
+    }
+    return inlinedCalls > 0;
+}
+
+void Inliner::printSummary()
+{
+    std::cout << "[OPTIMIZER LOG]: Inlining with threshold " << threshold << " inlined " << inlinedCalls << " calls and kept "
+              << keptCalls << "\n";
+}
+
+void Inliner::printReport()
+{
+    for (const auto &decision : decisions)
+    {
+        std::cout << "[OPTIMIZER LOG]: " << (decision.inlined ? "Inlined " : "Kept ") << decision.callee << " in " << decision.caller
+                  << ": " << decision.reason << "\n";
+    }
+}
+
+// Only the calls the function had before it was visited are considered, the ones inlining brings in were
+// already weighed inside their own function
+void Inliner::visit(Function *caller, const CallGraph &graph)
+{
+    std::vector<Instruction *> calls = graph.calls(caller);
+    for (auto call : calls)
+    {
+        if (!call->parent)
+            continue; // Was in a block that became unreachable behind a callee that never returns
+        Function *callee = call->callee;
+        Decision decision{caller->name, callee->name, false, ""};
+
+        if (graph.sameSCC(caller, callee))
+        {
+            decision.reason = callee == caller ? "recursive call" : "mutually recursive with the caller";
+        }
+        else if (callee->blocks.empty())
+        {
+            decision.reason = "callee has no body";
+        }
+        else
+        {
+            Cost cost = estimate(call);
+            std::string weighed = "cost " + std::to_string(cost.total()) + " (size " + std::to_string(cost.size) + " - benefit " +
+                                  std::to_string(cost.benefit) + ")";
+            if (cost.total() > threshold)
+            {
+                decision.reason = weighed + " > " + std::to_string(threshold);
+            }
+            else if (caller->instructionCount() + cost.size > CALLER_LIMIT)
+            {
+                decision.reason = "caller would grow past " + std::to_string(CALLER_LIMIT) + " instructions";
+            }
+            else
+            {
+                decision.inlined = true;
+                decision.reason = weighed + " <= " + std::to_string(threshold);
+            }
+        }
+
+        if (decision.inlined)
+        {
+            inlineCall(call);
+            inlinedCalls++;
+        }
+        else
+        {
+            keptCalls++;
+        }
+        decisions.push_back(std::move(decision));
+    }
+}
+
+Inliner::Cost Inliner::estimate(Instruction *call) const
+{
+    Function *callee = call->callee;
+    Cost cost;
+    for (auto block : callee->blocks)
+    {
+        for (auto inst : block->instructions)
+        {
+            switch (inst->op)
+            {
+            case Opcode::PHI:
+            case Opcode::BR:
+            case Opcode::RET:
+                break; // Become moves and jumps the backends mostly fold away
+            case Opcode::CALL:
+            case Opcode::SPAWN:
+                cost.size += 1 + static_cast<int>(inst->operands.size());
+                break;
+            default:
+                cost.size++;
+            }
+        }
+    }
+
+    cost.benefit = CALL_OVERHEAD + ARGUMENT_OVERHEAD * static_cast<int>(call->operands.size());
+    for (size_t i = 0; i < call->operands.size() && i < callee->arguments.size(); ++i)
+    {
+        if (call->operands[i]->kind != ValueKind::CONSTANT)
+            continue;
+        for (auto user : callee->arguments[i]->users)
+        {
+            bool decides = user->op == Opcode::CONDBR || (user->op >= Opcode::EQ && user->op <= Opcode::GE);
+            cost.benefit += decides ? CONSTANT_BRANCH : CONSTANT_USE;
+        }
+    }
+    return cost;
+}
+
+// The block of the call is split after it, the call becomes a jump to a copy of the callee's blocks and every
+// return in the copy jumps to the second half. The result is the returned value, or a phi when there are several
+void Inliner::inlineCall(Instruction *call)
+{
+    BasicBlock *block = call->parent;
+    Function *caller = block->parent;
+    Function *callee = call->callee;
+    const Type *voidType = module.types.scalar(TypeSystem::VOID);
+
+    BasicBlock *rest = module.createBlock(caller, callee->name + ".return");
+    auto &instructions = block->instructions;
+    auto position = std::find(instructions.begin(), instructions.end(), call);
+    for (auto it = position + 1; it != instructions.end(); ++it)
+    {
+        rest->append(*it);
+    }
+    instructions.erase(position + 1, instructions.end());
+    for (auto succ : rest->successors())
+    {
+        for (auto inst : succ->instructions)
+        {
+            if (!inst->isPhi())
+                break;
+            std::replace(inst->targets.begin(), inst->targets.end(), block, rest);
+        }
+    }
+
+    std::unordered_map<Value *, Value *> mapped;
+    for (size_t i = 0; i < callee->arguments.size(); ++i)
+    {
+        mapped[callee->arguments[i]] = call->operands[i];
+    }
+    auto map = [&](Value *value) -> Value *
+    { return value->kind == ValueKind::CONSTANT ? value : mapped.at(value); };
+
+    std::unordered_map<BasicBlock *, BasicBlock *> blocks;
+    for (auto original : callee->blocks)
+    {
+        blocks[original] = module.createBlock(caller, callee->name + "." + original->label);
+    }
+
+    // The callee is in reverse post order so only phis can use a value that was not copied yet
+    std::vector<std::pair<Value *, BasicBlock *>> returns;
+    std::vector<std::pair<Instruction *, Instruction *>> phis;
+    for (auto original : callee->blocks)
+    {
+        BasicBlock *copy = blocks[original];
+        for (auto inst : original->instructions)
+        {
+            if (inst->op == Opcode::RET)
+            {
+                if (!inst->operands.empty())
+                    returns.push_back({map(inst->operands[0]), copy});
+                Instruction *jump = module.createInstruction(Opcode::BR, voidType);
+                jump->targets.push_back(rest);
+                copy->append(jump);
+                continue;
+            }
+
+            Instruction *clone = module.createInstruction(inst->op, inst->type);
+            clone->callee = inst->callee;
+            clone->raceFree = inst->raceFree;
+            clone->collected = inst->collected;
+            clone->global = inst->global;
+            clone->name = inst->name;
+            for (auto target : inst->targets)
+            {
+                clone->targets.push_back(blocks[target]);
+            }
+            if (inst->isPhi())
+            {
+                phis.push_back({inst, clone});
+            }
+            else
+            {
+                for (auto operand : inst->operands)
+                {
+                    clone->addOperand(map(operand));
+                }
+            }
+            copy->append(clone);
+            mapped[inst] = clone;
+        }
+    }
+    for (auto [original, clone] : phis)
+    {
+        for (auto operand : original->operands)
+        {
+            clone->addOperand(map(operand));
+        }
+    }
+
+    if (!call->users.empty())
+    {
+        Value *result;
+        if (returns.empty())
+        {
+            result = module.zeroOf(call->type); // The callee never returns, nothing reads this
+        }
+        else if (returns.size() == 1)
+        {
+            result = returns[0].first;
+        }
+        else
+        {
+            Instruction *phi = module.createInstruction(Opcode::PHI, call->type);
+            phi->name = call->name;
+            for (auto [value, from] : returns)
+            {
+                phi->addIncoming(value, from);
+            }
+            rest->insertPhi(phi);
+            result = phi;
+        }
+        call->replaceAllUsesWith(result);
+    }
+
+    block->erase(call);
+    Instruction *jump = module.createInstruction(Opcode::BR, voidType);
+    jump->targets.push_back(blocks[callee->entry()]);
+    block->append(jump);
+
+    caller->recomputePredecessors();
+    caller->removeUnreachableBlocks();
+    // The split leaves straight line jumps at both ends, a callee without branches folds back into one block
+    caller->mergeIntoPredecessor(blocks[callee->entry()]);
+    if (std::find(caller->blocks.begin(), caller->blocks.end(), rest) != caller->blocks.end()) // Gone when the callee never returns
+        caller->mergeIntoPredecessor(rest);
+    caller->sortBlocks();
+    caller->renumber();
+}
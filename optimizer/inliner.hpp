@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "ir/callgraph.hpp"
+#include "ir/ir.hpp"
+
+// Inlines small functions into their callers on the SSA IR.
+// Functions are visited bottom up over the strongly connected components of the call graph, so a callee has
+// already had its own calls inlined by the time its size is weighed. Calls inside a component are never
+// inlined, that way recursion can not unroll forever. A call is inlined when the callee's size minus what
+// inlining it saves stays within the threshold
+class Inliner
+{
+    Module &module;
+    int threshold;
+
+    // Why every call site was or was not inlined, for the report
+    struct Decision
+    {
+        std::string caller;
+        std::string callee;
+        bool inlined;
+        std::string reason;
+    };
+    std::vector<Decision> decisions;
+    int inlinedCalls = 0;
+    int keptCalls = 0;
+
+    struct Cost
+    {
+        int size = 0;    // Instructions the callee adds to the caller
+        int benefit = 0; // Call overhead saved plus what constant arguments are likely to fold away
+        int total() const { return size - benefit; }
+    };
+
+public:
+    static constexpr int DEFAULT_THRESHOLD = 40;
+    static constexpr size_t CALLER_LIMIT = 4000; // Callers stop growing once they have this many instructions
+
+    Inliner(Module &module, int threshold = DEFAULT_THRESHOLD);
+    bool run(); // True when at least one call was inlined
+    void printSummary();
+    void printReport(); // One line per call site with the decision and its reason
+
+private:
+    void visit(Function *caller, const CallGraph &graph);
+    Cost estimate(Instruction *call) const;
+    void inlineCall(Instruction *call);
+};
@@ -0,0 +1,458 @@
+#include "interleaver.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+#include "ir/dominators.hpp"
+#include "ir/folding.hpp"
+
+static int64_t wrap(uint64_t value) { return static_cast<int64_t>(value); }
+
+static Value *lookup(const std::unordered_map<Value *, Value *> &values, Value *value)
+{
+    auto it = values.find(value);
+    return it == values.end() ? value : it->second;
+}
+
+LoopInterleaver::LoopInterleaver(Module &module, int lanes) : module(module), lanes(lanes) {}
+
+bool LoopInterleaver::run()
+{
+    for (auto function : module.functions)
+    {
+        if (!function->blocks.empty())
+            visit(function);
+    }
+    return interleavedLoops > 0;
+}
+
+void LoopInterleaver::printSummary()
+{
+    std::cout << "[OPTIMIZER LOG]: Interleaving with " << lanes << " lanes widened " << interleavedLoops << " loops and kept " << keptLoops << "\n";
+}
+
+void LoopInterleaver::printReport()
+{
+    for (const auto &decision : decisions)
+    {
+        std::cout << "[OPTIMIZER LOG]: " << (decision.interleaved ? "Interleaved " : "Kept ") << decision.loop << " in " << decision.function << ": "
+                  << decision.reason << "\n";
+    }
+}
+
+// Widening changes the CFG so the loops are found again after every loop that was widened. Headers that were
+// already looked at are skipped, that includes the remainder loops and the wide loops themselves
+void LoopInterleaver::visit(Function *function)
+{
+    std::unordered_set<BasicBlock *> visited;
+    bool widened = true;
+    while (widened)
+    {
+        widened = false;
+        DominatorTree dominators(function);
+        LoopInfo info(function, dominators);
+        for (auto loop : info.innermostFirst())
+        {
+            if (!visited.insert(loop->header).second)
+                continue;
+            Plan plan;
+            std::string reason = analyze(loop, plan);
+            std::string name = loop->header->label + "." + std::to_string(loop->header->id);
+            if (!reason.empty())
+            {
+                decisions.push_back({function->name, name, false, reason});
+                keptLoops++;
+                continue;
+            }
+            decisions.push_back({function->name, name, true,
+                                 std::to_string(plan.reductions.size()) + (plan.reductions.size() == 1 ? " reduction" : " reductions") + " over " + std::to_string(lanes) + " lanes"});
+            interleave(plan, visited);
+            interleavedLoops++;
+            widened = true;
+            break;
+        }
+    }
+    function->renumber();
+}
+
+//---------LEGALITY----------
+std::string LoopInterleaver::analyze(Loop *loop, Plan &plan) const
+{
+    plan.loop = loop;
+    if (!loop->children.empty())
+        return "has nested loops";
+    BasicBlock *preheader = loop->preheader();
+    if (!preheader || loop->latches.size() != 1)
+        return "has no preheader or more than one latch";
+    BasicBlock *header = loop->header;
+    BasicBlock *latch = loop->latches[0];
+    std::vector<BasicBlock *> exiting = loop->exitingBlocks();
+    if (exiting.size() != 1 || exiting[0] != header)
+        return "can be left from inside its body";
+
+    Instruction *branch = header->terminator();
+    if (!branch || branch->op != Opcode::CONDBR || branch->operands[0]->kind != ValueKind::INSTRUCTION)
+        return "has no exit test";
+    plan.test = static_cast<Instruction *>(branch->operands[0]);
+    plan.continueWhenTrue = loop->contains(branch->targets[0]);
+    if (plan.test->parent != header || plan.test->op < Opcode::EQ || plan.test->op > Opcode::GE)
+        return "has no exit test";
+    for (auto inst : header->instructions)
+    {
+        if (!inst->isPhi() && inst != plan.test && inst != branch)
+            return "header does more than test the exit";
+    }
+    for (auto user : plan.test->users)
+    {
+        if (!user->parent || !loop->contains(user->parent))
+            return "exit test is used after the loop";
+    }
+
+    // The body has to be straight line code from the header back to it
+    BasicBlock *block = branch->targets[plan.continueWhenTrue ? 0 : 1];
+    size_t seen = 1;
+    while (block != header)
+    {
+        if (++seen > loop->blocks.size())
+            return "has control flow in its body";
+        for (auto inst : block->instructions)
+        {
+            if (inst->isPhi())
+                return "has control flow in its body";
+            if (inst->op == Opcode::CALL)
+                return "calls @" + inst->callee->name;
+            if (inst->op == Opcode::SPAWN || inst->op == Opcode::JOIN || inst->op == Opcode::DETACH)
+                return "starts or waits for a task";
+            if (inst->op == Opcode::STORE_GLOBAL)
+                return "stores to @" + inst->global->name;
+            // Lanes only widen reductions of values they read, writes to memory would need a dependence test first
+            if (inst->op == Opcode::STORE)
+                return "stores through a pointer or array element";
+            if (inst->op == Opcode::ALLOC || inst->op == Opcode::FREE || inst->op == Opcode::NEW_ARRAY || inst->op == Opcode::ZONE_ENTER ||
+                inst->op == Opcode::ZONE_EXIT)
+                return "allocates or frees memory";
+            if (!inst->isTerminator())
+                plan.body.push_back(inst);
+        }
+        Instruction *term = block->terminator();
+        if (term->op != Opcode::BR)
+            return "has control flow in its body";
+        block = term->targets[0];
+    }
+    if (seen != loop->blocks.size())
+        return "has control flow in its body";
+
+    // The exit test has to count a unit stride induction variable up to a bound that stays the same
+    plan.inductions = loop->inductionVariables();
+    bool counted = false;
+    for (const auto &variable : plan.inductions)
+    {
+        if (plan.test->operands[0] == variable.phi)
+        {
+            plan.compare = plan.test->op;
+            plan.bound = plan.test->operands[1];
+        }
+        else if (plan.test->operands[1] == variable.phi)
+        {
+            plan.compare = swappedComparison(plan.test->op);
+            plan.bound = plan.test->operands[0];
+        }
+        else
+        {
+            continue;
+        }
+        plan.counter = variable;
+        counted = true;
+        break;
+    }
+    if (!counted)
+        return "exit test is not on an induction variable";
+    if (!plan.continueWhenTrue)
+        plan.compare = negatedComparison(plan.compare);
+    if (plan.counter.step != 1)
+        return "counter moves by " + std::to_string(plan.counter.step) + " instead of 1";
+    if (plan.compare != Opcode::LT && plan.compare != Opcode::LE)
+        return "does not count up to a bound";
+    if (!loop->isInvariant(plan.bound))
+        return "bound changes inside the loop";
+    auto bound = integerConstant(plan.bound);
+    if (bound && *bound < INT64_MIN + (lanes - 1))
+        return "bound is too small to widen";
+    auto start = integerConstant(plan.counter.start);
+    if (bound && start)
+    {
+        __int128 trips = static_cast<__int128>(*bound) - *start + (plan.compare == Opcode::LE ? 1 : 0);
+        if (trips < 2 * lanes)
+            return "runs " + std::to_string(static_cast<int64_t>(std::max<__int128>(trips, 0))) + " iterations, too few to fill the lanes";
+    }
+
+    // Every other value carried around the loop is an induction variable or a reduction nothing else reads
+    for (auto phi : header->instructions)
+    {
+        if (!phi->isPhi())
+            break;
+        if (std::any_of(plan.inductions.begin(), plan.inductions.end(), [phi](const InductionVariable &variable) { return variable.phi == phi; }))
+            continue;
+        if (phi->scalar() == TypeSystem::FLOAT)
+            return valueName(phi) + " is a float reduction, reordering it would change the rounding";
+        if (phi->scalar() != TypeSystem::INTEGER || phi->operands.size() != 2)
+            return "carries " + valueName(phi) + " which is not a reduction";
+
+        Reduction reduction{phi, nullptr, nullptr, Opcode::ADD};
+        for (size_t i = 0; i < 2; ++i)
+        {
+            if (phi->targets[i] == preheader)
+                reduction.start = phi->operands[i];
+            else if (phi->targets[i] == latch && phi->operands[i]->kind == ValueKind::INSTRUCTION)
+                reduction.update = static_cast<Instruction *>(phi->operands[i]);
+        }
+        Instruction *update = reduction.update;
+        std::string dependence = "loop carried dependence through " + valueName(phi);
+        if (!reduction.start || !update || !update->parent || !loop->contains(update->parent))
+            return dependence;
+        bool associative = update->op == Opcode::ADD || update->op == Opcode::MUL;
+        bool onLeft = update->operands[0] == phi && update->operands[1] != phi;
+        bool onRight = update->operands[1] == phi && update->operands[0] != phi;
+        if (!(associative && (onLeft || onRight)) && !(update->op == Opcode::SUB && onLeft))
+            return dependence;
+        // Only the final value may be read, after the loop
+        size_t insideUses = std::count_if(phi->users.begin(), phi->users.end(), [loop](Instruction *user) { return user->parent && loop->contains(user->parent); });
+        if (insideUses != 1 || update->users.size() != 1 || update->users[0] != phi)
+            return dependence;
+        reduction.op = update->op;
+        plan.reductions.push_back(reduction);
+    }
+    if (plan.reductions.empty())
+        return "has no reduction to widen";
+    if (plan.body.size() * lanes > MAX_WIDE_BODY)
+        return "body is too large to copy " + std::to_string(lanes) + " times";
+    return "";
+}
+
+//---------WIDENING----------
+// The preheader now enters a wide loop whose lanes run iterations counter, counter + 1... each with its own partial
+// result of every reduction. Its test checks the last lane is still in range, counter + lanes - 1 < bound, written
+// as counter < bound - (lanes - 1) so large counters can not wrap. The subtraction wraps for bounds near the bottom
+// of the range instead, those go straight to the original loop. When the wide loop ends the partial results are
+// combined and the original loop carries on from there
+void LoopInterleaver::interleave(const Plan &plan, std::unordered_set<BasicBlock *> &visited)
+{
+    Loop *loop = plan.loop;
+    BasicBlock *header = loop->header;
+    BasicBlock *preheader = loop->preheader();
+    Function *function = header->parent;
+    const Type *intType = module.types.scalar(TypeSystem::INTEGER);
+    const Type *boolType = module.types.scalar(TypeSystem::BOOLEAN);
+    const Type *voidType = module.types.scalar(TypeSystem::VOID);
+
+    BasicBlock *wideHeader = module.createBlock(function, header->label + ".interleaved");
+    BasicBlock *wideBody = module.createBlock(function, header->label + ".interleaved.body");
+    BasicBlock *wideEnd = module.createBlock(function, header->label + ".interleaved.end");
+    BasicBlock *remainder = module.createBlock(function, header->label + ".remainder");
+    visited.insert(wideHeader);
+
+    Value *limit = emit(Opcode::SUB, intType, plan.bound, module.constantInt(lanes - 1), preheader);
+    bool guarded = !integerConstant(plan.bound);
+    Value *inRange = guarded ? emit(Opcode::GE, boolType, plan.bound, module.constantInt(INT64_MIN + (lanes - 1)), preheader) : nullptr;
+    preheader->erase(preheader->terminator());
+    Instruction *enter = module.createInstruction(guarded ? Opcode::CONDBR : Opcode::BR, voidType);
+    if (guarded)
+        enter->addOperand(inRange);
+    enter->targets.push_back(wideHeader);
+    if (guarded)
+        enter->targets.push_back(remainder);
+    preheader->append(enter);
+
+    std::vector<Instruction *> wideInductions;
+    Instruction *wideCounter = nullptr;
+    for (const auto &variable : plan.inductions)
+    {
+        Instruction *phi = module.createInstruction(Opcode::PHI, intType);
+        phi->name = variable.phi->name;
+        wideHeader->append(phi);
+        wideInductions.push_back(phi);
+        if (variable.phi == plan.counter.phi)
+            wideCounter = phi;
+    }
+    std::vector<std::vector<Instruction *>> partials;
+    for (const auto &reduction : plan.reductions)
+    {
+        std::vector<Instruction *> lanePhis;
+        for (int lane = 0; lane < lanes; ++lane)
+        {
+            Instruction *phi = module.createInstruction(Opcode::PHI, intType);
+            phi->name = reduction.phi->name;
+            wideHeader->append(phi);
+            lanePhis.push_back(phi);
+        }
+        partials.push_back(std::move(lanePhis));
+    }
+    Instruction *wideTest = module.createInstruction(plan.compare, boolType);
+    wideTest->addOperand(wideCounter);
+    wideTest->addOperand(limit);
+    wideHeader->append(wideTest);
+    Instruction *branch = module.createInstruction(Opcode::CONDBR, voidType);
+    branch->addOperand(wideTest);
+    branch->targets = {wideBody, wideEnd};
+    wideHeader->append(branch);
+
+    // One copy of the body per lane, with the induction variables of that iteration
+    std::vector<std::vector<Value *>> results(plan.reductions.size(), std::vector<Value *>(lanes));
+    for (int lane = 0; lane < lanes; ++lane)
+    {
+        std::unordered_map<Value *, Value *> mapped;
+        mapped[plan.test] = module.constantBool(plan.continueWhenTrue); // Every lane is inside the range
+        for (size_t i = 0; i < plan.inductions.size(); ++i)
+        {
+            Value *offset = module.constantInt(wrap(static_cast<uint64_t>(lane) * static_cast<uint64_t>(plan.inductions[i].step)));
+            mapped[plan.inductions[i].phi] = lane == 0 ? wideInductions[i] : emit(Opcode::ADD, intType, wideInductions[i], offset, wideBody);
+        }
+        for (size_t i = 0; i < plan.reductions.size(); ++i)
+        {
+            mapped[plan.reductions[i].phi] = partials[i][lane];
+        }
+        for (auto inst : plan.body)
+        {
+            std::vector<Value *> operands;
+            for (auto operand : inst->operands)
+            {
+                operands.push_back(lookup(mapped, operand));
+            }
+            if (Constant *folded = foldConstant(module, inst->op, operands))
+            {
+                mapped[inst] = folded;
+                continue;
+            }
+            Instruction *clone = module.createInstruction(inst->op, inst->type);
+            clone->global = inst->global;
+            clone->name = inst->name;
+            for (auto operand : operands)
+            {
+                clone->addOperand(operand);
+            }
+            wideBody->append(clone);
+            mapped[inst] = clone;
+        }
+        for (size_t i = 0; i < plan.reductions.size(); ++i)
+        {
+            results[i][lane] = lookup(mapped, plan.reductions[i].update);
+        }
+    }
+    std::vector<Value *> nextInductions;
+    for (size_t i = 0; i < plan.inductions.size(); ++i)
+    {
+        Value *stride = module.constantInt(wrap(static_cast<uint64_t>(lanes) * static_cast<uint64_t>(plan.inductions[i].step)));
+        nextInductions.push_back(emit(Opcode::ADD, intType, wideInductions[i], stride, wideBody));
+    }
+    Instruction *back = module.createInstruction(Opcode::BR, voidType);
+    back->targets.push_back(wideHeader);
+    wideBody->append(back);
+
+    for (size_t i = 0; i < plan.inductions.size(); ++i)
+    {
+        wideInductions[i]->addIncoming(plan.inductions[i].start, preheader);
+        wideInductions[i]->addIncoming(nextInductions[i], wideBody);
+    }
+    for (size_t i = 0; i < plan.reductions.size(); ++i)
+    {
+        const Reduction &reduction = plan.reductions[i];
+        Value *identity = module.constantInt(reduction.op == Opcode::MUL ? 1 : 0);
+        for (int lane = 0; lane < lanes; ++lane)
+        {
+            partials[i][lane]->addIncoming(lane == 0 ? reduction.start : identity, preheader);
+            partials[i][lane]->addIncoming(results[i][lane], wideBody);
+        }
+    }
+    removeDeadCode(wideBody);
+
+    // Subtracting lanes start from zero, so their partial results add up like the others
+    std::vector<Value *> combined;
+    for (size_t i = 0; i < plan.reductions.size(); ++i)
+    {
+        Opcode op = plan.reductions[i].op == Opcode::MUL ? Opcode::MUL : Opcode::ADD;
+        Value *total = partials[i][0];
+        for (int lane = 1; lane < lanes; ++lane)
+        {
+            total = emit(op, intType, total, partials[i][lane], wideEnd);
+        }
+        combined.push_back(total);
+    }
+    Instruction *toRemainder = module.createInstruction(Opcode::BR, voidType);
+    toRemainder->targets.push_back(remainder);
+    wideEnd->append(toRemainder);
+
+    // The original loop starts from where the wide one stopped, or from the beginning when it was skipped
+    std::unordered_map<Value *, Value *> resumed;
+    auto resume = [&](Instruction *phi, Value *start, Value *wide)
+    {
+        Instruction *merged = module.createInstruction(Opcode::PHI, phi->type);
+        merged->name = phi->name;
+        if (guarded)
+            merged->addIncoming(start, preheader);
+        merged->addIncoming(wide, wideEnd);
+        remainder->append(merged);
+        resumed[phi] = merged;
+    };
+    for (size_t i = 0; i < plan.inductions.size(); ++i)
+    {
+        resume(plan.inductions[i].phi, plan.inductions[i].start, wideInductions[i]);
+    }
+    for (size_t i = 0; i < plan.reductions.size(); ++i)
+    {
+        resume(plan.reductions[i].phi, plan.reductions[i].start, combined[i]);
+    }
+    Instruction *toHeader = module.createInstruction(Opcode::BR, voidType);
+    toHeader->targets.push_back(header);
+    remainder->append(toHeader);
+    for (auto phi : header->instructions)
+    {
+        if (!phi->isPhi())
+            break;
+        for (size_t i = 0; i < phi->operands.size(); ++i)
+        {
+            if (phi->targets[i] != preheader)
+                continue;
+            phi->setOperand(i, resumed.at(phi));
+            phi->targets[i] = remainder;
+        }
+    }
+
+    function->recomputePredecessors();
+    function->mergeIntoPredecessor(remainder);
+    function->sortBlocks();
+}
+
+//---------HELPER FUNCTIONS----------
+Value *LoopInterleaver::emit(Opcode op, const Type *type, Value *a, Value *b, BasicBlock *block)
+{
+    if (Constant *folded = foldConstant(module, op, {a, b}))
+        return folded;
+    Instruction *inst = module.createInstruction(op, type);
+    inst->addOperand(a);
+    inst->addOperand(b);
+    if (Instruction *term = block->terminator())
+        block->insertBefore(term, inst);
+    else
+        block->append(inst);
+    return inst;
+}
+
+// Lanes copy the whole body, including increments that only the original loop needed
+void LoopInterleaver::removeDeadCode(BasicBlock *block)
+{
+    bool removed = true;
+    while (removed)
+    {
+        removed = false;
+        std::vector<Instruction *> instructions = block->instructions;
+        for (auto it = instructions.rbegin(); it != instructions.rend(); ++it)
+        {
+            Instruction *inst = *it;
+            if (inst->users.empty() && !inst->hasSideEffects() && !inst->isPhi())
+            {
+                block->erase(inst);
+                removed = true;
+            }
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "ir/ir.hpp"
+#include "ir/loops.hpp"
+
+// Reduction interleaving on the SSA IR. A counted loop whose body has no side effects and whose only loop carried
+// values are induction variables and integer reductions runs its body for several consecutive iterations at once,
+// one lane per iteration with its own partial result, and the partial results are combined when the wide loop ends.
+// The original loop stays behind it to run the last iterations that do not fill every lane. There is no memory
+// dependence test, loops that store through pointers or array elements, allocate or free are kept as they are.
+// Lanes are plain scalar instructions next to each other, the IR has no vector types, so this is not SIMD by itself.
+// The backends see independent work they can schedule in parallel and only a fraction of the loop overhead
+class LoopInterleaver
+{
+    Module &module;
+    int lanes;
+
+    // Why every loop was or was not interleaved, for the report
+    struct Decision
+    {
+        std::string function;
+        std::string loop;
+        bool interleaved;
+        std::string reason;
+    };
+    std::vector<Decision> decisions;
+    int interleavedLoops = 0;
+    int keptLoops = 0;
+
+    // A value accumulated over the iterations with an associative operation, sum = sum + x or product = product * x
+    struct Reduction
+    {
+        Instruction *phi;
+        Instruction *update; // The operation feeding the phi from the latch
+        Value *start;
+        Opcode op;           // ADD, SUB or MUL
+    };
+
+    // Everything the widening needs, filled in while the loop is checked
+    struct Plan
+    {
+        Loop *loop;
+        Instruction *test;      // Exit test of the header
+        bool continueWhenTrue;  // Which side of the test stays in the loop
+        InductionVariable counter;
+        Opcode compare;         // LT or LE with the counter on the left
+        Value *bound;
+        std::vector<InductionVariable> inductions;
+        std::vector<Reduction> reductions;
+        std::vector<Instruction *> body; // Instructions copied once per lane, in order
+    };
+
+public:
+    static constexpr int DEFAULT_LANES = 4;
+    static constexpr size_t MAX_WIDE_BODY = 256; // Instructions of all lanes together
+
+    LoopInterleaver(Module &module, int lanes = DEFAULT_LANES);
+    bool run(); // True when at least one loop was interleaved
+    void printSummary();
+    void printReport(); // One line per loop with the decision and its reason
+
+private:
+    void visit(Function *function);
+    std::string analyze(Loop *loop, Plan &plan) const; // Empty when the loop can be interleaved, otherwise why not
+    void interleave(const Plan &plan, std::unordered_set<BasicBlock *> &visited);
+
+    //---------HELPER FUNCTIONS----------
+    Value *emit(Opcode op, const Type *type, Value *a, Value *b, BasicBlock *block); // Folded when it can be
+    static void removeDeadCode(BasicBlock *block);
+};
@@ -0,0 +1,832 @@
+#include "loop_optimizer.hpp"
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+#include "ir/dominators.hpp"
+#include "ir/folding.hpp"
+
+static int64_t wrap(uint64_t value) { return static_cast<int64_t>(value); }
+
+static bool isInteger(Value *value, int64_t expected)
+{
+    auto constant = integerConstant(value);
+    return constant && *constant == expected;
+}
+
+// How many times "variable op bound" holds for start, start + step, start + 2 * step... when it is a closed
+// form. The variable may not wrap around before the test fails since that would change what the test sees
+static std::optional<int64_t> countTrips(Opcode op, int64_t start, int64_t bound, int64_t step)
+{
+    if (!compareIntegers(op, start, bound))
+        return 0;
+    __int128 s = start, b = bound, d = step, trips;
+    switch (op)
+    {
+    case Opcode::LT:
+        if (d <= 0)
+            return std::nullopt;
+        trips = (b - s + d - 1) / d;
+        break;
+    case Opcode::LE:
+        if (d <= 0)
+            return std::nullopt;
+        trips = (b - s) / d + 1;
+        break;
+    case Opcode::GT:
+        if (d >= 0)
+            return std::nullopt;
+        trips = (s - b - d - 1) / -d;
+        break;
+    case Opcode::GE:
+        if (d >= 0)
+            return std::nullopt;
+        trips = (s - b) / -d + 1;
+        break;
+    case Opcode::NE:
+        if (d == 0 || (b - s) % d != 0 || (b - s) / d < 0)
+            return std::nullopt;
+        trips = (b - s) / d;
+        break;
+    default: // EQ holds at the start and never again
+        if (d == 0)
+            return std::nullopt;
+        trips = 1;
+    }
+    __int128 last = s + trips * d;
+    if (last < INT64_MIN || last > INT64_MAX)
+        return std::nullopt;
+    return static_cast<int64_t>(trips);
+}
+
+LoopOptimizer::LoopOptimizer(Module &module, LoopOptions options) : module(module), options(options), purity(module) {}
+
+bool LoopOptimizer::run()
+{
+    for (auto function : module.functions)
+    {
+        optimizeFunction(function);
+    }
+    return changed;
+}
+
+void LoopOptimizer::printSummary()
+{
+    std::cout << "[OPTIMIZER LOG]: Loop optimization found " << loopsFound << " loops, hoisted " << hoisted << " invariant instructions ("
+              << hoistedCalls << " calls, " << hoistedLoads << " loads), merged "
+              << mergedVariables << " and removed " << deadVariables << " dead induction variables, replaced " << exitValues << " exit values, reduced "
+              << reducedMultiplies << " multiplies, fully unrolled " << unrolledLoops << " loops and removed " << removedChecks << " bounds checks\n";
+}
+
+// Every transformation works on fresh analyses since the ones before it may have moved code or blocks
+void LoopOptimizer::optimizeFunction(Function *function)
+{
+    if (function->blocks.empty())
+        return;
+
+    {
+        DominatorTree dominators(function);
+        LoopInfo info(function, dominators);
+        if (info.size() == 0)
+            return;
+        loopsFound += info.size();
+        bool inserted = false;
+        for (auto loop : info.innermostFirst())
+        {
+            inserted |= insertPreheader(loop);
+        }
+        if (inserted)
+            function->sortBlocks();
+    }
+
+    auto forEachLoop = [function](auto &&transform)
+    {
+        DominatorTree dominators(function);
+        LoopInfo info(function, dominators);
+        for (auto loop : info.innermostFirst())
+        {
+            transform(loop);
+        }
+    };
+
+    // Unrolling goes first, there is no point in optimizing a loop that is about to disappear. It changes the
+    // CFG so the loops are found again after each one
+    if (options.unroll)
+    {
+        bool unrolled = true;
+        while (unrolled)
+        {
+            unrolled = false;
+            DominatorTree dominators(function);
+            LoopInfo info(function, dominators);
+            for (auto loop : info.innermostFirst())
+            {
+                if (unroll(loop))
+                {
+                    unrolled = true;
+                    break;
+                }
+            }
+        }
+    }
+    if (options.licm)
+        forEachLoop([this](Loop *loop) { hoistInvariants(loop); });
+    // After LICM so the length of an argument array is the same value in the loop test and in the checks.
+    // Only instructions go, so one dominator tree serves every loop
+    if (options.boundsChecks)
+    {
+        DominatorTree dominators(function);
+        LoopInfo info(function, dominators);
+        for (auto loop : info.innermostFirst())
+        {
+            eliminateBoundsChecks(loop, dominators);
+        }
+    }
+    if (options.inductionVariables)
+        forEachLoop([this](Loop *loop) { simplifyInductionVariables(loop); });
+    if (options.strengthReduction)
+        forEachLoop([this](Loop *loop) { reduceStrength(loop); });
+    function->renumber();
+}
+
+// Gives the loop a block that jumps to the header and nowhere else. The header's phis take what enters the loop
+// from it, merged in a phi of the preheader when several blocks enter
+bool LoopOptimizer::insertPreheader(Loop *loop)
+{
+    if (loop->preheader())
+        return false;
+    BasicBlock *header = loop->header;
+    std::vector<BasicBlock *> outside;
+    for (auto pred : header->predecessors)
+    {
+        if (!loop->contains(pred))
+            outside.push_back(pred);
+    }
+    if (outside.empty())
+        return false;
+
+    Function *function = header->parent;
+    BasicBlock *preheader = module.createBlock(function, header->label + ".preheader");
+    for (auto pred : outside)
+    {
+        Instruction *term = pred->terminator();
+        std::replace(term->targets.begin(), term->targets.end(), header, preheader);
+    }
+
+    for (auto inst : header->instructions)
+    {
+        if (!inst->isPhi())
+            break;
+        std::vector<std::pair<Value *, BasicBlock *>> entering;
+        for (size_t i = inst->operands.size(); i-- > 0;)
+        {
+            if (loop->contains(inst->targets[i]))
+                continue;
+            entering.insert(entering.begin(), {inst->operands[i], inst->targets[i]});
+            inst->removeOperand(i);
+        }
+        bool same = std::all_of(entering.begin(), entering.end(), [&](const auto &input) { return input.first == entering[0].first; });
+        Value *value = entering[0].first;
+        if (!same)
+        {
+            Instruction *merged = module.createInstruction(Opcode::PHI, inst->type);
+            merged->name = inst->name;
+            for (auto [incoming, from] : entering)
+            {
+                merged->addIncoming(incoming, from);
+            }
+            preheader->insertPhi(merged);
+            value = merged;
+        }
+        inst->addIncoming(value, preheader);
+    }
+
+    Instruction *jump = module.createInstruction(Opcode::BR, module.types.scalar(TypeSystem::VOID));
+    jump->targets.push_back(header);
+    preheader->append(jump);
+    function->recomputePredecessors();
+    changed = true;
+    return true;
+}
+
+//---------LOOP INVARIANT CODE MOTION----------
+// Only instructions that can run when the loop would not have are moved, the preheader runs them even if the
+// body never does. Integer division traps on zero so it needs a constant divisor
+bool LoopOptimizer::isHoistable(Instruction *inst, Loop *loop) const
+{
+    switch (inst->op)
+    {
+    case Opcode::ADD:
+    case Opcode::SUB:
+    case Opcode::MUL:
+    case Opcode::NEG:
+    case Opcode::EQ:
+    case Opcode::NE:
+    case Opcode::LT:
+    case Opcode::GT:
+    case Opcode::LE:
+    case Opcode::GE:
+    case Opcode::NOT:
+    case Opcode::CONCAT:
+    case Opcode::ITOF:
+        break;
+    case Opcode::DIV:
+    case Opcode::MOD:
+        if (mayTrap(inst))
+            return false;
+        break;
+    case Opcode::ELEMENT:
+        break; // Only computes the address, nothing is read
+    case Opcode::LENGTH:
+    {
+        // Reads the block of the array, like loads only arguments are sure to have one before the loop
+        Value *array = inst->operands[0];
+        if (array->kind != ValueKind::ARGUMENT || std::any_of(array->users.begin(), array->users.end(), [](Instruction *user) { return user->op == Opcode::FREE; }))
+            return false;
+        break;
+    }
+    default:
+        return false;
+    }
+    return std::all_of(inst->operands.begin(), inst->operands.end(), [loop](Value *operand) { return loop->isInvariant(operand); });
+}
+
+// The call may run even on paths that would have skipped it, so it can not trap, loop forever or store anything
+bool LoopOptimizer::isHoistableCall(Instruction *call, Loop *loop) const
+{
+    if (purity.purity(call->callee) == Purity::IMPURE || !purity.alwaysReturns(call->callee))
+        return false;
+    return std::all_of(call->operands.begin(), call->operands.end(), [loop](Value *operand) { return loop->isInvariant(operand); });
+}
+
+// The load runs before the loop even when the loop body would not, so the pointer has to be valid there. Arguments
+// are for the whole call unless the function frees them itself
+bool LoopOptimizer::isHoistableLoad(Instruction *load, Loop *loop, const std::vector<Value *> &written) const
+{
+    Value *pointer = load->operands[0];
+    if (pointer->kind != ValueKind::ARGUMENT || !loop->isInvariant(pointer))
+        return false;
+    if (std::any_of(pointer->users.begin(), pointer->users.end(), [](Instruction *user) { return user->op == Opcode::FREE; }))
+        return false;
+    return std::none_of(written.begin(), written.end(), [pointer](Value *other) { return mayAlias(pointer, other); });
+}
+
+// The blocks are in reverse post order, an instruction is seen after everything it uses that could be hoisted
+bool LoopOptimizer::hoistInvariants(Loop *loop)
+{
+    BasicBlock *preheader = loop->preheader();
+    if (!preheader)
+        return false;
+
+    // Loads are invariant unless something in the loop may store to the global, which any impure call could.
+    // Stores and frees through pointers never touch a global but may touch the cell of another pointer
+    std::unordered_set<GlobalVariable *> stored;
+    std::vector<Value *> written;
+    bool calls = false;
+    for (auto block : loop->blocks)
+    {
+        for (auto inst : block->instructions)
+        {
+            if (inst->op == Opcode::STORE_GLOBAL)
+                stored.insert(inst->global);
+            else if (inst->op == Opcode::STORE || inst->op == Opcode::FREE)
+                written.push_back(inst->operands[0]);
+            else
+                calls |= purity.writesMemory(inst);
+        }
+    }
+
+    Instruction *position = preheader->terminator();
+    int before = hoisted;
+    for (auto block : loop->blocks)
+    {
+        std::vector<Instruction *> instructions = block->instructions;
+        for (auto inst : instructions)
+        {
+            bool invariant;
+            if (inst->op == Opcode::LOAD_GLOBAL)
+                invariant = !calls && !stored.count(inst->global);
+            else if (inst->op == Opcode::LOAD)
+                invariant = !calls && isHoistableLoad(inst, loop, written);
+            else if (inst->op == Opcode::CALL)
+                invariant = isHoistableCall(inst, loop) && (purity.purity(inst->callee) == Purity::PURE || (!calls && stored.empty() && written.empty()));
+            else
+                invariant = isHoistable(inst, loop);
+            if (!invariant)
+                continue;
+            // Inlining leaves invariant math on constant arguments, that needs no instruction at all
+            if (Constant *folded = foldInstruction(module, inst))
+            {
+                inst->replaceAllUsesWith(folded);
+                block->erase(inst);
+                hoisted++;
+                continue;
+            }
+            block->remove(inst);
+            preheader->insertBefore(position, inst);
+            hoisted++;
+            hoistedCalls += inst->op == Opcode::CALL;
+            hoistedLoads += inst->op == Opcode::LOAD;
+        }
+    }
+    changed |= hoisted > before;
+    return hoisted > before;
+}
+
+//---------BOUNDS CHECK ELIMINATION----------
+// A check is dropped when the header test keeps its index in range for every block the test guards. The
+// index has to be an induction variable counting up from a constant, plus or minus a constant, and the test
+// has to compare it against the length of the array or a constant that fits in it
+bool LoopOptimizer::eliminateBoundsChecks(Loop *loop, const DominatorTree &dominators)
+{
+    BasicBlock *header = loop->header;
+    Instruction *branch = header->terminator();
+    if (!branch || branch->op != Opcode::CONDBR || branch->operands[0]->kind != ValueKind::INSTRUCTION)
+        return false;
+    auto test = static_cast<Instruction *>(branch->operands[0]);
+    if (test->op < Opcode::EQ || test->op > Opcode::GE || loop->contains(branch->targets[0]) == loop->contains(branch->targets[1]))
+        return false;
+    bool continueWhenTrue = loop->contains(branch->targets[0]);
+    BasicBlock *body = branch->targets[continueWhenTrue ? 0 : 1];
+    if (body->predecessors.size() != 1)
+        return false; // Some other way into the body skips the test
+
+    std::vector<InductionVariable> variables = loop->inductionVariables();
+    if (variables.empty())
+        return false;
+    int before = removedChecks;
+    for (auto block : loop->blocks)
+    {
+        if (!dominators.dominates(body, block))
+            continue;
+        std::vector<Instruction *> instructions = block->instructions;
+        for (auto inst : instructions)
+        {
+            if (inst->op == Opcode::CHECK_BOUNDS && isInRange(inst->operands[0], inst->operands[1], test, continueWhenTrue, variables))
+            {
+                block->erase(inst);
+                removedChecks++;
+            }
+        }
+    }
+    changed |= removedChecks > before;
+    return removedChecks > before;
+}
+
+// Lengths are far below the largest int, so a variable that stays below one can take small steps without wrapping
+bool LoopOptimizer::isInRange(Value *index, Value *length, Instruction *test, bool continueWhenTrue, const std::vector<InductionVariable> &variables) const
+{
+    // i + c, c + i and i - c
+    Value *base = index;
+    int64_t offset = 0;
+    if (index->kind == ValueKind::INSTRUCTION)
+    {
+        auto inst = static_cast<Instruction *>(index);
+        bool add = inst->op == Opcode::ADD, sub = inst->op == Opcode::SUB;
+        for (size_t i = 0; i < 2 && (add || sub) && base == index; ++i)
+        {
+            auto constant = integerConstant(inst->operands[1 - i]);
+            if (!constant || (sub && i == 1))
+                continue;
+            base = inst->operands[i];
+            offset = sub ? wrap(0 - static_cast<uint64_t>(*constant)) : *constant;
+        }
+    }
+    if (offset < INT32_MIN || offset > INT32_MAX)
+        return false;
+
+    for (const auto &variable : variables)
+    {
+        if (variable.phi != base)
+            continue;
+        Opcode op = test->op;
+        Value *bound;
+        if (test->operands[0] == variable.phi)
+        {
+            bound = test->operands[1];
+        }
+        else if (test->operands[1] == variable.phi)
+        {
+            bound = test->operands[0];
+            op = swappedComparison(op);
+        }
+        else
+        {
+            return false;
+        }
+        if (!continueWhenTrue)
+            op = negatedComparison(op);
+
+        // The variable never goes below where it starts
+        auto start = integerConstant(variable.start);
+        if (!start || variable.step <= 0 || variable.step > INT32_MAX || *start < -offset)
+            return false;
+
+        // The largest index the body sees is bound + slack - 1, it has to be below the length
+        int64_t slack;
+        if (op == Opcode::LT)
+            slack = offset;
+        else if (op == Opcode::LE)
+            slack = offset + 1;
+        else
+            return false;
+        if (bound == length)
+            return slack <= 0;
+        auto boundValue = integerConstant(bound);
+        auto lengthValue = integerConstant(length);
+        if (boundValue && lengthValue)
+            return static_cast<__int128>(*boundValue) + slack <= *lengthValue;
+        // len(a) - c and len(a) + -c
+        if (bound->kind != ValueKind::INSTRUCTION)
+            return false;
+        auto reduced = static_cast<Instruction *>(bound);
+        if (reduced->operands.size() != 2 || reduced->operands[0] != length)
+            return false;
+        auto amount = integerConstant(reduced->operands[1]);
+        if (!amount || *amount < INT32_MIN || *amount > INT32_MAX)
+            return false;
+        if (reduced->op == Opcode::SUB)
+            return slack - *amount <= 0;
+        if (reduced->op == Opcode::ADD)
+            return slack + *amount <= 0;
+        return false;
+    }
+    return false;
+}
+
+//---------INDUCTION VARIABLES----------
+// The header must be the only way out and test one induction variable against a constant, then the value of
+// every induction variable when the loop exits is known too
+std::optional<int64_t> LoopOptimizer::tripCount(Loop *loop) const
+{
+    BasicBlock *header = loop->header;
+    std::vector<BasicBlock *> exiting = loop->exitingBlocks();
+    if (exiting.size() != 1 || exiting[0] != header)
+        return std::nullopt;
+    Instruction *branch = header->terminator();
+    if (!branch || branch->op != Opcode::CONDBR || branch->operands[0]->kind != ValueKind::INSTRUCTION)
+        return std::nullopt;
+    bool continueWhenTrue = loop->contains(branch->targets[0]);
+    auto test = static_cast<Instruction *>(branch->operands[0]);
+    if (test->parent != header || test->op < Opcode::EQ || test->op > Opcode::GE)
+        return std::nullopt;
+
+    for (const auto &variable : loop->inductionVariables())
+    {
+        Opcode op = test->op;
+        Value *bound;
+        if (test->operands[0] == variable.phi)
+        {
+            bound = test->operands[1];
+        }
+        else if (test->operands[1] == variable.phi)
+        {
+            bound = test->operands[0];
+            op = swappedComparison(op);
+        }
+        else
+        {
+            continue;
+        }
+        auto start = integerConstant(variable.start);
+        auto limit = integerConstant(bound);
+        if (!start || !limit)
+            return std::nullopt;
+        return countTrips(continueWhenTrue ? op : negatedComparison(op), *start, *limit, variable.step);
+    }
+    return std::nullopt;
+}
+
+// Three cleanups: two variables that start at the same value and take the same steps are one, a variable read
+// after the loop is a constant once the trip count is, and a variable only feeding its own increment is dead
+bool LoopOptimizer::simplifyInductionVariables(Loop *loop)
+{
+    std::vector<InductionVariable> variables = loop->inductionVariables();
+    if (variables.empty())
+        return false;
+    BasicBlock *header = loop->header;
+    bool simplified = false;
+
+    std::vector<InductionVariable> kept;
+    for (const auto &variable : variables)
+    {
+        auto same = std::find_if(kept.begin(), kept.end(), [&](const InductionVariable &other)
+                                 { return other.start == variable.start && other.step == variable.step; });
+        if (same == kept.end())
+        {
+            kept.push_back(variable);
+            continue;
+        }
+        // The increment stays, it now adds to the surviving phi and may have users of its own
+        variable.phi->replaceAllUsesWith(same->phi);
+        header->erase(variable.phi);
+        if (variable.increment->users.empty())
+            variable.increment->parent->erase(variable.increment);
+        mergedVariables++;
+        simplified = true;
+    }
+
+    if (auto trips = tripCount(loop))
+    {
+        for (const auto &variable : kept)
+        {
+            auto start = integerConstant(variable.start);
+            if (!start)
+                continue;
+            Constant *last = module.constantInt(wrap(static_cast<uint64_t>(*start) + static_cast<uint64_t>(*trips) * static_cast<uint64_t>(variable.step)));
+            std::vector<Instruction *> users = variable.phi->users;
+            for (auto user : users)
+            {
+                if (!user->parent || loop->contains(user->parent))
+                    continue;
+                for (size_t i = 0; i < user->operands.size(); ++i)
+                {
+                    if (user->operands[i] == variable.phi)
+                        user->setOperand(i, last);
+                }
+                exitValues++;
+                simplified = true;
+            }
+        }
+    }
+
+    for (const auto &variable : kept)
+    {
+        const auto &phiUsers = variable.phi->users;
+        const auto &incrementUsers = variable.increment->users;
+        if (phiUsers.size() != 1 || phiUsers[0] != variable.increment || incrementUsers.size() != 1 || incrementUsers[0] != variable.phi)
+            continue;
+        header->erase(variable.phi);
+        variable.increment->parent->erase(variable.increment);
+        deadVariables++;
+        simplified = true;
+    }
+    changed |= simplified;
+    return simplified;
+}
+
+//---------STRENGTH REDUCTION----------
+// i * c with i an induction variable and c invariant is a variable of its own, it starts at start * c and moves
+// by step * c. One new variable serves every multiply by the same factor
+bool LoopOptimizer::reduceStrength(Loop *loop)
+{
+    BasicBlock *preheader = loop->preheader();
+    if (!preheader || loop->latches.size() != 1)
+        return false;
+    BasicBlock *latch = loop->latches[0];
+    const Type *intType = module.types.scalar(TypeSystem::INTEGER);
+    bool reduced = false;
+
+    for (const auto &variable : loop->inductionVariables())
+    {
+        std::unordered_map<Value *, Instruction *> products;
+        std::vector<Instruction *> users = variable.phi->users;
+        for (auto user : users)
+        {
+            if (user->op != Opcode::MUL || user->scalar() != TypeSystem::INTEGER || !user->parent || !loop->contains(user->parent))
+                continue;
+            Value *factor = user->operands[0] == variable.phi ? user->operands[1] : user->operands[0];
+            if (factor == variable.phi || !loop->isInvariant(factor))
+                continue;
+
+            Instruction *&product = products[factor];
+            if (!product)
+            {
+                Value *start = multiply(variable.start, factor, preheader);
+                Value *step = multiply(module.constantInt(variable.step), factor, preheader);
+                product = module.createInstruction(Opcode::PHI, intType);
+                Instruction *next = module.createInstruction(Opcode::ADD, intType);
+                next->addOperand(product);
+                next->addOperand(step);
+                // Next to the increment of the variable it follows, which is known to reach the latch
+                BasicBlock *block = variable.increment->parent;
+                auto position = std::find(block->instructions.begin(), block->instructions.end(), variable.increment);
+                block->insertBefore(*(position + 1), next);
+                product->addIncoming(start, preheader);
+                product->addIncoming(next, latch);
+                loop->header->insertPhi(product);
+            }
+            user->replaceAllUsesWith(product);
+            user->parent->erase(user);
+            reducedMultiplies++;
+            reduced = true;
+        }
+    }
+    changed |= reduced;
+    return reduced;
+}
+
+Value *LoopOptimizer::multiply(Value *a, Value *b, BasicBlock *block)
+{
+    if (Constant *folded = foldConstant(module, Opcode::MUL, {a, b}))
+        return folded;
+    if (isInteger(a, 1))
+        return b;
+    if (isInteger(b, 1))
+        return a;
+    if (isInteger(a, 0) || isInteger(b, 0))
+        return module.constantInt(0);
+    Instruction *product = module.createInstruction(Opcode::MUL, module.types.scalar(TypeSystem::INTEGER));
+    product->addOperand(a);
+    product->addOperand(b);
+    block->insertBefore(block->terminator(), product);
+    return product;
+}
+
+//---------UNROLLING----------
+// The loop is replaced by one copy of its blocks per trip, chained where the latch jumped back, and a last copy
+// of the header that leaves. The induction variables are constants in every copy so most of the copied
+// instructions fold while they are made, and so do the branches that depended on them
+bool LoopOptimizer::unroll(Loop *loop)
+{
+    if (!loop->children.empty() || loop->latches.size() != 1 || loop->latches[0] == loop->header)
+        return false;
+    Instruction *backEdge = loop->latches[0]->terminator();
+    BasicBlock *preheader = loop->preheader();
+    if (!backEdge || backEdge->op != Opcode::BR)
+        return false;
+    auto trips = tripCount(loop);
+    if (!preheader || !trips || *trips > UNROLL_MAX_TRIPS || loop->instructionCount() * (*trips + 1) > UNROLL_MAX_SIZE)
+        return false;
+
+    BasicBlock *header = loop->header;
+    BasicBlock *latch = loop->latches[0];
+    Function *function = header->parent;
+    Instruction *test = header->terminator();
+    BasicBlock *body = loop->contains(test->targets[0]) ? test->targets[0] : test->targets[1];
+    BasicBlock *exit = body == test->targets[0] ? test->targets[1] : test->targets[0];
+    const Type *voidType = module.types.scalar(TypeSystem::VOID);
+
+    auto lookup = [](const std::unordered_map<Value *, Value *> &values, Value *value)
+    {
+        auto it = values.find(value);
+        return it == values.end() ? value : it->second;
+    };
+
+    std::unordered_map<Value *, Value *> previous, current; // What every value of the loop became in a copy
+    std::vector<BasicBlock *> copies;
+    std::vector<Instruction *> branches;
+    Instruction *entering = preheader->terminator(); // Jumps to the header until the next copy exists
+    BasicBlock *lastHeader = nullptr;
+
+    for (int64_t trip = 0; trip <= *trips; ++trip)
+    {
+        bool last = trip == *trips;
+        current.clear();
+        for (auto phi : header->instructions)
+        {
+            if (!phi->isPhi())
+                break;
+            for (size_t i = 0; i < phi->operands.size(); ++i)
+            {
+                if (trip == 0 && phi->targets[i] == preheader)
+                    current[phi] = phi->operands[i];
+                else if (trip > 0 && phi->targets[i] == latch)
+                    current[phi] = lookup(previous, phi->operands[i]);
+            }
+        }
+
+        std::unordered_map<BasicBlock *, BasicBlock *> blocks;
+        for (auto block : loop->blocks)
+        {
+            if (last && block != header)
+                continue;
+            blocks[block] = module.createBlock(function, block->label + ".trip" + std::to_string(trip));
+            copies.push_back(blocks[block]);
+        }
+        std::replace(entering->targets.begin(), entering->targets.end(), header, blocks[header]);
+        lastHeader = blocks[header];
+
+        for (auto block : loop->blocks)
+        {
+            auto found = blocks.find(block);
+            if (found == blocks.end())
+                continue;
+            BasicBlock *copy = found->second;
+            for (auto inst : block->instructions)
+            {
+                if (block == header && inst->isPhi())
+                    continue;
+                if (inst == test)
+                {
+                    Instruction *jump = module.createInstruction(Opcode::BR, voidType);
+                    jump->targets.push_back(last ? exit : blocks.at(body));
+                    copy->append(jump);
+                    continue;
+                }
+
+                std::vector<Value *> operands;
+                for (auto operand : inst->operands)
+                {
+                    operands.push_back(lookup(current, operand));
+                }
+                if (!inst->isPhi())
+                {
+                    if (Constant *folded = foldConstant(module, inst->op, operands))
+                    {
+                        current[inst] = folded;
+                        continue;
+                    }
+                }
+                // Each trip knows its index, the checks that pass for it are not copied
+                if (inst->op == Opcode::CHECK_BOUNDS)
+                {
+                    auto index = integerConstant(operands[0]);
+                    auto length = integerConstant(operands[1]);
+                    if (index && length && *index >= 0 && *index < *length)
+                    {
+                        removedChecks++;
+                        continue;
+                    }
+                }
+
+                Instruction *clone = module.createInstruction(inst->op, inst->type);
+                clone->callee = inst->callee;
+                clone->raceFree = inst->raceFree;
+                clone->collected = inst->collected;
+                clone->global = inst->global;
+                clone->name = inst->name;
+                for (auto operand : operands)
+                {
+                    clone->addOperand(operand);
+                }
+                for (auto target : inst->targets)
+                {
+                    // Only the latch jumps to the header, that edge goes to the next copy
+                    clone->targets.push_back(inst->isTerminator() && target == header ? header : blocks.at(target));
+                }
+                if (inst == backEdge)
+                    entering = clone;
+                if (clone->op == Opcode::CONDBR)
+                    branches.push_back(clone);
+                copy->append(clone);
+                current[inst] = clone;
+            }
+        }
+        std::swap(previous, current);
+    }
+
+    // The loop is left from the last copy of the header now, with the values of the last trip
+    for (auto phi : exit->instructions)
+    {
+        if (!phi->isPhi())
+            break;
+        for (size_t i = 0; i < phi->operands.size(); ++i)
+        {
+            if (phi->targets[i] != header)
+                continue;
+            phi->setOperand(i, lookup(previous, phi->operands[i]));
+            phi->targets[i] = lastHeader;
+        }
+    }
+    for (auto inst : header->instructions)
+    {
+        std::vector<Instruction *> users = inst->users;
+        for (auto user : users)
+        {
+            if (!user->parent || loop->contains(user->parent))
+                continue;
+            for (size_t i = 0; i < user->operands.size(); ++i)
+            {
+                if (user->operands[i] == inst)
+                    user->setOperand(i, lookup(previous, inst));
+            }
+        }
+    }
+
+    for (auto block : loop->blocks)
+    {
+        for (auto inst : block->instructions)
+        {
+            inst->dropOperands();
+            inst->parent = nullptr;
+        }
+        block->instructions.clear();
+    }
+    function->blocks.erase(std::remove_if(function->blocks.begin(), function->blocks.end(), [loop](BasicBlock *block) { return loop->contains(block); }),
+                           function->blocks.end());
+
+    // Branches on a folded condition only keep the side they take
+    for (auto branch : branches)
+    {
+        Value *condition = branch->operands[0];
+        if (condition->kind != ValueKind::CONSTANT || static_cast<Constant *>(condition)->value.type != TypeSystem::BOOLEAN)
+            continue;
+        bool taken = static_cast<Constant *>(condition)->value.boolValue;
+        branch->parent->jumpTo(branch->targets[taken ? 0 : 1]);
+    }
+
+    function->recomputePredecessors();
+    function->removeUnreachableBlocks();
+    // The copies are a chain of straight line jumps that fold back into as few blocks as the body had branches
+    copies.push_back(exit);
+    for (auto block : copies)
+    {
+        if (std::find(function->blocks.begin(), function->blocks.end(), block) != function->blocks.end())
+            function->mergeIntoPredecessor(block);
+    }
+    function->sortBlocks();
+    unrolledLoops++;
+    changed = true;
+    return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "ir/ir.hpp"
+#include "ir/loops.hpp"
+#include "ir/purity.hpp"
+
+// Which loop transformations run, each one has its own command line flag
+struct LoopOptions
+{
+    bool licm = true;               // Hoist loop invariant instructions into the preheader
+    bool inductionVariables = true; // Merge equal induction variables, fold their exit values and drop dead ones
+    bool strengthReduction = false; // Multiplies of an induction variable become additions, the extra phi costs the VM and
+                                    // the template backend as much as the multiply it saves so it is opt in
+    bool unroll = true;             // Fully unroll short loops with a constant trip count
+    bool boundsChecks = true;       // Drop the bounds checks of array indexes the loop test keeps in range
+};
+
+// Loop optimizations on the SSA IR. Every loop first gets a preheader, a block that only jumps to the header,
+// where hoisted code and the starting values of new induction variables go. Loops are visited innermost first
+// so code hoisted out of an inner loop keeps moving out of the loops around it
+class LoopOptimizer
+{
+    Module &module;
+    LoopOptions options;
+    PurityAnalysis purity; // Calls to functions that never store and always return can move like arithmetic
+
+    // Statistics for the summary
+    bool changed = false;
+    int loopsFound = 0;
+    int hoisted = 0;
+    int hoistedCalls = 0;
+    int hoistedLoads = 0;
+    int mergedVariables = 0;
+    int deadVariables = 0;
+    int exitValues = 0;
+    int reducedMultiplies = 0;
+    int unrolledLoops = 0;
+    int removedChecks = 0;
+
+public:
+    static constexpr int64_t UNROLL_MAX_TRIPS = 8;
+    static constexpr size_t UNROLL_MAX_SIZE = 96; // Instructions of all the unrolled copies together
+
+    LoopOptimizer(Module &module, LoopOptions options);
+    bool run(); // True when any function changed
+    void printSummary();
+
+private:
+    void optimizeFunction(Function *function);
+    bool insertPreheader(Loop *loop);
+    bool hoistInvariants(Loop *loop);
+    bool simplifyInductionVariables(Loop *loop);
+    bool reduceStrength(Loop *loop);
+    bool unroll(Loop *loop);
+    bool eliminateBoundsChecks(Loop *loop, const DominatorTree &dominators);
+
+    //---------HELPER FUNCTIONS----------
+    std::optional<int64_t> tripCount(Loop *loop) const; // Times the body runs when the exit test of the header makes it a constant
+    bool isHoistable(Instruction *inst, Loop *loop) const;
+    bool isHoistableCall(Instruction *call, Loop *loop) const;
+    bool isHoistableLoad(Instruction *load, Loop *loop, const std::vector<Value *> &written) const;
+    bool isInRange(Value *index, Value *length, Instruction *test, bool continueWhenTrue, const std::vector<InductionVariable> &variables) const;
+    Value *multiply(Value *a, Value *b, BasicBlock *block); // Folded when it can be, otherwise placed before the terminator
+};
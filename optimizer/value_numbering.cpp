@@ -0,0 +1,301 @@
+#include "value_numbering.hpp"
+#include <algorithm>
+#include <iostream>
+#include "ir/dominators.hpp"
+#include "ir/folding.hpp"
+
+bool ValueNumbering::Expression::operator==(const Expression &other) const
+{
+    return op == other.op && type == other.type && operands == other.operands && incoming == other.incoming && extra == other.extra &&
+           generation == other.generation;
+}
+
+size_t ValueNumbering::ExpressionHash::operator()(const Expression &expression) const
+{
+    size_t hash = std::hash<uint64_t>()(static_cast<uint64_t>(expression.op) ^ (expression.generation << 8));
+    auto combine = [&hash](const void *pointer) { hash ^= std::hash<const void *>()(pointer) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2); };
+    combine(expression.type);
+    combine(expression.extra);
+    for (auto operand : expression.operands)
+    {
+        combine(operand);
+    }
+    for (auto block : expression.incoming)
+    {
+        combine(block);
+    }
+    return hash;
+}
+
+ValueNumbering::ValueNumbering(Module &module) : module(module), purity(module) {}
+
+bool ValueNumbering::run()
+{
+    for (auto function : module.functions)
+    {
+        visit(function);
+        removeDeadCode(function);
+        function->renumber();
+    }
+    return redundant + folded + deadInstructions > 0;
+}
+
+void ValueNumbering::printSummary()
+{
+    std::cout << "[OPTIMIZER LOG]: Value numbering replaced " << redundant << " redundant instructions (" << redundantCalls << " calls, "
+              << redundantLoads << " loads of which " << forwardedStores << " read a stored value), folded " << folded
+              << " constants and removed " << deadInstructions << " dead instructions\n";
+    std::cout << "[OPTIMIZER LOG]: Purity analysis found " << purity.count(Purity::PURE) << " pure and " << purity.count(Purity::READONLY)
+              << " read only functions\n";
+}
+
+// Preorder walk of the dominator tree. The table only ever holds expressions of blocks dominating the current one,
+// what a block adds is taken out again once the walk is done with everything it dominates
+void ValueNumbering::visit(Function *function)
+{
+    if (function->blocks.empty())
+        return;
+    DominatorTree dominators(function);
+    Table table;
+    std::vector<Expression> added;
+    uint64_t generations = 0;
+
+    struct Scope
+    {
+        BasicBlock *block;
+        size_t nextChild;
+        size_t firstAdded;
+        uint64_t generation; // At the end of the block, where its children start
+    };
+    std::vector<Scope> stack;
+
+    auto enter = [&](BasicBlock *block, uint64_t generation)
+    {
+        // A block with one predecessor runs right after its dominator, with several a store may be on some path in between
+        if (block->predecessors.size() != 1)
+            generation = ++generations;
+        size_t firstAdded = added.size();
+
+        std::vector<Instruction *> instructions = block->instructions;
+        for (auto inst : instructions)
+        {
+            if (Constant *constant = foldInstruction(module, inst))
+            {
+                inst->replaceAllUsesWith(constant);
+                block->erase(inst);
+                folded++;
+                continue;
+            }
+            if (inst->isPhi())
+            {
+                if (Value *value = trivialPhiValue(inst))
+                {
+                    inst->replaceAllUsesWith(value);
+                    block->erase(inst);
+                    redundant++;
+                    continue;
+                }
+            }
+            if (purity.writesMemory(inst))
+                generation = ++generations;
+
+            // Until the next store a load of the same global gives back the stored value
+            if (inst->op == Opcode::STORE_GLOBAL && inst->operands[0]->type == inst->global->type)
+            {
+                Expression load{Opcode::LOAD_GLOBAL, inst->global->type, {}, {}, inst->global, generation};
+                table[load] = inst->operands[0];
+                added.push_back(std::move(load));
+                continue;
+            }
+            // Same through a pointer, a store through any other pointer starts a new generation
+            if (inst->op == Opcode::STORE && inst->operands[0]->type->element == inst->operands[1]->type)
+            {
+                Expression load{Opcode::LOAD, inst->operands[1]->type, {inst->operands[0]}, {}, nullptr, generation};
+                table[load] = inst->operands[1];
+                added.push_back(std::move(load));
+                continue;
+            }
+
+            // An array keeps the length it was made with
+            if (inst->op == Opcode::NEW_ARRAY)
+            {
+                Expression length{Opcode::LENGTH, inst->operands[0]->type, {inst}, {}, nullptr, 0};
+                table[length] = inst->operands[0];
+                added.push_back(std::move(length));
+                continue;
+            }
+
+            Expression expression;
+            if (!expressionOf(inst, generation, expression))
+                continue;
+            auto it = table.find(expression);
+            if (it == table.end())
+            {
+                table.emplace(expression, inst);
+                added.push_back(std::move(expression));
+                continue;
+            }
+
+            if (inst->op == Opcode::CALL)
+                redundantCalls++;
+            if (inst->op == Opcode::LOAD_GLOBAL || inst->op == Opcode::LOAD)
+            {
+                redundantLoads++;
+                if (it->second->kind != ValueKind::INSTRUCTION || static_cast<Instruction *>(it->second)->op != inst->op)
+                    forwardedStores++;
+            }
+            inst->replaceAllUsesWith(it->second);
+            block->erase(inst);
+            redundant++;
+        }
+        stack.push_back({block, 0, firstAdded, generation});
+    };
+
+    enter(function->entry(), 0);
+    while (!stack.empty())
+    {
+        Scope &scope = stack.back();
+        const auto &children = dominators.children(scope.block);
+        if (scope.nextChild < children.size())
+        {
+            BasicBlock *child = children[scope.nextChild++];
+            enter(child, scope.generation);
+            continue;
+        }
+        while (added.size() > scope.firstAdded)
+        {
+            table.erase(added.back());
+            added.pop_back();
+        }
+        stack.pop_back();
+    }
+}
+
+bool ValueNumbering::expressionOf(Instruction *inst, uint64_t generation, Expression &expression) const
+{
+    expression = Expression{inst->op, inst->type, inst->operands, {}, nullptr, 0};
+    switch (inst->op)
+    {
+    case Opcode::ADD:
+    case Opcode::MUL:
+    case Opcode::EQ:
+    case Opcode::NE:
+        // Commutative, the order only has to be the same for both
+        if (expression.operands[0] > expression.operands[1])
+            std::swap(expression.operands[0], expression.operands[1]);
+        return true;
+    case Opcode::GT:
+    case Opcode::GE:
+        expression.op = swappedComparison(inst->op);
+        std::swap(expression.operands[0], expression.operands[1]);
+        return true;
+    case Opcode::SUB:
+    case Opcode::DIV:
+    case Opcode::MOD:
+    case Opcode::NEG:
+    case Opcode::LT:
+    case Opcode::LE:
+    case Opcode::NOT:
+    case Opcode::CONCAT:
+    case Opcode::ITOF:
+        return true;
+    case Opcode::PHI:
+        // Phis of the same block that merge the same values along the same edges
+        expression.incoming = inst->targets;
+        expression.extra = inst->parent;
+        return true;
+    case Opcode::LOAD_GLOBAL:
+        expression.extra = inst->global;
+        expression.generation = generation;
+        return true;
+    case Opcode::LOAD:
+        expression.generation = generation;
+        return true;
+    case Opcode::CALL:
+        if (purity.purity(inst->callee) == Purity::IMPURE)
+            return false;
+        expression.extra = inst->callee;
+        if (purity.purity(inst->callee) == Purity::READONLY)
+            expression.generation = generation;
+        return true;
+    case Opcode::JOIN:
+        // A task finishes once, waiting for it again gives the same result whatever ran in between
+        return true;
+    case Opcode::LENGTH:
+    case Opcode::ELEMENT:
+    case Opcode::CHECK_BOUNDS:
+        // An array never changes its length, and a check that passed once passes again for the same index
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Replaced instructions may have been the only users of what they computed, and pure calls whose result
+// nobody reads are left over from the source
+void ValueNumbering::removeDeadCode(Function *function)
+{
+    std::vector<Instruction *> worklist;
+    for (auto block : function->blocks)
+    {
+        for (auto inst : block->instructions)
+        {
+            if (isUnused(inst) && isRemovable(inst))
+                worklist.push_back(inst);
+        }
+    }
+    while (!worklist.empty())
+    {
+        Instruction *inst = worklist.back();
+        worklist.pop_back();
+        if (!inst->parent)
+            continue; // Already removed through another path
+        std::vector<Value *> operands = inst->operands;
+        std::vector<Instruction *> detaches = inst->users;
+        for (auto detach : detaches)
+        {
+            detach->parent->erase(detach); // A task that never started leaves no record behind
+        }
+        inst->parent->erase(inst);
+        deadInstructions++;
+        for (auto operand : operands)
+        {
+            if (operand->kind != ValueKind::INSTRUCTION)
+                continue;
+            auto used = static_cast<Instruction *>(operand);
+            if (used->parent && isUnused(used) && isRemovable(used))
+                worklist.push_back(used);
+        }
+    }
+}
+
+//---------HELPER FUNCTIONS----------
+bool ValueNumbering::isRemovable(Instruction *inst) const
+{
+    // A proven task nobody waits on goes like a call whose result is unused, its spawn follows once the wait is gone
+    Function *callee = inst->op == Opcode::CALL ? inst->callee : PurityAnalysis::raceFreeTask(inst);
+    if (callee)
+        return purity.purity(callee) != Purity::IMPURE && purity.alwaysReturns(callee);
+    if (inst->op == Opcode::CHECK_BOUNDS)
+        return !mayTrap(inst); // Folding left a constant index inside a constant length
+    return !inst->hasSideEffects() && !mayTrap(inst);
+}
+
+bool ValueNumbering::isUnused(Instruction *inst)
+{
+    return std::all_of(inst->users.begin(), inst->users.end(), [](Instruction *user) { return user->op == Opcode::DETACH; });
+}
+
+Value *ValueNumbering::trivialPhiValue(Instruction *phi)
+{
+    Value *value = nullptr;
+    for (auto operand : phi->operands)
+    {
+        if (operand == phi || operand == value)
+            continue;
+        if (value)
+            return nullptr;
+        value = operand;
+    }
+    return value;
+}
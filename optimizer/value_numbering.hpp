@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "ir/ir.hpp"
+#include "ir/purity.hpp"
+
+// Dominator based value numbering on the SSA IR. The dominator tree is walked from the entry with a scoped table
+// of the expressions computed so far, an instruction that computes an expression already in the table is
+// replaced by the earlier one, which dominates it. Pure calls are expressions like any other, calls and loads
+// that read globals only match while nothing in between may have stored to them
+class ValueNumbering
+{
+    Module &module;
+    PurityAnalysis purity;
+
+    // Statistics for the summary
+    int redundant = 0;
+    int redundantCalls = 0;
+    int redundantLoads = 0;
+    int forwardedStores = 0;
+    int folded = 0;
+    int deadInstructions = 0;
+
+    // What an instruction computes, two instructions with equal expressions give the same value
+    struct Expression
+    {
+        Opcode op;
+        const Type *type;
+        std::vector<Value *> operands;
+        std::vector<BasicBlock *> incoming; // Phis only
+        const void *extra = nullptr; // The callee, the global, or the block of a phi
+        uint64_t generation = 0;     // State of the globals and the allocator heap for loads and calls that read them, 0 when it does not matter
+
+        bool operator==(const Expression &other) const;
+    };
+    struct ExpressionHash
+    {
+        size_t operator()(const Expression &expression) const;
+    };
+    using Table = std::unordered_map<Expression, Value *, ExpressionHash>;
+
+public:
+    ValueNumbering(Module &module);
+    bool run(); // True when any function changed
+    void printSummary();
+
+private:
+    void visit(Function *function);
+    bool expressionOf(Instruction *inst, uint64_t generation, Expression &expression) const; // False for values that can not be shared
+    void removeDeadCode(Function *function);
+
+    //---------HELPER FUNCTIONS----------
+    bool isRemovable(Instruction *inst) const; // Unused it could go without anyone noticing
+    static bool isUnused(Instruction *inst);   // Nothing reads it, the detach of a spawn nobody waits on doesn't count
+    static Value *trivialPhiValue(Instruction *phi); // The single value a phi merges, nullptr when there are several
+};
@@ -7,7 +7,7 @@
 using namespace std;
 
 //--------------PARSER CLASS CONSTRUCTOR-------------
-Parser::Parser(vector<Token> &tokenInput) : tokenInput(tokenInput), currentPos(0), nextPos(1)
+Parser::Parser(vector<Token> &tokenInput, Diagnostics &diagnostics) : tokenInput(tokenInput), currentPos(0), nextPos(1), diagnostics(diagnostics)
 {
     lastToken = tokenInput.empty() ? Token{"", TokenType::ILLEGAL, 999, 999} : tokenInput[0];
     registerInfixFns();
@@ -20,7 +20,7 @@ vector<unique_ptr<Node>> Parser::parseProgram()
 {
     vector<unique_ptr<Node>> program;
 
-    while (currentPos < tokenInput.size())
+    while (currentPos < tokenInput.size() && !diagnostics.shouldAbort())
     {
         cout << "Parsing token: " << currentToken().TokenLiteral << endl;
         Token current = currentToken();
@@ -85,7 +85,7 @@ unique_ptr<Statement> Parser::parseStatement()
         }
         else
         {
-            logError("Expected ';' after expression statement");
+            logError("Expected ';' after expression statement", DiagnosticCode::EXPECTED_SEMICOLON);
             return nullptr;
         }
 
@@ -93,7 +93,7 @@ unique_ptr<Statement> Parser::parseStatement()
         return make_unique<ExpressionStatement>(current, move(expr));
     }
 
-    logError("Unexpected token at start of statement:  ");
+    // parseExpression already reported why the statement could not start here
     advance();
     return nullptr;
 }
@@ -113,14 +113,21 @@ unique_ptr<Statement> Parser::parseAssignmentStatement(bool isParam)
     advance();
 
     unique_ptr<Expression> value = parseExpression(Precedence::PREC_NONE);
-
-    if (!isParam && currentToken().type == TokenType::SEMICOLON)
+    if (!value)
     {
-        advance();
+        return nullptr;
     }
-    else
+
+    if (!isParam)
     {
-        logError("Expected a semi colon ");
+        if (currentToken().type == TokenType::SEMICOLON)
+        {
+            advance();
+        }
+        else
+        {
+            logError("Expected a semi colon ", DiagnosticCode::EXPECTED_SEMICOLON);
+        }
     }
 
     return make_unique<AssignmentStatement>(ident_token, move(value));
@@ -129,9 +136,25 @@ unique_ptr<Statement> Parser::parseAssignmentStatement(bool isParam)
 // Parsing let statements that have data types
 unique_ptr<Statement> Parser::parseLetStatementWithType(bool isParam)
 {
-    Token dataType_token = currentToken();
+    optional<Token> fixed_token;
+    optional<Token> gc_token;
+    optional<Token> unique_token;
+    optional<Token> access_token;
+    while (currentToken().type == TokenType::CONSTANT || currentToken().type == TokenType::GC || currentToken().type == TokenType::UNIQUE ||
+           currentToken().type == TokenType::READ || currentToken().type == TokenType::WRITE)
+    {
+        auto &modifier = currentToken().type == TokenType::CONSTANT ? fixed_token
+                         : currentToken().type == TokenType::GC     ? gc_token
+                         : currentToken().type == TokenType::UNIQUE ? unique_token
+                                                                    : access_token;
+        if (modifier)
+            logError("Repeated '" + currentToken().TokenLiteral + "' on a variable", DiagnosticCode::UNEXPECTED_TOKEN);
+        modifier = currentToken();
+        advance();
+    }
+
+    Token dataType_token = parseDataType();
     cout << "[DEBUG] Data type token: " + dataType_token.TokenLiteral << endl;
-    advance();
 
     if (currentToken().type != TokenType::IDENTIFIER)
     {
@@ -157,16 +180,19 @@ unique_ptr<Statement> Parser::parseLetStatementWithType(bool isParam)
         cout << "[DEBUG] Encountered semicolon token" << endl;
     }
 
-    if (!isParam && currentToken().type == TokenType::SEMICOLON)
+    if (!isParam)
     {
-        advance();
-    }
-    else
-    {
-        logError("Expected a semi colon");
+        if (currentToken().type == TokenType::SEMICOLON)
+        {
+            advance();
+        }
+        else
+        {
+            logError("Expected a semi colon", DiagnosticCode::EXPECTED_SEMICOLON);
+        }
     }
 
-    return make_unique<LetStatement>(dataType_token, ident_token, assign_token, move(value));
+    return make_unique<LetStatement>(dataType_token, ident_token, assign_token, move(value), fixed_token, gc_token, unique_token, access_token);
 }
 
 /*Decider on type of let statement: Now the name of this function is confusing initially I wanted it to be the function that decides how to parse let statements.
@@ -181,6 +207,11 @@ std::unique_ptr<Statement> Parser::parseLetStatementDecider()
         current.type == TokenType::STRING_KEYWORD ||
         current.type == TokenType::CHAR_KEYWORD ||
         current.type == TokenType::BOOL_KEYWORD ||
+        current.type == TokenType::POINTER ||
+        current.type == TokenType::ARRAY ||
+        current.type == TokenType::UNIQUE ||
+        current.type == TokenType::READ ||
+        current.type == TokenType::WRITE ||
         current.type == TokenType::AUTO)
     {
         // TODO: Will add support for functions as parameters later for now will only supoort simple parameters
@@ -194,7 +225,7 @@ std::unique_ptr<Statement> Parser::parseLetStatementDecider()
             return parseAssignmentStatement(true);
         }
     }
-    std::cerr << "[ERROR]: Failed to decide how to parse parameter variable. Token: " << current.TokenLiteral << "\n";
+    logError("Failed to decide how to parse parameter variable. Token: " + current.TokenLiteral, DiagnosticCode::UNEXPECTED_TOKEN);
     return nullptr;
 }
 
@@ -222,15 +253,27 @@ std::unique_ptr<Statement> Parser::parseSignalStatement()
         return nullptr;
     }
     advance();
+    if (currentToken().type != TokenType::IDENTIFIER)
+    {
+        logError("Expected the call of a work function after start(");
+        return nullptr;
+    }
     auto func_name = parseIdentifier();
     auto func_arg = parseCallExpression(std::move(func_name));
+    if (!func_arg)
+        return nullptr;
+    if (currentToken().type != TokenType::RPAREN)
+    {
+        logError("Expected ) after the started call but got " + currentToken().TokenLiteral);
+        return nullptr;
+    }
     advance();
     if (currentToken().type != TokenType::SEMICOLON)
     {
-        cout << "[ERROR]: Expected ; after ) but got->" << currentToken().TokenLiteral << "\n";
-        logError("Expected ; after )");
+        logError("Expected ; after ) but got " + currentToken().TokenLiteral, DiagnosticCode::EXPECTED_SEMICOLON);
         return nullptr;
     }
+    advance();
 
     return make_unique<SignalStatement>(signal_token, std::move(ident), std::move(start), std::move(func_arg));
 }
@@ -263,9 +306,10 @@ std::unique_ptr<Statement> Parser::parseWaitStatement()
     advance();
     if (currentToken().type != TokenType::SEMICOLON)
     {
-        logError("Expected ; after )");
+        logError("Expected ; after )", DiagnosticCode::EXPECTED_SEMICOLON);
         return nullptr;
     }
+    advance();
     return make_unique<WaitStatement>(wait, std::move(call));
 }
 
@@ -327,7 +371,7 @@ unique_ptr<Statement> Parser::parseForStatement()
 
     if (currentToken().type != TokenType::SEMICOLON)
     {
-        logError("Expected ';' after condition");
+        logError("Expected ';' after condition", DiagnosticCode::EXPECTED_SEMICOLON);
         return nullptr;
     }
     advance(); // skip ';'
@@ -377,6 +421,45 @@ unique_ptr<Statement> Parser::parseWhileStatement()
     return make_unique<WhileStatement>(while_key, move(condition), move(result));
 }
 
+// Parsing zone blocks like zone { ... }
+unique_ptr<Statement> Parser::parseZoneStatement()
+{
+    Token zone_token = currentToken();
+    advance();
+    auto body = parseBlockStatement();
+    if (!body)
+        return nullptr;
+    return make_unique<ZoneStatement>(zone_token, move(body));
+}
+
+// Parsing unsafe blocks like unsafe { ... }
+unique_ptr<Statement> Parser::parseUnsafeStatement()
+{
+    Token unsafe_token = currentToken();
+    advance();
+    auto body = parseBlockStatement();
+    if (!body)
+        return nullptr;
+    return make_unique<UnsafeStatement>(unsafe_token, move(body));
+}
+
+// Parsing free statements like free p;
+unique_ptr<Statement> Parser::parseFreeStatement()
+{
+    Token free_token = currentToken();
+    advance();
+    auto value = parseExpression(Precedence::PREC_NONE);
+    if (!value)
+        return nullptr;
+    if (currentToken().type != TokenType::SEMICOLON)
+    {
+        logError("Expected ; after the freed pointer", DiagnosticCode::EXPECTED_SEMICOLON);
+        return nullptr;
+    }
+    advance();
+    return make_unique<FreeStatement>(free_token, move(value));
+}
+
 // Parse break statement
 std::unique_ptr<Statement> Parser::parseBreakStatement()
 {
@@ -481,7 +564,7 @@ unique_ptr<Expression> Parser::parseExpression(Precedence precedence)
 
     if (PrefixParseFnIt == PrefixParseFunctionsMap.end()) // Checking if the iterator has reached the end of the map
     {
-        cerr << "[ERROR] No prefix parse function for token: " << currentToken().TokenLiteral << endl;
+        logError("No prefix parse function for token: " + currentToken().TokenLiteral, DiagnosticCode::UNEXPECTED_TOKEN);
         return nullptr;
     }
 
@@ -527,6 +610,86 @@ unique_ptr<Expression> Parser::parsePrefixExpression()
     return make_unique<PrefixExpression>(operat, move(operand));
 }
 
+// Parsing alloc(int), alloc(int, n) and make(value)
+unique_ptr<Expression> Parser::parseAllocExpression()
+{
+    Token alloc_token = currentToken();
+    advance();
+    if (currentToken().type != TokenType::LPAREN)
+    {
+        logError("Expected ( after " + alloc_token.TokenLiteral);
+        return nullptr;
+    }
+    advance();
+
+    optional<Token> data_type_token;
+    unique_ptr<Expression> value = nullptr;
+    unique_ptr<Expression> count = nullptr;
+    if (alloc_token.type == TokenType::ALLOCATE)
+        data_type_token = parseDataType();
+    else
+        value = parseExpression(Precedence::PREC_NONE);
+
+    if (data_type_token && currentToken().type == TokenType::COMMA)
+    {
+        advance();
+        count = parseExpression(Precedence::PREC_NONE);
+        if (!count)
+            return nullptr;
+    }
+
+    if (currentToken().type != TokenType::RPAREN)
+    {
+        logError("Expected ) after " + alloc_token.TokenLiteral + " argument");
+        return nullptr;
+    }
+    advance();
+    return make_unique<AllocExpression>(alloc_token, data_type_token, move(value), move(count));
+}
+
+// Parsing a[i], the array is whatever came before the bracket
+unique_ptr<Expression> Parser::parseIndexExpression(unique_ptr<Expression> left)
+{
+    Token lbracket = currentToken();
+    advance();
+    auto index = parseExpression(Precedence::PREC_NONE);
+    if (!index)
+        return nullptr;
+    if (currentToken().type != TokenType::RBRACKET)
+    {
+        logError("Expected ] after the index");
+        return nullptr;
+    }
+    advance();
+    return make_unique<IndexExpression>(move(left), lbracket, move(index));
+}
+
+// Parsing [1, 2, 3]
+unique_ptr<Expression> Parser::parseArrayLiteral()
+{
+    Token lbracket = currentToken();
+    advance();
+    vector<unique_ptr<Expression>> elements;
+    while (currentToken().type != TokenType::RBRACKET)
+    {
+        auto element = parseExpression(Precedence::PREC_NONE);
+        if (!element)
+            return nullptr;
+        elements.push_back(move(element));
+        if (currentToken().type == TokenType::COMMA)
+        {
+            advance();
+        }
+        else if (currentToken().type != TokenType::RBRACKET)
+        {
+            logError("Expected , or ] in the array literal");
+            return nullptr;
+        }
+    }
+    advance();
+    return make_unique<ArrayLiteral>(lbracket, move(elements));
+}
+
 // Integer literal parse function
 unique_ptr<Expression> Parser::parseIntegerLiteral()
 {
@@ -575,7 +738,6 @@ unique_ptr<Expression> Parser::parseGroupedExpression()
 
     if (currentToken().type == TokenType::RPAREN)
     {
-        std::cerr << "[ERROR] Empty grouped expression after '('\n";
         logError("Empty grouped expression after '('");
         return nullptr;
     }
@@ -583,14 +745,12 @@ unique_ptr<Expression> Parser::parseGroupedExpression()
     auto expr = parseExpression(Precedence::PREC_NONE);
     if (!expr)
     {
-        std::cerr << "[ERROR] Failed to parse expression inside grouped expr.\n";
         logError("Empty grouped expression after '('");
         return nullptr;
     }
 
     if (currentToken().type != TokenType::RPAREN)
     {
-        std::cerr << "[ERROR] Expected ')' to close grouped expression, got: " << currentToken().TokenLiteral << endl;
         logError("Expected ')' to close grouped expression ");
         return nullptr;
     }
@@ -631,7 +791,7 @@ vector<unique_ptr<Expression>> Parser::parseCallArguments()
     auto firstArg = parseExpression(Precedence::PREC_NONE);
     if (!firstArg)
     {
-        cerr << "Failed to parse first function argument.\n";
+        cout << "[DEBUG] Failed to parse first function argument.\n";
         return args;
     }
     args.push_back(std::move(firstArg));
@@ -642,7 +802,7 @@ vector<unique_ptr<Expression>> Parser::parseCallArguments()
         auto arg = parseExpression(Precedence::PREC_NONE);
         if (!arg)
         {
-            cerr << "Failed to parse function argument after comma.\n";
+            cout << "[DEBUG] Failed to parse function argument after comma.\n";
             return args;
         }
         args.push_back(std::move(arg));
@@ -674,7 +834,8 @@ unique_ptr<Expression> Parser::parseFunctionExpression()
         logError("Expected function name after keyword work");
         return nullptr;
     }
-    auto func_name = parseIdentifier();
+    Token func_name = currentToken();
+    advance();
 
     //---Dealing with the call itself
     auto call = parseFunctionParameters(); // We might get some arguments or not so we call the parse call expression
@@ -692,8 +853,9 @@ unique_ptr<Expression> Parser::parseFunctionExpression()
         case TokenType::BOOL_KEYWORD:
         case TokenType::AUTO:
         case TokenType::VOID:
-            return_type = make_unique<ReturnTypeExpression>(currentToken());
-            advance();
+        case TokenType::POINTER:
+        case TokenType::ARRAY:
+            return_type = make_unique<ReturnTypeExpression>(parseDataType());
             break;
         default:
             logError("Unexpected return type: ");
@@ -706,11 +868,11 @@ unique_ptr<Expression> Parser::parseFunctionExpression()
     auto block = parseBlockExpression(); // Parsing the blocks
     if (!block)
     {
-        cerr << "[ERROR] Failed to parse function body.\n";
+        cout << "[DEBUG] Failed to parse function body.\n";
         return nullptr;
     }
 
-    return make_unique<FunctionExpression>(func_tok, move(call), move(return_type), move(block));
+    return make_unique<FunctionExpression>(func_tok, func_name, move(call), move(return_type), move(block));
 }
 
 // Parsing function patamemters
@@ -744,7 +906,7 @@ vector<unique_ptr<Statement>> Parser::parseFunctionParameters()
 
     if (!firstParam)
     { // Checking if it failed to parse the 1st parameter
-        cerr << "Failed to parse first parameter.\n";
+        cout << "[DEBUG] Failed to parse first parameter.\n";
         return args;
     }
     args.push_back(move(firstParam)); // If its parsed we add it to the vector
@@ -755,7 +917,7 @@ vector<unique_ptr<Statement>> Parser::parseFunctionParameters()
         auto arg = parseLetStatementDecider(); // Parse the second parameter
         if (!arg)
         { // It it fails to parse the second parameter
-            cerr << "Failed to parse parameter after comma\n";
+            cout << "[DEBUG] Failed to parse parameter after comma\n";
             return args;
         }
         args.push_back(move(arg));
@@ -790,7 +952,7 @@ unique_ptr<Expression> Parser::parseBlockExpression()
     auto block = make_unique<BlockExpression>(lbrace);
     while (currentToken().type != TokenType::RBRACE)
     {
-        if (currentToken().type == TokenType::END)
+        if (currentToken().type == TokenType::END || diagnostics.shouldAbort())
         {
             logError("Unterminated block experession");
             return nullptr;
@@ -834,7 +996,7 @@ unique_ptr<Statement> Parser::parseBlockStatement()
     advance();
     vector<unique_ptr<Statement>> statements;
 
-    while (currentToken().type != TokenType::RBRACE && currentToken().type != TokenType::END)
+    while (currentToken().type != TokenType::RBRACE && currentToken().type != TokenType::END && !diagnostics.shouldAbort())
     {
         auto stmt = parseStatement();
         if (stmt != nullptr)
@@ -843,7 +1005,7 @@ unique_ptr<Statement> Parser::parseBlockStatement()
         }
         else
         {
-            cerr << "[ERROR] Failed to parse statement within block. Skipping token: " << currentToken().TokenLiteral << endl;
+            cout << "[DEBUG] Failed to parse statement within block. Skipping token: " << currentToken().TokenLiteral << endl;
             advance();
         }
     }
@@ -860,6 +1022,55 @@ unique_ptr<Statement> Parser::parseBlockStatement()
 }
 
 //----------HELPER FUNCTIONS---------------
+// Reads a data type, pointer and array types come back as one token whose literal is the whole type like
+// pointer<int> or arr<int, 4>
+Token Parser::parseDataType()
+{
+    Token dataType = currentToken();
+    advance();
+    if (dataType.type != TokenType::POINTER && dataType.type != TokenType::ARRAY)
+        return dataType;
+
+    std::string name = dataType.TokenLiteral;
+    if (currentToken().type != TokenType::LESS_THAN)
+    {
+        logError("Expected < after " + name);
+        return dataType;
+    }
+    advance();
+    Token element = parseDataType();
+
+    // Fixed size arrays give their length after the element type
+    std::string length;
+    if (dataType.type == TokenType::ARRAY && currentToken().type == TokenType::COMMA)
+    {
+        advance();
+        if (currentToken().type != TokenType::INTEGER)
+        {
+            logError("Expected the length of the array after ,");
+            return dataType;
+        }
+        length = ", " + currentToken().TokenLiteral;
+        advance();
+    }
+    dataType.TokenLiteral = name + "<" + element.TokenLiteral + length + ">";
+
+    // The lexer reads the end of pointer<pointer<int>> as >>, the inner type takes one half of it
+    if (currentToken().type == TokenType::SHIFT_RIGHT)
+    {
+        tokenInput[currentPos].type = TokenType::GREATER_THAN;
+        tokenInput[currentPos].TokenLiteral = ">";
+        return dataType;
+    }
+    if (currentToken().type != TokenType::GREATER_THAN)
+    {
+        logError("Expected > to close the " + name + " type");
+        return dataType;
+    }
+    advance();
+    return dataType;
+}
+
 // Slider function
 void Parser::advance()
 {
@@ -891,6 +1102,7 @@ void Parser::registerInfixFns()
     InfixParseFunctionsMap[TokenType::EQUALS] = &Parser::parseInfixExpression;
     InfixParseFunctionsMap[TokenType::ASSIGN] = &Parser::parseInfixExpression;
     InfixParseFunctionsMap[TokenType::LPAREN] = &Parser::parseCallExpression;
+    InfixParseFunctionsMap[TokenType::LBRACKET] = &Parser::parseIndexExpression;
 }
 
 // Registering prefix functions for a particular token type
@@ -909,6 +1121,12 @@ void Parser::registerPrefixFns()
     PrefixParseFunctionsMap[TokenType::LBRACE] = &Parser::parseBlockExpression;
     PrefixParseFunctionsMap[TokenType::PLUS_PLUS] = &Parser::parsePrefixExpression;
     PrefixParseFunctionsMap[TokenType::MINUS_MINUS] = &Parser::parsePrefixExpression;
+    PrefixParseFunctionsMap[TokenType::ASTERISK] = &Parser::parsePrefixExpression;
+    PrefixParseFunctionsMap[TokenType::ELEVATE] = &Parser::parsePrefixExpression;
+    PrefixParseFunctionsMap[TokenType::ALLOCATE] = &Parser::parseAllocExpression;
+    PrefixParseFunctionsMap[TokenType::MAKE] = &Parser::parseAllocExpression;
+    PrefixParseFunctionsMap[TokenType::LBRACKET] = &Parser::parseArrayLiteral;
+    PrefixParseFunctionsMap[TokenType::LENGTH] = &Parser::parsePrefixExpression;
 }
 
 // Wrapper function for letstatement with type
@@ -930,6 +1148,8 @@ void Parser::registerStatementParseFns()
     StatementParseFunctionsMap[TokenType::SIGNAL] = &Parser::parseSignalStatement;
     StatementParseFunctionsMap[TokenType::START] = &Parser::parseStartStatement;
     StatementParseFunctionsMap[TokenType::WAIT] = &Parser::parseWaitStatement;
+    StatementParseFunctionsMap[TokenType::ZONE] = &Parser::parseZoneStatement;
+    StatementParseFunctionsMap[TokenType::UNSAFE] = &Parser::parseUnsafeStatement;
     StatementParseFunctionsMap[TokenType::INT] = &Parser::parseLetStatementWithTypeWrapper;
     StatementParseFunctionsMap[TokenType::FLOAT_KEYWORD] = &Parser::parseLetStatementWithTypeWrapper;
     StatementParseFunctionsMap[TokenType::STRING_KEYWORD] = &Parser::parseLetStatementWithTypeWrapper;
@@ -937,6 +1157,14 @@ void Parser::registerStatementParseFns()
     StatementParseFunctionsMap[TokenType::CHAR_KEYWORD]=&Parser::parseLetStatementWithTypeWrapper;
     StatementParseFunctionsMap[TokenType::FUNCTION]=&Parser::parseFunctionStatement;
     StatementParseFunctionsMap[TokenType::AUTO] = &Parser::parseLetStatementWithTypeWrapper;
+    StatementParseFunctionsMap[TokenType::CONSTANT] = &Parser::parseLetStatementWithTypeWrapper;
+    StatementParseFunctionsMap[TokenType::GC] = &Parser::parseLetStatementWithTypeWrapper;
+    StatementParseFunctionsMap[TokenType::UNIQUE] = &Parser::parseLetStatementWithTypeWrapper;
+    StatementParseFunctionsMap[TokenType::READ] = &Parser::parseLetStatementWithTypeWrapper;
+    StatementParseFunctionsMap[TokenType::WRITE] = &Parser::parseLetStatementWithTypeWrapper;
+    StatementParseFunctionsMap[TokenType::POINTER] = &Parser::parseLetStatementWithTypeWrapper;
+    StatementParseFunctionsMap[TokenType::ARRAY] = &Parser::parseLetStatementWithTypeWrapper;
+    StatementParseFunctionsMap[TokenType::DROP] = &Parser::parseFreeStatement;
 }
 
 // Precedence getting function
@@ -961,19 +1189,10 @@ Token Parser::nextToken()
 }
 
 // Error logging
-void Parser::logError(const std::string &message)
+void Parser::logError(const std::string &message, const char *code)
 {
     Token token = getErrorToken();
-    if (token.line == 0 && token.column == 0)
-    {
-        std::cerr << "[PANIC]: Logging an uninitialized token! Investigate token flow.\n";
-    }
-    std::cerr << "[PARSER ERROR]: " << message << " At line: " << token.line << " column: " << token.column << "\n";
-    errors.push_back(
-        ParseError{
-            message,
-            token.line,
-            token.column});
+    diagnostics.error(code, Diagnostics::rangeOf(token), message);
 }
 
 // Getting the error token
@@ -1,15 +1,11 @@
+#pragma once
 #include "token/token.hpp"
 #include "ast.hpp"
+#include "diagnostics/diagnostics.hpp"
 #include <string>
 #include <vector>
 #include <map>
 
-struct ParseError{
-    std::string message;
-    int line;
-    int column;
-};
-
 class Parser
 {
     std::vector<Token> tokenInput;
@@ -31,19 +27,24 @@ class Parser
         {TokenType::MINUS, Precedence::PREC_TERM},
         {TokenType::ASTERISK, Precedence::PREC_FACTOR},
         {TokenType::DIVIDE, Precedence::PREC_FACTOR},
+        {TokenType::MODULUS, Precedence::PREC_FACTOR},
         {TokenType::BANG, Precedence::PREC_UNARY},
         {TokenType::MINUS_MINUS,Precedence::PREC_UNARY},
         {TokenType::PLUS_PLUS,Precedence::PREC_UNARY},
+        {TokenType::ELEVATE,Precedence::PREC_UNARY},
+        {TokenType::LENGTH,Precedence::PREC_UNARY},
         {TokenType::FULLSTOP, Precedence::PREC_CALL},
         {TokenType::LPAREN,Precedence::PREC_CALL},
+        {TokenType::LBRACKET,Precedence::PREC_CALL},
         {TokenType::IDENTIFIER, Precedence::PREC_PRIMARY},
     };
 
     Token lastToken;
+    Diagnostics &diagnostics;
 
 public:
     // Parser class declaration
-    Parser(std::vector<Token> &tokenInput);
+    Parser(std::vector<Token> &tokenInput, Diagnostics &diagnostics);
     // Main parser program
     std::vector<std::unique_ptr<Node>> parseProgram();
 
@@ -69,7 +70,6 @@ public:
     std::map<TokenType, infixParseFns> InfixParseFunctionsMap;
     
     std::map<TokenType, stmtParseFns> StatementParseFunctionsMap;
-    std::vector<ParseError> errors;
 
 private:
     //---------------PARSING STATEMENTS--------------------
@@ -109,6 +109,15 @@ private:
     //Parsing while loops
     std::unique_ptr<Statement>parseWhileStatement();
 
+    //Parsing zone blocks
+    std::unique_ptr<Statement> parseZoneStatement();
+
+    //Parsing unsafe blocks
+    std::unique_ptr<Statement> parseUnsafeStatement();
+
+    //Parsing free statements
+    std::unique_ptr<Statement> parseFreeStatement();
+
     //Parsing break statement
     std::unique_ptr<Statement> parseBreakStatement();
 
@@ -140,6 +149,15 @@ private:
     // Parsing grouped expressions
     std::unique_ptr<Expression> parseGroupedExpression();
 
+    // Parsing alloc and make
+    std::unique_ptr<Expression> parseAllocExpression();
+
+    // Parsing a[i]
+    std::unique_ptr<Expression> parseIndexExpression(std::unique_ptr<Expression> left);
+
+    // Parsing array literals
+    std::unique_ptr<Expression> parseArrayLiteral();
+
     // Parsing data type literals
     // Integer
     std::unique_ptr<Expression> parseIntegerLiteral();
@@ -174,11 +192,14 @@ private:
     Token currentToken();
     Token nextToken();
 
+    // Reading a data type, pointer<T> included
+    Token parseDataType();
+
     //Wrapper function
     std::unique_ptr<Statement> parseLetStatementWithTypeWrapper();
 
     //Error logging 
-    void logError(const std::string& message);
+    void logError(const std::string& message, const char *code = DiagnosticCode::SYNTAX_ERROR);
 
     //Getting the error token
     Token  getErrorToken();
@@ -0,0 +1,527 @@
+/* Allocator behind alloc, make and free. Every thread owns a heap of 64 KiB pages, each page hands out blocks of one
+ * size class from a free list that only the owning thread touches, so alloc and free on the owner are a pointer pop
+ * and push without any atomics. Pages are aligned so a block finds its page header by masking its address.
+ * A block freed by another thread goes to a batch of that thread first, the batch is pushed onto the remote list of
+ * its page with one compare and swap when it fills up or the freeing thread moves on to another page. The owner takes
+ * the whole remote list with one exchange once its free list runs dry. Pages come from 1 MiB segments that are never
+ * given back, a page whose blocks all came back is reused for any size class of its heap.
+ * A batch waits in its thread until then, the task workers live as long as the program so nothing stays stuck there.
+ * Objects over 8 KiB get an aligned mapping of their own. Freed ones wait in a small cache of the freeing thread's heap
+ * and the next large object that fits takes the warm span instead of faulting in a fresh mapping. A fresh mapping is
+ * known to be zero, arrays skip clearing it. IRON_ALLOC_STATS=1 prints the counters at exit */
+
+#define _GNU_SOURCE
+#include "runtime.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define PAGE_SIZE (64 * 1024)
+#define SEGMENT_SIZE (1024 * 1024)
+#define HEADER_SIZE 128 /* Page header, keeps the first block 16 byte aligned */
+#define CLASS_COUNT 32
+#define LARGE_CLASS CLASS_COUNT
+#define MAX_SMALL 8192
+#define REMOTE_BATCH 32
+#define CARVE_BATCH 64 /* Blocks a fresh page threads onto its free list at once */
+#define LARGE_CACHE (32 * 1024 * 1024) /* Bytes of freed large spans a heap keeps */
+
+typedef struct Block
+{
+    struct Block *next;
+} Block;
+
+typedef struct Heap Heap;
+
+typedef struct Page
+{
+    Heap *owner;
+    Block *free;             /* Owner only */
+    _Atomic(Block *) remote; /* Pushed by the other threads, taken by the owner */
+    struct Page *prev;
+    struct Page *next;
+    uint32_t blockSize;
+    uint32_t sizeClass;
+    uint32_t used;     /* Blocks out that did not come back to the owner yet */
+    uint32_t capacity;
+    uint32_t carved;   /* Blocks ever put on the free list, the rest of the page was never touched */
+    uint32_t full;     /* On the full list of the heap, only remote frees can give it blocks */
+    size_t largeSize;  /* Bytes of the mapping of a large object */
+} Page;
+
+_Static_assert(sizeof(Page) <= HEADER_SIZE, "The page header outgrew its space");
+
+struct Heap
+{
+    Page *pages[CLASS_COUNT]; /* Pages with free blocks, the first one is allocated from */
+    Page *full[CLASS_COUNT];
+    Page *empty;              /* No block out, ready for any class */
+    char *segmentCursor;
+    char *segmentEnd;
+    uint64_t sweptBatches;    /* Remote batches already looked for on the full lists */
+    Page *largeCache;         /* Freed large spans, the most recent first */
+    size_t largeCached;       /* Their bytes */
+    Heap *nextHeap;
+
+    /* Written by the owner only, atomics so a stats call of another thread reads them safely */
+    _Atomic uint64_t allocations;
+    _Atomic uint64_t frees;
+    _Atomic uint64_t pageCount;
+    _Atomic uint64_t reservedBytes;
+    _Atomic uint64_t largeReuses;
+    /* Written by the threads that free into the heap */
+    _Atomic uint64_t remoteFrees;
+    _Atomic uint64_t remoteBatches;
+};
+
+/* Remote frees of a thread waiting for the push to their page */
+typedef struct
+{
+    Page *page;
+    Block *first;
+    Block *last;
+    uint32_t count;
+} Batch;
+
+/* Heaps are malloced and never freed, the pages of an exited thread may still get remote frees */
+static _Thread_local Heap *local;
+static _Thread_local Batch pending;
+static _Atomic(Heap *) heaps;
+static _Atomic uint64_t largeAllocations;
+static _Atomic uint64_t largeFrees;
+static _Atomic uint64_t largeBytes; /* Mapped for large objects, the cached spans included */
+static atomic_flag statsChecked = ATOMIC_FLAG_INIT;
+
+/*---------HELPER FUNCTIONS----------*/
+/* Only the owner writes these counters, a plain load and store is enough */
+static inline void count(_Atomic uint64_t *counter, uint64_t amount)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+static inline Page *pageOf(void *memory)
+{
+    return (Page *)((uintptr_t)memory & ~(uintptr_t)(PAGE_SIZE - 1));
+}
+
+/* 16 byte steps up to 128, then 4 classes per doubling up to 8 KiB */
+static inline size_t classOf(size_t size)
+{
+    if (size <= 128)
+        return size ? (size + 15) / 16 - 1 : 0;
+    size_t last = size - 1;
+    int top = 63 - __builtin_clzll(last);
+    return 8 + (size_t)(top - 7) * 4 + ((last >> (top - 2)) & 3);
+}
+
+static uint32_t blockSizeOf(size_t sizeClass)
+{
+    if (sizeClass < 8)
+        return (uint32_t)(16 * (sizeClass + 1));
+    int top = 7 + (int)(sizeClass - 8) / 4;
+    return (1u << top) + (uint32_t)((sizeClass - 8) % 4 + 1) * (1u << (top - 2));
+}
+
+static void unlinkPage(Page **list, Page *page)
+{
+    if (page->prev)
+        page->prev->next = page->next;
+    else
+        *list = page->next;
+    if (page->next)
+        page->next->prev = page->prev;
+    page->prev = page->next = NULL;
+}
+
+static void pushPage(Page **list, Page *page)
+{
+    page->prev = NULL;
+    page->next = *list;
+    if (*list)
+        (*list)->prev = page;
+    *list = page;
+}
+
+/*---------REMOTE FREES----------*/
+static void flushPending(void)
+{
+    Page *page = pending.page;
+    if (!page)
+        return;
+    Block *head = atomic_load_explicit(&page->remote, memory_order_relaxed);
+    do
+    {
+        pending.last->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&page->remote, &head, pending.first, memory_order_release, memory_order_relaxed));
+    atomic_fetch_add_explicit(&page->owner->remoteFrees, pending.count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&page->owner->remoteBatches, 1, memory_order_relaxed);
+    pending = (Batch){0};
+}
+
+static void freeRemote(Page *page, Block *block)
+{
+    if (pending.page != page)
+    {
+        flushPending();
+        pending.page = page;
+        pending.last = block;
+    }
+    block->next = pending.first;
+    pending.first = block;
+    if (++pending.count == REMOTE_BATCH)
+        flushPending();
+}
+
+/* Takes the remote frees and carves more of the page when the free list is empty */
+static void refill(Page *page)
+{
+    Block *taken = atomic_exchange_explicit(&page->remote, NULL, memory_order_acquire);
+    while (taken)
+    {
+        Block *next = taken->next;
+        taken->next = page->free;
+        page->free = taken;
+        page->used--;
+        taken = next;
+    }
+    if (page->free || page->carved == page->capacity)
+        return;
+    char *start = (char *)page + HEADER_SIZE;
+    uint32_t end = page->carved + CARVE_BATCH < page->capacity ? page->carved + CARVE_BATCH : page->capacity;
+    for (uint32_t i = end; i-- > page->carved;)
+    {
+        Block *block = (Block *)(start + (size_t)i * page->blockSize);
+        block->next = page->free;
+        page->free = block;
+    }
+    page->carved = end;
+}
+
+/*---------PAGES----------*/
+static Page *newPage(Heap *heap, size_t sizeClass)
+{
+    Page *page = heap->empty;
+    if (page)
+    {
+        unlinkPage(&heap->empty, page);
+    }
+    else
+    {
+        if (heap->segmentCursor == heap->segmentEnd)
+        {
+            char *segment = aligned_alloc(PAGE_SIZE, SEGMENT_SIZE);
+            if (!segment)
+                iron_panic("Out of memory");
+            heap->segmentCursor = segment;
+            heap->segmentEnd = segment + SEGMENT_SIZE;
+            count(&heap->reservedBytes, SEGMENT_SIZE);
+        }
+        page = (Page *)heap->segmentCursor;
+        heap->segmentCursor += PAGE_SIZE;
+        count(&heap->pageCount, 1);
+        page->owner = heap;
+        atomic_init(&page->remote, NULL);
+    }
+    page->free = NULL;
+    page->prev = page->next = NULL;
+    page->blockSize = blockSizeOf(sizeClass);
+    page->sizeClass = (uint32_t)sizeClass;
+    page->used = 0;
+    page->capacity = (PAGE_SIZE - HEADER_SIZE) / page->blockSize;
+    page->carved = 0;
+    page->full = 0;
+    return page;
+}
+
+/* Remote frees into full pages are only looked for when some thread pushed a batch into the heap since the last sweep */
+static void sweepFull(Heap *heap)
+{
+    uint64_t batches = atomic_load_explicit(&heap->remoteBatches, memory_order_relaxed);
+    if (batches == heap->sweptBatches)
+        return;
+    heap->sweptBatches = batches;
+    for (size_t sizeClass = 0; sizeClass < CLASS_COUNT; ++sizeClass)
+    {
+        Page *page = heap->full[sizeClass];
+        while (page)
+        {
+            Page *next = page->next;
+            if (atomic_load_explicit(&page->remote, memory_order_relaxed))
+            {
+                refill(page);
+                unlinkPage(&heap->full[sizeClass], page);
+                page->full = 0;
+                pushPage(page->used ? &heap->pages[sizeClass] : &heap->empty, page);
+            }
+            page = next;
+        }
+    }
+}
+
+static Page *findPage(Heap *heap, size_t sizeClass)
+{
+    Page *page = heap->pages[sizeClass];
+    while (page)
+    {
+        Page *next = page->next;
+        refill(page);
+        if (page->free)
+        {
+            if (page != heap->pages[sizeClass])
+            {
+                unlinkPage(&heap->pages[sizeClass], page);
+                pushPage(&heap->pages[sizeClass], page);
+            }
+            return page;
+        }
+        unlinkPage(&heap->pages[sizeClass], page);
+        page->full = 1;
+        pushPage(&heap->full[sizeClass], page);
+        page = next;
+    }
+    sweepFull(heap);
+    page = heap->pages[sizeClass];
+    if (!page)
+    {
+        page = newPage(heap, sizeClass);
+        pushPage(&heap->pages[sizeClass], page);
+    }
+    refill(page);
+    return page;
+}
+
+/*---------INTERFACE----------*/
+static void printStats(void)
+{
+    IronAllocStats current;
+    iron_alloc_stats(&current);
+    fprintf(stderr, "[ALLOC] %llu allocations, %llu frees, %llu of them from other threads in %llu batches\n",
+            (unsigned long long)current.allocations, (unsigned long long)current.frees, (unsigned long long)current.remoteFrees,
+            (unsigned long long)current.remoteBatches);
+    fprintf(stderr, "[ALLOC] %llu large allocations of which %llu reused a cached span, %llu pages, %.1f KiB reserved\n",
+            (unsigned long long)current.largeAllocations, (unsigned long long)current.largeReuses, (unsigned long long)current.pages,
+            current.reservedBytes / 1024.0);
+}
+
+static Heap *createHeap(void)
+{
+    Heap *heap = calloc(1, sizeof(Heap));
+    if (!heap)
+        iron_panic("Out of memory");
+    Heap *head = atomic_load_explicit(&heaps, memory_order_relaxed);
+    do
+    {
+        heap->nextHeap = head;
+    } while (!atomic_compare_exchange_weak_explicit(&heaps, &head, heap, memory_order_release, memory_order_relaxed));
+    local = heap;
+
+    if (!atomic_flag_test_and_set(&statsChecked))
+    {
+        const char *printing = getenv("IRON_ALLOC_STATS");
+        if (printing && *printing && strcmp(printing, "0") != 0)
+            atexit(printStats);
+    }
+    return heap;
+}
+
+/*---------LARGE OBJECTS----------*/
+/* Maps one more page than needed and trims both ends so the span is page aligned */
+static Page *mapLarge(size_t total)
+{
+    size_t length = total + PAGE_SIZE;
+    char *raw = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        iron_panic("Out of memory");
+    char *start = (char *)(((uintptr_t)raw + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1));
+    if (start != raw)
+        munmap(raw, (size_t)(start - raw));
+    size_t tail = length - (size_t)(start - raw) - total;
+    if (tail)
+        munmap(start + total, tail);
+    atomic_fetch_add_explicit(&largeBytes, total, memory_order_relaxed);
+    Page *page = (Page *)start;
+    page->largeSize = total;
+    return page;
+}
+
+static void unmapLarge(Page *page)
+{
+    atomic_fetch_sub_explicit(&largeBytes, page->largeSize, memory_order_relaxed);
+    munmap(page, page->largeSize);
+}
+
+/* The smallest cached span that fits without wasting more than half of the request */
+static Page *takeCached(Heap *heap, size_t total)
+{
+    Page *best = NULL;
+    for (Page *page = heap->largeCache; page; page = page->next)
+    {
+        if (page->largeSize >= total && page->largeSize - total <= total / 2 && (!best || page->largeSize < best->largeSize))
+            best = page;
+    }
+    if (best)
+    {
+        unlinkPage(&heap->largeCache, best);
+        heap->largeCached -= best->largeSize;
+        count(&heap->largeReuses, 1);
+    }
+    return best;
+}
+
+/* The oldest spans go back to the system once the cache is over its budget */
+static void cacheLarge(Heap *heap, Page *page)
+{
+    if (page->largeSize > LARGE_CACHE)
+    {
+        unmapLarge(page);
+        return;
+    }
+    pushPage(&heap->largeCache, page);
+    heap->largeCached += page->largeSize;
+    while (heap->largeCached > LARGE_CACHE)
+    {
+        Page *oldest = heap->largeCache;
+        while (oldest->next)
+            oldest = oldest->next;
+        unlinkPage(&heap->largeCache, oldest);
+        heap->largeCached -= oldest->largeSize;
+        unmapLarge(oldest);
+    }
+}
+
+/* Cleared says the caller needs the first size bytes zero, only a reused span has to be cleared for that */
+static void *allocateLarge(size_t size, int cleared)
+{
+    if (size > SIZE_MAX - HEADER_SIZE - PAGE_SIZE * 2)
+        iron_panic("Out of memory");
+    size_t total = (size + HEADER_SIZE + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+    Heap *heap = local ? local : createHeap();
+    Page *page = takeCached(heap, total);
+    if (page && cleared)
+        memset((char *)page + HEADER_SIZE, 0, size);
+    if (!page)
+        page = mapLarge(total);
+    page->owner = NULL;
+    page->prev = page->next = NULL;
+    page->sizeClass = LARGE_CLASS;
+    atomic_fetch_add_explicit(&largeAllocations, 1, memory_order_relaxed);
+    return (char *)page + HEADER_SIZE;
+}
+
+static void *allocateSlow(size_t sizeClass)
+{
+    Heap *heap = local ? local : createHeap();
+    flushPending();
+    Page *page = findPage(heap, sizeClass);
+    Block *block = page->free;
+    page->free = block->next;
+    page->used++;
+    count(&heap->allocations, 1);
+    return block;
+}
+
+void *iron_alloc(size_t size)
+{
+    if (size > MAX_SMALL)
+        return allocateLarge(size, 0);
+    size_t sizeClass = classOf(size);
+    Heap *heap = local;
+    if (heap)
+    {
+        Page *page = heap->pages[sizeClass];
+        Block *block = page ? page->free : NULL;
+        if (block)
+        {
+            page->free = block->next;
+            page->used++;
+            count(&heap->allocations, 1);
+            return block;
+        }
+    }
+    return allocateSlow(sizeClass);
+}
+
+/* A page that got a block back leaves the full list, a page with no block out goes back to the heap unless it is the
+ * one the class allocates from */
+static void freedSlow(Heap *heap, Page *page)
+{
+    if (page->full)
+    {
+        unlinkPage(&heap->full[page->sizeClass], page);
+        page->full = 0;
+        pushPage(&heap->pages[page->sizeClass], page);
+    }
+    else if (page->used == 0 && page != heap->pages[page->sizeClass])
+    {
+        unlinkPage(&heap->pages[page->sizeClass], page);
+        pushPage(&heap->empty, page);
+    }
+}
+
+void iron_free(void *memory)
+{
+    if (!memory)
+        return;
+    Page *page = pageOf(memory);
+    Heap *heap = local;
+    Block *block = memory;
+    if (heap && page->owner == heap)
+    {
+        block->next = page->free;
+        page->free = block;
+        count(&heap->frees, 1);
+        if (--page->used == 0 || page->full)
+            freedSlow(heap, page);
+        return;
+    }
+    if (page->sizeClass == LARGE_CLASS)
+    {
+        atomic_fetch_add_explicit(&largeFrees, 1, memory_order_relaxed);
+        cacheLarge(heap ? heap : createHeap(), page);
+        return;
+    }
+    freeRemote(page, block);
+}
+
+void *iron_array_new(int64_t length, size_t elementSize)
+{
+    if (length < 0)
+        iron_panic("Array with a negative length");
+    if ((uint64_t)length > SIZE_MAX / 2 / elementSize)
+        iron_panic("Array too large");
+    size_t size = sizeof(int64_t) + (size_t)length * elementSize;
+    int64_t *array;
+    if (size > MAX_SMALL)
+    {
+        array = allocateLarge(size, 1);
+    }
+    else
+    {
+        array = iron_alloc(size);
+        memset(array, 0, size);
+    }
+    array[0] = length;
+    return array;
+}
+
+void iron_alloc_stats(IronAllocStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (Heap *heap = atomic_load_explicit(&heaps, memory_order_acquire); heap; heap = heap->nextHeap)
+    {
+        uint64_t remote = atomic_load_explicit(&heap->remoteFrees, memory_order_relaxed);
+        stats->allocations += atomic_load_explicit(&heap->allocations, memory_order_relaxed);
+        stats->frees += atomic_load_explicit(&heap->frees, memory_order_relaxed) + remote;
+        stats->remoteFrees += remote;
+        stats->remoteBatches += atomic_load_explicit(&heap->remoteBatches, memory_order_relaxed);
+        stats->pages += atomic_load_explicit(&heap->pageCount, memory_order_relaxed);
+        stats->reservedBytes += atomic_load_explicit(&heap->reservedBytes, memory_order_relaxed);
+        stats->largeReuses += atomic_load_explicit(&heap->largeReuses, memory_order_relaxed);
+    }
+    stats->largeAllocations = atomic_load_explicit(&largeAllocations, memory_order_relaxed);
+    stats->allocations += stats->largeAllocations;
+    stats->frees += atomic_load_explicit(&largeFrees, memory_order_relaxed);
+    stats->reservedBytes += atomic_load_explicit(&largeBytes, memory_order_relaxed);
+}
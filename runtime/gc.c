@@ -0,0 +1,713 @@
+/* Generational collector behind gc bindings. Strings concatenated for a gc binding are bump allocated in a nursery
+ * of blocks, a minor collection copies the survivors into the old space and the old space is collected by marking
+ * the lines of its blocks that hold live strings and reusing the free lines in place (mark-region).
+ * Strings hold no references so the roots are all there is to trace. The compiler registers every top level string
+ * variable together with a card its stores mark, a global is the only old location that can point into the nursery
+ * so a minor collection only visits the marked cards. The main thread's stack is scanned conservatively, a nursery
+ * string it may point at can not move and is promoted in place instead, its block joins the old space.
+ * Only the main thread allocates here and collections wait until every started task was waited on, a task on a
+ * worker thread gets its strings from the normal heap. IRON_GC_STATS=1 prints the counters at exit */
+
+#define _GNU_SOURCE
+#include "runtime.h"
+#include <setjmp.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BLOCK_SIZE (32 * 1024)
+#define LINE_SIZE 256
+#define GRANULE 16
+#define LINES_PER_BLOCK (BLOCK_SIZE / LINE_SIZE)
+#define GRANULES_PER_BLOCK (BLOCK_SIZE / GRANULE)
+#define BLOCKS_PER_REGION 64
+#define NURSERY_BLOCKS 64 /* 2 MiB, the most a minor collection ever walks */
+#define LARGE_OBJECT (8 * 1024)
+#define MIN_MAJOR_THRESHOLD (16 * 1024 * 1024)
+
+#if defined(__GLIBC__)
+extern void *__libc_stack_end;
+#endif
+
+enum
+{
+    BLOCK_FREE,
+    BLOCK_NURSERY,
+    BLOCK_OLD
+};
+
+enum
+{
+    FLAG_MARKED = 1,
+    FLAG_PINNED = 2,    /* The stack may point at it, promoted in place */
+    FLAG_FORWARDED = 4, /* Copied to the old space, the new address is in the first payload word */
+    FLAG_OLD = 8        /* Large objects only, a block knows the generation of its strings */
+};
+
+typedef struct
+{
+    uint32_t size; /* Payload bytes with the NUL */
+    uint32_t flags;
+} Header;
+
+/* Large strings get a malloc block of their own, the header keeps the payload 16 byte aligned */
+typedef struct
+{
+    size_t size;
+    size_t flags;
+} LargeHeader;
+
+typedef struct
+{
+    char *base;
+    uint32_t state;
+    uint32_t top; /* Nursery blocks: bytes bumped so far */
+    uint8_t pinned;
+    uint8_t lines[LINES_PER_BLOCK];         /* Old blocks: lines a live string covers */
+    uint8_t starts[GRANULES_PER_BLOCK / 8]; /* Granules where a header starts */
+} Block;
+
+typedef struct
+{
+    char *base;
+    Block blocks[BLOCKS_PER_REGION];
+} Region;
+
+typedef struct
+{
+    const char **slot;
+    uint64_t *card;
+} Root;
+
+typedef struct
+{
+    void **items;
+    size_t count;
+    size_t capacity;
+} List;
+
+/*---------STATE----------*/
+static _Thread_local int isMainThread;
+static void *stackBase;
+
+static Region **regions; /* Sorted by address for the conservative lookup */
+static size_t regionCount;
+static uintptr_t heapLow = UINTPTR_MAX;
+static uintptr_t heapHigh;
+static List allBlocks;
+static List freeBlocks;
+
+static List nursery;
+static Block *nurseryBlock;
+static char *nurseryCursor;
+static char *nurseryLimit;
+
+static Block *oldBlock;
+static char *oldCursor;
+static char *oldLimit;
+static size_t holeBlock; /* Where the search for free old lines goes on */
+static size_t holeLine;
+static size_t oldBytes;
+static size_t majorThreshold = MIN_MAJOR_THRESHOLD;
+
+static List youngLarge;
+static List oldLarge;
+static size_t youngLargeBytes;
+static uintptr_t *largeSet; /* Open addressing set of large payload addresses */
+static size_t largeSetCapacity;
+static size_t largeSetCount;
+
+static Root *roots;
+static size_t rootCount;
+static size_t rootCapacity;
+
+static IronGcStats stats;
+static uint64_t startTime;
+
+/*---------HELPERS----------*/
+static uint64_t now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000u + (uint64_t)time.tv_nsec;
+}
+
+static void *checked(void *memory)
+{
+    if (!memory)
+        iron_panic("Out of memory");
+    return memory;
+}
+
+static void push(List *list, void *item)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->items = checked(realloc(list->items, list->capacity * sizeof(void *)));
+    }
+    list->items[list->count++] = item;
+}
+
+static size_t granules(size_t size)
+{
+    return (sizeof(Header) + size + GRANULE - 1) & ~(size_t)(GRANULE - 1);
+}
+
+static int hasStart(Block *block, size_t granule)
+{
+    return block->starts[granule / 8] & (1u << (granule % 8));
+}
+
+static void setStart(Block *block, Header *header)
+{
+    size_t granule = ((char *)header - block->base) / GRANULE;
+    block->starts[granule / 8] |= (uint8_t)(1u << (granule % 8));
+}
+
+static void clearStart(Block *block, Header *header)
+{
+    size_t granule = ((char *)header - block->base) / GRANULE;
+    block->starts[granule / 8] &= (uint8_t)~(1u << (granule % 8));
+}
+
+static void markLines(Block *block, Header *header, size_t total)
+{
+    size_t first = ((char *)header - block->base) / LINE_SIZE;
+    size_t last = ((char *)header + total - 1 - block->base) / LINE_SIZE;
+    memset(block->lines + first, 1, last - first + 1);
+}
+
+/*---------LARGE OBJECTS----------*/
+static size_t hashAddress(uintptr_t address)
+{
+    return (size_t)((address >> 4) * 0x9e3779b97f4a7c15ULL) & (largeSetCapacity - 1);
+}
+
+static void largeSetInsert(uintptr_t address)
+{
+    if ((largeSetCount + 1) * 2 > largeSetCapacity)
+    {
+        uintptr_t *old = largeSet;
+        size_t oldCapacity = largeSetCapacity;
+        largeSetCapacity = oldCapacity ? oldCapacity * 2 : 256;
+        largeSet = checked(calloc(largeSetCapacity, sizeof(uintptr_t)));
+        largeSetCount = 0;
+        for (size_t i = 0; i < oldCapacity; ++i)
+        {
+            if (old[i])
+                largeSetInsert(old[i]);
+        }
+        free(old);
+    }
+    size_t at = hashAddress(address);
+    while (largeSet[at])
+        at = (at + 1) & (largeSetCapacity - 1);
+    largeSet[at] = address;
+    largeSetCount++;
+}
+
+static int largeSetContains(uintptr_t address)
+{
+    if (!largeSetCount)
+        return 0;
+    for (size_t at = hashAddress(address); largeSet[at]; at = (at + 1) & (largeSetCapacity - 1))
+    {
+        if (largeSet[at] == address)
+            return 1;
+    }
+    return 0;
+}
+
+/* Linear probing, the entries after the removed one move back so lookups never stop early */
+static void largeSetRemove(uintptr_t address)
+{
+    size_t at = hashAddress(address);
+    while (largeSet[at] != address)
+        at = (at + 1) & (largeSetCapacity - 1);
+    largeSet[at] = 0;
+    largeSetCount--;
+    for (size_t next = (at + 1) & (largeSetCapacity - 1); largeSet[next]; next = (next + 1) & (largeSetCapacity - 1))
+    {
+        uintptr_t moved = largeSet[next];
+        largeSet[next] = 0;
+        largeSetCount--;
+        largeSetInsert(moved);
+    }
+}
+
+static LargeHeader *findLarge(const void *value)
+{
+    uintptr_t address = (uintptr_t)value;
+    if (address % GRANULE || !largeSetContains(address))
+        return NULL;
+    return (LargeHeader *)value - 1;
+}
+
+static void freeLarge(LargeHeader *large)
+{
+    largeSetRemove((uintptr_t)(large + 1));
+    stats.heapBytes -= large->size;
+    free(large);
+}
+
+/*---------BLOCKS----------*/
+static void addRegion(void)
+{
+    Region *region = checked(calloc(1, sizeof(Region)));
+    region->base = checked(aligned_alloc(BLOCK_SIZE, (size_t)BLOCK_SIZE * BLOCKS_PER_REGION));
+    regions = checked(realloc(regions, (regionCount + 1) * sizeof(Region *)));
+    size_t at = regionCount++;
+    while (at > 0 && regions[at - 1]->base > region->base)
+    {
+        regions[at] = regions[at - 1];
+        at--;
+    }
+    regions[at] = region;
+
+    if ((uintptr_t)region->base < heapLow)
+        heapLow = (uintptr_t)region->base;
+    if ((uintptr_t)region->base + (size_t)BLOCK_SIZE * BLOCKS_PER_REGION > heapHigh)
+        heapHigh = (uintptr_t)region->base + (size_t)BLOCK_SIZE * BLOCKS_PER_REGION;
+    stats.heapBytes += (size_t)BLOCK_SIZE * BLOCKS_PER_REGION;
+
+    for (size_t i = 0; i < BLOCKS_PER_REGION; ++i)
+    {
+        region->blocks[i].base = region->base + i * BLOCK_SIZE;
+        push(&allBlocks, &region->blocks[i]);
+    }
+    for (size_t i = BLOCKS_PER_REGION; i > 0; --i)
+        push(&freeBlocks, &region->blocks[i - 1]);
+}
+
+static Block *takeBlock(uint32_t state)
+{
+    if (!freeBlocks.count)
+        addRegion();
+    Block *block = freeBlocks.items[--freeBlocks.count];
+    block->state = state;
+    return block;
+}
+
+static void releaseBlock(Block *block)
+{
+    memset(block->lines, 0, sizeof(block->lines));
+    memset(block->starts, 0, sizeof(block->starts));
+    block->state = BLOCK_FREE;
+    block->top = 0;
+    block->pinned = 0;
+    push(&freeBlocks, block);
+}
+
+static Block *blockOf(uintptr_t address)
+{
+    if (address < heapLow || address >= heapHigh)
+        return NULL;
+    size_t low = 0;
+    size_t high = regionCount;
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+        uintptr_t base = (uintptr_t)regions[middle]->base;
+        if (address < base)
+            high = middle;
+        else if (address >= base + (size_t)BLOCK_SIZE * BLOCKS_PER_REGION)
+            low = middle + 1;
+        else
+            return &regions[middle]->blocks[(address - base) / BLOCK_SIZE];
+    }
+    return NULL;
+}
+
+/* A word is a string of the heap only if it points right behind a header, interior pointers are never made */
+static Header *findObject(const void *value, Block **owner)
+{
+    uintptr_t address = (uintptr_t)value;
+    Block *block = blockOf(address);
+    if (!block || block->state == BLOCK_FREE || address % GRANULE != sizeof(Header) % GRANULE)
+        return NULL;
+    uintptr_t header = address - sizeof(Header);
+    if (header < (uintptr_t)block->base || !hasStart(block, (header - (uintptr_t)block->base) / GRANULE))
+        return NULL;
+    *owner = block;
+    return (Header *)header;
+}
+
+/*---------ALLOCATION----------*/
+/* Moves on to the next run of free lines in the old blocks, a fresh block once they are used up */
+static void nextHole(size_t total)
+{
+    while (holeBlock < allBlocks.count)
+    {
+        Block *block = allBlocks.items[holeBlock];
+        while (block->state == BLOCK_OLD && holeLine < LINES_PER_BLOCK)
+        {
+            while (holeLine < LINES_PER_BLOCK && block->lines[holeLine])
+                holeLine++;
+            size_t end = holeLine;
+            while (end < LINES_PER_BLOCK && !block->lines[end])
+                end++;
+            size_t start = holeLine;
+            holeLine = end;
+            if ((end - start) * LINE_SIZE >= total)
+            {
+                oldBlock = block;
+                oldCursor = block->base + start * LINE_SIZE;
+                oldLimit = block->base + end * LINE_SIZE;
+                return;
+            }
+        }
+        holeBlock++;
+        holeLine = 0;
+    }
+    oldBlock = takeBlock(BLOCK_OLD);
+    oldCursor = oldBlock->base;
+    oldLimit = oldBlock->base + BLOCK_SIZE;
+}
+
+static char *allocateOld(size_t size)
+{
+    size_t total = granules(size);
+    if (!oldBlock || total > (size_t)(oldLimit - oldCursor))
+        nextHole(total);
+    Header *header = (Header *)oldCursor;
+    oldCursor += total;
+    header->size = (uint32_t)size;
+    header->flags = 0;
+    setStart(oldBlock, header);
+    markLines(oldBlock, header, total);
+    oldBytes += total;
+    return (char *)(header + 1);
+}
+
+static void collect(void);
+
+static int canCollect(void)
+{
+    return atomic_load(&iron_tasks_unjoined) == 0;
+}
+
+static void refillNursery(void)
+{
+    if (nursery.count >= NURSERY_BLOCKS && canCollect())
+        collect();
+    nurseryBlock = takeBlock(BLOCK_NURSERY);
+    push(&nursery, nurseryBlock);
+    nurseryCursor = nurseryBlock->base;
+    nurseryLimit = nurseryBlock->base + BLOCK_SIZE;
+}
+
+static char *allocateLarge(size_t size)
+{
+    if (youngLargeBytes + size > (size_t)NURSERY_BLOCKS * BLOCK_SIZE && canCollect())
+        collect();
+    LargeHeader *large = checked(malloc(sizeof(LargeHeader) + size));
+    large->size = size;
+    large->flags = 0;
+    push(&youngLarge, large);
+    largeSetInsert((uintptr_t)(large + 1));
+    youngLargeBytes += size;
+    stats.heapBytes += size;
+    return (char *)(large + 1);
+}
+
+static char *allocate(size_t size)
+{
+    stats.allocatedBytes += size;
+    if (size > LARGE_OBJECT)
+        return allocateLarge(size);
+    size_t total = granules(size);
+    if (total > (size_t)(nurseryLimit - nurseryCursor))
+        refillNursery();
+    Header *header = (Header *)nurseryCursor;
+    nurseryCursor += total;
+    header->size = (uint32_t)size;
+    header->flags = 0;
+    setStart(nurseryBlock, header);
+    return (char *)(header + 1);
+}
+
+/*---------ROOTS----------*/
+/* The registers are spilled into this frame and the scan starts below it, in a frame of its own */
+static __attribute__((noinline)) void scanRange(void (*visit)(const void *))
+{
+    volatile uintptr_t marker = 0;
+    uintptr_t at = (uintptr_t)&marker & ~(uintptr_t)(sizeof(void *) - 1);
+    for (; at + sizeof(void *) <= (uintptr_t)stackBase; at += sizeof(void *))
+        visit(*(const void *const *)at);
+}
+
+static __attribute__((noinline)) void scanStack(void (*visit)(const void *))
+{
+    jmp_buf registers;
+#if defined(__GNUC__)
+    __builtin_unwind_init();
+#endif
+    setjmp(registers);
+    scanRange(visit);
+}
+
+static void pinYoung(const void *value)
+{
+    Block *block;
+    Header *header = findObject(value, &block);
+    if (header && block->state == BLOCK_NURSERY)
+    {
+        header->flags |= FLAG_PINNED;
+        block->pinned = 1;
+        return;
+    }
+    LargeHeader *large = header ? NULL : findLarge(value);
+    if (large)
+        large->flags |= FLAG_OLD;
+}
+
+static const char *promote(const char *value)
+{
+    Block *block;
+    Header *header = findObject(value, &block);
+    if (header && block->state == BLOCK_NURSERY)
+    {
+        if (header->flags & FLAG_FORWARDED)
+            return *(const char **)(header + 1);
+        if (header->flags & FLAG_PINNED)
+            return value;
+        char *copy = allocateOld(header->size);
+        memcpy(copy, header + 1, header->size);
+        header->flags |= FLAG_FORWARDED;
+        *(char **)(header + 1) = copy;
+        stats.copiedBytes += header->size;
+        return copy;
+    }
+    LargeHeader *large = header ? NULL : findLarge(value);
+    if (large)
+        large->flags |= FLAG_OLD;
+    return value;
+}
+
+static void markOld(const void *value)
+{
+    Block *block;
+    Header *header = findObject(value, &block);
+    if (header)
+    {
+        header->flags |= FLAG_MARKED;
+        return;
+    }
+    LargeHeader *large = findLarge(value);
+    if (large)
+        large->flags |= FLAG_MARKED;
+}
+
+/*---------COLLECTION----------*/
+static void minorCollection(void)
+{
+    if (nurseryBlock)
+        nurseryBlock->top = (uint32_t)(nurseryCursor - nurseryBlock->base);
+    scanStack(pinYoung);
+    for (size_t i = 0; i < rootCount; ++i)
+    {
+        if (!*roots[i].card)
+            continue;
+        *roots[i].card = 0;
+        *roots[i].slot = promote(*roots[i].slot);
+    }
+
+    /* Blocks with a pinned string join the old space, the rest of the nursery is free again */
+    for (size_t i = 0; i < nursery.count; ++i)
+    {
+        Block *block = nursery.items[i];
+        if (!block->pinned)
+        {
+            releaseBlock(block);
+            continue;
+        }
+        for (char *at = block->base; at < block->base + block->top;)
+        {
+            Header *header = (Header *)at;
+            size_t total = granules(header->size);
+            if (header->flags & FLAG_PINNED)
+            {
+                header->flags = 0;
+                markLines(block, header, total);
+                oldBytes += total;
+                stats.promotedBytes += header->size;
+            }
+            else
+            {
+                clearStart(block, header);
+            }
+            at += total;
+        }
+        block->state = BLOCK_OLD;
+        block->pinned = 0;
+    }
+    nursery.count = 0;
+    nurseryBlock = NULL;
+    nurseryCursor = nurseryLimit = NULL;
+
+    for (size_t i = 0; i < youngLarge.count; ++i)
+    {
+        LargeHeader *large = youngLarge.items[i];
+        if (!(large->flags & FLAG_OLD))
+        {
+            freeLarge(large);
+            continue;
+        }
+        large->flags = FLAG_OLD;
+        push(&oldLarge, large);
+        oldBytes += large->size;
+        stats.promotedBytes += large->size;
+    }
+    youngLarge.count = 0;
+    youngLargeBytes = 0;
+}
+
+/* Runs right after a minor collection so every string is old, nothing moves */
+static void majorCollection(void)
+{
+    scanStack(markOld);
+    for (size_t i = 0; i < rootCount; ++i)
+        markOld(*roots[i].slot);
+
+    size_t live = 0;
+    for (size_t i = 0; i < allBlocks.count; ++i)
+    {
+        Block *block = allBlocks.items[i];
+        if (block->state != BLOCK_OLD)
+            continue;
+        memset(block->lines, 0, sizeof(block->lines));
+        int used = 0;
+        for (size_t granule = 0; granule < GRANULES_PER_BLOCK; ++granule)
+        {
+            if (!block->starts[granule / 8])
+            {
+                granule |= 7;
+                continue;
+            }
+            if (!hasStart(block, granule))
+                continue;
+            Header *header = (Header *)(block->base + granule * GRANULE);
+            size_t total = granules(header->size);
+            if (header->flags & FLAG_MARKED)
+            {
+                header->flags = 0;
+                markLines(block, header, total);
+                live += total;
+                used = 1;
+            }
+            else
+            {
+                clearStart(block, header);
+            }
+            granule += total / GRANULE - 1;
+        }
+        if (!used)
+            releaseBlock(block);
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < oldLarge.count; ++i)
+    {
+        LargeHeader *large = oldLarge.items[i];
+        if (!(large->flags & FLAG_MARKED))
+        {
+            freeLarge(large);
+            continue;
+        }
+        large->flags = FLAG_OLD;
+        oldLarge.items[kept++] = large;
+        live += large->size;
+    }
+    oldLarge.count = kept;
+
+    oldBytes = live;
+    majorThreshold = live * 2 > MIN_MAJOR_THRESHOLD ? live * 2 : MIN_MAJOR_THRESHOLD;
+    oldBlock = NULL;
+    oldCursor = oldLimit = NULL;
+    holeBlock = 0;
+    holeLine = 0;
+}
+
+static void collect(void)
+{
+    uint64_t start = now();
+    minorCollection();
+    uint64_t pause = now() - start;
+    stats.minorCollections++;
+    stats.minorPauseTotal += pause;
+    if (pause > stats.minorPauseMax)
+        stats.minorPauseMax = pause;
+
+    if (oldBytes < majorThreshold)
+        return;
+    start = now();
+    majorCollection();
+    pause = now() - start;
+    stats.majorCollections++;
+    stats.majorPauseTotal += pause;
+    if (pause > stats.majorPauseMax)
+        stats.majorPauseMax = pause;
+}
+
+/*---------INTERFACE----------*/
+static void printStats(void)
+{
+    IronGcStats current;
+    iron_gc_stats(&current);
+    uint64_t run = now() - startTime;
+    uint64_t paused = current.minorPauseTotal + current.majorPauseTotal;
+    fprintf(stderr, "[GC] minor: %llu collections, %.1f us average pause, %.1f us longest\n", (unsigned long long)current.minorCollections,
+            current.minorCollections ? current.minorPauseTotal / 1000.0 / current.minorCollections : 0.0, current.minorPauseMax / 1000.0);
+    fprintf(stderr, "[GC] major: %llu collections, %.1f us average pause, %.1f us longest\n", (unsigned long long)current.majorCollections,
+            current.majorCollections ? current.majorPauseTotal / 1000.0 / current.majorCollections : 0.0, current.majorPauseMax / 1000.0);
+    fprintf(stderr, "[GC] %.1f KiB allocated, %.1f KiB copied, %.1f KiB promoted in place, %.1f KiB heap\n", current.allocatedBytes / 1024.0,
+            current.copiedBytes / 1024.0, current.promotedBytes / 1024.0, current.heapBytes / 1024.0);
+    fprintf(stderr, "[GC] %.2f%% of the run spent collecting\n", run ? 100.0 * paused / run : 0.0);
+}
+
+void iron_gc_init(void)
+{
+    isMainThread = 1;
+#if defined(__GLIBC__)
+    stackBase = __libc_stack_end;
+#else
+    stackBase = __builtin_frame_address(1); /* The entry point's frame, nothing above it holds a string of the heap */
+#endif
+    startTime = now();
+    const char *printing = getenv("IRON_GC_STATS");
+    if (printing && *printing && strcmp(printing, "0") != 0)
+        atexit(printStats);
+}
+
+void iron_gc_root(const char **slot, uint64_t *card)
+{
+    if (rootCount == rootCapacity)
+    {
+        rootCapacity = rootCapacity ? rootCapacity * 2 : 16;
+        roots = checked(realloc(roots, rootCapacity * sizeof(Root)));
+    }
+    roots[rootCount].slot = slot;
+    roots[rootCount].card = card;
+    rootCount++;
+}
+
+const char *iron_gc_concat(const char *left, const char *right)
+{
+    if (!isMainThread)
+        return iron_string_concat(left, right);
+    size_t leftLength = strlen(left);
+    size_t rightLength = strlen(right);
+    /* left and right stay on this frame while a collection runs, so they are pinned if they are nursery strings */
+    char *joined = allocate(leftLength + rightLength + 1);
+    memcpy(joined, left, leftLength);
+    memcpy(joined + leftLength, right, rightLength + 1);
+    return joined;
+}
+
+void iron_gc_stats(IronGcStats *current)
+{
+    *current = stats;
+}
@@ -0,0 +1,142 @@
+#include "runtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char *iron_string_concat(const char *left, const char *right)
+{
+    size_t leftLength = strlen(left);
+    size_t rightLength = strlen(right);
+    char *joined = malloc(leftLength + rightLength + 1);
+    if (!joined)
+    {
+        fputs("[FATAL] Out of memory\n", stderr);
+        exit(1);
+    }
+    memcpy(joined, left, leftLength);
+    memcpy(joined + leftLength, right, rightLength + 1);
+    return joined;
+}
+
+_Atomic int64_t iron_tasks_unjoined;
+
+_Noreturn void iron_panic(const char *message)
+{
+    fprintf(stderr, "[FATAL] %s\n", message);
+    exit(1);
+}
+
+/* Zones hand out memory from chunks of IRON_ZONE_CHUNK bytes, a request too big to share a chunk gets one of its own.
+ * The zone record sits at the start of its first chunk so entering a zone is a single chunk from the cache */
+#define IRON_ZONE_CHUNK (64 * 1024)
+#define IRON_ZONE_CACHED_CHUNKS 16
+#define IRON_ZONE_ALIGN 16
+
+typedef struct IronChunk
+{
+    struct IronChunk *next;
+    size_t size; /* Usable bytes after the header */
+} IronChunk;
+
+struct IronZone
+{
+    IronChunk *chunks; /* The chunk being bumped first, the first chunk of the zone last */
+    char *cursor;
+    char *limit;
+};
+
+/* Chunks of the standard size that zones on this thread gave back. A task may finish its zone on another worker,
+ * its chunks then simply go to that worker's cache */
+static _Thread_local IronChunk *cachedChunks;
+static _Thread_local int cachedCount;
+
+static size_t alignUp(size_t size)
+{
+    return (size + IRON_ZONE_ALIGN - 1) & ~(size_t)(IRON_ZONE_ALIGN - 1);
+}
+
+static IronChunk *takeChunk(size_t usable)
+{
+    size_t standard = IRON_ZONE_CHUNK - sizeof(IronChunk);
+    if (usable <= standard && cachedChunks)
+    {
+        IronChunk *chunk = cachedChunks;
+        cachedChunks = chunk->next;
+        cachedCount--;
+        return chunk;
+    }
+    if (usable < standard)
+        usable = standard;
+    IronChunk *chunk = malloc(sizeof(IronChunk) + usable);
+    if (!chunk)
+        iron_panic("Out of memory");
+    chunk->size = usable;
+    return chunk;
+}
+
+static void releaseChunk(IronChunk *chunk)
+{
+    if (chunk->size == IRON_ZONE_CHUNK - sizeof(IronChunk) && cachedCount < IRON_ZONE_CACHED_CHUNKS)
+    {
+        chunk->next = cachedChunks;
+        cachedChunks = chunk;
+        cachedCount++;
+        return;
+    }
+    free(chunk);
+}
+
+IronZone *iron_zone_enter(void)
+{
+    IronChunk *chunk = takeChunk(0);
+    chunk->next = NULL;
+    IronZone *zone = (IronZone *)(chunk + 1);
+    zone->chunks = chunk;
+    zone->cursor = (char *)(chunk + 1) + alignUp(sizeof(IronZone));
+    zone->limit = (char *)(chunk + 1) + chunk->size;
+    return zone;
+}
+
+void *iron_zone_alloc(IronZone *zone, size_t size)
+{
+    size = alignUp(size);
+    if (size > (size_t)(zone->limit - zone->cursor))
+    {
+        IronChunk *chunk = takeChunk(size);
+        if (size > IRON_ZONE_CHUNK / 4)
+        {
+            /* A big request keeps the current chunk for the small ones that follow */
+            chunk->next = zone->chunks->next;
+            zone->chunks->next = chunk;
+            return chunk + 1;
+        }
+        chunk->next = zone->chunks;
+        zone->chunks = chunk;
+        zone->cursor = (char *)(chunk + 1);
+        zone->limit = zone->cursor + chunk->size;
+    }
+    void *memory = zone->cursor;
+    zone->cursor += size;
+    return memory;
+}
+
+void iron_zone_exit(IronZone *zone)
+{
+    IronChunk *chunk = zone->chunks;
+    while (chunk)
+    {
+        IronChunk *next = chunk->next;
+        releaseChunk(chunk);
+        chunk = next;
+    }
+}
+
+const char *iron_zone_concat(const char *left, const char *right, IronZone *zone)
+{
+    size_t leftLength = strlen(left);
+    size_t rightLength = strlen(right);
+    char *joined = iron_zone_alloc(zone, leftLength + rightLength + 1);
+    memcpy(joined, left, leftLength);
+    memcpy(joined + leftLength, right, rightLength + 1);
+    return joined;
+}
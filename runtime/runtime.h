@@ -0,0 +1,126 @@
+#ifndef IRON_RUNTIME_H
+#define IRON_RUNTIME_H
+
+/* Support code linked into native Iron programs, shared by the template, LLVM and C backends.
+ * Strings are NUL terminated and never freed */
+
+#include <stddef.h>
+#include <stdint.h>
+
+const char *iron_string_concat(const char *left, const char *right);
+
+/* Reports a runtime error like division by zero and exits, the VM throws in the same places */
+_Noreturn void iron_panic(const char *message);
+
+/* Integer arithmetic wraps like in the VM. The C backend goes through these so the C compiler
+ * never gets to assume signed overflow away */
+static inline int64_t iron_add(int64_t a, int64_t b) { return (int64_t)((uint64_t)a + (uint64_t)b); }
+static inline int64_t iron_sub(int64_t a, int64_t b) { return (int64_t)((uint64_t)a - (uint64_t)b); }
+static inline int64_t iron_mul(int64_t a, int64_t b) { return (int64_t)((uint64_t)a * (uint64_t)b); }
+static inline int64_t iron_neg(int64_t a) { return (int64_t)(0 - (uint64_t)a); }
+
+static inline int64_t iron_div(int64_t a, int64_t b)
+{
+    if (b == 0)
+        iron_panic("Division by zero");
+    return b == -1 ? iron_neg(a) : a / b;
+}
+
+static inline int64_t iron_mod(int64_t a, int64_t b)
+{
+    if (b == 0)
+        iron_panic("Modulo by zero");
+    return b == -1 ? 0 : a % b;
+}
+
+/* Regions behind zone blocks. Strings concatenated inside a zone are bump allocated from chunks that all go back
+ * when the block ends, nothing in a zone is freed on its own. Chunks are cached per thread so entering a zone
+ * rarely reaches malloc. The zone comes last in iron_zone_concat so the strings stay where iron_string_concat has them */
+typedef struct IronZone IronZone;
+
+IronZone *iron_zone_enter(void);
+void iron_zone_exit(IronZone *zone);
+void *iron_zone_alloc(IronZone *zone, size_t size);
+const char *iron_zone_concat(const char *left, const char *right, IronZone *zone);
+
+/* Green threads behind start and wait, implemented in tasks.c which needs -pthread.
+ * A task gets its arguments as raw 64 bit slots copied at spawn, up to IRON_TASK_INLINE_ARGS of them live in the
+ * task record itself. Waiting inside a task parks it, the main thread runs other tasks until the result is there.
+ * IRON_WORKERS overrides the number of worker threads, the default is one per core */
+#define IRON_TASK_INLINE_ARGS 6
+
+typedef struct IronTask IronTask;
+typedef uint64_t (*iron_task_entry)(const uint64_t *args);
+
+IronTask *iron_task_spawn(iron_task_entry entry, const uint64_t *args, uint32_t count);
+uint64_t iron_task_wait(IronTask *task);
+void iron_task_detach(IronTask *task); /* The signal went out of scope, the record is reused once the task finished too */
+
+/* Tasks started and not waited on yet, a task may hold strings where the collector does not look until then */
+extern _Atomic int64_t iron_tasks_unjoined;
+
+/* Generational collector behind gc bindings, implemented in gc.c. The entry point calls iron_gc_init and registers
+ * every top level string variable with the card that its stores set to 1, iron_gc_concat allocates the strings built
+ * for a gc binding. Pauses are in nanoseconds, sizes in bytes */
+typedef struct
+{
+    uint64_t minorCollections;
+    uint64_t majorCollections;
+    uint64_t minorPauseTotal;
+    uint64_t minorPauseMax;
+    uint64_t majorPauseTotal;
+    uint64_t majorPauseMax;
+    uint64_t allocatedBytes;
+    uint64_t copiedBytes;   /* Moved from the nursery to the old space */
+    uint64_t promotedBytes; /* Became old where they were, the stack may point at them */
+    uint64_t heapBytes;
+} IronGcStats;
+
+void iron_gc_init(void);
+void iron_gc_root(const char **slot, uint64_t *card);
+const char *iron_gc_concat(const char *left, const char *right);
+void iron_gc_stats(IronGcStats *stats);
+
+/* Thread caching allocator behind alloc, make and free, implemented in alloc.c. Blocks go back to the heap of the
+ * thread that allocated them, frees from other threads are batched. reservedBytes counts the segments and the live
+ * large objects */
+typedef struct
+{
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t remoteFrees;   /* Freed by a thread other than the allocating one */
+    uint64_t remoteBatches; /* Pushes that handed those back */
+    uint64_t largeAllocations;
+    uint64_t largeReuses; /* Large allocations that took a span freed earlier instead of a fresh mapping */
+    uint64_t pages;
+    uint64_t reservedBytes;
+} IronAllocStats;
+
+void *iron_alloc(size_t size);
+void iron_free(void *memory);
+void iron_alloc_stats(IronAllocStats *stats);
+
+/* Arrays are allocator blocks with the length in front of the zeroed elements, iron_free takes them back like cells.
+ * One unsigned compare covers both ends of the range */
+void *iron_array_new(int64_t length, size_t elementSize);
+
+static inline void iron_check_index(int64_t index, int64_t length, const char *message)
+{
+    if ((uint64_t)index >= (uint64_t)length)
+        iron_panic(message);
+}
+
+/* Floats travel through the argument and result slots as their bits */
+static inline uint64_t iron_float_bits(double value)
+{
+    union { double f; uint64_t u; } bits = {value};
+    return bits.u;
+}
+
+static inline double iron_bits_float(uint64_t value)
+{
+    union { uint64_t u; double f; } bits = {value};
+    return bits.f;
+}
+
+#endif
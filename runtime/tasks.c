@@ -0,0 +1,554 @@
+/* Green threads for start and wait on a work stealing scheduler.
+ * Every worker owns a Chase-Lev deque: it pushes and pops the bottom end, idle workers steal from the top.
+ * A task runs on a small stack of its own, so waiting on an unfinished task parks it on that task's waiter list
+ * and the worker moves on to other tasks instead of blocking its OS thread. Finished tasks give their stack back
+ * to the worker's pool, so only running and parked tasks hold one. A record goes back to a worker's free list once
+ * the task finished and its signal went out of scope, whichever comes last. The main thread is worker 0: it runs
+ * the program and only picks up tasks while it waits for one */
+
+#define _GNU_SOURCE
+#include "runtime.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#if !defined(__x86_64__) || !defined(__ELF__) || defined(IRON_TASKS_UCONTEXT)
+#define IRON_TASKS_USE_UCONTEXT 1
+#include <ucontext.h>
+#endif
+
+#define STACK_SIZE (256 * 1024)
+#define MAX_WORKERS 256
+#define CACHED_TASKS 1024
+#define SPINS_BEFORE_SLEEP 64
+
+/*---------CONTEXT SWITCH----------*/
+#ifdef IRON_TASKS_USE_UCONTEXT
+typedef struct
+{
+    ucontext_t context;
+} Context;
+
+static void contextSwitch(Context *from, Context *to)
+{
+    swapcontext(&from->context, &to->context);
+}
+
+static void contextPrepare(Context *context, char *base, size_t size, void (*entry)(void))
+{
+    getcontext(&context->context);
+    context->context.uc_stack.ss_sp = base;
+    context->context.uc_stack.ss_size = size;
+    context->context.uc_link = NULL;
+    makecontext(&context->context, entry, 0);
+}
+#else
+/* Saves the callee saved registers on the current stack, stores the stack pointer in *from and continues on the
+ * stack in to. Everything else is caller saved in the System V ABI so the compiler already spilled it */
+void iron_switch_context(void **from, void *to);
+__asm__(".text\n"
+        ".globl iron_switch_context\n"
+        ".hidden iron_switch_context\n"
+        ".type iron_switch_context, @function\n"
+        "iron_switch_context:\n"
+        "    pushq %rbp\n"
+        "    pushq %rbx\n"
+        "    pushq %r12\n"
+        "    pushq %r13\n"
+        "    pushq %r14\n"
+        "    pushq %r15\n"
+        "    movq %rsp, (%rdi)\n"
+        "    movq %rsi, %rsp\n"
+        "    popq %r15\n"
+        "    popq %r14\n"
+        "    popq %r13\n"
+        "    popq %r12\n"
+        "    popq %rbx\n"
+        "    popq %rbp\n"
+        "    ret\n"
+        ".size iron_switch_context, .-iron_switch_context\n");
+
+typedef struct
+{
+    void *sp;
+} Context;
+
+static void contextSwitch(Context *from, Context *to)
+{
+    iron_switch_context(&from->sp, to->sp);
+}
+
+/* A fresh stack looks like a switch left it: six saved registers and the entry as return address, placed so the
+ * entry starts with the stack aligned like right after a call */
+static void contextPrepare(Context *context, char *base, size_t size, void (*entry)(void))
+{
+    uintptr_t top = ((uintptr_t)(base + size)) & ~(uintptr_t)15;
+    void **sp = (void **)top;
+    *--sp = NULL; /* Return address of the entry, it never returns */
+    *--sp = (void *)entry;
+    for (int i = 0; i < 6; ++i)
+    {
+        *--sp = NULL;
+    }
+    context->sp = sp;
+}
+#endif
+
+/*---------TASKS----------*/
+typedef struct Stack
+{
+    struct Stack *next; /* In the pool */
+    Context context;    /* Where the task on this stack continues */
+} Stack;
+
+typedef struct Worker Worker;
+
+struct IronTask
+{
+    iron_task_entry entry;
+    uint64_t *args;
+    uint64_t result;
+    _Atomic(IronTask *) waiters; /* Parked tasks waiting for this one, FINISHED once the result is there */
+    IronTask *nextWaiter;
+    Stack *stack;   /* Only while running or parked */
+    Worker *worker; /* The worker that resumed it last, the task may move between OS threads every time it parks */
+    atomic_int joined;
+    atomic_int holders; /* The scheduler until the task finished and the handle until it is detached */
+    uint64_t inlineArgs[IRON_TASK_INLINE_ARGS];
+};
+
+static IronTask finishedMarker;
+#define FINISHED (&finishedMarker)
+
+/*---------DEQUES----------*/
+typedef struct
+{
+    int64_t capacity; /* Power of two */
+    _Atomic(IronTask *) slots[];
+} Ring;
+
+typedef struct
+{
+    _Atomic int64_t top;
+    _Atomic int64_t bottom;
+    _Atomic(Ring *) ring;
+} Deque;
+
+static Ring *ringCreate(int64_t capacity)
+{
+    Ring *ring = malloc(sizeof(Ring) + capacity * sizeof(IronTask *));
+    if (!ring)
+        iron_panic("Out of memory");
+    ring->capacity = capacity;
+    return ring;
+}
+
+/* Only the owner grows the ring, thieves may still read the old one so it is never freed */
+static Ring *ringGrow(Ring *old, int64_t top, int64_t bottom)
+{
+    Ring *ring = ringCreate(old->capacity * 2);
+    for (int64_t i = top; i < bottom; ++i)
+    {
+        atomic_store_explicit(&ring->slots[i & (ring->capacity - 1)], atomic_load_explicit(&old->slots[i & (old->capacity - 1)], memory_order_relaxed),
+                              memory_order_relaxed);
+    }
+    return ring;
+}
+
+static void dequePush(Deque *deque, IronTask *task)
+{
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    Ring *ring = atomic_load_explicit(&deque->ring, memory_order_relaxed);
+    if (bottom - top > ring->capacity - 1)
+    {
+        ring = ringGrow(ring, top, bottom);
+        atomic_store_explicit(&deque->ring, ring, memory_order_release);
+    }
+    atomic_store_explicit(&ring->slots[bottom & (ring->capacity - 1)], task, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release); /* Publishes the task to thieves */
+}
+
+static IronTask *dequeTake(Deque *deque)
+{
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    Ring *ring = atomic_load_explicit(&deque->ring, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    if (top > bottom)
+    {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+    IronTask *task = atomic_load_explicit(&ring->slots[bottom & (ring->capacity - 1)], memory_order_relaxed);
+    if (top == bottom)
+    {
+        /* The last task, a thief may be going for it too */
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+            task = NULL;
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+static IronTask *dequeSteal(Deque *deque)
+{
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom)
+        return NULL;
+    Ring *ring = atomic_load_explicit(&deque->ring, memory_order_acquire);
+    IronTask *task = atomic_load_explicit(&ring->slots[top & (ring->capacity - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+        return NULL;
+    return task;
+}
+
+/*---------WORKERS----------*/
+enum Request
+{
+    REQUEST_FINISHED,
+    REQUEST_PARK,
+};
+
+struct Worker
+{
+    Deque deque;
+    Context scheduler;   /* Where the worker continues when its current task finishes or parks */
+    IronTask *current;
+    enum Request request; /* Why the current task switched back */
+    IronTask *parkOn;
+    Stack *stackPool;
+    IronTask *freeTasks; /* Records to reuse, linked through nextWaiter */
+    int freeCount;
+    uint32_t random;
+};
+
+static Worker workers[MAX_WORKERS];
+static int workerCount;
+static _Thread_local Worker *currentWorker;
+static pthread_once_t startOnce = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t sleepLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sleepCondition = PTHREAD_COND_INITIALIZER;
+static _Atomic int sleepers;
+
+static void *workerMain(void *argument);
+
+static int configuredWorkers(void)
+{
+    const char *text = getenv("IRON_WORKERS");
+    long count = text ? strtol(text, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (count < 1)
+        count = 1;
+    return count > MAX_WORKERS ? MAX_WORKERS : (int)count;
+}
+
+static void startWorkers(void)
+{
+    workerCount = configuredWorkers();
+    for (int i = 0; i < workerCount; ++i)
+    {
+        atomic_init(&workers[i].deque.ring, ringCreate(1024));
+        workers[i].random = 0x9e3779b9u * (i + 1);
+    }
+    currentWorker = &workers[0];
+    for (int i = 1; i < workerCount; ++i)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, workerMain, &workers[i]) != 0)
+            iron_panic("Could not start a worker thread");
+        pthread_detach(thread);
+    }
+}
+
+static void notifySleepers(void)
+{
+    if (atomic_load_explicit(&sleepers, memory_order_relaxed) == 0)
+        return;
+    pthread_mutex_lock(&sleepLock);
+    pthread_cond_signal(&sleepCondition);
+    pthread_mutex_unlock(&sleepLock);
+}
+
+/* The timeout covers a push that checked for sleepers just before this worker went to sleep */
+static void sleepBriefly(void)
+{
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += 1000000;
+    if (until.tv_nsec >= 1000000000)
+    {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&sleepLock);
+    atomic_fetch_add(&sleepers, 1);
+    pthread_cond_timedwait(&sleepCondition, &sleepLock, &until);
+    atomic_fetch_sub(&sleepers, 1);
+    pthread_mutex_unlock(&sleepLock);
+}
+
+static IronTask *findTask(Worker *worker)
+{
+    IronTask *task = dequeTake(&worker->deque);
+    if (task || workerCount == 1)
+        return task;
+    /* xorshift picks where to start so thieves spread over the victims */
+    uint32_t x = worker->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    worker->random = x;
+    for (int i = 0; i < workerCount; ++i)
+    {
+        Worker *victim = &workers[(x + i) % workerCount];
+        if (victim != worker && (task = dequeSteal(&victim->deque)))
+            return task;
+    }
+    return NULL;
+}
+
+static void readyTask(Worker *worker, IronTask *task)
+{
+    dequePush(&worker->deque, task);
+    notifySleepers();
+}
+
+/*---------STACKS----------*/
+static Stack *stackAcquire(Worker *worker)
+{
+    Stack *stack = worker->stackPool;
+    if (stack)
+    {
+        worker->stackPool = stack->next;
+        return stack;
+    }
+    /* The lowest page stays inaccessible so running off the end faults instead of corrupting a neighbour */
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char *memory = mmap(NULL, STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED)
+        iron_panic("Out of memory for task stacks");
+    mprotect(memory, page, PROT_NONE);
+    stack = (Stack *)(memory + STACK_SIZE - sizeof(Stack));
+    stack->next = NULL;
+    return stack;
+}
+
+static void stackRelease(Worker *worker, Stack *stack)
+{
+    stack->next = worker->stackPool;
+    worker->stackPool = stack;
+}
+
+static char *stackBase(Stack *stack)
+{
+    return (char *)stack + sizeof(Stack) - STACK_SIZE;
+}
+
+/*---------RECORDS----------*/
+static IronTask *taskAcquire(Worker *worker)
+{
+    IronTask *task = worker->freeTasks;
+    if (task)
+    {
+        worker->freeTasks = task->nextWaiter;
+        worker->freeCount--;
+        return task;
+    }
+    task = malloc(sizeof(IronTask));
+    if (!task)
+        iron_panic("Out of memory");
+    return task;
+}
+
+/* Called by whoever lets go of the record last. It goes to the free list of the worker that thread runs, a
+ * full list hands it back to malloc so records freed away from where they were started can't pile up */
+static void taskRelease(IronTask *task)
+{
+    if (atomic_fetch_sub_explicit(&task->holders, 1, memory_order_acq_rel) != 1)
+        return;
+    if (!atomic_load_explicit(&task->joined, memory_order_relaxed))
+        atomic_fetch_sub(&iron_tasks_unjoined, 1); /* Nobody can wait for its result anymore */
+    Worker *worker = currentWorker;
+    if (!worker || worker->freeCount >= CACHED_TASKS)
+    {
+        free(task);
+        return;
+    }
+    task->nextWaiter = worker->freeTasks;
+    worker->freeTasks = task;
+    worker->freeCount++;
+}
+
+/*---------RUNNING----------*/
+/* First frame of every task stack, it reads the task from the worker that just switched to it */
+static void taskMain(void)
+{
+    IronTask *task = currentWorker->current;
+    task->result = task->entry(task->args);
+    if (task->args != task->inlineArgs)
+        free(task->args);
+    Worker *worker = task->worker; /* Not the one it started on if it parked in between */
+    worker->request = REQUEST_FINISHED;
+    contextSwitch(&task->stack->context, &worker->scheduler);
+    __builtin_unreachable();
+}
+
+static void runTask(Worker *worker, IronTask *task)
+{
+    if (!task->stack)
+    {
+        task->stack = stackAcquire(worker);
+        contextPrepare(&task->stack->context, stackBase(task->stack) + sysconf(_SC_PAGESIZE),
+                       STACK_SIZE - sizeof(Stack) - sysconf(_SC_PAGESIZE), taskMain);
+    }
+    task->worker = worker;
+    worker->current = task;
+    contextSwitch(&worker->scheduler, &task->stack->context);
+    worker->current = NULL;
+
+    if (worker->request == REQUEST_FINISHED)
+    {
+        stackRelease(worker, task->stack);
+        task->stack = NULL;
+        IronTask *waiter = atomic_exchange_explicit(&task->waiters, FINISHED, memory_order_acq_rel);
+        while (waiter)
+        {
+            IronTask *next = waiter->nextWaiter;
+            readyTask(worker, waiter);
+            waiter = next;
+        }
+        taskRelease(task);
+        return;
+    }
+
+    /* The task is off its stack now, so it can go on the waiter list without anyone resuming it too early */
+    IronTask *target = worker->parkOn;
+    IronTask *head = atomic_load_explicit(&target->waiters, memory_order_acquire);
+    do
+    {
+        if (head == FINISHED)
+        {
+            readyTask(worker, task);
+            return;
+        }
+        task->nextWaiter = head;
+    } while (!atomic_compare_exchange_weak_explicit(&target->waiters, &head, task, memory_order_acq_rel, memory_order_acquire));
+}
+
+static void *workerMain(void *argument)
+{
+    Worker *worker = argument;
+    currentWorker = worker;
+    int idle = 0;
+    for (;;)
+    {
+        IronTask *task = findTask(worker);
+        if (task)
+        {
+            runTask(worker, task);
+            idle = 0;
+        }
+        else if (++idle < SPINS_BEFORE_SLEEP)
+        {
+            sched_yield();
+        }
+        else
+        {
+            sleepBriefly();
+        }
+    }
+    return NULL;
+}
+
+static int isFinished(IronTask *task)
+{
+    return atomic_load_explicit(&task->waiters, memory_order_acquire) == FINISHED;
+}
+
+/*---------API----------*/
+IronTask *iron_task_spawn(iron_task_entry entry, const uint64_t *args, uint32_t count)
+{
+    pthread_once(&startOnce, startWorkers);
+    Worker *worker = currentWorker;
+    if (!worker)
+        iron_panic("Tasks can only be started from the program's own threads");
+
+    IronTask *task = taskAcquire(worker);
+    task->entry = entry;
+    task->stack = NULL;
+    task->nextWaiter = NULL;
+    atomic_init(&task->waiters, NULL);
+    atomic_init(&task->joined, 0);
+    atomic_init(&task->holders, 2);
+    atomic_fetch_add(&iron_tasks_unjoined, 1);
+    task->args = task->inlineArgs;
+    if (count > IRON_TASK_INLINE_ARGS)
+    {
+        task->args = malloc(count * sizeof(uint64_t));
+        if (!task->args)
+            iron_panic("Out of memory");
+    }
+    memcpy(task->args, args, count * sizeof(uint64_t));
+    readyTask(worker, task);
+    return task;
+}
+
+static uint64_t waitFor(IronTask *task)
+{
+    if (isFinished(task))
+        return task->result;
+    Worker *worker = currentWorker;
+    IronTask *self = worker ? worker->current : NULL;
+    if (self)
+    {
+        worker->request = REQUEST_PARK;
+        worker->parkOn = task;
+        contextSwitch(&self->stack->context, &worker->scheduler);
+        /* Only resumed once the task finished, possibly on another worker */
+        return task->result;
+    }
+
+    /* The main thread has no stack to park, it runs other tasks until this one is done */
+    int idle = 0;
+    while (!isFinished(task))
+    {
+        IronTask *next = findTask(worker);
+        if (next)
+        {
+            runTask(worker, next);
+            idle = 0;
+        }
+        else if (++idle < SPINS_BEFORE_SLEEP)
+        {
+            sched_yield();
+        }
+        else
+        {
+            sleepBriefly();
+        }
+    }
+    return task->result;
+}
+
+uint64_t iron_task_wait(IronTask *task)
+{
+    uint64_t result = waitFor(task);
+    if (!atomic_exchange(&task->joined, 1))
+        atomic_fetch_sub(&iron_tasks_unjoined, 1);
+    return result;
+}
+
+void iron_task_detach(IronTask *task)
+{
+    taskRelease(task);
+}
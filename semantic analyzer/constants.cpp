@@ -0,0 +1,256 @@
+#include <cmath>
+#include <limits>
+#include <string>
+#include "semantics.hpp"
+#include "ast.hpp"
+
+// Compile time evaluation of literals, fixed bindings and the operators applied to them.
+// The folded values are stored in the annotations so the later stages can use them as immediates
+
+namespace
+{
+    ConstantValue makeInt(int64_t value)
+    {
+        return ConstantValue{.type = TypeSystem::INTEGER, .intValue = value};
+    }
+
+    ConstantValue makeFloat(double value)
+    {
+        return ConstantValue{.type = TypeSystem::FLOAT, .floatValue = value};
+    }
+
+    ConstantValue makeBool(bool value)
+    {
+        return ConstantValue{.type = TypeSystem::BOOLEAN, .boolValue = value};
+    }
+
+    ConstantValue makeString(std::string value)
+    {
+        return ConstantValue{.type = TypeSystem::STRING, .stringValue = std::move(value)};
+    }
+
+    bool isNumeric(const ConstantValue &value)
+    {
+        return value.type == TypeSystem::INTEGER || value.type == TypeSystem::FLOAT;
+    }
+
+    double asFloat(const ConstantValue &value)
+    {
+        return value.type == TypeSystem::INTEGER ? (double)value.intValue : value.floatValue;
+    }
+
+    // Folding the comparison operators for any ordered value
+    template <typename T>
+    std::optional<ConstantValue> foldComparison(TokenType op, const T &left, const T &right)
+    {
+        switch (op)
+        {
+        case TokenType::EQUALS:
+            return makeBool(left == right);
+        case TokenType::NOT_EQUALS:
+            return makeBool(left != right);
+        case TokenType::LESS_THAN:
+            return makeBool(left < right);
+        case TokenType::GREATER_THAN:
+            return makeBool(left > right);
+        case TokenType::LT_OR_EQ:
+            return makeBool(left <= right);
+        case TokenType::GT_OR_EQ:
+            return makeBool(left >= right);
+        default:
+            return std::nullopt;
+        }
+    }
+}
+
+// Reading the annotation that was recorded for a node
+const SemanticInfo *Semantics::getAnnotation(Node *node) const
+{
+    auto it = annotations.find(node);
+    if (it == annotations.end())
+        return nullptr;
+    return &it->second;
+}
+
+// Reading the compile time value that was recorded for a node if it has one
+std::optional<ConstantValue> Semantics::constantOf(Node *node) const
+{
+    auto info = getAnnotation(node);
+    if (!info || !info->isConstant)
+        return std::nullopt;
+    return info->constantValue;
+}
+
+void Semantics::forgetAnnotation(Node *node)
+{
+    annotations.erase(node);
+    drops.erase(node);
+}
+
+std::optional<ConstantValue> Semantics::foldIntegerLiteral(IntegerLiteral *node)
+{
+    try
+    {
+        return makeInt(std::stoll(node->int_token.TokenLiteral));
+    }
+    catch (const std::out_of_range &)
+    {
+        logError("Integer literal '" + node->int_token.TokenLiteral + "' is out of range", node, DiagnosticCode::CONSTANT_FOLDING);
+        return std::nullopt;
+    }
+}
+
+std::optional<ConstantValue> Semantics::foldInfix(InfixExpression *node, const ConstantValue &left, const ConstantValue &right)
+{
+    TokenType op = node->operat.type;
+
+    // Boolean logic
+    if (left.type == TypeSystem::BOOLEAN && right.type == TypeSystem::BOOLEAN)
+    {
+        switch (op)
+        {
+        case TokenType::AND:
+            return makeBool(left.boolValue && right.boolValue);
+        case TokenType::OR:
+            return makeBool(left.boolValue || right.boolValue);
+        case TokenType::EQUALS:
+            return makeBool(left.boolValue == right.boolValue);
+        case TokenType::NOT_EQUALS:
+            return makeBool(left.boolValue != right.boolValue);
+        default:
+            return std::nullopt;
+        }
+    }
+
+    // String concatenation and comparison
+    if (left.type == TypeSystem::STRING && right.type == TypeSystem::STRING)
+    {
+        if (op == TokenType::PLUS)
+            return makeString(left.stringValue + right.stringValue);
+        return foldComparison(op, left.stringValue, right.stringValue);
+    }
+
+    if (left.type == TypeSystem::CHAR && right.type == TypeSystem::CHAR)
+    {
+        return foldComparison(op, left.charValue, right.charValue);
+    }
+
+    if (!isNumeric(left) || !isNumeric(right))
+        return std::nullopt;
+
+    // Integer arithmetic is checked for overflow since the result has to fit in the target int
+    if (left.type == TypeSystem::INTEGER && right.type == TypeSystem::INTEGER)
+    {
+        int64_t a = left.intValue;
+        int64_t b = right.intValue;
+        int64_t result = 0;
+        switch (op)
+        {
+        case TokenType::PLUS:
+            if (__builtin_add_overflow(a, b, &result))
+            {
+                logError("Integer overflow while folding " + std::to_string(a) + " + " + std::to_string(b), node, DiagnosticCode::CONSTANT_FOLDING);
+                return std::nullopt;
+            }
+            return makeInt(result);
+        case TokenType::MINUS:
+            if (__builtin_sub_overflow(a, b, &result))
+            {
+                logError("Integer overflow while folding " + std::to_string(a) + " - " + std::to_string(b), node, DiagnosticCode::CONSTANT_FOLDING);
+                return std::nullopt;
+            }
+            return makeInt(result);
+        case TokenType::ASTERISK:
+            if (__builtin_mul_overflow(a, b, &result))
+            {
+                logError("Integer overflow while folding " + std::to_string(a) + " * " + std::to_string(b), node, DiagnosticCode::CONSTANT_FOLDING);
+                return std::nullopt;
+            }
+            return makeInt(result);
+        case TokenType::DIVIDE:
+        case TokenType::MODULUS:
+            if (b == 0)
+            {
+                logError("Division by zero in constant expression", node, DiagnosticCode::CONSTANT_FOLDING);
+                return std::nullopt;
+            }
+            if (a == std::numeric_limits<int64_t>::min() && b == -1)
+            {
+                logError("Integer overflow while folding division of " + std::to_string(a) + " by -1", node, DiagnosticCode::CONSTANT_FOLDING);
+                return std::nullopt;
+            }
+            return makeInt(op == TokenType::DIVIDE ? a / b : a % b);
+        default:
+            return foldComparison(op, a, b);
+        }
+    }
+
+    // Mixed or float arithmetic is done in double precision like at runtime
+    double a = asFloat(left);
+    double b = asFloat(right);
+    switch (op)
+    {
+    case TokenType::PLUS:
+        return makeFloat(a + b);
+    case TokenType::MINUS:
+        return makeFloat(a - b);
+    case TokenType::ASTERISK:
+        return makeFloat(a * b);
+    case TokenType::DIVIDE:
+    case TokenType::MODULUS:
+        if (b == 0.0)
+        {
+            logError("Division by zero in constant expression", node, DiagnosticCode::CONSTANT_FOLDING);
+            return std::nullopt;
+        }
+        return makeFloat(op == TokenType::DIVIDE ? a / b : std::fmod(a, b));
+    default:
+        return foldComparison(op, a, b);
+    }
+}
+
+std::optional<ConstantValue> Semantics::foldPrefix(PrefixExpression *node, const ConstantValue &operand)
+{
+    switch (node->operat.type)
+    {
+    case TokenType::BANG:
+        if (operand.type == TypeSystem::BOOLEAN)
+            return makeBool(!operand.boolValue);
+        return std::nullopt;
+    case TokenType::MINUS:
+        if (operand.type == TypeSystem::INTEGER)
+        {
+            if (operand.intValue == std::numeric_limits<int64_t>::min())
+            {
+                logError("Integer overflow while folding negation of " + std::to_string(operand.intValue), node, DiagnosticCode::CONSTANT_FOLDING);
+                return std::nullopt;
+            }
+            return makeInt(-operand.intValue);
+        }
+        if (operand.type == TypeSystem::FLOAT)
+            return makeFloat(-operand.floatValue);
+        return std::nullopt;
+    default:
+        // ++ and -- change their operand so they are never folded
+        return std::nullopt;
+    }
+}
+
+std::string Semantics::constantToString(const ConstantValue &value)
+{
+    switch (value.type)
+    {
+    case TypeSystem::INTEGER:
+        return std::to_string(value.intValue);
+    case TypeSystem::FLOAT:
+        return std::to_string(value.floatValue);
+    case TypeSystem::BOOLEAN:
+        return value.boolValue ? "true" : "false";
+    case TypeSystem::CHAR:
+        return "'" + std::string(1, value.charValue) + "'";
+    case TypeSystem::STRING:
+        return "\"" + value.stringValue + "\"";
+    default:
+        return "<unknown>";
+    }
+}
@@ -0,0 +1,524 @@
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "semantics.hpp"
+#include "ast.hpp"
+
+// A unique pointer owns its cell alone. Giving it to another unique binding, a unique parameter or a return moves
+// the cell and the old name may not be used again, and whatever a unique binding still owns when its block ends,
+// or when a break, continue or return leaves it, is freed right there. Moves happen at compile time only, there is
+// no flag at run time saying whether a binding still owns its cell, so every path has to agree on it.
+// A signal is dropped the same way so the record of its task can be reused, it is never moved and reading it
+// only waits for the result, so it owns nothing the checks above look at
+
+namespace
+{
+    struct Owner
+    {
+        std::string name;
+        Node *declaration; // The let or the parameter, the lowering finds the variable through it
+        bool moved = false;
+    };
+
+    struct OwnershipScope
+    {
+        std::unordered_map<std::string, Owner *> names; // Plain bindings are kept as null so they shadow outer owners
+        std::vector<Owner *> owners;                    // In declaration order, they are dropped the other way around
+    };
+
+    // Which owners have given their cell away at one point of the walk
+    struct OwnershipState
+    {
+        std::vector<std::pair<Owner *, bool>> moved;
+        bool ended = false;
+    };
+
+    struct LoopEntry
+    {
+        size_t scopeCount; // Scopes open before the loop, break and continue drop the ones above
+        OwnershipState state;
+    };
+
+    struct OwnershipWalker
+    {
+        const std::unordered_map<std::string, std::vector<bool>> &uniqueParameters;
+        std::vector<std::pair<std::string, Node *>> errors{};
+        std::unordered_map<Node *, std::vector<Node *>> drops{};
+        std::deque<Owner> allOwners{};
+        std::vector<OwnershipScope> scopes{1};
+        std::vector<LoopEntry> loops{};
+        size_t functionScope = 1; // First scope of the current work, a return drops everything from there
+        bool ended = false;       // The path already left through a return, break or continue
+
+        Owner *ownerOf(Node *node) const
+        {
+            auto ident = dynamic_cast<Identifier *>(node);
+            if (!ident)
+                return nullptr;
+            for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope)
+            {
+                auto it = scope->names.find(ident->identifier.TokenLiteral);
+                if (it != scope->names.end())
+                    return it->second;
+            }
+            return nullptr;
+        }
+
+        // Values a unique binding may take over, anything else could still be reachable through another name
+        bool givesOwnership(Node *value) const
+        {
+            return ownerOf(value) || dynamic_cast<AllocExpression *>(value) || dynamic_cast<ArrayLiteral *>(value) || dynamic_cast<CallExpression *>(value);
+        }
+
+        void declare(const std::string &name, Node *declaration, bool unique, bool moved = false)
+        {
+            if (!unique)
+            {
+                scopes.back().names[name] = nullptr;
+                return;
+            }
+            allOwners.push_back({name, declaration, moved});
+            scopes.back().names[name] = &allOwners.back();
+            scopes.back().owners.push_back(&allOwners.back());
+        }
+
+        // Dropped with the scope but not a name anything can take over
+        void declareSignal(const std::string &name, SignalStatement *signalStmt)
+        {
+            declare(name, signalStmt, false);
+            allOwners.push_back({name, signalStmt});
+            scopes.back().owners.push_back(&allOwners.back());
+        }
+
+        void use(Owner *owner, Node *node)
+        {
+            if (owner->moved)
+                errors.push_back({"'" + owner->name + "' is used after it was moved", node});
+        }
+
+        // The value goes to a unique binding, parameter or the caller, a unique identifier gives its cell away
+        void take(Node *value)
+        {
+            if (Owner *owner = ownerOf(value))
+            {
+                use(owner, value);
+                owner->moved = true;
+                return;
+            }
+            walk(value);
+        }
+
+        // Owners in the scopes from the first one up that still hold their cell, innermost and latest first
+        std::vector<Node *> liveOwners(size_t first) const
+        {
+            std::vector<Node *> live;
+            for (size_t i = scopes.size(); i > first; --i)
+            {
+                auto &owners = scopes[i - 1].owners;
+                for (auto owner = owners.rbegin(); owner != owners.rend(); ++owner)
+                {
+                    if (!(*owner)->moved)
+                        live.push_back((*owner)->declaration);
+                }
+            }
+            return live;
+        }
+
+        void dropScope(Node *node)
+        {
+            if (ended)
+                return;
+            auto live = liveOwners(scopes.size() - 1);
+            if (!live.empty())
+                drops[node] = live;
+        }
+
+        OwnershipState save() const
+        {
+            OwnershipState state;
+            state.ended = ended;
+            for (auto &scope : scopes)
+            {
+                for (auto owner : scope.owners)
+                    state.moved.push_back({owner, owner->moved});
+            }
+            return state;
+        }
+
+        void restore(const OwnershipState &state)
+        {
+            for (auto &[owner, moved] : state.moved)
+                owner->moved = moved;
+            ended = state.ended;
+        }
+
+        // The paths out of an if meet again, the ones that returned or jumped away do not count
+        void merge(const std::vector<OwnershipState> &paths, Node *node)
+        {
+            std::vector<const OwnershipState *> live;
+            for (auto &path : paths)
+            {
+                if (!path.ended)
+                    live.push_back(&path);
+            }
+            if (live.empty())
+            {
+                restore(paths.front());
+                return;
+            }
+            restore(*live.front());
+            for (size_t i = 0; i < live.front()->moved.size(); ++i)
+            {
+                auto [owner, moved] = live.front()->moved[i];
+                for (auto path : live)
+                {
+                    if (path->moved[i].second != moved)
+                    {
+                        errors.push_back({"'" + owner->name + "' is moved on only some paths through the if, move it on all of them or none", node});
+                        owner->moved = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        // Every way back to the top of a loop and out of it has to leave the outer owners like they were before it
+        void checkIteration(const OwnershipState &entry, Node *node)
+        {
+            for (auto &[owner, moved] : entry.moved)
+            {
+                if (owner->moved == moved)
+                    continue;
+                if (owner->moved)
+                    errors.push_back({"'" + owner->name + "' is moved inside a loop, the next iteration would use it again", node});
+                else
+                    errors.push_back({"'" + owner->name + "' gets a new cell inside a loop after it was moved before it, assign it before the loop", node});
+                owner->moved = moved;
+            }
+        }
+
+        void walkBlock(Node *block, const std::vector<std::unique_ptr<Statement>> &statements, Expression *finalExpr = nullptr, bool isBody = false)
+        {
+            scopes.push_back({});
+            for (auto &stmt : statements)
+            {
+                // Nothing after a return, break or continue runs
+                if (ended)
+                    break;
+                walk(stmt.get());
+            }
+            if (!ended && finalExpr)
+            {
+                // The trailing expression of a work body is what it returns
+                if (isBody)
+                    take(finalExpr);
+                else
+                    walk(finalExpr);
+            }
+            dropScope(block);
+            scopes.pop_back();
+        }
+
+        void walkFunction(FunctionExpression *funcExpr)
+        {
+            auto body = dynamic_cast<BlockExpression *>(funcExpr->block.get());
+            if (!body)
+                return;
+            size_t savedFunctionScope = functionScope;
+            auto savedLoops = std::move(loops);
+            loops.clear();
+            ended = false;
+
+            scopes.push_back({});
+            functionScope = scopes.size() - 1;
+            for (auto &param : funcExpr->call)
+            {
+                if (auto letParam = dynamic_cast<LetStatement *>(param.get()))
+                    declare(letParam->ident_token.TokenLiteral, letParam, letParam->unique_token.has_value());
+                else if (auto assignParam = dynamic_cast<AssignmentStatement *>(param.get()))
+                    declare(assignParam->ident_token.TokenLiteral, assignParam, false);
+            }
+            walkBlock(body, body->statements, body->finalexpr.has_value() ? body->finalexpr.value().get() : nullptr, true);
+
+            // The unique parameters the work kept are freed after its locals
+            if (!ended)
+            {
+                auto params = liveOwners(scopes.size() - 1);
+                auto &bodyDrops = drops[body];
+                bodyDrops.insert(bodyDrops.end(), params.begin(), params.end());
+                if (bodyDrops.empty())
+                    drops.erase(body);
+            }
+            scopes.pop_back();
+
+            functionScope = savedFunctionScope;
+            loops = std::move(savedLoops);
+            ended = false;
+        }
+
+        void walkLoop(Node *loop, Node *body, Expression *step)
+        {
+            OwnershipState entry = save();
+            loops.push_back({scopes.size(), entry});
+            walk(body);
+            if (!ended)
+            {
+                walk(step);
+                checkIteration(entry, loop);
+            }
+            loops.pop_back();
+            restore(entry);
+        }
+
+        void walk(Node *node)
+        {
+            if (!node)
+                return;
+
+            if (auto funcStmt = dynamic_cast<FunctionStatement *>(node))
+            {
+                if (auto funcExpr = dynamic_cast<FunctionExpression *>(funcStmt->funcExpr.get()))
+                    walkFunction(funcExpr);
+            }
+            else if (auto blockStmt = dynamic_cast<BlockStatement *>(node))
+            {
+                walkBlock(blockStmt, blockStmt->statements);
+            }
+            else if (auto blockExpr = dynamic_cast<BlockExpression *>(node))
+            {
+                walkBlock(blockExpr, blockExpr->statements, blockExpr->finalexpr.has_value() ? blockExpr->finalexpr.value().get() : nullptr);
+            }
+            else if (auto letStmt = dynamic_cast<LetStatement *>(node))
+            {
+                auto name = letStmt->ident_token.TokenLiteral;
+                Owner *source = ownerOf(letStmt->value.get());
+                bool unique = letStmt->unique_token.has_value();
+                if (unique)
+                {
+                    if (scopes.size() == 1)
+                        errors.push_back({"'" + name + "' can not be unique at the top level, it would never be freed", letStmt});
+                    if (letStmt->value && !givesOwnership(letStmt->value.get()))
+                        errors.push_back({"'" + name + "' can only own a cell from alloc, make, a work or another unique pointer", letStmt});
+                    take(letStmt->value.get());
+                }
+                else
+                {
+                    if (source)
+                        errors.push_back({"'" + name + "' would share the cell owned by '" + source->name + "', declare it unique to move the cell", letStmt});
+                    walk(letStmt->value.get());
+                }
+                // Without a value there is nothing to free yet
+                declare(name, letStmt, unique, !letStmt->value);
+            }
+            else if (auto assign = dynamic_cast<AssignmentStatement *>(node))
+            {
+                auto name = assign->ident_token.TokenLiteral;
+                Owner *target = nullptr;
+                for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope)
+                {
+                    auto it = scope->names.find(name);
+                    if (it != scope->names.end())
+                    {
+                        target = it->second;
+                        break;
+                    }
+                }
+                Owner *source = ownerOf(assign->value.get());
+                if (target)
+                {
+                    if (!givesOwnership(assign->value.get()))
+                        errors.push_back({"'" + name + "' can only own a cell from alloc, make, a work or another unique pointer", assign});
+                    take(assign->value.get());
+                    // The cell it owned so far goes away with the assignment
+                    if (!target->moved)
+                        drops[assign] = {target->declaration};
+                    target->moved = false;
+                }
+                else
+                {
+                    if (source)
+                        errors.push_back({"'" + name + "' would share the cell owned by '" + source->name + "', declare it unique to move the cell", assign});
+                    walk(assign->value.get());
+                }
+            }
+            else if (auto call = dynamic_cast<CallExpression *>(node))
+            {
+                const std::vector<bool> *unique = nullptr;
+                std::string work = call->function_identifier ? call->function_identifier->token.TokenLiteral : "";
+                if (auto it = uniqueParameters.find(work); it != uniqueParameters.end())
+                    unique = &it->second;
+                for (size_t i = 0; i < call->parameters.size(); ++i)
+                {
+                    Node *arg = call->parameters[i].get();
+                    if (unique && i < unique->size() && (*unique)[i])
+                    {
+                        if (!givesOwnership(arg))
+                            errors.push_back({"'" + work + "' takes over argument " + std::to_string(i + 1) + ", pass it a unique pointer or a new cell", call});
+                        take(arg);
+                    }
+                    else
+                    {
+                        walk(arg); // Lent for the call, the caller still owns it
+                    }
+                }
+            }
+            else if (auto signalStmt = dynamic_cast<SignalStatement *>(node))
+            {
+                // A task may run after the caller freed what it lent, so tasks only take cells over
+                auto call = dynamic_cast<CallExpression *>(signalStmt->func_arg.get());
+                std::string work = call && call->function_identifier ? call->function_identifier->token.TokenLiteral : "";
+                auto it = uniqueParameters.find(work);
+                for (size_t i = 0; call && i < call->parameters.size(); ++i)
+                {
+                    Owner *owner = ownerOf(call->parameters[i].get());
+                    bool takes = it != uniqueParameters.end() && i < it->second.size() && it->second[i];
+                    if (owner && !takes)
+                        errors.push_back({"The task of '" + work + "' could outlive '" + owner->name + "', hand the cell over with a unique parameter", signalStmt});
+                }
+                walk(signalStmt->func_arg.get());
+                if (auto ident = dynamic_cast<Identifier *>(signalStmt->identifier.get()))
+                    declareSignal(ident->identifier.TokenLiteral, signalStmt);
+            }
+            else if (auto retStmt = dynamic_cast<ReturnStatement *>(node))
+            {
+                take(retStmt->return_value.get());
+                auto live = liveOwners(functionScope);
+                if (!live.empty())
+                    drops[retStmt] = live;
+                ended = true;
+            }
+            else if (dynamic_cast<BreakStatement *>(node) || dynamic_cast<ContinueStatement *>(node))
+            {
+                if (loops.empty())
+                    return;
+                checkIteration(loops.back().state, node);
+                auto live = liveOwners(loops.back().scopeCount);
+                if (!live.empty())
+                    drops[node] = live;
+                ended = true;
+            }
+            else if (auto ifStmt = dynamic_cast<ifStatement *>(node))
+            {
+                walk(ifStmt->condition.get());
+                OwnershipState before = save();
+                std::vector<OwnershipState> paths;
+                walk(ifStmt->if_result.get());
+                paths.push_back(save());
+                restore(before);
+                if (ifStmt->elseif_result.has_value())
+                {
+                    if (ifStmt->elseif_condition.has_value())
+                        walk(ifStmt->elseif_condition.value().get());
+                    OwnershipState afterCondition = save();
+                    walk(ifStmt->elseif_result.value().get());
+                    paths.push_back(save());
+                    restore(afterCondition);
+                }
+                if (ifStmt->else_result.has_value())
+                    walk(ifStmt->else_result.value().get());
+                paths.push_back(save());
+                merge(paths, ifStmt);
+            }
+            else if (auto whileStmt = dynamic_cast<WhileStatement *>(node))
+            {
+                walk(whileStmt->condition.get());
+                walkLoop(whileStmt, whileStmt->loop.get(), nullptr);
+            }
+            else if (auto forStmt = dynamic_cast<ForStatement *>(node))
+            {
+                scopes.push_back({});
+                auto init = dynamic_cast<LetStatement *>(forStmt->initializer.get());
+                if (init && init->unique_token)
+                    errors.push_back({"'" + init->ident_token.TokenLiteral + "' can not be unique in a for header", init});
+                walk(forStmt->initializer.get());
+                walk(forStmt->condition.get());
+                walkLoop(forStmt, forStmt->body.get(), forStmt->step.get());
+                scopes.pop_back();
+            }
+            else if (auto freeStmt = dynamic_cast<FreeStatement *>(node))
+            {
+                take(freeStmt->value.get());
+            }
+            else if (auto alloc = dynamic_cast<AllocExpression *>(node))
+            {
+                if (Owner *owner = ownerOf(alloc->value.get()))
+                    errors.push_back({"'" + owner->name + "' can not be copied into another cell, both would own it", alloc});
+                walk(alloc->value.get());
+                walk(alloc->count.get());
+            }
+            else if (auto literal = dynamic_cast<ArrayLiteral *>(node))
+            {
+                for (auto &element : literal->elements)
+                {
+                    if (Owner *owner = ownerOf(element.get()))
+                        errors.push_back({"'" + owner->name + "' can not be copied into an array, both would own it", literal});
+                    walk(element.get());
+                }
+            }
+            else if (auto infix = dynamic_cast<InfixExpression *>(node); infix && infix->operat.type == TokenType::ASSIGN)
+            {
+                Owner *owner = ownerOf(infix->left_operand.get());
+                if (!owner)
+                    owner = ownerOf(infix->right_operand.get());
+                if (owner)
+                    errors.push_back({"'" + owner->name + "' is unique, move it with an assignment statement", infix});
+                forEachChild(node, [this](Node *child)
+                             { walk(child); });
+            }
+            else if (auto ident = dynamic_cast<Identifier *>(node))
+            {
+                if (Owner *owner = ownerOf(ident))
+                    use(owner, ident);
+            }
+            else
+            {
+                forEachChild(node, [this](Node *child)
+                             { walk(child); });
+            }
+        }
+    };
+
+    std::unordered_map<std::string, std::vector<bool>> findUniqueParameters(const std::vector<std::unique_ptr<Node>> &nodes)
+    {
+        std::unordered_map<std::string, std::vector<bool>> works;
+        for (const auto &node : nodes)
+        {
+            auto funcStmt = dynamic_cast<FunctionStatement *>(node.get());
+            auto funcExpr = funcStmt ? dynamic_cast<FunctionExpression *>(funcStmt->funcExpr.get()) : nullptr;
+            if (!funcExpr)
+                continue;
+            auto &unique = works[funcExpr->func_name.TokenLiteral];
+            for (auto &param : funcExpr->call)
+            {
+                auto letParam = dynamic_cast<LetStatement *>(param.get());
+                unique.push_back(letParam && letParam->unique_token);
+            }
+        }
+        return works;
+    }
+}
+
+void Semantics::checkOwnership(const std::vector<std::unique_ptr<Node>> &nodes)
+{
+    auto uniqueParameters = findUniqueParameters(nodes);
+    OwnershipWalker walker{uniqueParameters};
+    for (const auto &node : nodes)
+        walker.walk(node.get());
+
+    for (auto &[message, node] : walker.errors)
+        logError(message, node, DiagnosticCode::USE_AFTER_MOVE);
+    size_t dropCount = 0;
+    for (auto &[node, dropped] : walker.drops)
+        dropCount += dropped.size();
+    drops = std::move(walker.drops);
+    logs << "[SEMANTIC LOG]: Ownership check found " << walker.errors.size() << " errors and placed " << dropCount << " drops\n";
+}
+
+const std::vector<Node *> &Semantics::dropsAt(Node *node) const
+{
+    static const std::vector<Node *> none;
+    auto it = drops.find(node);
+    return it == drops.end() ? none : it->second;
+}
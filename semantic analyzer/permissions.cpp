@@ -0,0 +1,435 @@
+#include <algorithm>
+#include <deque>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "semantics.hpp"
+#include "ast.hpp"
+
+// Pointers may be declared read or write. Nothing is written or freed through a read pointer and it is only copied
+// to other read pointers, elevate inside an unsafe block is the way around that. A read or write parameter is
+// borrowed from the caller for the call, it can be read, written as allowed and lent on to other read or write
+// parameters but it is never returned, stored or handed to anything that could keep it.
+// A write parameter is also the only way to its cell while the call runs, every call site has to prove that the
+// argument comes from a cell nothing else can reach and that no other argument may point into it. That is what
+// lets the backends mark write parameters noalias
+
+namespace
+{
+    enum class Access : uint8_t
+    {
+        PLAIN,
+        READ,
+        WRITE,
+    };
+
+    Access declaredAccess(const LetStatement *letStmt)
+    {
+        if (!letStmt->access_token)
+            return Access::PLAIN;
+        return letStmt->access_token->type == TokenType::READ ? Access::READ : Access::WRITE;
+    }
+
+    struct Binding
+    {
+        std::string name;
+        Access access = Access::PLAIN;
+        bool borrowed = false;      // A read or write parameter, or a copy of one
+        Node *declaration = nullptr; // The let or the parameter, origin of write parameters
+    };
+
+    // Where the pointers of one work come from. An origin is an alloc or make of the work or one of its write
+    // parameters, null stands for a pointer that could come from anywhere
+    using OriginSet = std::set<Node *>;
+    struct Frame
+    {
+        std::unordered_map<Binding *, OriginSet> origins; // Locals and parameters, top level variables are never in here
+        std::unordered_map<Binding *, std::vector<Node *>> values;
+        std::unordered_map<Identifier *, Binding *> resolved;
+        std::vector<Node *> escaping; // Pointers that leave the work or go to memory
+        std::vector<CallExpression *> calls;
+    };
+
+    struct PermissionWalker
+    {
+        const Semantics &semantics;
+        const std::unordered_map<std::string, std::vector<Access>> &parameterAccess;
+        std::vector<std::pair<std::string, Node *>> errors{};
+        std::deque<Binding> bindings{};
+        std::vector<std::unordered_map<std::string, Binding *>> scopes{1};
+        std::vector<Frame> frames{1};
+        std::set<CallExpression *> tasks{}; // Calls started as tasks, every pointer they get escapes
+        size_t exclusiveCalls = 0;
+
+        bool isPointer(Node *node) const
+        {
+            auto info = semantics.getAnnotation(node);
+            return info && info->nodeType == TypeSystem::POINTER;
+        }
+
+        Binding *lookup(const std::string &name) const
+        {
+            for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope)
+            {
+                auto it = scope->find(name);
+                if (it != scope->end())
+                    return it->second;
+            }
+            return nullptr;
+        }
+
+        // The binding a pointer expression names, elevate and assignments pass it through
+        Binding *bindingOf(Node *node) const
+        {
+            if (auto ident = dynamic_cast<Identifier *>(node))
+                return lookup(ident->identifier.TokenLiteral);
+            if (auto prefix = dynamic_cast<PrefixExpression *>(node); prefix && prefix->operat.type == TokenType::ELEVATE)
+                return bindingOf(prefix->operand.get());
+            if (auto infix = dynamic_cast<InfixExpression *>(node); infix && infix->operat.type == TokenType::ASSIGN)
+                return bindingOf(infix->right_operand.get());
+            return nullptr;
+        }
+
+        Access accessOf(Node *node) const
+        {
+            if (auto prefix = dynamic_cast<PrefixExpression *>(node); prefix && prefix->operat.type == TokenType::ELEVATE)
+                return Access::PLAIN;
+            Binding *binding = bindingOf(node);
+            return binding ? binding->access : Access::PLAIN;
+        }
+
+        bool isBorrowed(Node *node) const
+        {
+            Binding *binding = bindingOf(node);
+            return binding && binding->borrowed;
+        }
+
+        bool isLocal(Binding *binding) const
+        {
+            return frames.back().origins.count(binding);
+        }
+
+        std::string nameOf(Node *node) const
+        {
+            Binding *binding = bindingOf(node);
+            return binding ? "'" + binding->name + "'" : "the pointer";
+        }
+
+        Binding *declare(const std::string &name, Access access, bool borrowed, Node *declaration, bool parameter = false)
+        {
+            bindings.push_back({name, access, borrowed, declaration});
+            Binding *binding = &bindings.back();
+            scopes.back()[name] = binding;
+            // Top level variables stay out of the frame, any work could change them
+            if (scopes.size() > 1)
+            {
+                OriginSet origins;
+                if (parameter)
+                    origins.insert(access == Access::WRITE ? declaration : nullptr);
+                frames.back().origins[binding] = origins;
+            }
+            return binding;
+        }
+
+        // The pointer goes somewhere it could outlive the call or be reached through something else
+        void escape(Node *value, Node *node, const std::string &where)
+        {
+            if (!value || !isPointer(value))
+                return;
+            if (isBorrowed(value))
+                errors.push_back({nameOf(value) + " is borrowed for the call and can not be " + where, node});
+            frames.back().escaping.push_back(value);
+        }
+
+        void assign(Binding *target, Node *value, Node *node)
+        {
+            if (!target || !value || !isPointer(value))
+                return;
+            if (accessOf(value) == Access::READ && target->access != Access::READ)
+                errors.push_back({"'" + target->name + "' would get write access to the read pointer " + nameOf(value) + ", declare it read too", node});
+            if (isLocal(target))
+            {
+                if (isBorrowed(value) && !target->borrowed)
+                    errors.push_back({"'" + target->name + "' can not hold the borrowed " + nameOf(value) + ", copy it into a new variable instead", node});
+                frames.back().values[target].push_back(value);
+            }
+            else
+            {
+                escape(value, node, "stored in the top level variable '" + target->name + "'");
+            }
+        }
+
+        void checkWrite(Node *pointer, Node *node, const std::string &action)
+        {
+            if (accessOf(pointer) == Access::READ)
+                errors.push_back({nameOf(pointer) + " is read only and can not be " + action + ", use elevate inside an unsafe block", node});
+        }
+
+        void walkFunction(FunctionExpression *funcExpr)
+        {
+            frames.push_back({});
+            scopes.push_back({});
+            for (auto &param : funcExpr->call)
+            {
+                if (auto letParam = dynamic_cast<LetStatement *>(param.get()))
+                {
+                    Access access = declaredAccess(letParam);
+                    declare(letParam->ident_token.TokenLiteral, access, access != Access::PLAIN, letParam, true);
+                }
+                else if (auto assignParam = dynamic_cast<AssignmentStatement *>(param.get()))
+                {
+                    declare(assignParam->ident_token.TokenLiteral, Access::PLAIN, false, assignParam, true);
+                }
+            }
+            walk(funcExpr->block.get());
+            if (auto body = dynamic_cast<BlockExpression *>(funcExpr->block.get()); body && body->finalexpr.has_value())
+                escape(body->finalexpr.value().get(), body, "returned");
+            scopes.pop_back();
+            finishFrame();
+            frames.pop_back();
+        }
+
+        OriginSet originsOf(Node *node, const Frame &frame, const std::unordered_map<Binding *, OriginSet> &current) const
+        {
+            if (auto ident = dynamic_cast<Identifier *>(node))
+            {
+                auto binding = frame.resolved.find(ident);
+                if (binding != frame.resolved.end())
+                {
+                    auto origins = current.find(binding->second);
+                    if (origins != current.end())
+                        return origins->second;
+                }
+                return {nullptr};
+            }
+            if (dynamic_cast<AllocExpression *>(node) || dynamic_cast<ArrayLiteral *>(node))
+                return {node};
+            if (auto prefix = dynamic_cast<PrefixExpression *>(node); prefix && prefix->operat.type == TokenType::ELEVATE)
+                return originsOf(prefix->operand.get(), frame, current);
+            if (auto infix = dynamic_cast<InfixExpression *>(node); infix && infix->operat.type == TokenType::ASSIGN)
+                return originsOf(infix->right_operand.get(), frame, current);
+            return {nullptr};
+        }
+
+        // Flow insensitive, a variable may point wherever any of its values came from
+        void finishFrame()
+        {
+            Frame &frame = frames.back();
+            auto origins = frame.origins;
+            bool changed = true;
+            while (changed)
+            {
+                changed = false;
+                for (auto &[binding, values] : frame.values)
+                {
+                    auto &set = origins[binding];
+                    for (auto value : values)
+                    {
+                        for (auto origin : originsOf(value, frame, origins))
+                            changed |= set.insert(origin).second;
+                    }
+                }
+            }
+
+            // A cell whose pointer escaped may be reached from anywhere
+            OriginSet escaped;
+            for (auto value : frame.escaping)
+            {
+                auto set = originsOf(value, frame, origins);
+                escaped.insert(set.begin(), set.end());
+            }
+            auto reach = [&](Node *node)
+            {
+                OriginSet set = originsOf(node, frame, origins);
+                if (std::any_of(set.begin(), set.end(), [&escaped](Node *origin)
+                                { return escaped.count(origin); }))
+                    set.insert(nullptr);
+                return set;
+            };
+
+            for (auto call : frame.calls)
+            {
+                auto work = call->function_identifier->token.TokenLiteral;
+                auto &access = parameterAccess.at(work);
+                for (size_t i = 0; i < call->parameters.size() && i < access.size(); ++i)
+                {
+                    if (access[i] != Access::WRITE || !isPointer(call->parameters[i].get()))
+                        continue;
+                    exclusiveCalls++;
+                    OriginSet mine = reach(call->parameters[i].get());
+                    if (mine.count(nullptr))
+                    {
+                        errors.push_back({"'" + work + "' needs argument " + std::to_string(i + 1) + " to be the only way to its cell, pass a cell of this work or a write parameter", call});
+                        continue;
+                    }
+                    for (size_t j = 0; j < call->parameters.size(); ++j)
+                    {
+                        if (j == i || !isPointer(call->parameters[j].get()))
+                            continue;
+                        OriginSet other = reach(call->parameters[j].get());
+                        bool overlaps = false;
+                        for (auto origin : mine)
+                            overlaps |= other.count(origin) > 0;
+                        if (overlaps)
+                        {
+                            errors.push_back({"Argument " + std::to_string(i + 1) + " of '" + work + "' is written through and may point at the same cell as argument " + std::to_string(j + 1), call});
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        void walk(Node *node)
+        {
+            if (!node)
+                return;
+
+            if (auto funcStmt = dynamic_cast<FunctionStatement *>(node))
+            {
+                if (auto funcExpr = dynamic_cast<FunctionExpression *>(funcStmt->funcExpr.get()))
+                    walkFunction(funcExpr);
+                return;
+            }
+            if (dynamic_cast<BlockStatement *>(node) || dynamic_cast<BlockExpression *>(node) || dynamic_cast<ForStatement *>(node))
+            {
+                scopes.push_back({});
+                forEachChild(node, [this](Node *child)
+                             { walk(child); });
+                scopes.pop_back();
+                return;
+            }
+            if (auto signalStmt = dynamic_cast<SignalStatement *>(node))
+            {
+                if (auto call = dynamic_cast<CallExpression *>(signalStmt->func_arg.get()))
+                    tasks.insert(call);
+            }
+
+            forEachChild(node, [this](Node *child)
+                         { walk(child); });
+
+            if (auto ident = dynamic_cast<Identifier *>(node))
+            {
+                if (Binding *binding = lookup(ident->identifier.TokenLiteral))
+                    frames.back().resolved[ident] = binding;
+            }
+            else if (auto letStmt = dynamic_cast<LetStatement *>(node))
+            {
+                Access access = declaredAccess(letStmt);
+                Node *value = letStmt->value.get();
+                bool borrowed = value && isPointer(value) && isBorrowed(value);
+                assign(declare(letStmt->ident_token.TokenLiteral, access, borrowed, letStmt), value, letStmt);
+            }
+            else if (auto assignStmt = dynamic_cast<AssignmentStatement *>(node))
+            {
+                assign(lookup(assignStmt->ident_token.TokenLiteral), assignStmt->value.get(), assignStmt);
+            }
+            else if (auto infix = dynamic_cast<InfixExpression *>(node); infix && infix->operat.type == TokenType::ASSIGN)
+            {
+                auto target = infix->left_operand.get();
+                if (auto deref = dynamic_cast<PrefixExpression *>(target); deref && deref->operat.type == TokenType::ASTERISK)
+                {
+                    checkWrite(deref->operand.get(), infix, "written through");
+                    escape(infix->right_operand.get(), infix, "stored through a pointer");
+                }
+                else if (auto index = dynamic_cast<IndexExpression *>(target))
+                {
+                    checkWrite(index->array.get(), infix, "written through");
+                    escape(infix->right_operand.get(), infix, "stored through a pointer");
+                }
+                else if (auto ident = dynamic_cast<Identifier *>(target))
+                {
+                    assign(lookup(ident->identifier.TokenLiteral), infix->right_operand.get(), infix);
+                }
+            }
+            else if (auto prefix = dynamic_cast<PrefixExpression *>(node); prefix && (prefix->operat.type == TokenType::PLUS_PLUS || prefix->operat.type == TokenType::MINUS_MINUS))
+            {
+                if (auto deref = dynamic_cast<PrefixExpression *>(prefix->operand.get()); deref && deref->operat.type == TokenType::ASTERISK)
+                    checkWrite(deref->operand.get(), prefix, "written through");
+                else if (auto index = dynamic_cast<IndexExpression *>(prefix->operand.get()))
+                    checkWrite(index->array.get(), prefix, "written through");
+            }
+            else if (auto freeStmt = dynamic_cast<FreeStatement *>(node))
+            {
+                checkWrite(freeStmt->value.get(), freeStmt, "freed");
+                if (isBorrowed(freeStmt->value.get()))
+                    errors.push_back({nameOf(freeStmt->value.get()) + " is borrowed for the call and can not be freed", freeStmt});
+            }
+            else if (auto alloc = dynamic_cast<AllocExpression *>(node))
+            {
+                escape(alloc->value.get(), alloc, "copied into a cell");
+            }
+            else if (auto literal = dynamic_cast<ArrayLiteral *>(node))
+            {
+                for (auto &element : literal->elements)
+                    escape(element.get(), literal, "copied into an array");
+            }
+            else if (auto retStmt = dynamic_cast<ReturnStatement *>(node))
+            {
+                escape(retStmt->return_value.get(), retStmt, "returned");
+            }
+            else if (auto signalStmt = dynamic_cast<SignalStatement *>(node))
+            {
+                if (auto call = dynamic_cast<CallExpression *>(signalStmt->func_arg.get()))
+                {
+                    for (auto &param : call->parameters)
+                        escape(param.get(), signalStmt, "handed to a task");
+                }
+                if (auto ident = dynamic_cast<Identifier *>(signalStmt->identifier.get()))
+                    declare(ident->identifier.TokenLiteral, Access::PLAIN, false, signalStmt);
+            }
+            else if (auto call = dynamic_cast<CallExpression *>(node); call && call->function_identifier)
+            {
+                auto work = call->function_identifier->token.TokenLiteral;
+                auto it = parameterAccess.find(work);
+                for (size_t i = 0; i < call->parameters.size(); ++i)
+                {
+                    Node *arg = call->parameters[i].get();
+                    if (!isPointer(arg))
+                        continue;
+                    Access param = it != parameterAccess.end() && i < it->second.size() ? it->second[i] : Access::PLAIN;
+                    if (param != Access::READ && accessOf(arg) == Access::READ)
+                        errors.push_back({"'" + work + "' may write through argument " + std::to_string(i + 1) + " but " + nameOf(arg) + " is read only", call});
+                    if (param == Access::PLAIN && !tasks.count(call))
+                        escape(arg, call, "passed to '" + work + "' which could keep it, make the parameter read or write");
+                }
+                if (it != parameterAccess.end() && std::find(it->second.begin(), it->second.end(), Access::WRITE) != it->second.end())
+                    frames.back().calls.push_back(call);
+            }
+        }
+    };
+
+    std::unordered_map<std::string, std::vector<Access>> findParameterAccess(const std::vector<std::unique_ptr<Node>> &nodes)
+    {
+        std::unordered_map<std::string, std::vector<Access>> works;
+        for (const auto &node : nodes)
+        {
+            auto funcStmt = dynamic_cast<FunctionStatement *>(node.get());
+            auto funcExpr = funcStmt ? dynamic_cast<FunctionExpression *>(funcStmt->funcExpr.get()) : nullptr;
+            if (!funcExpr)
+                continue;
+            auto &access = works[funcExpr->func_name.TokenLiteral];
+            for (auto &param : funcExpr->call)
+            {
+                auto letParam = dynamic_cast<LetStatement *>(param.get());
+                access.push_back(letParam ? declaredAccess(letParam) : Access::PLAIN);
+            }
+        }
+        return works;
+    }
+}
+
+void Semantics::checkPointerAccess(const std::vector<std::unique_ptr<Node>> &nodes)
+{
+    auto parameterAccess = findParameterAccess(nodes);
+    PermissionWalker walker{*this, parameterAccess};
+    for (const auto &node : nodes)
+        walker.walk(node.get());
+    walker.finishFrame();
+
+    for (auto &[message, node] : walker.errors)
+        logError(message, node, DiagnosticCode::POINTER_ACCESS);
+    logs << "[SEMANTIC LOG]: Pointer access check found " << walker.errors.size() << " errors in " << walker.exclusiveCalls << " exclusive arguments\n";
+}
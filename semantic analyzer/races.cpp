@@ -0,0 +1,303 @@
+#include <functional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "semantics.hpp"
+#include "ast.hpp"
+
+// Checking that a task can not race the code that started it. Arguments are copied into the task and strings never
+// change, so the mutable top level variables are the only state two tasks can share besides what pointers point at.
+// Pointers are not followed, all of their memory counts as one shared name. A task runs from its signal statement
+// until the first statement that waits on it, that window is compared with everything the task touches
+
+namespace
+{
+    const std::string POINTEE = "the memory behind pointers";
+
+    // Array elements live behind a pointer too
+    bool isDeref(Node *node)
+    {
+        auto prefix = dynamic_cast<PrefixExpression *>(node);
+        return (prefix && prefix->operat.type == TokenType::ASTERISK) || dynamic_cast<IndexExpression *>(node);
+    }
+
+    struct Effects
+    {
+        std::set<std::string> reads;
+        std::set<std::string> writes;
+        std::set<std::string> works; // Works called or started, their effects are folded in by close()
+    };
+
+    std::string sharedName(Node *node, const Semantics &semantics)
+    {
+        auto ident = dynamic_cast<Identifier *>(node);
+        auto info = ident ? semantics.getAnnotation(ident) : nullptr;
+        return info && info->isShared ? ident->identifier.TokenLiteral : "";
+    }
+
+    void collect(Node *node, const Semantics &semantics, Effects &effects)
+    {
+        // Nested works get a summary of their own
+        if (!node || dynamic_cast<FunctionStatement *>(node))
+            return;
+
+        if (auto ident = dynamic_cast<Identifier *>(node))
+        {
+            auto name = sharedName(ident, semantics);
+            if (!name.empty())
+                effects.reads.insert(name);
+            return;
+        }
+        if (isDeref(node))
+            effects.reads.insert(POINTEE);
+        if (auto assign = dynamic_cast<AssignmentStatement *>(node))
+        {
+            auto info = semantics.getAnnotation(assign);
+            if (info && info->isShared)
+                effects.writes.insert(assign->ident_token.TokenLiteral);
+        }
+        else if (auto infix = dynamic_cast<InfixExpression *>(node))
+        {
+            auto name = infix->operat.type == TokenType::ASSIGN ? sharedName(infix->left_operand.get(), semantics) : "";
+            if (infix->operat.type == TokenType::ASSIGN && isDeref(infix->left_operand.get()))
+                name = POINTEE;
+            if (!name.empty())
+                effects.writes.insert(name);
+        }
+        else if (auto prefix = dynamic_cast<PrefixExpression *>(node))
+        {
+            bool step = prefix->operat.type == TokenType::PLUS_PLUS || prefix->operat.type == TokenType::MINUS_MINUS;
+            auto name = step ? sharedName(prefix->operand.get(), semantics) : "";
+            if (step && isDeref(prefix->operand.get()))
+                name = POINTEE;
+            if (!name.empty())
+                effects.writes.insert(name);
+        }
+        else if (dynamic_cast<FreeStatement *>(node))
+        {
+            effects.writes.insert(POINTEE);
+        }
+        else if (auto call = dynamic_cast<CallExpression *>(node))
+        {
+            if (call->function_identifier)
+                effects.works.insert(call->function_identifier->token.TokenLiteral);
+        }
+        forEachChild(node, [&semantics, &effects](Node *child)
+                     { collect(child, semantics, effects); });
+    }
+
+    // Summaries of every work in the program, works sharing a name through nesting are merged which only adds effects
+    void summarize(Node *node, const Semantics &semantics, std::unordered_map<std::string, Effects> &summaries)
+    {
+        if (!node)
+            return;
+        if (auto funcStmt = dynamic_cast<FunctionStatement *>(node))
+        {
+            auto funcExpr = dynamic_cast<FunctionExpression *>(funcStmt->funcExpr.get());
+            if (funcExpr)
+                collect(funcExpr->block.get(), semantics, summaries[funcExpr->func_name.TokenLiteral]);
+            node = funcExpr;
+            if (!node)
+                return;
+        }
+        forEachChild(node, [&semantics, &summaries](Node *child)
+                     { summarize(child, semantics, summaries); });
+    }
+
+    // Adding what the called works do, and what they call in turn
+    Effects close(const Effects &effects, const std::unordered_map<std::string, Effects> &summaries)
+    {
+        Effects closed = effects;
+        std::vector<std::string> pending(effects.works.begin(), effects.works.end());
+        while (!pending.empty())
+        {
+            auto name = pending.back();
+            pending.pop_back();
+            auto summaryIt = summaries.find(name);
+            if (summaryIt == summaries.end())
+                continue;
+            closed.reads.insert(summaryIt->second.reads.begin(), summaryIt->second.reads.end());
+            closed.writes.insert(summaryIt->second.writes.begin(), summaryIt->second.writes.end());
+            for (auto &callee : summaryIt->second.works)
+            {
+                if (closed.works.insert(callee).second)
+                    pending.push_back(callee);
+            }
+        }
+        return closed;
+    }
+
+    std::string firstCommon(const std::set<std::string> &a, const std::set<std::string> &b)
+    {
+        for (auto &name : a)
+        {
+            if (b.count(name))
+                return name;
+        }
+        return "";
+    }
+
+    // Reading the signal waits for its task, unless the read sits behind a short circuit
+    bool readsAlways(Node *node, const std::string &signal)
+    {
+        if (!node || dynamic_cast<FunctionStatement *>(node))
+            return false;
+        if (auto ident = dynamic_cast<Identifier *>(node))
+            return ident->identifier.TokenLiteral == signal;
+        if (auto infix = dynamic_cast<InfixExpression *>(node))
+        {
+            if (infix->operat.type == TokenType::AND || infix->operat.type == TokenType::OR)
+                return readsAlways(infix->left_operand.get(), signal);
+        }
+        bool found = false;
+        forEachChild(node, [&found, &signal](Node *child)
+                     { found = found || readsAlways(child, signal); });
+        return found;
+    }
+
+    // Statements that wait on the signal every time they run
+    bool joins(Node *stmt, const std::string &signal)
+    {
+        if (auto waitStmt = dynamic_cast<WaitStatement *>(stmt))
+            return readsAlways(waitStmt->arg.get(), signal);
+        if (auto letStmt = dynamic_cast<LetStatement *>(stmt))
+            return readsAlways(letStmt->value.get(), signal);
+        if (auto assign = dynamic_cast<AssignmentStatement *>(stmt))
+            return readsAlways(assign->value.get(), signal);
+        if (auto retStmt = dynamic_cast<ReturnStatement *>(stmt))
+            return readsAlways(retStmt->return_value.get(), signal);
+        if (auto exprStmt = dynamic_cast<ExpressionStatement *>(stmt))
+            return readsAlways(exprStmt->expression.get(), signal);
+        if (auto ifStmt = dynamic_cast<ifStatement *>(stmt))
+            return readsAlways(ifStmt->condition.get(), signal);
+        if (auto whileStmt = dynamic_cast<WhileStatement *>(stmt))
+            return readsAlways(whileStmt->condition.get(), signal);
+        return false;
+    }
+
+    // A return, or a break or continue of a loop around the signal, leaves before the task is waited on
+    bool leaves(Node *node, bool insideLoop)
+    {
+        if (!node || dynamic_cast<FunctionStatement *>(node))
+            return false;
+        if (dynamic_cast<ReturnStatement *>(node))
+            return true;
+        if (dynamic_cast<BreakStatement *>(node) || dynamic_cast<ContinueStatement *>(node))
+            return !insideLoop;
+        bool loop = insideLoop || dynamic_cast<ForStatement *>(node) || dynamic_cast<WhileStatement *>(node);
+        bool found = false;
+        forEachChild(node, [&found, loop](Node *child)
+                     { found = found || leaves(child, loop); });
+        return found;
+    }
+}
+
+void Semantics::checkTaskRaces(const std::vector<std::unique_ptr<Node>> &nodes)
+{
+    std::unordered_map<std::string, Effects> summaries;
+    Effects program;
+    std::vector<Node *> topLevel;
+    for (const auto &node : nodes)
+    {
+        summarize(node.get(), *this, summaries);
+        collect(node.get(), *this, program);
+        if (!dynamic_cast<FunctionStatement *>(node.get()))
+            topLevel.push_back(node.get());
+    }
+    for (auto &[name, summary] : summaries)
+        program.writes.insert(summary.writes.begin(), summary.writes.end());
+
+    int proven = 0;
+    int rejected = 0;
+    auto checkList = [&](const std::vector<Node *> &statements, bool isTopLevel)
+    {
+        for (size_t i = 0; i < statements.size(); ++i)
+        {
+            auto signalStmt = dynamic_cast<SignalStatement *>(statements[i]);
+            auto ident = signalStmt ? dynamic_cast<Identifier *>(signalStmt->identifier.get()) : nullptr;
+            auto call = signalStmt ? dynamic_cast<CallExpression *>(signalStmt->func_arg.get()) : nullptr;
+            if (!ident || !call || !call->function_identifier)
+                continue;
+            std::string signal = ident->identifier.TokenLiteral;
+
+            // The arguments are evaluated before the task starts so only the work itself counts
+            Effects start;
+            start.works.insert(call->function_identifier->token.TokenLiteral);
+            Effects task = close(start, summaries);
+
+            Effects window;
+            bool joined = false;
+            bool escapes = false;
+            for (size_t j = i + 1; j < statements.size() && !joined; ++j)
+            {
+                collect(statements[j], *this, window);
+                if (auto letStmt = dynamic_cast<LetStatement *>(statements[j]); letStmt && isTopLevel)
+                    window.writes.insert(letStmt->ident_token.TokenLiteral);
+                joined = joins(statements[j], signal);
+                escapes = escapes || (!joined && leaves(statements[j], false));
+            }
+            window = close(window, summaries);
+
+            // A task that outlives the window could overlap anything, so it may only read what nobody writes
+            std::string conflict;
+            std::string reason;
+            if (!joined || escapes)
+            {
+                window.writes.insert(program.writes.begin(), program.writes.end());
+                if (!task.writes.empty())
+                {
+                    conflict = *task.writes.begin();
+                    reason = conflict == POINTEE ? "is not always waited on and writes " + POINTEE
+                                                 : "is not always waited on and writes the top level variable '" + conflict + "'";
+                }
+                else if (!(conflict = firstCommon(task.reads, window.writes)).empty())
+                {
+                    reason = "is not always waited on and reads '" + conflict + "' which other code writes";
+                }
+            }
+            else if (!(conflict = firstCommon(task.writes, window.writes)).empty() ||
+                     !(conflict = firstCommon(task.writes, window.reads)).empty())
+            {
+                reason = "writes '" + conflict + "' while the code before its wait uses it";
+            }
+            else if (!(conflict = firstCommon(task.reads, window.writes)).empty())
+            {
+                reason = "reads '" + conflict + "' while the code before its wait writes it";
+            }
+
+            if (!conflict.empty())
+            {
+                logError("Task of signal '" + signal + "' " + reason + ", wait on it first", signalStmt, DiagnosticCode::DATA_RACE);
+                ++rejected;
+                continue;
+            }
+            annotations[signalStmt].isRaceFree = true;
+            ++proven;
+            logs << "[SEMANTIC LOG]: Signal '" << signal << "' is race free\n";
+        }
+    };
+
+    checkList(topLevel, true);
+    std::function<void(Node *)> visit = [&](Node *node)
+    {
+        std::vector<Node *> statements;
+        if (auto block = dynamic_cast<BlockStatement *>(node))
+        {
+            for (auto &stmt : block->statements)
+                statements.push_back(stmt.get());
+        }
+        else if (auto block = dynamic_cast<BlockExpression *>(node))
+        {
+            for (auto &stmt : block->statements)
+                statements.push_back(stmt.get());
+        }
+        if (!statements.empty())
+            checkList(statements, false);
+        forEachChild(node, visit);
+    };
+    for (const auto &node : nodes)
+        visit(node.get());
+
+    logs << "[SEMANTIC LOG]: Race check proved " << proven << " tasks safe and rejected " << rejected << "\n";
+}
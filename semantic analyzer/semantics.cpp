@@ -1,21 +1,95 @@
+#include <algorithm>
+#include <exception>
 #include <iostream>
 #include "semantics.hpp"
 #include "ast.hpp"
+#include "utils/threadpool.hpp"
 
-Semantics::Semantics()
+Semantics::Semantics(TypeContext &types, Diagnostics &diagnostics) : logs(std::cout), types(types), diagnostics(diagnostics)
 {
     symbolTable.push_back({});
     registerAnalyzerFunctions();
 };
 
+// Worker constructor, the worker starts without scopes of its own and resolves globals from the frozen scope
+Semantics::Semantics(const Scope *globals, TypeContext &types, Diagnostics &diagnostics) : globalScope(globals), logs(logBuffer), types(types), diagnostics(diagnostics)
+{
+    registerAnalyzerFunctions();
+};
+
+// Two phase analysis of the whole program
+void Semantics::analyzeProgram(const std::vector<std::unique_ptr<Node>> &nodes, size_t threadCount)
+{
+    // Phase one: registering every work signature first so that calls can appear before the declaration
+    std::vector<FunctionExpression *> functions;
+    for (const auto &node : nodes)
+    {
+        auto funcStmt = dynamic_cast<FunctionStatement *>(node.get());
+        if (!funcStmt)
+            continue;
+        auto funcExpr = dynamic_cast<FunctionExpression *>(funcStmt->funcExpr.get());
+        if (!funcExpr)
+            continue;
+        declareFunction(funcExpr);
+        functions.push_back(funcExpr);
+    }
+
+    // Still in phase one: the global declarations and top level statements are analyzed serially in source order
+    for (const auto &node : nodes)
+    {
+        if (dynamic_cast<FunctionStatement *>(node.get()))
+            continue;
+        analyzer(node.get());
+    }
+
+    if (functions.empty())
+        return;
+
+    // Phase two: the global scope is now frozen and every function body is checked by its own worker
+    const Scope *globals = &symbolTable.front();
+    std::vector<std::unique_ptr<Semantics>> workers(functions.size());
+    std::vector<std::exception_ptr> failures(functions.size()); // A throw on a pool thread would terminate, it is rethrown here instead
+    {
+        ThreadPool pool(std::min(std::max<size_t>(threadCount, 1), functions.size()));
+        for (size_t i = 0; i < functions.size(); ++i)
+        {
+            pool.submit([this, &workers, &failures, &functions, globals, i]()
+                        {
+                try
+                {
+                    workers[i] = std::make_unique<Semantics>(globals, types, diagnostics);
+                    workers[i]->analyzeFunctionBody(functions[i]);
+                }
+                catch (...)
+                {
+                    failures[i] = std::current_exception();
+                } });
+        }
+        pool.wait();
+    }
+    for (auto &failure : failures)
+    {
+        if (failure)
+            std::rethrow_exception(failure);
+    }
+
+    // Merging the worker logs and annotations in source order so the output does not depend on scheduling,
+    // the workers reported their errors straight into their thread's diagnostics buffer
+    for (auto &worker : workers)
+    {
+        logs << worker->logBuffer.str();
+        annotations.insert(worker->annotations.begin(), worker->annotations.end());
+    }
+}
+
 // Main walker function
 void Semantics::analyzer(Node *node)
 {
-    if (!node)
+    if (!node || diagnostics.shouldAbort())
     {
         return;
     }
-    std::cout << "Analyzing AST node: " << node->toString() << "\n";
+    logs << "Analyzing AST node: " << node->toString() << "\n";
     auto analyzerIt = analyzerFunctionsMap.find(typeid(*node));
     if (analyzerIt != analyzerFunctionsMap.end())
     {
@@ -23,53 +97,114 @@ void Semantics::analyzer(Node *node)
     }
     else
     {
-        std::cout << "Failed to find analyzer for node: " << node->toString() << "\n";
-        std::cout << "Actual runtime type: " << typeid(*node).name() << "\n";
+        logs << "Failed to find analyzer for node: " << node->toString() << "\n";
+        logs << "Actual runtime type: " << typeid(*node).name() << "\n";
     }
 }
 
 // WALKING FUNCTIONS FOR DIFFERENT NODES
 void Semantics::analyzeFunctionStatement(Node *node)
 {
-    auto funcExpr = dynamic_cast<FunctionExpression *>(node);
+    auto funcStmt = dynamic_cast<FunctionStatement *>(node);
+    if (!funcStmt)
+        return;
+    auto funcExpr = dynamic_cast<FunctionExpression *>(funcStmt->funcExpr.get());
     if (!funcExpr)
         return;
-    std::cout << "[SEMANTIC LOG]: Analyzing function statement node: " << funcExpr->toString() << "\n";
-    auto& funcCall = funcExpr->call;
-    std::vector<TypeSystem> paramTypes;
-    TypeSystem callType;
-    for (const auto &call : funcCall)
+    logs << "[SEMANTIC LOG]: Analyzing function statement node: " << funcExpr->toString() << "\n";
+    declareFunction(funcExpr);
+    analyzeFunctionBody(funcExpr);
+}
+
+// Registering the signature of a function in the current scope without touching its body
+void Semantics::declareFunction(FunctionExpression *funcExpr)
+{
+    std::vector<const Type *> paramTypes;
+    for (const auto &param : funcExpr->call)
     {
-        auto callNode = call.get();
-        callType = inferExpressionType(callNode);
-        paramTypes.push_back(callType);
-        analyzer(call.get());
+        if (auto letParam = dynamic_cast<LetStatement *>(param.get()))
+        {
+            paramTypes.push_back(resolveType(letParam->data_type_token.TokenLiteral));
+        }
+        else if (auto assignParam = dynamic_cast<AssignmentStatement *>(param.get()))
+        {
+            paramTypes.push_back(types.scalar(inferExpressionType(assignParam->value.get())));
+        }
+        else
+        {
+            paramTypes.push_back(types.scalar(TypeSystem::UNKNOWN));
+        }
     }
 
-    auto retType = funcExpr->return_type.get();
-    TypeSystem retTypeSystem;
-    if (!retType)
-        return;
-    analyzer(retType);
-    retTypeSystem = inferExpressionType(retType);
+    const Type *returnType = types.scalar(TypeSystem::VOID);
+    if (auto retType = dynamic_cast<ReturnTypeExpression *>(funcExpr->return_type.get()))
+    {
+        returnType = resolveType(retType->typeToken.TokenLiteral);
+        checkPointee(returnType, retType);
+    }
+    TypeSystem retTypeSystem = returnType->scalar;
+
+    std::string funcName = funcExpr->func_name.TokenLiteral;
+    if (symbolTable.back().count(funcName))
+    {
+        logError("Redefinition of function '" + funcName + "'", funcExpr, DiagnosticCode::REDEFINITION);
+    }
+
+    // Functions with the same signature share one interned type
+    const Type *signature = types.function(returnType, paramTypes);
+    logs << "[SEMANTIC LOG]: Declared function '" << funcName << "' as " << TypeContext::toString(signature) << "\n";
 
-    symbolTable.back()[funcExpr->func_key.TokenLiteral] = Symbol{
-        .nodeName = funcExpr->func_key.TokenLiteral,
+    symbolTable.back()[funcName] = Symbol{
+        .nodeName = funcName,
         .nodeType = retTypeSystem,
-        .parameterTypes = paramTypes,
+        .type = signature,
         .kind = SymbolKind::FUNCTION,
         .isMutable = false,
         .isConstant = false,
-        .scopeDepth = (int)symbolTable.size() - 1,
+        .scopeDepth = currentScopeDepth(),
     };
+}
+
+// Checking the parameters and body of a function whose signature is already registered
+void Semantics::analyzeFunctionBody(FunctionExpression *funcExpr)
+{
+    auto symbol = resolveSymbol(funcExpr->func_name.TokenLiteral);
+    TypeSystem savedReturnType = currentReturnType;
+    const Type *savedReturnFullType = currentReturnFullType;
+    currentReturnType = symbol ? symbol->nodeType : TypeSystem::UNKNOWN;
+    currentReturnFullType = symbol && symbol->type ? symbol->type->element : nullptr;
+
     symbolTable.push_back({});
+    declaringParameters = true;
+    for (const auto &param : funcExpr->call)
+    {
+        if (auto assignParam = dynamic_cast<AssignmentStatement *>(param.get()))
+        {
+            // Parameters with default values are declared straight from their value
+            analyzer(assignParam->value.get());
+            TypeSystem paramType = inferExpressionType(assignParam->value.get());
+            symbolTable.back()[assignParam->ident_token.TokenLiteral] = Symbol{
+                .nodeName = assignParam->ident_token.TokenLiteral,
+                .nodeType = paramType,
+                .kind = SymbolKind::VARIABLE,
+                .isMutable = true,
+                .isConstant = false,
+                .scopeDepth = currentScopeDepth(),
+            };
+            continue;
+        }
+        analyzer(param.get());
+    }
+    declaringParameters = false;
 
-    auto funcBlock = funcExpr->block.get();
-    if (!funcBlock)
-        return;
-    analyzer(funcBlock);
+    if (funcExpr->block)
+    {
+        analyzer(funcExpr->block.get());
+    }
 
     symbolTable.pop_back();
+    currentReturnType = savedReturnType;
+    currentReturnFullType = savedReturnFullType;
 }
 
 void Semantics::analyzeFunctionCallExpression(Node *node)
@@ -77,7 +212,7 @@ void Semantics::analyzeFunctionCallExpression(Node *node)
     auto callExp = dynamic_cast<CallExpression *>(node);
     if (!callExp)
         return;
-    std::cout << "[SEMANTIC LOGS]: Analyzing call expression " << callExp->toString() << "\n";
+    logs << "[SEMANTIC LOGS]: Analyzing call expression " << callExp->toString() << "\n";
     auto funcIdent = callExp->function_identifier.get();
     if (!funcIdent)
         return;
@@ -86,27 +221,32 @@ void Semantics::analyzeFunctionCallExpression(Node *node)
     auto symbol = resolveSymbol(funcIdent->token.TokenLiteral);
     if (!symbol)
         return;
-    if (symbol->parameterTypes.size() != callExp->parameters.size())
+    if (symbol->kind != SymbolKind::FUNCTION || !symbol->type)
     {
-        logError("Mismatched number of arguments", node);
+        logError("'" + funcIdent->token.TokenLiteral + "' is not a function", node, DiagnosticCode::TYPE_MISMATCH);
+        return;
+    }
+    const auto &parameterTypes = symbol->type->parameters;
+    if (parameterTypes.size() != callExp->parameters.size())
+    {
+        logError("Mismatched number of arguments", node, DiagnosticCode::ARGUMENT_MISMATCH);
         return;
     }
 
     for (size_t i = 0; i < callExp->parameters.size(); ++i)
     {
         analyzer(callExp->parameters[i].get());
-        auto argType = inferExpressionType(callExp->parameters[i].get());
-
-        if (argType != symbol->parameterTypes[i])
+        if (!isAssignable(parameterTypes[i], inferType(callExp->parameters[i].get())))
         {
-            logError("Type mismatch in argument " + std::to_string(i), callExp->parameters[i].get());
+            logError("Type mismatch in argument " + std::to_string(i), callExp->parameters[i].get(), DiagnosticCode::ARGUMENT_MISMATCH);
         }
     }
     annotations[callExp] = SemanticInfo{
         .nodeType = symbol->nodeType,
         .isMutable = false,
         .isConstant = false,
-        .scopeDepth = (int)symbolTable.size() - 1,
+        .scopeDepth = currentScopeDepth(),
+        .type = symbol->nodeType == TypeSystem::POINTER ? symbol->type->element : nullptr,
     };
 }
 
@@ -115,28 +255,36 @@ void Semantics::analyzeIdentifierExpression(Node *node)
     auto identExp = dynamic_cast<Identifier *>(node);
     if (!identExp)
         return;
-    std::cout << "[SEMANTIC LOG]: Analyzing function statement node: " << identExp->toString() << "\n";
+    logs << "[SEMANTIC LOG]: Analyzing function statement node: " << identExp->toString() << "\n";
     auto identExpName = identExp->token.TokenLiteral;
     auto symbol = resolveSymbol(identExpName);
 
     if (!symbol)
     {
-        logError("Use of undeclared identifier ", identExp);
+        logError("Use of undeclared identifier ", identExp, DiagnosticCode::UNDECLARED_IDENTIFIER);
         annotations[identExp] = SemanticInfo{
             .nodeType = TypeSystem::UNKNOWN,
             .isMutable = false,
             .isConstant = false,
-            .scopeDepth = (int)symbolTable.size() - 1,
+            .scopeDepth = currentScopeDepth(),
         };
         return;
     }
     auto identType = symbol->nodeType;
+    if (isForeignSignal(identExpName, symbol))
+    {
+        logError("Signal '" + identExpName + "' belongs to the top level code, a function can not wait on it", identExp, DiagnosticCode::INVALID_SIGNAL);
+    }
 
+    // Fixed bindings with a folded value propagate it to every use
     annotations[identExp] = SemanticInfo{
         .nodeType = identType,
-        .isMutable = false,
-        .isConstant = false,
-        .scopeDepth = (int)symbolTable.size() - 1,
+        .isMutable = symbol->isMutable,
+        .isConstant = symbol->constantValue.has_value(),
+        .scopeDepth = currentScopeDepth(),
+        .constantValue = symbol->constantValue,
+        .isShared = isSharedVariable(identExpName, symbol),
+        .type = identType == TypeSystem::POINTER ? symbol->type : nullptr,
     };
 }
 
@@ -147,7 +295,7 @@ void Semantics::analyzeForStatement(Node *node)
     if (!forStmt)
         return;
     symbolTable.push_back({});
-    std::cout << "[SEMANTIC LOG]: Analyzing for loop node " << forStmt->toString() << "\n";
+    logs << "[SEMANTIC LOG]: Analyzing for loop node " << forStmt->toString() << "\n";
     auto forInit = forStmt->initializer.get();
     if (!forInit)
         return;
@@ -156,11 +304,12 @@ void Semantics::analyzeForStatement(Node *node)
     TypeSystem forCondType;
     if (forCond)
     {
+        analyzer(forCond);
         forCondType = inferExpressionType(forCond);
-        std::cout << "[SEMANTIC LOG]: For loop condition type " << TypeSystemString(forCondType) << "\n";
+        logs << "[SEMANTIC LOG]: For loop condition type " << TypeSystemString(forCondType) << "\n";
         if (forCondType != TypeSystem::BOOLEAN)
         {
-            logError("For loop condition is not a boolean", forStmt);
+            logError("For loop condition is not a boolean", forStmt, DiagnosticCode::TYPE_MISMATCH);
         }
     }
 
@@ -178,7 +327,7 @@ void Semantics::analyzeForStatement(Node *node)
         .nodeType = TypeSystem::UNKNOWN,
         .isMutable = false,
         .isConstant = false,
-        .scopeDepth = (int)symbolTable.size() - 1};
+        .scopeDepth = currentScopeDepth()};
 
     symbolTable.pop_back();
 }
@@ -188,17 +337,17 @@ void Semantics::analyzeWhileStatement(Node *node)
     auto whileStmt = dynamic_cast<WhileStatement *>(node);
     if (!whileStmt)
         return;
-    std::cout << "[SEMANTIC LOG]: Analyzing while statement node " << whileStmt->toString() << "\n";
+    logs << "[SEMANTIC LOG]: Analyzing while statement node " << whileStmt->toString() << "\n";
     auto whileCond = whileStmt->condition.get();
     TypeSystem condType;
     if (whileCond)
     {
         analyzer(whileCond);
         condType = inferExpressionType(whileCond);
-        std::cout << "While condition type:" << TypeSystemString(condType) << "\n";
+        logs << "While condition type:" << TypeSystemString(condType) << "\n";
         if (condType != TypeSystem::BOOLEAN)
         {
-            logError("While condition type must be a boolean", whileCond);
+            logError("While condition type must be a boolean", whileCond, DiagnosticCode::TYPE_MISMATCH);
         }
     }
     // Analyzing content of the while block
@@ -212,7 +361,7 @@ void Semantics::analyzeWhileStatement(Node *node)
         .nodeType = condType,
         .isMutable = false,
         .isConstant = false,
-        .scopeDepth = (int)symbolTable.size() - 1};
+        .scopeDepth = currentScopeDepth()};
 }
 
 void Semantics::analyzeIfStatements(Node *node)
@@ -220,18 +369,18 @@ void Semantics::analyzeIfStatements(Node *node)
     auto ifNode = dynamic_cast<ifStatement *>(node);
     if (!ifNode)
         return;
-    std::cout << "[SEMANTIC LOG]: Analyzing if statement" << ifNode->toString() << "\n";
+    logs << "[SEMANTIC LOG]: Analyzing if statement" << ifNode->toString() << "\n";
     if (ifNode->condition)
     {
         analyzer(ifNode->condition.get());
         auto condType = inferExpressionType(ifNode->condition.get());
-        std::cout << "Condition Type: " << TypeSystemString(condType) << "\n";
+        logs << "Condition Type: " << TypeSystemString(condType) << "\n";
         if (condType != TypeSystem::BOOLEAN)
         {
-            logError("If condition must be boolean type", ifNode->condition.get());
+            logError("If condition must be boolean type", ifNode->condition.get(), DiagnosticCode::TYPE_MISMATCH);
         }
     }
-    std::cout << "Now analyzing if statement conditions\n";
+    logs << "Now analyzing if statement conditions\n";
     if (ifNode->if_result)
     {
         analyzeBlockStatements(ifNode->if_result.get());
@@ -239,25 +388,25 @@ void Semantics::analyzeIfStatements(Node *node)
 
     if (ifNode->elseif_condition.has_value() && ifNode->elseif_condition)
     {
-        std::cout << "[SEMANTIC LOG]: Analyzing else-if condition\n";
+        logs << "[SEMANTIC LOG]: Analyzing else-if condition\n";
         analyzer(ifNode->elseif_condition.value().get());
         auto elseifcondType = inferExpressionType(ifNode->elseif_condition.value().get());
 
         if (elseifcondType != TypeSystem::BOOLEAN)
         {
-            logError("If condition must be boolean type ", ifNode->elseif_condition.value().get());
+            logError("If condition must be boolean type ", ifNode->elseif_condition.value().get(), DiagnosticCode::TYPE_MISMATCH);
         }
 
         if (ifNode->elseif_result.has_value() && ifNode->elseif_result)
         {
-            std::cout << "[SEMANTIC LOG]: Analyzing else-if block\n";
+            logs << "[SEMANTIC LOG]: Analyzing else-if block\n";
             analyzeBlockStatements(ifNode->elseif_result.value().get());
         }
     }
 
     if (ifNode->else_result.has_value() && ifNode->else_result)
     {
-        std::cout << "[SEMANTIC LOG]: Analyzing else block\n";
+        logs << "[SEMANTIC LOG]: Analyzing else block\n";
         analyzeBlockStatements(ifNode->else_result.value().get());
     }
 
@@ -265,7 +414,7 @@ void Semantics::analyzeIfStatements(Node *node)
         .nodeType = TypeSystem::BOOLEAN,
         .isMutable = false,
         .isConstant = false,
-        .scopeDepth = (int)symbolTable.size() - 1,
+        .scopeDepth = currentScopeDepth(),
     };
 }
 
@@ -276,7 +425,7 @@ void Semantics::analyzeBlockStatements(Node *node)
     auto &stmts = blockStmt->statements;
     for (const auto &stmt : stmts)
     {
-        std::cout << "Analyzing statement in statement block: " << stmt->toString() << "\n";
+        logs << "Analyzing statement in statement block: " << stmt->toString() << "\n";
         analyzer(stmt.get());
     }
     symbolTable.pop_back();
@@ -284,8 +433,8 @@ void Semantics::analyzeBlockStatements(Node *node)
 
 void Semantics::analyzeLetStatements(Node *node)
 {
-    std::cout << "[SEMANTIC LOG]: Analyzing let statement: " << dynamic_cast<LetStatement *>(node)->toString() << "\n";
-    std::cout << "[DEBUG]: Current symbol table size: " << symbolTable.size() << "\n";
+    logs << "[SEMANTIC LOG]: Analyzing let statement: " << dynamic_cast<LetStatement *>(node)->toString() << "\n";
+    logs << "[DEBUG]: Current symbol table size: " << symbolTable.size() << "\n";
     auto letStmt = dynamic_cast<LetStatement *>(node);
     if (!letStmt)
         return;
@@ -293,13 +442,29 @@ void Semantics::analyzeLetStatements(Node *node)
     std::string varName = letStmt->ident_token.TokenLiteral;             // Getting the variable name
 
     TypeSystem varType = mapTypeStringToTypeSystem(declaredTypeStr); // Getting the type of the variable
+    const Type *pointerType = varType == TypeSystem::POINTER ? resolveType(declaredTypeStr) : nullptr;
+    if (pointerType)
+    {
+        checkPointee(pointerType, letStmt);
+        // A fixed size array gets zeroed storage from its declaration, everything else has nothing to point at yet
+        if (!letStmt->value && !declaringParameters && pointerType->kind == TypeKind::POINTER)
+            logError("Pointer '" + varName + "' must be initialized, there is no null pointer", letStmt);
+        else if (!letStmt->value && !declaringParameters && pointerType->kind == TypeKind::ARRAY && pointerType->length == 0)
+            logError("Array '" + varName + "' must be initialized, only fixed size arrays get their storage from the declaration", letStmt);
+    }
 
     // Checking if the user provided a variable after using auto if not we get the error early
     if (!letStmt->value && declaredTypeStr == "auto")
     {
-        std::cerr << "[SEMANTIC ERROR] Cannot use 'auto' without initialization in variable '" << varName << "'\n";
-        logError("Cannot use 'auto' without initialization in variable ", letStmt);
+        logError("Cannot use 'auto' without initialization in variable '" + varName + "'", letStmt);
+    }
+
+    bool isFixed = letStmt->fixed_token.has_value();
+    if (isFixed && !letStmt->value)
+    {
+        logError("Fixed variable '" + varName + "' must be initialized", letStmt);
     }
+    bool isGc = letStmt->gc_token.has_value();
 
     // Analysing the assigned expressions value if it exists
     if (letStmt->value)
@@ -313,46 +478,90 @@ void Semantics::analyzeLetStatements(Node *node)
             if (declaredTypeStr == "auto")
             {
                 varType = exprType;
+                if (varType == TypeSystem::POINTER)
+                    pointerType = inferType(letStmt->value.get());
                 if (varType == TypeSystem::UNKNOWN)
                 {
-                    std::cerr << "[SEMANTIC ERROR]: Type inference failed, could not infer type for unkown type for variable" << varName << "\n";
+                    logError("Type inference failed, could not infer type for unkown type for variable '" + varName + "'", letStmt, DiagnosticCode::TYPE_MISMATCH);
                 }
             }
             else
             {
                 // No 'auto' and no valid type — reject this statement
-                std::cerr << "[SEMANTIC ERROR]: variable '" << varName << "' has no valid type and 'auto' keyword was not used.\n";
+                logError("Variable '" + varName + "' has no valid type and 'auto' keyword was not used", letStmt);
             }
         }
         else
         {
             if (exprType != TypeSystem::UNKNOWN && exprType != varType)
             {
-                std::cerr << "[SEMANTIC ERROR]: Type mismatch: variable '" << varName << "' declared as '" << declaredTypeStr << "' but assigned value of different type\n";
+                logError("Type mismatch: variable '" + varName + "' declared as '" + declaredTypeStr + "' but assigned value of different type", letStmt, DiagnosticCode::TYPE_MISMATCH);
+            }
+            else if (pointerType && !isAssignable(pointerType, inferType(letStmt->value.get())))
+            {
+                logError("Type mismatch: variable '" + varName + "' declared as '" + declaredTypeStr + "' but assigned a " + TypeContext::toString(inferType(letStmt->value.get())), letStmt, DiagnosticCode::TYPE_MISMATCH);
             }
         }
     }
 
+    // Only fixed bindings carry their folded value since other variables can be reassigned later
+    std::optional<ConstantValue> fixedValue;
+    if (isFixed && letStmt->value)
+    {
+        fixedValue = constantOf(letStmt->value.get());
+        if (fixedValue && fixedValue->type != varType)
+        {
+            fixedValue.reset();
+        }
+    }
+
+    // Strings are the only values that live on a heap, the others are copied around in registers
+    if (isGc && varType != TypeSystem::STRING && varType != TypeSystem::UNKNOWN)
+    {
+        logError("Only strings can live on the gc heap but '" + varName + "' is " + TypeContext::scalarName(varType), letStmt, DiagnosticCode::TYPE_MISMATCH);
+        isGc = false;
+    }
+    if (letStmt->unique_token && varType != TypeSystem::POINTER && varType != TypeSystem::UNKNOWN)
+    {
+        logError("Only pointers can be unique but '" + varName + "' is " + TypeContext::scalarName(varType), letStmt, DiagnosticCode::TYPE_MISMATCH);
+    }
+    if (letStmt->access_token && varType != TypeSystem::POINTER && varType != TypeSystem::UNKNOWN)
+    {
+        logError("Only pointers can be " + letStmt->access_token->TokenLiteral + " but '" + varName + "' is " + TypeContext::scalarName(varType), letStmt, DiagnosticCode::TYPE_MISMATCH);
+    }
+
     Symbol sym{
         .nodeName = varName,
         .nodeType = varType,
-        .isMutable = true,
-        .isConstant = false,
-        .scopeDepth = (int)symbolTable.size() - 1};
+        .type = pointerType,
+        .kind = SymbolKind::VARIABLE,
+        .isMutable = !isFixed,
+        .isConstant = fixedValue.has_value(),
+        .scopeDepth = currentScopeDepth(),
+        .constantValue = fixedValue,
+        .isGc = isGc};
 
     annotations[letStmt] = SemanticInfo{
         .nodeType = varType,
-        .isMutable = true,
-        .isConstant = false,
-        .scopeDepth = (int)symbolTable.size() - 1};
+        .isMutable = !isFixed,
+        .isConstant = fixedValue.has_value(),
+        .scopeDepth = currentScopeDepth(),
+        .constantValue = fixedValue,
+        .isGc = isGc,
+        .type = pointerType};
+
+    if (fixedValue)
+    {
+        logs << "[SEMANTIC LOG]: Fixed variable '" << varName << "' folded to " << constantToString(*fixedValue) << "\n";
+    }
 
     symbolTable.back()[varName] = sym;
-    std::cout << "[DEBUG] Inserted '" << varName << "' into scope 0\n";
+    logs << "[DEBUG] Inserted '" << varName << "' into scope " << currentScopeDepth() << "\n";
 }
 
 void Semantics::analyzeAssignmentStatement(Node *node)
 {
-    std::cout << "[SEMANTIC LOG] Analyzing Assignment statement: " << dynamic_cast<AssignmentStatement *>(node)->ident_token.TokenLiteral << "\n";
+    logs << "[SEMANTIC LOG] Analyzing Assignment statement: " << dynamic_cast<AssignmentStatement *>(node)->ident_token.TokenLiteral << "\n";
     auto stmtNode = dynamic_cast<AssignmentStatement *>(node);
     if (!stmtNode)
         return;
@@ -361,15 +570,29 @@ void Semantics::analyzeAssignmentStatement(Node *node)
     auto identSymbol = resolveSymbol(identifierName);
     if (!identSymbol)
     {
-        std::cerr << "[SEMANTIC ERROR]: Variable '" << identifierName << "' not declared.\n";
+        logError("Variable '" + identifierName + "' not declared", stmtNode, DiagnosticCode::UNDECLARED_IDENTIFIER);
         return;
     }
+    if (isSignal(identSymbol))
+    {
+        logError("Cannot assign to signal '" + identifierName + "', it reads as the result of its task", stmtNode, DiagnosticCode::FIXED_ASSIGNMENT);
+    }
+    else if (identSymbol->kind == SymbolKind::VARIABLE && !identSymbol->isMutable)
+    {
+        logError("Cannot assign to fixed variable '" + identifierName + "'", stmtNode, DiagnosticCode::FIXED_ASSIGNMENT);
+    }
     auto identType = identSymbol->nodeType;
 
+    analyzer(stmtNode->value.get());
     auto valueType = inferExpressionType(stmtNode->value.get());
     if (identType != valueType)
     {
-        std::cerr << "[SEMANTIC ERROR]: Type mismatch: " << identifierName << " doesnt match " << TypeSystemString(valueType) << "\n";
+        logError("Type mismatch: " + identifierName + " doesnt match " + TypeSystemString(valueType), stmtNode, DiagnosticCode::TYPE_MISMATCH);
+        return;
+    }
+    if (identType == TypeSystem::POINTER && !isAssignable(identSymbol->type, inferType(stmtNode->value.get())))
+    {
+        logError("Type mismatch: " + identifierName + " is a " + TypeContext::toString(identSymbol->type) + " but got a " + TypeContext::toString(inferType(stmtNode->value.get())), stmtNode, DiagnosticCode::TYPE_MISMATCH);
         return;
     }
 
@@ -377,40 +600,45 @@ void Semantics::analyzeAssignmentStatement(Node *node)
         .nodeType = identType,
         .isMutable = true,
         .isConstant = false,
-        .scopeDepth = (int)symbolTable.size() - 1};
+        .scopeDepth = currentScopeDepth(),
+        .isShared = isSharedVariable(identifierName, identSymbol),
+        .isGc = identSymbol->isGc,
+        .type = identType == TypeSystem::POINTER ? identSymbol->type : nullptr};
 }
 
 void Semantics::analyzeIntegerLiteral(Node *node)
 {
-    std::cout << "[SEMANTIC LOG] Analyzing IntegerLiteral: " << dynamic_cast<IntegerLiteral *>(node)->int_token.TokenLiteral << "\n";
+    logs << "[SEMANTIC LOG] Analyzing IntegerLiteral: " << dynamic_cast<IntegerLiteral *>(node)->int_token.TokenLiteral << "\n";
     if (!node)
         return;
 
     IntegerLiteral *intNode = dynamic_cast<IntegerLiteral *>(node);
     if (!intNode)
     {
-        std::cerr << "[SEMANTIC ERROR]: Failed to analyze integer node received wrong node" << "\n";
+        logs << "[SEMANTIC LOG]: Failed to analyze integer node received wrong node" << "\n";
         return;
     }
     std::string intName = intNode->int_token.TokenLiteral;
     TypeSystem intType = TypeSystem::INTEGER;
+    auto intValue = foldIntegerLiteral(intNode);
 
     annotations[intNode] = SemanticInfo{
         .nodeType = intType,
         .isMutable = true,
-        .isConstant = false,
-        .scopeDepth = (int)symbolTable.size() - 1};
+        .isConstant = intValue.has_value(),
+        .scopeDepth = currentScopeDepth(),
+        .constantValue = intValue};
 }
 
 void Semantics::analyzeFloatLiteral(Node *node)
 {
-    std::cout << "[SEMANTIC LOG] Analyzing FloatLiteral: " << dynamic_cast<FloatLiteral *>(node)->float_token.TokenLiteral << "\n";
+    logs << "[SEMANTIC LOG] Analyzing FloatLiteral: " << dynamic_cast<FloatLiteral *>(node)->float_token.TokenLiteral << "\n";
     if (!node)
         return;
     FloatLiteral *fltNode = dynamic_cast<FloatLiteral *>(node);
     if (!fltNode)
     {
-        std::cerr << "[SEMANTIC ERROR]: Failed to analyze float node recieved";
+        logs << "[SEMANTIC LOG]: Failed to analyze float node recieved\n";
         return;
     }
     std::string fltName = fltNode->float_token.TokenLiteral;
@@ -419,8 +647,9 @@ void Semantics::analyzeFloatLiteral(Node *node)
     annotations[fltNode] = SemanticInfo{
         .nodeType = fltType,
         .isMutable = true,
-        .isConstant = false,
-        .scopeDepth = (int)symbolTable.size() - 1};
+        .isConstant = true,
+        .scopeDepth = currentScopeDepth(),
+        .constantValue = ConstantValue{.type = fltType, .floatValue = std::stod(fltName)}};
 }
 
 void Semantics::analyzeStringLiteral(Node *node)
@@ -428,36 +657,38 @@ void Semantics::analyzeStringLiteral(Node *node)
     if (!node)
         return;
     StringLiteral *strNode = dynamic_cast<StringLiteral *>(node);
-    std::cout << "[SEMANTIC LOG]: Analyzing string node: " << strNode->string_token.TokenLiteral << "\n";
+    logs << "[SEMANTIC LOG]: Analyzing string node: " << strNode->string_token.TokenLiteral << "\n";
     if (!strNode)
     {
-        std::cout << "Failed to analyze string node\n";
+        logs << "Failed to analyze string node\n";
         return;
     }
     TypeSystem strType = TypeSystem::STRING;
     annotations[strNode] = SemanticInfo{
         .nodeType = strType,
         .isMutable = true,
-        .isConstant = false,
-        .scopeDepth = (int)symbolTable.size() - 1};
+        .isConstant = true,
+        .scopeDepth = currentScopeDepth(),
+        .constantValue = ConstantValue{.type = strType, .stringValue = strNode->string_token.TokenLiteral}};
 }
 void Semantics::analyzeBooleanLiteral(Node *node)
 {
     if (!node)
         return;
     BooleanLiteral *boolNode = dynamic_cast<BooleanLiteral *>(node);
-    std::cout << "[SEMANTIC LOG]: Analyzing boolean node: " << boolNode->boolean_token.TokenLiteral << "\n";
+    logs << "[SEMANTIC LOG]: Analyzing boolean node: " << boolNode->boolean_token.TokenLiteral << "\n";
     if (!boolNode)
     {
-        std::cout << "Failed to analyze boolean node\n";
+        logs << "Failed to analyze boolean node\n";
         return;
     }
     TypeSystem boolType = TypeSystem::BOOLEAN;
     annotations[boolNode] = SemanticInfo{
         .nodeType = boolType,
         .isMutable = true,
-        .isConstant = false,
-        .scopeDepth = (int)symbolTable.size() - 1};
+        .isConstant = true,
+        .scopeDepth = currentScopeDepth(),
+        .constantValue = ConstantValue{.type = boolType, .boolValue = boolNode->boolean_token.type == TokenType::TRUE}};
 }
 
 void Semantics::analyzeCharLiteral(Node *node)
@@ -465,38 +696,485 @@ void Semantics::analyzeCharLiteral(Node *node)
     if (!node)
         return;
     CharLiteral *charNode = dynamic_cast<CharLiteral *>(node);
-    std::cout << "[SEMANTIC LOG]: Analyzing char node: " << charNode->char_token.TokenLiteral << "\n";
+    logs << "[SEMANTIC LOG]: Analyzing char node: " << charNode->char_token.TokenLiteral << "\n";
     if (!charNode)
     {
-        std::cout << "Failed to analyze char node\n";
+        logs << "Failed to analyze char node\n";
         return;
     }
     TypeSystem charType = TypeSystem::CHAR;
     annotations[charNode] = SemanticInfo{
         .nodeType = charType,
         .isMutable = true,
-        .isConstant = false,
-        .scopeDepth = (int)symbolTable.size() - 1};
+        .isConstant = true,
+        .scopeDepth = currentScopeDepth(),
+        .constantValue = ConstantValue{.type = charType, .charValue = charNode->char_token.TokenLiteral.empty() ? '\0' : charNode->char_token.TokenLiteral[0]}};
 }
 
 void Semantics::analyzeInfixExpression(Node *node)
 {
-    std::cout << "[SEMANTIC LOG]: Analyzing infix node\n";
+    logs << "[SEMANTIC LOG]: Analyzing infix node\n";
     auto infixNode = dynamic_cast<InfixExpression *>(node);
     if (!infixNode)
         return;
+    analyzer(infixNode->left_operand.get());
+    analyzer(infixNode->right_operand.get());
+
     TypeSystem leftType = inferExpressionType(infixNode->left_operand.get());
     TypeSystem rightType = inferExpressionType(infixNode->right_operand.get());
 
     TypeSystem resultType = resultOf(infixNode->operat.type, leftType, rightType);
+    if (resultType == TypeSystem::UNKNOWN && leftType != TypeSystem::UNKNOWN && rightType != TypeSystem::UNKNOWN)
+    {
+        logError("Cannot apply '" + infixNode->operat.TokenLiteral + "' to " + TypeContext::scalarName(leftType) + " and " + TypeContext::scalarName(rightType), infixNode, DiagnosticCode::INVALID_OPERATOR);
+    }
+    // Pointers only mix when they point at the same type, arrays of any length compare but only fit a target of the same length or a dynamic one
+    const Type *pointerType = nullptr;
+    if (resultType != TypeSystem::UNKNOWN && leftType == TypeSystem::POINTER && rightType == TypeSystem::POINTER)
+    {
+        pointerType = inferType(infixNode->left_operand.get());
+        const Type *valueType = inferType(infixNode->right_operand.get());
+        bool matches = infixNode->operat.type == TokenType::ASSIGN ? isAssignable(pointerType, valueType)
+                                                                   : types.withoutLengths(pointerType) == types.withoutLengths(valueType);
+        if (!matches)
+        {
+            logError("Cannot apply '" + infixNode->operat.TokenLiteral + "' to " + TypeContext::toString(pointerType) + " and " + TypeContext::toString(inferType(infixNode->right_operand.get())), infixNode, DiagnosticCode::INVALID_OPERATOR);
+        }
+    }
+
+    // Assignments inside expressions like the for loop step change their target so they are never folded
+    std::optional<ConstantValue> folded;
+    if (infixNode->operat.type == TokenType::ASSIGN)
+    {
+        auto target = dynamic_cast<Identifier *>(infixNode->left_operand.get());
+        auto targetInfo = target ? getAnnotation(target) : nullptr;
+        if (targetInfo && targetInfo->nodeType != TypeSystem::UNKNOWN && !targetInfo->isMutable)
+        {
+            logError("Cannot assign to fixed variable '" + target->identifier.TokenLiteral + "'", infixNode, DiagnosticCode::FIXED_ASSIGNMENT);
+        }
+    }
+    else
+    {
+        auto leftValue = constantOf(infixNode->left_operand.get());
+        auto rightValue = constantOf(infixNode->right_operand.get());
+        if (leftValue && rightValue && resultType != TypeSystem::UNKNOWN)
+        {
+            folded = foldInfix(infixNode, *leftValue, *rightValue);
+        }
+    }
+
+    if (folded)
+    {
+        logs << "[SEMANTIC LOG]: Folded infix expression to " << constantToString(*folded) << "\n";
+    }
 
-    if (!infixNode)
-        return;
     annotations[infixNode] = SemanticInfo{
         .nodeType = resultType,
         .isMutable = false,
+        .isConstant = folded.has_value(),
+        .scopeDepth = currentScopeDepth(),
+        .constantValue = folded,
+        .type = resultType == TypeSystem::POINTER ? pointerType : nullptr};
+}
+
+void Semantics::analyzePrefixExpression(Node *node)
+{
+    logs << "[SEMANTIC LOG]: Analyzing prefix node\n";
+    auto prefixNode = dynamic_cast<PrefixExpression *>(node);
+    if (!prefixNode)
+        return;
+    analyzer(prefixNode->operand.get());
+
+    TokenType op = prefixNode->operat.type;
+    if (op == TokenType::ASTERISK)
+    {
+        // Reading through a pointer, *p = v writes through it
+        const Type *pointer = inferType(prefixNode->operand.get());
+        const Type *pointee = pointer->kind == TypeKind::POINTER ? pointer->element : nullptr;
+        if (!pointee && pointer->scalar != TypeSystem::UNKNOWN)
+        {
+            logError("Cannot dereference " + TypeContext::toString(pointer) + ", only pointers can be read through with '*'", prefixNode, DiagnosticCode::INVALID_OPERATOR);
+        }
+        annotations[prefixNode] = SemanticInfo{
+            .nodeType = pointee ? pointee->scalar : TypeSystem::UNKNOWN,
+            .isMutable = true,
+            .isConstant = false,
+            .scopeDepth = currentScopeDepth(),
+            .type = pointee && pointee->scalar == TypeSystem::POINTER ? pointee : nullptr};
+        return;
+    }
+    if (op == TokenType::LENGTH)
+    {
+        // The length of a fixed size array is known here, dynamic ones read it from their block
+        const Type *array = inferType(prefixNode->operand.get());
+        if (array->kind != TypeKind::ARRAY && array->scalar != TypeSystem::UNKNOWN)
+        {
+            logError("Cannot take the length of " + TypeContext::toString(array) + ", only arrays have one", prefixNode, DiagnosticCode::INVALID_OPERATOR);
+        }
+        std::optional<ConstantValue> length;
+        if (array->kind == TypeKind::ARRAY && array->length > 0)
+        {
+            length = ConstantValue{.type = TypeSystem::INTEGER, .intValue = (int64_t)array->length};
+        }
+        annotations[prefixNode] = SemanticInfo{
+            .nodeType = TypeSystem::INTEGER,
+            .isMutable = false,
+            .isConstant = length.has_value(),
+            .scopeDepth = currentScopeDepth(),
+            .constantValue = length};
+        return;
+    }
+    if (op == TokenType::ELEVATE)
+    {
+        // Gives the write access a read pointer does not have, the permission check trusts it inside unsafe blocks only
+        const Type *pointer = inferType(prefixNode->operand.get());
+        if (pointer->scalar != TypeSystem::POINTER && pointer->scalar != TypeSystem::UNKNOWN)
+        {
+            logError("Cannot elevate " + TypeContext::toString(pointer) + ", only pointers and arrays have access permissions", prefixNode, DiagnosticCode::INVALID_OPERATOR);
+        }
+        if (unsafeDepth == 0)
+        {
+            logError("'elevate' is only allowed inside an unsafe block", prefixNode, DiagnosticCode::POINTER_ACCESS);
+        }
+        annotations[prefixNode] = SemanticInfo{
+            .nodeType = pointer->scalar == TypeSystem::POINTER ? TypeSystem::POINTER : TypeSystem::UNKNOWN,
+            .isMutable = false,
+            .isConstant = false,
+            .scopeDepth = currentScopeDepth(),
+            .type = pointer->scalar == TypeSystem::POINTER ? pointer : nullptr};
+        return;
+    }
+    TypeSystem operandType = inferExpressionType(prefixNode->operand.get());
+    TypeSystem resultType = resultOfUnary(op, operandType);
+    if (resultType == TypeSystem::UNKNOWN && operandType != TypeSystem::UNKNOWN)
+    {
+        logError("Cannot apply '" + prefixNode->operat.TokenLiteral + "' to type " + TypeSystemString(operandType), prefixNode, DiagnosticCode::INVALID_OPERATOR);
+    }
+
+    std::optional<ConstantValue> folded;
+    if (op == TokenType::PLUS_PLUS || op == TokenType::MINUS_MINUS)
+    {
+        auto operandInfo = getAnnotation(prefixNode->operand.get());
+        if (operandInfo && !operandInfo->isMutable && dynamic_cast<Identifier *>(prefixNode->operand.get()))
+        {
+            logError("Cannot modify fixed variable with '" + prefixNode->operat.TokenLiteral + "'", prefixNode, DiagnosticCode::FIXED_ASSIGNMENT);
+        }
+    }
+    else if (auto operandValue = constantOf(prefixNode->operand.get()))
+    {
+        folded = foldPrefix(prefixNode, *operandValue);
+        if (folded)
+        {
+            logs << "[SEMANTIC LOG]: Folded prefix expression to " << constantToString(*folded) << "\n";
+        }
+    }
+
+    annotations[prefixNode] = SemanticInfo{
+        .nodeType = resultType,
+        .isMutable = false,
+        .isConstant = folded.has_value(),
+        .scopeDepth = currentScopeDepth(),
+        .constantValue = folded};
+}
+
+void Semantics::analyzeReturnStatement(Node *node)
+{
+    auto retStmt = dynamic_cast<ReturnStatement *>(node);
+    if (!retStmt)
+        return;
+    logs << "[SEMANTIC LOG]: Analyzing return statement\n";
+    TypeSystem valueType = TypeSystem::VOID;
+    if (retStmt->return_value)
+    {
+        analyzer(retStmt->return_value.get());
+        valueType = inferExpressionType(retStmt->return_value.get());
+    }
+
+    if (currentReturnType != TypeSystem::UNKNOWN && valueType != TypeSystem::UNKNOWN && valueType != currentReturnType)
+    {
+        logError("Return type mismatch: expected " + TypeSystemString(currentReturnType) + "but got " + TypeSystemString(valueType), retStmt, DiagnosticCode::TYPE_MISMATCH);
+    }
+    else if (currentReturnType == TypeSystem::POINTER && currentReturnFullType && !isAssignable(currentReturnFullType, inferType(retStmt->return_value.get())))
+    {
+        logError("Return type mismatch: expected " + TypeContext::toString(currentReturnFullType) + " but got " + TypeContext::toString(inferType(retStmt->return_value.get())), retStmt, DiagnosticCode::TYPE_MISMATCH);
+    }
+
+    annotations[retStmt] = SemanticInfo{
+        .nodeType = valueType,
+        .isMutable = false,
+        .isConstant = false,
+        .scopeDepth = currentScopeDepth()};
+}
+
+void Semantics::analyzeBlockExpression(Node *node)
+{
+    auto blockExpr = dynamic_cast<BlockExpression *>(node);
+    if (!blockExpr)
+        return;
+    symbolTable.push_back({});
+    for (const auto &stmt : blockExpr->statements)
+    {
+        logs << "Analyzing statement in block expression: " << stmt->toString() << "\n";
+        analyzer(stmt.get());
+    }
+    if (blockExpr->finalexpr.has_value() && blockExpr->finalexpr.value())
+    {
+        analyzer(blockExpr->finalexpr.value().get());
+    }
+    symbolTable.pop_back();
+}
+
+void Semantics::analyzeExpressionStatement(Node *node)
+{
+    auto exprStmt = dynamic_cast<ExpressionStatement *>(node);
+    if (!exprStmt)
+        return;
+    analyzer(exprStmt->expression.get());
+}
+
+// A signal starts its call as a task and is typed as a future of what the call returns. Reading the signal
+// waits for the task and gives that result, so it is fixed like any other binding of a value
+void Semantics::analyzeSignalStatement(Node *node)
+{
+    auto signalStmt = dynamic_cast<SignalStatement *>(node);
+    if (!signalStmt)
+        return;
+    logs << "[SEMANTIC LOG]: Analyzing signal statement " << signalStmt->toString() << "\n";
+    auto ident = dynamic_cast<Identifier *>(signalStmt->identifier.get());
+    auto call = dynamic_cast<CallExpression *>(signalStmt->func_arg.get());
+    if (!ident || !call || !call->function_identifier)
+        return;
+    std::string name = ident->identifier.TokenLiteral;
+
+    // The call is checked like any other, the target has to be a work with matching arguments
+    analyzer(call);
+    auto target = resolveSymbol(call->function_identifier->token.TokenLiteral);
+    const Type *future = nullptr;
+    TypeSystem resultType = TypeSystem::UNKNOWN;
+    if (target && target->kind == SymbolKind::FUNCTION && target->type)
+    {
+        future = types.futureOf(target->type->element);
+        resultType = target->nodeType;
+        logs << "[SEMANTIC LOG]: Signal '" << name << "' is a " << TypeContext::toString(future) << "\n";
+    }
+
+    if (symbolTable.back().count(name))
+    {
+        logError("Redefinition of '" + name + "', a signal needs a name of its own", signalStmt, DiagnosticCode::REDEFINITION);
+    }
+    symbolTable.back()[name] = Symbol{
+        .nodeName = name,
+        .nodeType = resultType,
+        .type = future,
+        .kind = SymbolKind::VARIABLE,
+        .isMutable = false,
+        .isConstant = false,
+        .scopeDepth = currentScopeDepth(),
+    };
+    annotations[signalStmt] = SemanticInfo{
+        .nodeType = resultType,
+        .isMutable = false,
+        .isConstant = false,
+        .scopeDepth = currentScopeDepth()};
+}
+
+// The block of a zone is checked like any other, checkZoneEscapes looks at what leaves it once every body is analyzed
+void Semantics::analyzeZoneStatement(Node *node)
+{
+    auto zoneStmt = dynamic_cast<ZoneStatement *>(node);
+    if (!zoneStmt)
+        return;
+    logs << "[SEMANTIC LOG]: Analyzing zone statement at line " << zoneStmt->zone_token.line << "\n";
+    analyzer(zoneStmt->body.get());
+    annotations[zoneStmt] = SemanticInfo{
+        .nodeType = TypeSystem::VOID,
+        .isMutable = false,
+        .isConstant = false,
+        .scopeDepth = currentScopeDepth()};
+}
+
+void Semantics::analyzeUnsafeStatement(Node *node)
+{
+    auto unsafeStmt = dynamic_cast<UnsafeStatement *>(node);
+    if (!unsafeStmt)
+        return;
+    logs << "[SEMANTIC LOG]: Analyzing unsafe statement at line " << unsafeStmt->unsafe_token.line << "\n";
+    unsafeDepth++;
+    analyzer(unsafeStmt->body.get());
+    unsafeDepth--;
+    annotations[unsafeStmt] = SemanticInfo{
+        .nodeType = TypeSystem::VOID,
+        .isMutable = false,
+        .isConstant = false,
+        .scopeDepth = currentScopeDepth()};
+}
+
+// alloc(T) and make(value) give a pointer to a fresh cell on the allocator heap, alloc(T, n) an array of n zeroed elements
+void Semantics::analyzeAllocExpression(Node *node)
+{
+    auto allocExpr = dynamic_cast<AllocExpression *>(node);
+    if (!allocExpr)
+        return;
+    logs << "[SEMANTIC LOG]: Analyzing " << allocExpr->toString() << "\n";
+    const Type *pointee = types.scalar(TypeSystem::UNKNOWN);
+    if (allocExpr->value)
+    {
+        analyzer(allocExpr->value.get());
+        pointee = inferType(allocExpr->value.get());
+    }
+    else if (allocExpr->data_type_token)
+    {
+        pointee = resolveType(allocExpr->data_type_token->TokenLiteral);
+    }
+    if (allocExpr->count)
+    {
+        analyzer(allocExpr->count.get());
+        TypeSystem countType = inferExpressionType(allocExpr->count.get());
+        if (countType != TypeSystem::INTEGER && countType != TypeSystem::UNKNOWN)
+        {
+            logError("The length of an array has to be an int but got " + TypeContext::scalarName(countType), allocExpr->count.get(), DiagnosticCode::TYPE_MISMATCH);
+        }
+        auto count = constantOf(allocExpr->count.get());
+        if (count && count->type == TypeSystem::INTEGER && count->intValue < 0)
+        {
+            logError("An array can not have a negative length of " + std::to_string(count->intValue), allocExpr->count.get(), DiagnosticCode::INDEX_OUT_OF_BOUNDS);
+        }
+    }
+    const Type *pointer = allocExpr->count ? types.arrayOf(pointee) : types.pointerTo(pointee);
+    checkPointee(pointer, allocExpr);
+    annotations[allocExpr] = SemanticInfo{
+        .nodeType = TypeSystem::POINTER,
+        .isMutable = false,
+        .isConstant = false,
+        .scopeDepth = currentScopeDepth(),
+        .type = pointer};
+}
+
+// Nothing stops a freed pointer from being used again, the allocator hands the cell out to the next alloc
+void Semantics::analyzeFreeStatement(Node *node)
+{
+    auto freeStmt = dynamic_cast<FreeStatement *>(node);
+    if (!freeStmt)
+        return;
+    logs << "[SEMANTIC LOG]: Analyzing free statement at line " << freeStmt->free_token.line << "\n";
+    analyzer(freeStmt->value.get());
+    const Type *type = inferType(freeStmt->value.get());
+    if (type->scalar != TypeSystem::POINTER && type->scalar != TypeSystem::UNKNOWN)
+    {
+        logError("free needs a pointer or an array but got " + TypeContext::toString(type), freeStmt, DiagnosticCode::TYPE_MISMATCH);
+    }
+    annotations[freeStmt] = SemanticInfo{
+        .nodeType = TypeSystem::VOID,
+        .isMutable = false,
+        .isConstant = false,
+        .scopeDepth = currentScopeDepth()};
+}
+
+// a[i] reads or writes one element, the index is checked against the length at run time unless the
+// optimizer proves it in range or the access sits in an unsafe block. Constant indexes are checked here
+void Semantics::analyzeIndexExpression(Node *node)
+{
+    auto indexExpr = dynamic_cast<IndexExpression *>(node);
+    if (!indexExpr)
+        return;
+    logs << "[SEMANTIC LOG]: Analyzing index expression " << indexExpr->toString() << "\n";
+    analyzer(indexExpr->array.get());
+    analyzer(indexExpr->index.get());
+
+    const Type *array = inferType(indexExpr->array.get());
+    const Type *element = array->kind == TypeKind::ARRAY ? array->element : nullptr;
+    if (!element && array->scalar != TypeSystem::UNKNOWN)
+    {
+        logError("Cannot index " + TypeContext::toString(array) + ", only arrays have elements", indexExpr, DiagnosticCode::INVALID_OPERATOR);
+    }
+    TypeSystem indexType = inferExpressionType(indexExpr->index.get());
+    if (indexType != TypeSystem::INTEGER && indexType != TypeSystem::UNKNOWN)
+    {
+        logError("An array index has to be an int but got " + TypeContext::scalarName(indexType), indexExpr->index.get(), DiagnosticCode::TYPE_MISMATCH);
+    }
+    auto index = constantOf(indexExpr->index.get());
+    if (element && index && index->type == TypeSystem::INTEGER && (index->intValue < 0 || (array->length > 0 && (uint64_t)index->intValue >= array->length)))
+    {
+        logError("Index " + std::to_string(index->intValue) + " is out of bounds for " + TypeContext::toString(array), indexExpr, DiagnosticCode::INDEX_OUT_OF_BOUNDS);
+    }
+
+    annotations[indexExpr] = SemanticInfo{
+        .nodeType = element ? element->scalar : TypeSystem::UNKNOWN,
+        .isMutable = true,
+        .isConstant = false,
+        .scopeDepth = currentScopeDepth(),
+        .type = element && element->scalar == TypeSystem::POINTER ? element : nullptr};
+}
+
+// [a, b, c] makes a fixed size array on the allocator heap holding the values
+void Semantics::analyzeArrayLiteral(Node *node)
+{
+    auto literal = dynamic_cast<ArrayLiteral *>(node);
+    if (!literal)
+        return;
+    logs << "[SEMANTIC LOG]: Analyzing array literal " << literal->toString() << "\n";
+    if (literal->elements.empty())
+    {
+        logError("An array literal needs at least one element, use alloc(T, n) for an empty array", literal, DiagnosticCode::TYPE_MISMATCH);
+        return;
+    }
+    const Type *element = nullptr;
+    for (const auto &value : literal->elements)
+    {
+        analyzer(value.get());
+        const Type *valueType = inferType(value.get());
+        if (!element)
+        {
+            element = valueType;
+        }
+        else if (valueType != element && valueType->scalar != TypeSystem::UNKNOWN)
+        {
+            logError("Array elements must share one type, got " + TypeContext::toString(element) + " and " + TypeContext::toString(valueType), value.get(), DiagnosticCode::TYPE_MISMATCH);
+        }
+    }
+    const Type *array = types.arrayOf(element, literal->elements.size());
+    checkPointee(array, literal);
+    annotations[literal] = SemanticInfo{
+        .nodeType = TypeSystem::POINTER,
+        .isMutable = false,
         .isConstant = false,
-        .scopeDepth = (int)symbolTable.size() - 1};
+        .scopeDepth = currentScopeDepth(),
+        .type = array};
+}
+
+// A task nobody can wait on would be lost, start only makes sense as the value of a signal
+void Semantics::analyzeStartStatement(Node *node)
+{
+    logError("start has to be the value of a signal, like signal name = start(work(args));", node, DiagnosticCode::INVALID_SIGNAL);
+}
+
+void Semantics::analyzeWaitStatement(Node *node)
+{
+    auto waitStmt = dynamic_cast<WaitStatement *>(node);
+    if (!waitStmt)
+        return;
+    logs << "[SEMANTIC LOG]: Analyzing wait statement " << waitStmt->toString() << "\n";
+    auto ident = dynamic_cast<Identifier *>(waitStmt->arg.get());
+    if (!ident)
+    {
+        logError("wait needs the name of a signal", waitStmt, DiagnosticCode::INVALID_SIGNAL);
+        return;
+    }
+    analyzer(ident);
+    std::string name = ident->identifier.TokenLiteral;
+    auto symbol = resolveSymbol(name);
+    if (!symbol)
+        return; // Reported as undeclared already
+    if (!isSignal(symbol))
+    {
+        logError("wait needs a signal and '" + name + "' is not one", ident, DiagnosticCode::INVALID_SIGNAL);
+        return;
+    }
+    annotations[waitStmt] = SemanticInfo{
+        .nodeType = symbol->nodeType,
+        .isMutable = false,
+        .isConstant = false,
+        .scopeDepth = currentScopeDepth()};
 }
 
 // HELPER FUNCTIONS
@@ -510,7 +1188,7 @@ void Semantics::registerAnalyzerFunctions()
     analyzerFunctionsMap[typeid(CharLiteral)] = &Semantics::analyzeCharLiteral;
     analyzerFunctionsMap[typeid(BooleanLiteral)] = &Semantics::analyzeBooleanLiteral;
     analyzerFunctionsMap[typeid(InfixExpression)] = &Semantics::analyzeInfixExpression;
-    analyzerFunctionsMap[typeid(PrefixExpression)] = &Semantics::analyzeInfixExpression;
+    analyzerFunctionsMap[typeid(PrefixExpression)] = &Semantics::analyzePrefixExpression;
     analyzerFunctionsMap[typeid(AssignmentStatement)] = &Semantics::analyzeAssignmentStatement;
     analyzerFunctionsMap[typeid(ifStatement)] = &Semantics::analyzeIfStatements;
     analyzerFunctionsMap[typeid(ForStatement)] = &Semantics::analyzeForStatement;
@@ -519,6 +1197,18 @@ void Semantics::registerAnalyzerFunctions()
     analyzerFunctionsMap[typeid(Identifier)] = &Semantics::analyzeIdentifierExpression;
     analyzerFunctionsMap[typeid(FunctionStatement)] = &Semantics::analyzeFunctionStatement;
     analyzerFunctionsMap[typeid(CallExpression)] = &Semantics::analyzeFunctionCallExpression;
+    analyzerFunctionsMap[typeid(ReturnStatement)] = &Semantics::analyzeReturnStatement;
+    analyzerFunctionsMap[typeid(BlockExpression)] = &Semantics::analyzeBlockExpression;
+    analyzerFunctionsMap[typeid(ExpressionStatement)] = &Semantics::analyzeExpressionStatement;
+    analyzerFunctionsMap[typeid(SignalStatement)] = &Semantics::analyzeSignalStatement;
+    analyzerFunctionsMap[typeid(StartStatement)] = &Semantics::analyzeStartStatement;
+    analyzerFunctionsMap[typeid(WaitStatement)] = &Semantics::analyzeWaitStatement;
+    analyzerFunctionsMap[typeid(ZoneStatement)] = &Semantics::analyzeZoneStatement;
+    analyzerFunctionsMap[typeid(UnsafeStatement)] = &Semantics::analyzeUnsafeStatement;
+    analyzerFunctionsMap[typeid(AllocExpression)] = &Semantics::analyzeAllocExpression;
+    analyzerFunctionsMap[typeid(FreeStatement)] = &Semantics::analyzeFreeStatement;
+    analyzerFunctionsMap[typeid(IndexExpression)] = &Semantics::analyzeIndexExpression;
+    analyzerFunctionsMap[typeid(ArrayLiteral)] = &Semantics::analyzeArrayLiteral;
 }
 
 // Function maps the type string to the respective type system
@@ -534,9 +1224,62 @@ TypeSystem Semantics::mapTypeStringToTypeSystem(const std::string &typeStr)
         return TypeSystem::CHAR;
     if (typeStr == "bool")
         return TypeSystem::BOOLEAN;
+    if (typeStr == "void")
+        return TypeSystem::VOID;
+    if (typeStr.rfind("pointer<", 0) == 0 || typeStr.rfind("arr<", 0) == 0)
+        return TypeSystem::POINTER;
     return TypeSystem::UNKNOWN;
 }
 
+// The parser hands pointer and array types over as one literal like pointer<arr<int, 4>>
+const Type *Semantics::resolveType(const std::string &typeStr)
+{
+    if (typeStr.rfind("pointer<", 0) == 0 && typeStr.back() == '>')
+        return types.pointerTo(resolveType(typeStr.substr(8, typeStr.size() - 9)));
+    if (typeStr.rfind("arr<", 0) == 0 && typeStr.back() == '>')
+    {
+        // The length follows the comma outside any nested type
+        std::string inner = typeStr.substr(4, typeStr.size() - 5);
+        int depth = 0;
+        for (size_t i = 0; i < inner.size(); ++i)
+        {
+            if (inner[i] == '<')
+                depth++;
+            else if (inner[i] == '>')
+                depth--;
+            else if (inner[i] == ',' && depth == 0)
+                return types.arrayOf(resolveType(inner.substr(0, i)), std::stoull(inner.substr(i + 1)));
+        }
+        return types.arrayOf(resolveType(inner));
+    }
+    return types.scalar(mapTypeStringToTypeSystem(typeStr));
+}
+
+// Pointers and arrays hold plain values, the gc does not look behind them so a string there could be collected
+void Semantics::checkPointee(const Type *type, Node *node)
+{
+    for (; type && (type->kind == TypeKind::POINTER || type->kind == TypeKind::ARRAY); type = type->element)
+    {
+        const Type *pointee = type->element;
+        if (pointee && pointee->kind == TypeKind::SCALAR && (pointee->scalar == TypeSystem::STRING || pointee->scalar == TypeSystem::VOID || pointee->scalar == TypeSystem::UNKNOWN))
+        {
+            if (type->kind == TypeKind::ARRAY)
+                logError("An array can not hold " + TypeContext::toString(pointee) + ", only int, float, bool, char, pointers or other arrays", node, DiagnosticCode::TYPE_MISMATCH);
+            else
+                logError("A pointer can not point at " + TypeContext::toString(pointee) + ", only at int, float, bool, char, an array or another pointer", node, DiagnosticCode::TYPE_MISMATCH);
+            return;
+        }
+    }
+}
+
+// Same types fit, and any array fits a dynamic array of its element type since the length travels with the block
+bool Semantics::isAssignable(const Type *target, const Type *value)
+{
+    if (target == value)
+        return true;
+    return target && value && target->kind == TypeKind::ARRAY && target->length == 0 && value->kind == TypeKind::ARRAY && value->element == target->element;
+}
+
 // Type inference helper function
 TypeSystem Semantics::inferExpressionType(Node *node)
 {
@@ -570,15 +1313,26 @@ TypeSystem Semantics::inferExpressionType(Node *node)
     if (auto ident = dynamic_cast<Identifier *>(node))
     {
         std::string name = ident->identifier.TokenLiteral;
-        for (auto it = symbolTable.rbegin(); it != symbolTable.rend(); ++it)
+        auto symbol = resolveSymbol(name);
+        if (symbol)
         {
-            auto symIt = it->find(name);
-            if (symIt != it->end())
-            {
-                return symIt->second.nodeType;
-            }
+            return symbol->nodeType;
+        }
+        // Identifiers the walker already visited had their error reported there
+        if (!getAnnotation(ident))
+        {
+            logError("Identifier '" + name + "' not declared", ident, DiagnosticCode::UNDECLARED_IDENTIFIER);
+        }
+        return TypeSystem::UNKNOWN;
+    }
+
+    if (auto call = dynamic_cast<CallExpression *>(node))
+    {
+        auto symbol = resolveSymbol(call->function_identifier->token.TokenLiteral);
+        if (symbol && symbol->kind == SymbolKind::FUNCTION)
+        {
+            return symbol->nodeType;
         }
-        std::cerr << "Semantic error: identifier '" << name << "' not declared\n";
         return TypeSystem::UNKNOWN;
     }
 
@@ -592,6 +1346,26 @@ TypeSystem Semantics::inferExpressionType(Node *node)
         return resultOf(operatType, leftType, rightType);
     }
 
+    if (dynamic_cast<AllocExpression *>(node) || dynamic_cast<ArrayLiteral *>(node))
+    {
+        return TypeSystem::POINTER;
+    }
+
+    if (dynamic_cast<IndexExpression *>(node))
+    {
+        return inferType(node)->scalar;
+    }
+
+    if (auto prefix = dynamic_cast<PrefixExpression *>(node); prefix && prefix->operat.type == TokenType::LENGTH)
+    {
+        return TypeSystem::INTEGER;
+    }
+
+    if (auto prefix = dynamic_cast<PrefixExpression *>(node); prefix && prefix->operat.type == TokenType::ASTERISK)
+    {
+        return inferType(prefix)->scalar;
+    }
+
     if (auto prefix = dynamic_cast<PrefixExpression *>(node))
     {
         return resultOfUnary(prefix->operat.type, inferExpressionType(prefix->operand.get()));
@@ -600,6 +1374,53 @@ TypeSystem Semantics::inferExpressionType(Node *node)
     return TypeSystem::UNKNOWN;
 }
 
+// Full type of an expression, the analyzed pointer nodes carry it in their annotation
+const Type *Semantics::inferType(Node *node)
+{
+    if (auto info = getAnnotation(node); info && info->type)
+        return info->type;
+
+    if (auto ident = dynamic_cast<Identifier *>(node))
+    {
+        auto symbol = resolveSymbol(ident->identifier.TokenLiteral);
+        if (symbol && symbol->nodeType == TypeSystem::POINTER && symbol->type)
+            return symbol->type;
+    }
+    else if (auto call = dynamic_cast<CallExpression *>(node); call && call->function_identifier)
+    {
+        auto symbol = resolveSymbol(call->function_identifier->token.TokenLiteral);
+        if (symbol && symbol->kind == SymbolKind::FUNCTION && symbol->type)
+            return symbol->type->element;
+    }
+    else if (auto prefix = dynamic_cast<PrefixExpression *>(node); prefix && prefix->operat.type == TokenType::ASTERISK)
+    {
+        const Type *pointer = inferType(prefix->operand.get());
+        return pointer->kind == TypeKind::POINTER ? pointer->element : types.scalar(TypeSystem::UNKNOWN);
+    }
+    else if (auto index = dynamic_cast<IndexExpression *>(node))
+    {
+        const Type *array = inferType(index->array.get());
+        return array->kind == TypeKind::ARRAY ? array->element : types.scalar(TypeSystem::UNKNOWN);
+    }
+    else if (auto literal = dynamic_cast<ArrayLiteral *>(node); literal && !literal->elements.empty())
+    {
+        return types.arrayOf(inferType(literal->elements.front().get()), literal->elements.size());
+    }
+    else if (auto alloc = dynamic_cast<AllocExpression *>(node))
+    {
+        if (alloc->count)
+            return types.arrayOf(alloc->data_type_token ? resolveType(alloc->data_type_token->TokenLiteral) : types.scalar(TypeSystem::UNKNOWN));
+        if (alloc->value)
+            return types.pointerTo(inferType(alloc->value.get()));
+        return types.pointerTo(alloc->data_type_token ? resolveType(alloc->data_type_token->TokenLiteral) : types.scalar(TypeSystem::UNKNOWN));
+    }
+    else if (auto infix = dynamic_cast<InfixExpression *>(node); infix && infix->operat.type == TokenType::ASSIGN)
+    {
+        return inferType(infix->left_operand.get());
+    }
+    return types.scalar(inferExpressionType(node));
+}
+
 // Function converts the type system to a respective string
 std::string Semantics::TypeSystemString(TypeSystem type)
 {
@@ -615,109 +1436,95 @@ std::string Semantics::TypeSystemString(TypeSystem type)
         return "Type: CHAR ";
     case TypeSystem::BOOLEAN:
         return "Type: BOOLEAN ";
+    case TypeSystem::POINTER:
+        return "Type: POINTER ";
+    case TypeSystem::VOID:
+        return "Type: VOID ";
     default:
         return "Type: UNKOWN ";
     }
 }
 
-std::optional<Symbol> Semantics::resolveSymbol(const std::string &name)
+const Symbol *Semantics::resolveSymbol(const std::string &name)
 {
     for (int i = symbolTable.size() - 1; i >= 0; --i)
     {
         auto &scope = symbolTable[i];
-        std::cout << "[DEBUG] Searching for '" << name << "' in scope level " << i << "\n";
+        logs << "[DEBUG] Searching for '" << name << "' in scope level " << i << "\n";
         for (auto &[key, val] : scope)
         {
-            std::cout << "    >> Key in scope: '" << key << "'\n";
+            logs << "    >> Key in scope: '" << key << "'\n";
         }
         if (scope.find(name) != scope.end())
         {
-            std::cout << "[DEBUG] Found match for '" << name << "'\n";
-            return scope[name];
+            logs << "[DEBUG] Found match for '" << name << "'\n";
+            return &scope[name];
         }
     }
-    std::cout << "[DEBUG] No match for '" << name << "'\n";
-    return std::nullopt;
-}
-
-TypeSystem Semantics::resultOf(TokenType operatorType, TypeSystem leftType, TypeSystem rightType)
-{
-    if (operatorType == TokenType::AND || operatorType == TokenType::OR)
+    if (globalScope)
     {
-        if (leftType == TypeSystem::BOOLEAN && rightType == TypeSystem::BOOLEAN)
-        {
-            return TypeSystem::BOOLEAN;
-        }
-        else
+        auto globalIt = globalScope->find(name);
+        if (globalIt != globalScope->end())
         {
-            return TypeSystem::UNKNOWN;
-        }
-    }
-    bool isComparison = (operatorType == TokenType::GREATER_THAN || operatorType == TokenType::LESS_THAN || operatorType == TokenType::GT_OR_EQ || operatorType == TokenType::LT_OR_EQ || operatorType == TokenType::EQUALS || operatorType == TokenType::NOT_EQUALS);
-    if (isComparison)
-    {
-        if ((leftType != rightType) && !((leftType == TypeSystem::INTEGER && rightType == TypeSystem::FLOAT) || (leftType == TypeSystem::FLOAT && rightType == TypeSystem::INTEGER)))
-        {
-            return TypeSystem::UNKNOWN;
-        }
-        return TypeSystem::BOOLEAN;
-    }
-    else
-    {
-        if (leftType == rightType)
-        {
-            return leftType;
-        }
-        if ((leftType == TypeSystem::INTEGER && rightType == TypeSystem::FLOAT) || (leftType == TypeSystem::FLOAT && rightType == TypeSystem::INTEGER))
-        {
-            return TypeSystem::FLOAT;
+            logs << "[DEBUG] Found match for '" << name << "' in the global scope\n";
+            return &globalIt->second;
         }
     }
+    logs << "[DEBUG] No match for '" << name << "'\n";
+    return nullptr;
+}
 
-    return TypeSystem::UNKNOWN;
+bool Semantics::isSignal(const Symbol *symbol) const
+{
+    return symbol && symbol->kind == SymbolKind::VARIABLE && symbol->type && symbol->type->kind == TypeKind::FUTURE;
 }
 
-TypeSystem Semantics::resultOfUnary(TokenType operatorType, TypeSystem operandType)
+// The task handle of a top level signal only lives in the top level code, the function bodies are checked
+// against the frozen global scope so that is where they would find it
+bool Semantics::isForeignSignal(const std::string &name, const Symbol *symbol) const
 {
-    if (operatorType == TokenType::BANG)
-    {
-        if (operandType != TypeSystem::BOOLEAN)
-        {
-            std::cerr << "[SEMANTIC ERROR]: Cannot apply '!' to type "
-                      << TypeSystemString(operandType) << "\n";
-            return TypeSystem::UNKNOWN;
-        }
-        return TypeSystem::BOOLEAN;
-    }
+    if (!globalScope || !isSignal(symbol))
+        return false;
+    auto globalIt = globalScope->find(name);
+    return globalIt != globalScope->end() && &globalIt->second == symbol;
+}
 
-    if (operatorType == TokenType::MINUS_MINUS || operatorType == TokenType::PLUS_PLUS)
-    {
-        if (operandType == TypeSystem::INTEGER || operandType == TypeSystem::FLOAT)
-        {
-            return operandType; // Avoid repeating return logic
-        }
+// Arguments are copied into the task and strings never change, so the globals are the only state tasks share
+bool Semantics::isSharedVariable(const std::string &name, const Symbol *symbol) const
+{
+    if (!symbol || symbol->kind != SymbolKind::VARIABLE || !symbol->isMutable || isSignal(symbol))
+        return false;
+    const Scope &globals = globalScope ? *globalScope : symbolTable.front();
+    auto globalIt = globals.find(name);
+    return globalIt != globals.end() && &globalIt->second == symbol;
+}
 
-        std::cerr << "[SEMANTIC ERROR]: Cannot apply '++' or '--' to type "
-                  << TypeSystemString(operandType) << "\n";
-        return TypeSystem::UNKNOWN;
-    }
+// Operator results come from the tables built once by the type context
+TypeSystem Semantics::resultOf(TokenType operatorType, TypeSystem leftType, TypeSystem rightType)
+{
+    return types.binaryResult(operatorType, leftType, rightType);
+}
 
-    std::cerr << "[SEMANTIC ERROR]: Unsupported unary operator "
-              << static_cast<int>(operatorType)
-              << " on type " << TypeSystemString(operandType) << "\n";
-    return TypeSystem::UNKNOWN;
+// Unary operators are checked silently since this is also used for inference, analyzePrefixExpression reports the errors
+TypeSystem Semantics::resultOfUnary(TokenType operatorType, TypeSystem operandType)
+{
+    return types.unaryResult(operatorType, operandType);
 }
 
-// Error logging function
-void Semantics::logError(const std::string &message, Node *node)
+// Error logging function, errors go to the calling thread's diagnostics buffer
+void Semantics::logError(const std::string &message, Node *node, const char *code)
 {
     if (!node)
     {
-        std::cerr << "[SEMANTIC ERROR]: " << message << " (at unknown location)\n";
+        diagnostics.error(code, SourceRange{}, message);
         return;
     }
 
-    std::cerr << "[SEMANTIC ERROR]: " << message
-              << " (line: " << node->token.line
-              << ", column: " << node->token.column << ")\n";
+    diagnostics.error(code, Diagnostics::rangeOf(node->token), message);
+}
+
+// Scope depth of the innermost scope, workers count the frozen global scope as depth 0
+int Semantics::currentScopeDepth()
+{
+    return (int)symbolTable.size() - (globalScope ? 0 : 1);
 }
@@ -1,57 +1,90 @@
 #pragma once
+#include <cstdint>
 #include <memory>
 #include <map>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <typeindex>
+#include <unordered_map>
+#include <vector>
 #include "ast.hpp"
-
-// Type system
-enum class TypeSystem
-{
-    INTEGER,
-    FLOAT,
-    BOOLEAN,
-    STRING,
-    CHAR,
-    UNKNOWN,
-};
+#include "diagnostics/diagnostics.hpp"
+#include "types.hpp"
 
 enum class SymbolKind{
     VARIABLE,
     FUNCTION,
 };
 
+// Value of a node that was evaluated at compile time
+struct ConstantValue
+{
+    TypeSystem type = TypeSystem::UNKNOWN;
+    int64_t intValue = 0;
+    double floatValue = 0.0;
+    bool boolValue = false;
+    char charValue = '\0';
+    std::string stringValue{};
+};
+
 // Meta data struct that will be attached to each node after semantic analysis
 struct SemanticInfo
 {
-    TypeSystem nodeType = TypeSystem::UNKNOWN; // Info on the node's type
-    bool isMutable = false;                    // Flag on the mutability of the node
-    bool isConstant = false;                   // Flag on the node being constant at compile time
-    int scopeDepth = -1;                       // Info on scope depth of the node
+    TypeSystem nodeType = TypeSystem::UNKNOWN;   // Info on the node's type
+    bool isMutable = false;                      // Flag on the mutability of the node
+    bool isConstant = false;                     // Flag on the node being constant at compile time
+    int scopeDepth = -1;                         // Info on scope depth of the node
+    std::optional<ConstantValue> constantValue = std::nullopt; // The folded value when isConstant is set
+    bool isShared = false;                      // Names a top level variable that tasks could touch at the same time
+    bool isRaceFree = false;                    // Set on signal statements whose task was proven not to race the code around it
+    bool isGc = false;                          // Set on declarations of and assignments to gc variables, their strings go to the collected heap
+    const Type *type = nullptr;                 // Full type of pointer values, nodeType only says pointer
 };
 
 // Symbol that will be created per node and pushed to the symbol table
 struct Symbol
 {
     std::string nodeName;
-    TypeSystem nodeType;
-    std::vector<TypeSystem> parameterTypes;
+    TypeSystem nodeType;                        // Type of the variable or return type of the function
+    const Type *type = nullptr;                 // Interned type, functions share their signature through it
     SymbolKind kind;
     bool isMutable;
     bool isConstant;
     int scopeDepth;
+    std::optional<ConstantValue> constantValue = std::nullopt; // Value of fixed bindings whose initializer was folded
+    bool isGc = false;                          // Declared with gc
 };
 
+using Scope = std::unordered_map<std::string, Symbol>;
+
 // The semantic analyser class
 class Semantics
 {
-    std::unordered_map<Node *, SemanticInfo> annotations;             // Annotations map this will store the meta data per AST node
-    std::vector<std::unordered_map<std::string, Symbol>> symbolTable; // This the symbol table which is a stack of hashmaps that will store info about the node during analysis
+    std::unordered_map<Node *, SemanticInfo> annotations; // Annotations map this will store the meta data per AST node
+    std::vector<Scope> symbolTable;                       // This the symbol table which is a stack of hashmaps that will store info about the node during analysis
+    const Scope *globalScope = nullptr;                   // Frozen global scope, only set on the workers that check function bodies
+    TypeSystem currentReturnType = TypeSystem::UNKNOWN;   // Return type of the function whose body is being analyzed
+    const Type *currentReturnFullType = nullptr;          // Same with the pointee, pointer returns are checked against it
+    bool declaringParameters = false;                     // Parameters are declared without a value
+    int unsafeDepth = 0;                                  // Unsafe blocks around the node being analyzed
+    std::unordered_map<Node *, std::vector<Node *>> drops; // Declarations of the unique pointers freed at a node
+
+    std::ostringstream logBuffer; // Workers write their logs here so they can be printed in source order
+    std::ostream &logs;
+    TypeContext &types;
+    Diagnostics &diagnostics;
 
 public:
-    Semantics();     // Semantics class analyzer
+    Semantics(TypeContext &types, Diagnostics &diagnostics);                       // Semantics class analyzer
+    Semantics(const Scope *globals, TypeContext &types, Diagnostics &diagnostics); // Worker analyzer that resolves globals from a frozen scope
     void analyzer(Node *node); // The walker that will traverse the AST
 
+    // Two phase analysis of the whole program, phase one registers the globals and the work signatures
+    // phase two checks the function bodies in parallel
+    void analyzeProgram(const std::vector<std::unique_ptr<Node>> &nodes, size_t threadCount = std::thread::hardware_concurrency());
+
     using analyzerFuncs = void (Semantics::*)(Node *);
     std::map<std::type_index, analyzerFuncs> analyzerFunctionsMap;
 
@@ -71,15 +104,62 @@ public:
     void analyzeStringLiteral(Node *node);
     void analyzeCharLiteral(Node *node);
     void analyzeBooleanLiteral(Node *node);
+    void analyzeReturnStatement(Node *node);
+    void analyzeBlockExpression(Node *node);
+    void analyzeExpressionStatement(Node *node);
+    void analyzePrefixExpression(Node *node);
+    void analyzeSignalStatement(Node *node);
+    void analyzeStartStatement(Node *node);
+    void analyzeWaitStatement(Node *node);
+    void analyzeZoneStatement(Node *node);
+    void analyzeUnsafeStatement(Node *node);
+    void analyzeAllocExpression(Node *node);
+    void analyzeFreeStatement(Node *node);
+    void analyzeIndexExpression(Node *node);
+    void analyzeArrayLiteral(Node *node);
+
+    // Reading the results of the analysis for the later stages
+    const SemanticInfo *getAnnotation(Node *node) const;
+    std::optional<ConstantValue> constantOf(Node *node) const;
+    void forgetAnnotation(Node *node); // Used by the passes that delete nodes from the AST
+
+    //---------DATA RACES----------
+    void checkTaskRaces(const std::vector<std::unique_ptr<Node>> &nodes);
+
+    //---------ZONES----------
+    void checkZoneEscapes(const std::vector<std::unique_ptr<Node>> &nodes);
+
+    //---------OWNERSHIP----------
+    void checkOwnership(const std::vector<std::unique_ptr<Node>> &nodes);
+    const std::vector<Node *> &dropsAt(Node *node) const; // Unique pointers whose cells are freed and signals that end at the node, innermost first
+
+    //---------POINTER ACCESS----------
+    void checkPointerAccess(const std::vector<std::unique_ptr<Node>> &nodes);
+
+    //---------CONSTANT FOLDING----------
+    std::optional<ConstantValue> foldInfix(InfixExpression *node, const ConstantValue &left, const ConstantValue &right);
+    std::optional<ConstantValue> foldPrefix(PrefixExpression *node, const ConstantValue &operand);
+    std::string constantToString(const ConstantValue &value);
+    TypeSystem mapTypeStringToTypeSystem(const std::string &typeStr);
+    const Type *resolveType(const std::string &typeStr); // Like the above but keeps what pointers point at and array lengths
 
 private:
     //---------HELPER FUNCTIONS----------
     void registerAnalyzerFunctions();
-    void logError(const std::string &message, Node *node);
+    void declareFunction(FunctionExpression *funcExpr);
+    void analyzeFunctionBody(FunctionExpression *funcExpr);
+    int currentScopeDepth();
+    void logError(const std::string &message, Node *node, const char *code = DiagnosticCode::SEMANTIC_ERROR);
     TypeSystem resultOf(TokenType operatorType,TypeSystem leftType,TypeSystem rightType);
     TypeSystem resultOfUnary(TokenType operatorType,TypeSystem operandType);
-    TypeSystem mapTypeStringToTypeSystem(const std::string &typeStr);
     TypeSystem inferExpressionType(Node *node);
+    const Type *inferType(Node *node); // Full type, only differs from the scalar one for pointers
+    void checkPointee(const Type *type, Node *node);
+    bool isAssignable(const Type *target, const Type *value); // Value fits a variable, parameter or return of the target type
     std::string TypeSystemString(TypeSystem type);
-    std::optional<Symbol> resolveSymbol(const std::string& name);
+    const Symbol *resolveSymbol(const std::string& name); // Points into the scope, only valid until the scope is popped
+    bool isSignal(const Symbol *symbol) const;
+    bool isForeignSignal(const std::string &name, const Symbol *symbol) const; // A signal of the top level code seen from a function body
+    bool isSharedVariable(const std::string &name, const Symbol *symbol) const; // A mutable top level variable every task can reach
+    std::optional<ConstantValue> foldIntegerLiteral(IntegerLiteral *node);
 };
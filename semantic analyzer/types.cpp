@@ -0,0 +1,243 @@
+#include <functional>
+#include "types.hpp"
+
+namespace
+{
+    size_t combineHash(size_t seed, size_t value)
+    {
+        return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+    }
+
+    size_t hashOf(const Type &type)
+    {
+        size_t hash = combineHash((size_t)type.kind, (size_t)type.scalar);
+        hash = combineHash(hash, std::hash<const void *>{}(type.element));
+        for (auto param : type.parameters)
+        {
+            hash = combineHash(hash, std::hash<const void *>{}(param));
+        }
+        return combineHash(hash, type.length);
+    }
+
+    bool isNumeric(TypeSystem type)
+    {
+        return type == TypeSystem::INTEGER || type == TypeSystem::FLOAT;
+    }
+}
+
+// The components of a composite are already interned so comparing them by address is enough
+bool TypeContext::TypeEqual::operator()(const Type *a, const Type *b) const
+{
+    return a->kind == b->kind && a->scalar == b->scalar && a->element == b->element && a->parameters == b->parameters && a->length == b->length;
+}
+
+TypeContext::TypeContext()
+{
+    for (size_t i = 0; i < SCALAR_TYPE_COUNT; ++i)
+    {
+        scalars[i].kind = TypeKind::SCALAR;
+        scalars[i].scalar = (TypeSystem)i;
+        scalars[i].hash = hashOf(scalars[i]);
+        interned.insert(&scalars[i]);
+    }
+    buildOperatorTables();
+}
+
+const Type *TypeContext::scalar(TypeSystem type) const
+{
+    return &scalars[(size_t)type];
+}
+
+const Type *TypeContext::function(const Type *returnType, const std::vector<const Type *> &parameters)
+{
+    Type probe;
+    probe.kind = TypeKind::FUNCTION;
+    probe.scalar = returnType ? returnType->scalar : TypeSystem::UNKNOWN;
+    probe.element = returnType;
+    probe.parameters = parameters;
+    return intern(std::move(probe));
+}
+
+// An array is a pointer to its heap block, so it reduces to the pointer scalar like a pointer does
+const Type *TypeContext::arrayOf(const Type *element, size_t length)
+{
+    Type probe;
+    probe.kind = TypeKind::ARRAY;
+    probe.scalar = TypeSystem::POINTER;
+    probe.element = element;
+    probe.length = length;
+    return intern(std::move(probe));
+}
+
+// The length of a fixed size array only matters to the checks, the block carries it at run time
+const Type *TypeContext::withoutLengths(const Type *type)
+{
+    if (!type)
+        return type;
+    switch (type->kind)
+    {
+    case TypeKind::ARRAY:
+        return arrayOf(withoutLengths(type->element));
+    case TypeKind::POINTER:
+        return pointerTo(withoutLengths(type->element));
+    case TypeKind::FUTURE:
+        return futureOf(withoutLengths(type->element));
+    default:
+        return type;
+    }
+}
+
+const Type *TypeContext::pointerTo(const Type *pointee)
+{
+    Type probe;
+    probe.kind = TypeKind::POINTER;
+    probe.scalar = TypeSystem::POINTER;
+    probe.element = pointee;
+    return intern(std::move(probe));
+}
+
+// The handle is one machine word, so the backends keep it like an int
+const Type *TypeContext::futureOf(const Type *result)
+{
+    Type probe;
+    probe.kind = TypeKind::FUTURE;
+    probe.scalar = TypeSystem::INTEGER;
+    probe.element = result;
+    return intern(std::move(probe));
+}
+
+size_t TypeContext::internedCount() const
+{
+    std::lock_guard<std::mutex> lock(internMutex);
+    return interned.size();
+}
+
+// Returning the existing instance of a type or adding it if this is the first time it is seen
+const Type *TypeContext::intern(Type probe)
+{
+    probe.hash = hashOf(probe);
+    std::lock_guard<std::mutex> lock(internMutex);
+    auto it = interned.find(&probe);
+    if (it != interned.end())
+    {
+        return *it;
+    }
+    composites.push_back(std::move(probe));
+    const Type *type = &composites.back();
+    interned.insert(type);
+    return type;
+}
+
+std::string TypeContext::scalarName(TypeSystem type)
+{
+    switch (type)
+    {
+    case TypeSystem::INTEGER:
+        return "int";
+    case TypeSystem::FLOAT:
+        return "float";
+    case TypeSystem::BOOLEAN:
+        return "bool";
+    case TypeSystem::STRING:
+        return "string";
+    case TypeSystem::CHAR:
+        return "char";
+    case TypeSystem::POINTER:
+        return "pointer";
+    case TypeSystem::VOID:
+        return "void";
+    default:
+        return "unknown";
+    }
+}
+
+std::string TypeContext::toString(const Type *type)
+{
+    if (!type)
+        return "unknown";
+    switch (type->kind)
+    {
+    case TypeKind::SCALAR:
+        return scalarName(type->scalar);
+    case TypeKind::ARRAY:
+        return "arr<" + toString(type->element) + (type->length ? ", " + std::to_string(type->length) : "") + ">";
+    case TypeKind::POINTER:
+        return "pointer<" + toString(type->element) + ">";
+    case TypeKind::FUTURE:
+        return "future<" + toString(type->element) + ">";
+    case TypeKind::FUNCTION:
+    {
+        std::string text = "work(";
+        for (size_t i = 0; i < type->parameters.size(); ++i)
+        {
+            if (i > 0)
+                text += ", ";
+            text += toString(type->parameters[i]);
+        }
+        return text + "): " + toString(type->element);
+    }
+    }
+    return "unknown";
+}
+
+// Filling the operator tables once so checking an expression is a single lookup
+void TypeContext::buildOperatorTables()
+{
+    for (auto &byOperator : binaryTable)
+        for (auto &byLeft : byOperator)
+            byLeft.fill(TypeSystem::UNKNOWN);
+    for (auto &byOperator : unaryTable)
+        byOperator.fill(TypeSystem::UNKNOWN);
+
+    const TokenType arithmetic[] = {TokenType::PLUS, TokenType::MINUS, TokenType::ASTERISK, TokenType::DIVIDE, TokenType::MODULUS};
+    const TokenType ordering[] = {TokenType::LESS_THAN, TokenType::GREATER_THAN, TokenType::LT_OR_EQ, TokenType::GT_OR_EQ};
+    const TokenType equality[] = {TokenType::EQUALS, TokenType::NOT_EQUALS};
+
+    for (size_t l = 0; l < SCALAR_TYPE_COUNT; ++l)
+    {
+        for (size_t r = 0; r < SCALAR_TYPE_COUNT; ++r)
+        {
+            TypeSystem left = (TypeSystem)l;
+            TypeSystem right = (TypeSystem)r;
+            bool numeric = isNumeric(left) && isNumeric(right);
+
+            // Mixing int and float promotes to float
+            if (numeric)
+            {
+                TypeSystem promoted = (left == TypeSystem::FLOAT || right == TypeSystem::FLOAT) ? TypeSystem::FLOAT : TypeSystem::INTEGER;
+                for (auto op : arithmetic)
+                    binaryTable[(size_t)op][l][r] = promoted;
+            }
+
+            bool sameComparable = left == right && left != TypeSystem::VOID && left != TypeSystem::UNKNOWN;
+            if (numeric || sameComparable)
+            {
+                for (auto op : equality)
+                    binaryTable[(size_t)op][l][r] = TypeSystem::BOOLEAN;
+            }
+            if (numeric || (sameComparable && (left == TypeSystem::STRING || left == TypeSystem::CHAR)))
+            {
+                for (auto op : ordering)
+                    binaryTable[(size_t)op][l][r] = TypeSystem::BOOLEAN;
+            }
+        }
+    }
+
+    // Assignments inside expressions (the for loop step) take the type of their target
+    for (size_t t = 0; t < (size_t)TypeSystem::VOID; ++t)
+        binaryTable[(size_t)TokenType::ASSIGN][t][t] = (TypeSystem)t;
+    binaryTable[(size_t)TokenType::ASSIGN][(size_t)TypeSystem::FLOAT][(size_t)TypeSystem::INTEGER] = TypeSystem::FLOAT;
+
+    // String concatenation
+    binaryTable[(size_t)TokenType::PLUS][(size_t)TypeSystem::STRING][(size_t)TypeSystem::STRING] = TypeSystem::STRING;
+
+    for (auto op : {TokenType::AND, TokenType::OR})
+        binaryTable[(size_t)op][(size_t)TypeSystem::BOOLEAN][(size_t)TypeSystem::BOOLEAN] = TypeSystem::BOOLEAN;
+
+    unaryTable[(size_t)TokenType::BANG][(size_t)TypeSystem::BOOLEAN] = TypeSystem::BOOLEAN;
+    for (auto op : {TokenType::MINUS, TokenType::PLUS_PLUS, TokenType::MINUS_MINUS})
+    {
+        unaryTable[(size_t)op][(size_t)TypeSystem::INTEGER] = TypeSystem::INTEGER;
+        unaryTable[(size_t)op][(size_t)TypeSystem::FLOAT] = TypeSystem::FLOAT;
+    }
+}
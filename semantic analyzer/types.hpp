@@ -0,0 +1,99 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "token/token.hpp"
+
+// Type system
+enum class TypeSystem : uint8_t
+{
+    INTEGER,
+    FLOAT,
+    BOOLEAN,
+    STRING,
+    CHAR,
+    POINTER, // Any pointer or array, the Type says what it points at
+    VOID,
+    UNKNOWN,
+};
+
+inline constexpr size_t SCALAR_TYPE_COUNT = (size_t)TypeSystem::UNKNOWN + 1;
+inline constexpr size_t TOKEN_TYPE_COUNT = (size_t)TokenType::END + 1;
+
+enum class TypeKind : uint8_t
+{
+    SCALAR,
+    FUNCTION,
+    ARRAY,
+    POINTER,
+    FUTURE, // Handle of a started task, element is what the task returns
+};
+
+// A type owned by the TypeContext, structurally equal types share one instance so comparing two
+// types is comparing their addresses
+struct Type
+{
+    TypeKind kind = TypeKind::SCALAR;
+    TypeSystem scalar = TypeSystem::UNKNOWN; // The scalar itself, or the scalar the type reduces to (return type for functions, int for the task handle of futures, pointer for pointers and arrays)
+    const Type *element = nullptr;           // Element type of arrays, pointee of pointers, return type of functions and futures
+    std::vector<const Type *> parameters;    // Parameter types of functions
+    size_t length = 0;                       // Element count of fixed size arrays, 0 for arrays sized at run time
+    size_t hash = 0;
+};
+
+// Interns every type the compiler sees and owns the operator result tables
+class TypeContext
+{
+    struct TypeHash
+    {
+        size_t operator()(const Type *type) const { return type->hash; }
+    };
+    struct TypeEqual
+    {
+        bool operator()(const Type *a, const Type *b) const;
+    };
+
+    std::array<Type, SCALAR_TYPE_COUNT> scalars;
+    std::deque<Type> composites; // Deque so the handles stay valid while new types are added
+    std::unordered_set<const Type *, TypeHash, TypeEqual> interned;
+    mutable std::mutex internMutex; // Only taken when a composite type is interned
+
+    // Result of every operator for every pair of scalar operands, UNKNOWN means the operator is not allowed
+    std::array<std::array<std::array<TypeSystem, SCALAR_TYPE_COUNT>, SCALAR_TYPE_COUNT>, TOKEN_TYPE_COUNT> binaryTable;
+    std::array<std::array<TypeSystem, SCALAR_TYPE_COUNT>, TOKEN_TYPE_COUNT> unaryTable;
+
+public:
+    TypeContext();
+
+    TypeContext(const TypeContext &) = delete;
+    TypeContext &operator=(const TypeContext &) = delete;
+
+    const Type *scalar(TypeSystem type) const;
+    const Type *function(const Type *returnType, const std::vector<const Type *> &parameters);
+    const Type *arrayOf(const Type *element, size_t length = 0);
+    const Type *withoutLengths(const Type *type); // Every fixed size array inside made dynamic
+    const Type *pointerTo(const Type *pointee);
+    const Type *futureOf(const Type *result);
+
+    TypeSystem binaryResult(TokenType op, TypeSystem left, TypeSystem right) const
+    {
+        return binaryTable[(size_t)op][(size_t)left][(size_t)right];
+    }
+    TypeSystem unaryResult(TokenType op, TypeSystem operand) const
+    {
+        return unaryTable[(size_t)op][(size_t)operand];
+    }
+
+    size_t internedCount() const;
+    static std::string toString(const Type *type);
+    static std::string scalarName(TypeSystem type);
+
+private:
+    const Type *intern(Type probe);
+    void buildOperatorTables();
+};
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <functional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "semantics.hpp"
+#include "ast.hpp"
+
+// Strings concatenated inside a zone block are bump allocated from a region that is freed when the block ends,
+// so none of them may be reachable afterwards. Every string value gets the depth of the zone it may live in,
+// 0 for the normal heap, and a value may only go to a variable declared at the same depth or deeper
+
+namespace
+{
+    // Works that keep a string somewhere that outlives the call, in a top level variable or a task
+    std::set<std::string> findKeepingWorks(const std::vector<std::unique_ptr<Node>> &nodes, const Semantics &semantics)
+    {
+        std::unordered_map<std::string, std::set<std::string>> callers; // Work to the works that call it
+        std::set<std::string> keeping;
+        std::function<void(Node *, const std::string &)> walk = [&](Node *node, const std::string &work)
+        {
+            if (!node)
+                return;
+            std::string current = work;
+            if (auto funcExpr = dynamic_cast<FunctionExpression *>(node))
+                current = funcExpr->func_name.TokenLiteral;
+            if (!current.empty())
+            {
+                auto info = semantics.getAnnotation(node);
+                if (dynamic_cast<SignalStatement *>(node))
+                    keeping.insert(current);
+                else if (dynamic_cast<AssignmentStatement *>(node) && info && info->isShared && info->nodeType == TypeSystem::STRING)
+                    keeping.insert(current);
+                else if (auto call = dynamic_cast<CallExpression *>(node); call && call->function_identifier)
+                    callers[call->function_identifier->token.TokenLiteral].insert(current);
+            }
+            forEachChild(node, [&walk, &current](Node *child)
+                         { walk(child, current); });
+        };
+        for (const auto &node : nodes)
+            walk(node.get(), "");
+
+        std::vector<std::string> pending(keeping.begin(), keeping.end());
+        while (!pending.empty())
+        {
+            auto work = pending.back();
+            pending.pop_back();
+            for (auto &caller : callers[work])
+            {
+                if (keeping.insert(caller).second)
+                    pending.push_back(caller);
+            }
+        }
+        return keeping;
+    }
+
+    struct ZoneWalker
+    {
+        const Semantics &semantics;
+        const std::set<std::string> &keepingWorks;
+        std::vector<std::pair<std::string, Node *>> escapes{};
+        std::vector<std::unordered_map<std::string, int>> scopes{1};
+        int zoneDepth = 0;
+
+        bool isString(Node *node) const
+        {
+            auto info = semantics.getAnnotation(node);
+            return info && info->nodeType == TypeSystem::STRING && !info->isConstant;
+        }
+
+        // Names that are not found are top level variables declared outside of any zone
+        int depthOf(const std::string &name) const
+        {
+            for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope)
+            {
+                auto it = scope->find(name);
+                if (it != scope->end())
+                    return it->second;
+            }
+            return 0;
+        }
+
+        // Deepest zone the string may have been allocated in, the concatenations in the value of a gc variable
+        // go to the collected heap instead
+        int zoneOf(Node *node, bool collected = false) const
+        {
+            if (!node || !isString(node))
+                return 0;
+            if (auto ident = dynamic_cast<Identifier *>(node))
+                return depthOf(ident->identifier.TokenLiteral);
+            if (auto infix = dynamic_cast<InfixExpression *>(node))
+            {
+                if (infix->operat.type == TokenType::ASSIGN)
+                    return zoneOf(infix->right_operand.get(), collected);
+                return collected ? 0 : zoneDepth; // A concatenation allocates from the innermost zone
+            }
+            if (auto call = dynamic_cast<CallExpression *>(node))
+            {
+                // The work may hand back one of its arguments
+                int depth = 0;
+                for (auto &param : call->parameters)
+                    depth = std::max(depth, zoneOf(param.get(), collected));
+                return depth;
+            }
+            return 0;
+        }
+
+        void declare(const std::string &name)
+        {
+            scopes.back()[name] = zoneDepth;
+        }
+
+        void walk(Node *node)
+        {
+            if (!node)
+                return;
+
+            if (auto funcStmt = dynamic_cast<FunctionStatement *>(node))
+            {
+                auto funcExpr = dynamic_cast<FunctionExpression *>(funcStmt->funcExpr.get());
+                if (!funcExpr)
+                    return;
+                int savedDepth = zoneDepth;
+                zoneDepth = 0;
+                scopes.push_back({});
+                for (auto &param : funcExpr->call)
+                {
+                    if (auto letParam = dynamic_cast<LetStatement *>(param.get()))
+                        declare(letParam->ident_token.TokenLiteral);
+                    else if (auto assignParam = dynamic_cast<AssignmentStatement *>(param.get()))
+                        declare(assignParam->ident_token.TokenLiteral);
+                }
+                walk(funcExpr->block.get());
+                scopes.pop_back();
+                zoneDepth = savedDepth;
+                return;
+            }
+            if (auto zoneStmt = dynamic_cast<ZoneStatement *>(node))
+            {
+                ++zoneDepth;
+                walk(zoneStmt->body.get());
+                --zoneDepth;
+                return;
+            }
+            if (dynamic_cast<BlockStatement *>(node) || dynamic_cast<BlockExpression *>(node) || dynamic_cast<ForStatement *>(node))
+            {
+                scopes.push_back({});
+                forEachChild(node, [this](Node *child)
+                             { walk(child); });
+                scopes.pop_back();
+                return;
+            }
+
+            forEachChild(node, [this](Node *child)
+                         { walk(child); });
+
+            if (auto letStmt = dynamic_cast<LetStatement *>(node))
+            {
+                declare(letStmt->ident_token.TokenLiteral);
+            }
+            else if (auto assign = dynamic_cast<AssignmentStatement *>(node))
+            {
+                auto name = assign->ident_token.TokenLiteral;
+                auto info = semantics.getAnnotation(assign);
+                if (zoneOf(assign->value.get(), info && info->isGc) > depthOf(name))
+                    escapes.push_back({"A string built in the zone is assigned to '" + name + "' which outlives the zone", assign});
+            }
+            else if (auto infix = dynamic_cast<InfixExpression *>(node); infix && infix->operat.type == TokenType::ASSIGN)
+            {
+                auto target = dynamic_cast<Identifier *>(infix->left_operand.get());
+                if (target && zoneOf(infix->right_operand.get()) > depthOf(target->identifier.TokenLiteral))
+                    escapes.push_back({"A string built in the zone is assigned to '" + target->identifier.TokenLiteral + "' which outlives the zone", infix});
+            }
+            else if (auto retStmt = dynamic_cast<ReturnStatement *>(node))
+            {
+                if (zoneOf(retStmt->return_value.get()) > 0)
+                    escapes.push_back({"A string built in the zone can not be returned, the zone is freed when the work returns", retStmt});
+            }
+            else if (auto signalStmt = dynamic_cast<SignalStatement *>(node))
+            {
+                auto call = dynamic_cast<CallExpression *>(signalStmt->func_arg.get());
+                for (size_t i = 0; call && i < call->parameters.size(); ++i)
+                {
+                    if (zoneOf(call->parameters[i].get()) > 0)
+                    {
+                        escapes.push_back({"A task can not take a string built in the zone, it may still run after the zone is freed", signalStmt});
+                        break;
+                    }
+                }
+                if (auto ident = dynamic_cast<Identifier *>(signalStmt->identifier.get()))
+                    declare(ident->identifier.TokenLiteral);
+            }
+            else if (auto call = dynamic_cast<CallExpression *>(node); call && call->function_identifier)
+            {
+                auto work = call->function_identifier->token.TokenLiteral;
+                bool keeps = keepingWorks.count(work);
+                for (size_t i = 0; keeps && i < call->parameters.size(); ++i)
+                {
+                    if (zoneOf(call->parameters[i].get()) > 0)
+                    {
+                        escapes.push_back({"'" + work + "' keeps strings past its return, it can not take a string built in the zone", call});
+                        break;
+                    }
+                }
+            }
+        }
+    };
+}
+
+void Semantics::checkZoneEscapes(const std::vector<std::unique_ptr<Node>> &nodes)
+{
+    auto keepingWorks = findKeepingWorks(nodes, *this);
+    ZoneWalker walker{*this, keepingWorks};
+    for (const auto &node : nodes)
+        walker.walk(node.get());
+
+    for (auto &[message, node] : walker.escapes)
+        logError(message, node, DiagnosticCode::ZONE_ESCAPE);
+    logs << "[SEMANTIC LOG]: Zone check found " << walker.escapes.size() << " escaping strings\n";
+}
@@ -0,0 +1,82 @@
+#!/bin/sh
+# Runs every test program on each backend and checks they all behave the same, usage: tests/run.sh [path/to/iron]
+# A program's header says what it has to do, "# exit: <status>" and for programs that stop early "# panic: <message>".
+# It runs on the VM, as an x86-64 object, as C and through LLVM -O2 when iron was built with it.
+# The C files test the runtime on their own, they are linked with it and have to exit with 0
+IRON=${1:-./iron}
+DIR=$(dirname "$0")
+RUNTIME="$DIR/../runtime"
+CC=${CC:-cc}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+failures=0
+
+link() { "$CC" -O2 -std=c11 "$@" "$RUNTIME"/runtime.c "$RUNTIME"/tasks.c "$RUNTIME"/gc.c "$RUNTIME"/alloc.c -I"$RUNTIME" -pthread -lm; }
+
+# Compares the status and the error output of one backend with the header
+check() {
+    if [ "$3" != "$expected" ]; then
+        echo "FAIL $1 on $2: exited with $3 instead of $expected"
+        failures=$((failures + 1))
+    elif [ -n "$panic" ] && ! grep -q "$panic" "$4"; then
+        echo "FAIL $1 on $2: no '$panic' in $(cat "$4")"
+        failures=$((failures + 1))
+    fi
+}
+
+# Runs the native program an object or C file was built into
+native() {
+    if "$@" >"$WORK/build.log" 2>&1; then
+        "$WORK/program" >/dev/null 2>"$WORK/err"
+        check "$name" "$backend" $? "$WORK/err"
+    else
+        echo "FAIL $name on $backend: did not build"
+        cat "$WORK/build.log"
+        failures=$((failures + 1))
+    fi
+}
+
+for program in "$DIR"/*.unn; do
+    name=$(basename "$program")
+    expected=$(sed -n 's/^# exit: *//p' "$program")
+    panic=$(sed -n 's/^# panic: *//p' "$program")
+
+    # The VM prints what main returned and exits with 1 on a panic
+    "$IRON" --run "$program" >"$WORK/out" 2>"$WORK/err"
+    status=$?
+    if [ $status -eq 0 ]; then
+        status=$(sed -n 's/^main returned //p' "$WORK/out")
+        status=$(((status % 256 + 256) % 256))
+    fi
+    check "$name" vm "$status" "$WORK/err"
+
+    backend=obj
+    "$IRON" --emit=obj -o "$WORK/program.o" "$program" >/dev/null 2>&1
+    native link "$WORK/program.o" -o "$WORK/program"
+
+    backend=c
+    "$IRON" --emit=c -o "$WORK/program.c" "$program" >/dev/null 2>&1
+    native link "$WORK/program.c" -o "$WORK/program"
+
+    backend=llvm
+    if "$IRON" -O2 -o "$WORK/program.o" "$program" 2>&1 | grep -q "built without LLVM"; then
+        echo "skipped $name on llvm, iron was built without it"
+    else
+        native link "$WORK/program.o" -o "$WORK/program"
+    fi
+    echo "ran $name"
+done
+
+for test in "$DIR"/*.c; do
+    [ -e "$test" ] || continue
+    name=$(basename "$test")
+    if link "$test" -o "$WORK/test" && "$WORK/test"; then
+        echo "ran $name"
+    else
+        echo "FAIL $name"
+        failures=$((failures + 1))
+    fi
+done
+
+[ $failures -eq 0 ] && echo "All tests passed"
+[ $failures -eq 0 ]
@@ -0,0 +1,66 @@
+/* Starting and waiting for a million tasks, some with arguments spilled out of the record and some detached
+ * before they finished, has to reuse the records instead of growing with every task */
+#include "runtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+static uint64_t sum(const uint64_t *args)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        total += args[i];
+    }
+    return total;
+}
+
+static uint64_t identity(const uint64_t *args)
+{
+    return args[0];
+}
+
+static long peakKilobytes(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void startTasks(uint64_t count)
+{
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        uint64_t args[8] = {i, 1, 2, 3, 4, 5, 6, 7};
+        IronTask *spilled = iron_task_spawn(sum, args, 8);
+        IronTask *inlined = iron_task_spawn(identity, args, 1);
+        IronTask *dropped = iron_task_spawn(identity, args, 1); /* Nobody waits on it */
+        if (iron_task_wait(spilled) != i + 28 || iron_task_wait(inlined) != i)
+        {
+            fprintf(stderr, "wrong result for task %llu\n", (unsigned long long)i);
+            exit(1);
+        }
+        iron_task_detach(spilled);
+        iron_task_detach(inlined);
+        iron_task_detach(dropped);
+    }
+}
+
+int main(void)
+{
+    startTasks(10000);
+    long before = peakKilobytes();
+    startTasks(1000000);
+    long growth = peakKilobytes() - before;
+    if (growth > 16 * 1024)
+    {
+        fprintf(stderr, "peak memory grew by %ld KB over a million tasks\n", growth);
+        return 1;
+    }
+    if (iron_tasks_unjoined != 0)
+    {
+        fprintf(stderr, "%lld tasks still count as unjoined\n", (long long)iron_tasks_unjoined);
+        return 1;
+    }
+    return 0;
+}
@@ -34,6 +34,8 @@ string TokenTypeToLiteral(TokenType type){
             return "Token Type: MINUS MINUS";
         case TokenType::DIVIDE:
             return"Token Type: DIVIDE";
+        case TokenType::MODULUS:
+            return "Token Type: MODULUS";
         case TokenType::OR:
             return"Token Type: OR";
         case TokenType::SHIFT_RIGHT:
@@ -132,6 +134,8 @@ string TokenTypeToLiteral(TokenType type){
             return "Token Type: FALSE";
         case TokenType::ARRAY:
             return "Token Type: ARRAY";
+        case TokenType::LENGTH:
+            return "Token Type: LENGTH";
         case TokenType::ZONE:
             return "Token Type: ZONE";
         case TokenType::UNIQUE:
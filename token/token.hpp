@@ -88,6 +88,7 @@ enum class TokenType{
     FALSE,
     DOUBLE,
     ARRAY,
+    LENGTH,
 
     //Memory management keywords
     ZONE,
@@ -0,0 +1,74 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for objects that all die together, like the IR of a module.
+// Objects are never freed one by one, the ones with a destructor are destroyed when the arena goes away
+class Arena
+{
+    struct Destructor
+    {
+        void (*destroy)(void *);
+        void *object;
+    };
+
+    std::vector<std::unique_ptr<std::byte[]>> chunks;
+    std::vector<Destructor> destructors;
+    std::byte *cursor = nullptr;
+    size_t remaining = 0;
+    size_t chunkSize;
+    size_t bytesUsed = 0;
+
+public:
+    explicit Arena(size_t chunkSize = 64 * 1024) : chunkSize(chunkSize) {};
+    ~Arena()
+    {
+        // Destroying in reverse order like the stack would
+        for (auto it = destructors.rbegin(); it != destructors.rend(); ++it)
+        {
+            it->destroy(it->object);
+        }
+    }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(size_t size, size_t alignment)
+    {
+        size_t padding = (alignment - ((uintptr_t)cursor & (alignment - 1))) & (alignment - 1);
+        if (!cursor || padding + size > remaining)
+        {
+            size_t newSize = std::max(chunkSize, size + alignment);
+            chunks.push_back(std::make_unique<std::byte[]>(newSize));
+            cursor = chunks.back().get();
+            remaining = newSize;
+            padding = (alignment - ((uintptr_t)cursor & (alignment - 1))) & (alignment - 1);
+        }
+        std::byte *result = cursor + padding;
+        cursor = result + size;
+        remaining -= padding + size;
+        bytesUsed += size;
+        return result;
+    }
+
+    template <typename T, typename... Args>
+    T *make(Args &&...args)
+    {
+        T *object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>)
+        {
+            destructors.push_back(Destructor{[](void *p)
+                                             { static_cast<T *>(p)->~T(); },
+                                             object});
+        }
+        return object;
+    }
+
+    size_t used() const { return bytesUsed; }
+};
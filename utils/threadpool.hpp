@@ -0,0 +1,33 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Small fixed size thread pool used by the compiler phases that can work on independent pieces of the program
+class ThreadPool
+{
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex queueMutex;
+    std::condition_variable taskAvailable;
+    std::condition_variable tasksFinished;
+    size_t pendingTasks = 0; // Tasks queued or still running
+    bool stopping = false;
+
+public:
+    explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> task); // Queue a task for the workers
+    void wait();                             // Block until every submitted task has finished
+    size_t size() const { return workers.size(); }
+
+private:
+    void workerLoop();
+};
@@ -0,0 +1,119 @@
+#include "bytecode.hpp"
+
+BytecodeProgram::~BytecodeProgram()
+{
+    for (auto str : ownedStrings)
+    {
+        delete str;
+    }
+}
+
+int BytecodeProgram::findFunction(const std::string &name) const
+{
+    for (size_t i = 0; i < functions.size(); ++i)
+    {
+        if (functions[i].name == name)
+            return i;
+    }
+    return -1;
+}
+
+std::string opName(Op op)
+{
+    static const char *names[] = {
+        "move", "move.s", "take.s", "loadk", "loadk.s", "loadi",
+        "add.i", "sub.i", "mul.i", "div.i", "mod.i", "neg.i", "addi.i", "subi.i",
+        "add.f", "sub.f", "mul.f", "div.f", "mod.f", "neg.f", "itof",
+        "eq.i", "ne.i", "lt.i", "le.i", "gt.i", "ge.i",
+        "eq.f", "ne.f", "lt.f", "le.f", "gt.f", "ge.f",
+        "eq.s", "ne.s", "lt.s", "le.s", "gt.s", "ge.s",
+        "not", "concat", "concat.steal",
+        "jmp", "jmp.if", "jmp.ifnot", "jlt.i", "jle.i", "jgt.i", "jge.i", "jeq.i", "jne.i",
+        "call", "call.s", "ret", "ret.s", "ret.void",
+        "load.global", "load.global.s", "store.global", "store.global.s",
+        "alloc", "free", "load.ptr", "store.ptr", "array.new", "length", "element", "check.bounds"};
+    static_assert(sizeof(names) / sizeof(names[0]) == (size_t)Op::OP_COUNT, "every opcode needs a name");
+    return (size_t)op < (size_t)Op::OP_COUNT ? names[(size_t)op] : "unknown";
+}
+
+void BytecodeProgram::print(std::ostream &out) const
+{
+    out << "constants: " << constants.size() << ", globals: " << globals.size() << "\n";
+    for (const auto &function : functions)
+    {
+        out << "work " << function.name << " (registers: " << function.registerCount << ", params: " << function.paramCount << ")\n";
+        for (size_t pc = 0; pc < function.code.size(); ++pc)
+        {
+            const Instr &instr = function.code[pc];
+            out << "    " << pc << ": " << opName(instr.op);
+            switch (instr.op)
+            {
+            case Op::JMP:
+                out << " @" << instr.c;
+                break;
+            case Op::JMP_IF:
+            case Op::JMP_IFNOT:
+                out << " r" << instr.a << " @" << instr.c;
+                break;
+            case Op::JLT_I:
+            case Op::JLE_I:
+            case Op::JGT_I:
+            case Op::JGE_I:
+            case Op::JEQ_I:
+            case Op::JNE_I:
+                out << " r" << instr.a << " r" << instr.b << " @" << instr.c;
+                break;
+            case Op::LOADK:
+            case Op::LOADK_S:
+                out << " r" << instr.a << " k" << instr.b;
+                break;
+            case Op::LOADI:
+                out << " r" << instr.a << " " << (int16_t)instr.b;
+                break;
+            case Op::ADDI_I:
+            case Op::SUBI_I:
+                out << " r" << instr.a << " r" << instr.b << " " << (int16_t)instr.c;
+                break;
+            case Op::CALL:
+            case Op::CALL_S:
+            {
+                out << " r" << instr.a << " " << functions[instr.b].name << "(";
+                uint16_t count = function.argumentLists[instr.c];
+                for (uint16_t i = 0; i < count; ++i)
+                {
+                    out << (i ? ", r" : "r") << function.argumentLists[instr.c + 1 + i];
+                }
+                out << ")";
+                break;
+            }
+            case Op::RET:
+            case Op::RET_S:
+                out << " r" << instr.a;
+                break;
+            case Op::RET_VOID:
+                break;
+            case Op::LOAD_GLOBAL:
+            case Op::LOAD_GLOBAL_S:
+            case Op::STORE_GLOBAL:
+            case Op::STORE_GLOBAL_S:
+                out << " r" << instr.a << " @" << globals[instr.b].name;
+                break;
+            case Op::MOVE:
+            case Op::MOVE_S:
+            case Op::TAKE_S:
+            case Op::NEG_I:
+            case Op::NEG_F:
+            case Op::ITOF:
+            case Op::NOT:
+            case Op::NEW_ARRAY:
+            case Op::LENGTH:
+            case Op::CHECK_BOUNDS:
+                out << " r" << instr.a << " r" << instr.b;
+                break;
+            default:
+                out << " r" << instr.a << " r" << instr.b << " r" << instr.c;
+            }
+            out << "\n";
+        }
+    }
+}
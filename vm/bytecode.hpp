@@ -0,0 +1,157 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Register based bytecode executed by the VM.
+// Registers are untyped 64 bit slots, the compiler picks the typed opcode so the VM never checks a tag.
+// Ints, bools and chars live in the slot as int64, floats as double and strings as a reference counted object
+
+struct StringObject
+{
+    uint32_t refs;
+    std::string text;
+};
+
+union Slot
+{
+    int64_t i;
+    double f;
+    StringObject *s;
+};
+
+inline constexpr uint16_t NO_REGISTER = 0xFFFF;
+
+// Keep the order in sync with the dispatch table in vm.cpp
+enum class Op : uint8_t
+{
+    MOVE,   // a = b
+    MOVE_S, // a = b for strings
+    TAKE_S, // a = b and b is cleared, hands the reference over when b is dead afterwards
+    LOADK,  // a = constants[b]
+    LOADK_S,
+    LOADI, // a = (int16)b
+
+    ADD_I, // a = b + c
+    SUB_I,
+    MUL_I,
+    DIV_I,
+    MOD_I,
+    NEG_I, // a = -b
+    ADDI_I, // a = b + (int16)c
+    SUBI_I,
+
+    ADD_F,
+    SUB_F,
+    MUL_F,
+    DIV_F,
+    MOD_F,
+    NEG_F,
+    ITOF, // a = (double)b
+
+    EQ_I, // a = b == c, also used for bools and chars
+    NE_I,
+    LT_I,
+    LE_I,
+    GT_I,
+    GE_I,
+    EQ_F,
+    NE_F,
+    LT_F,
+    LE_F,
+    GT_F,
+    GE_F,
+    EQ_S,
+    NE_S,
+    LT_S,
+    LE_S,
+    GT_S,
+    GE_S,
+    NOT,
+
+    CONCAT,       // a = b + c
+    CONCAT_STEAL, // a = b + c, b is dead afterwards so its buffer is reused when nothing else holds it
+
+    JMP,      // pc = c
+    JMP_IF,   // if a: pc = c
+    JMP_IFNOT,
+    JLT_I, // if a < b: pc = c
+    JLE_I,
+    JGT_I,
+    JGE_I,
+    JEQ_I,
+    JNE_I,
+
+    CALL,   // a = functions[b](args[c]...)
+    CALL_S, // CALL with a string result
+    RET,    // return a
+    RET_S,
+    RET_VOID,
+
+    LOAD_GLOBAL, // a = globals[b]
+    LOAD_GLOBAL_S,
+    STORE_GLOBAL, // globals[b] = a
+    STORE_GLOBAL_S,
+
+    ALLOC, // a = b zeroed cells
+    FREE,  // gives the cells a points at back
+    LOAD,  // a = *b
+    STORE, // *a = b, pointers never hold strings so this is a plain copy
+    NEW_ARRAY,    // a = array of b zeroed slots, the length goes in the slot before them
+    LENGTH,       // a = length of the array b
+    ELEMENT,      // a = address of the element c of the array b
+    CHECK_BOUNDS, // stops unless 0 <= a < b
+
+    OP_COUNT,
+};
+
+struct Instr
+{
+    Op op;
+    uint16_t a = 0;
+    uint16_t b = 0;
+    uint16_t c = 0;
+};
+
+struct BytecodeFunction
+{
+    std::string name;
+    std::vector<Instr> code;
+    uint16_t registerCount = 0;
+    uint16_t paramCount = 0;
+    std::vector<uint16_t> stringRegisters; // Cleared on entry and released on return
+    std::vector<bool> paramIsString;
+    std::vector<uint16_t> argumentLists;   // CALL c indexes here: count followed by the argument registers
+    bool returnsString = false;
+    std::string returnTypeName;
+};
+
+struct BytecodeGlobal
+{
+    std::string name;
+    Slot initial;
+    bool isString = false;
+    std::string typeName; // Only used when printing the final values
+};
+
+struct BytecodeProgram
+{
+    std::vector<BytecodeFunction> functions;
+    std::vector<Slot> constants;
+    std::vector<BytecodeGlobal> globals;
+    int entry = -1; // The function holding the top level statements
+
+    BytecodeProgram() = default;
+    BytecodeProgram(const BytecodeProgram &) = delete;
+    BytecodeProgram &operator=(const BytecodeProgram &) = delete;
+    BytecodeProgram(BytecodeProgram &&) = default;
+    ~BytecodeProgram();
+
+    std::vector<StringObject *> ownedStrings; // String constants, owned by the program
+
+    int findFunction(const std::string &name) const;
+    void print(std::ostream &out) const;
+};
+
+std::string opName(Op op);
@@ -0,0 +1,591 @@
+#include "compiler.hpp"
+#include <limits>
+#include <stdexcept>
+
+BytecodeCompiler::BytecodeCompiler(Module &module) : module(module) {}
+
+// Value of a constant as it sits in a register, strings are created here and owned by the program
+static Slot slotOf(const Value *type, const ConstantValue &value, std::vector<StringObject *> &owned)
+{
+    Slot slot;
+    slot.i = 0;
+    switch (type->scalar())
+    {
+    case TypeSystem::INTEGER:
+        slot.i = value.intValue;
+        break;
+    case TypeSystem::FLOAT:
+        slot.f = value.floatValue;
+        break;
+    case TypeSystem::BOOLEAN:
+        slot.i = value.boolValue;
+        break;
+    case TypeSystem::CHAR:
+        slot.i = value.charValue;
+        break;
+    case TypeSystem::STRING:
+        slot.s = new StringObject{1, value.stringValue};
+        owned.push_back(slot.s);
+        break;
+    default:
+        break;
+    }
+    return slot;
+}
+
+BytecodeProgram BytecodeCompiler::compile()
+{
+    for (auto global : module.globals)
+    {
+        BytecodeGlobal entry;
+        entry.name = global->name;
+        entry.isString = global->type && global->type->scalar == TypeSystem::STRING;
+        entry.typeName = TypeContext::toString(global->type);
+        Constant *initial = global->initializer ? module.constant(*global->initializer) : module.zeroOf(global->type);
+        entry.initial = slotOf(initial, initial->value, program.ownedStrings);
+        globalIndex[global] = program.globals.size();
+        program.globals.push_back(std::move(entry));
+    }
+
+    for (auto fn : module.functions)
+    {
+        functionIndex[fn] = program.functions.size();
+        if (fn->isTopLevel)
+            program.entry = program.functions.size();
+        program.functions.emplace_back();
+    }
+
+    for (auto fn : module.functions)
+    {
+        compileFunction(fn);
+    }
+    return std::move(program);
+}
+
+void BytecodeCompiler::compileFunction(Function *target)
+{
+    function = target;
+    out = &program.functions[functionIndex[target]];
+    out->name = target->name;
+    out->paramCount = target->arguments.size();
+    out->returnsString = target->returnType && target->returnType->scalar == TypeSystem::STRING;
+    out->returnTypeName = TypeContext::toString(target->returnType);
+    for (auto arg : target->arguments)
+    {
+        out->paramIsString.push_back(isString(arg));
+    }
+
+    registers.clear();
+    constantRegisters.clear();
+    blockLabels.clear();
+    labels.clear();
+    patches.clear();
+    stubs.clear();
+    fusedCompares.clear();
+
+    assignRegisters();
+    // Only strings care about who else holds the value
+    Liveness stringLiveness(target, [this](Value *value)
+                            { return isString(value); });
+    liveness = &stringLiveness;
+    for (auto block : target->blocks)
+    {
+        blockLabels[block] = labels.size();
+        labels.push_back(0);
+        Instruction *term = block->terminator();
+        if (term && term->op == Opcode::CONDBR)
+        {
+            if (Instruction *compare = fusableCompare(term))
+                fusedCompares.insert(compare);
+        }
+    }
+
+    for (size_t i = 0; i < target->blocks.size(); ++i)
+    {
+        compileBlock(target->blocks[i], i + 1 < target->blocks.size() ? target->blocks[i + 1] : nullptr);
+    }
+
+    // Edges from conditional branches into blocks with phis get their moves down here
+    for (size_t i = 0; i < stubs.size(); ++i)
+    {
+        Stub stub = stubs[i];
+        labels[stub.label] = out->code.size();
+        compileMoves(stub.from, stub.to);
+        emitJump(Op::JMP, blockLabels[stub.to]);
+    }
+
+    // Constants are only known once the body is done, they go in front and every jump moves along
+    std::vector<Instr> code;
+    compileConstantLoads(code);
+    size_t offset = code.size();
+    for (auto [index, label] : patches)
+    {
+        size_t destination = labels[label] + offset;
+        if (destination > std::numeric_limits<uint16_t>::max())
+            throw std::runtime_error("Function '" + target->name + "' is too large for the bytecode format");
+        out->code[index].c = destination;
+    }
+    code.insert(code.end(), out->code.begin(), out->code.end());
+    out->code = std::move(code);
+    liveness = nullptr;
+}
+
+// Arguments take the first registers so the caller can copy them straight in
+void BytecodeCompiler::assignRegisters()
+{
+    for (auto arg : function->arguments)
+    {
+        registers[arg] = newRegister(isString(arg));
+    }
+    scratch = newRegister(false);
+    stringScratch = newRegister(true);
+    for (auto block : function->blocks)
+    {
+        for (auto inst : block->instructions)
+        {
+            // A spawn keeps the result of its task, the handle itself is never needed
+            if (inst->op == Opcode::SPAWN)
+                registers[inst] = newRegister(inst->callee->returnType->scalar == TypeSystem::STRING);
+            else if (inst->scalar() != TypeSystem::VOID && inst->scalar() != TypeSystem::UNKNOWN)
+                registers[inst] = newRegister(isString(inst));
+        }
+    }
+}
+
+// True when inst is the last thing to read value, and reads it only once
+bool BytecodeCompiler::diesAt(Value *value, Instruction *inst) const
+{
+    BasicBlock *block = inst->parent;
+    if (liveness->isLiveOut(value, block))
+        return false;
+    size_t reads = 0;
+    bool after = false;
+    for (auto other : block->instructions)
+    {
+        after = after || other == inst;
+        if (!after)
+            continue;
+        for (auto operand : other->operands)
+        {
+            reads += operand == value;
+        }
+    }
+    return reads == 1;
+}
+
+bool BytecodeCompiler::diesOnEdge(Value *value, BasicBlock *from, BasicBlock *to) const
+{
+    if (value->kind == ValueKind::CONSTANT)
+        return false;
+    if (liveness->isLiveIn(value, to))
+        return false;
+    size_t reads = 0;
+    for (auto inst : to->instructions)
+    {
+        if (!inst->isPhi())
+            break;
+        for (size_t i = 0; i < inst->operands.size(); ++i)
+        {
+            reads += inst->targets[i] == from && inst->operands[i] == value;
+        }
+    }
+    return reads == 1;
+}
+
+void BytecodeCompiler::compileBlock(BasicBlock *block, BasicBlock *next)
+{
+    labels[blockLabels[block]] = out->code.size();
+    for (auto inst : block->instructions)
+    {
+        if (inst->isPhi() || fusedCompares.count(inst))
+            continue;
+
+        switch (inst->op)
+        {
+        case Opcode::BR:
+            compileEdge(block, inst->targets[0], next);
+            break;
+        case Opcode::CONDBR:
+            compileBranch(inst, next);
+            break;
+        case Opcode::RET:
+            if (inst->operands.empty())
+                emit(Op::RET_VOID);
+            else
+                emit(isString(inst->operands[0]) ? Op::RET_S : Op::RET, registerOf(inst->operands[0]));
+            break;
+        default:
+            compileInstruction(inst);
+        }
+    }
+}
+
+static Op compareOp(Opcode op, Op base)
+{
+    // The bytecode keeps EQ NE LT LE GT GE for every operand type
+    static const int order[] = {0, 1, 2, 4, 3, 5}; // Indexed from Opcode::EQ, the IR has GT before LE
+    return static_cast<Op>(static_cast<int>(base) + order[static_cast<int>(op) - static_cast<int>(Opcode::EQ)]);
+}
+
+void BytecodeCompiler::compileInstruction(Instruction *inst)
+{
+    uint16_t dst = registers.count(inst) ? registers[inst] : NO_REGISTER;
+    int16_t immediate;
+
+    switch (inst->op)
+    {
+    case Opcode::ADD:
+        if (isFloat(inst))
+            emit(Op::ADD_F, dst, registerOf(inst->operands[0]), registerOf(inst->operands[1]));
+        else if (smallInt(inst->operands[1], immediate))
+            emit(Op::ADDI_I, dst, registerOf(inst->operands[0]), immediate);
+        else if (smallInt(inst->operands[0], immediate))
+            emit(Op::ADDI_I, dst, registerOf(inst->operands[1]), immediate);
+        else
+            emit(Op::ADD_I, dst, registerOf(inst->operands[0]), registerOf(inst->operands[1]));
+        break;
+    case Opcode::SUB:
+        if (isFloat(inst))
+            emit(Op::SUB_F, dst, registerOf(inst->operands[0]), registerOf(inst->operands[1]));
+        else if (smallInt(inst->operands[1], immediate))
+            emit(Op::SUBI_I, dst, registerOf(inst->operands[0]), immediate);
+        else
+            emit(Op::SUB_I, dst, registerOf(inst->operands[0]), registerOf(inst->operands[1]));
+        break;
+    case Opcode::MUL:
+        emit(isFloat(inst) ? Op::MUL_F : Op::MUL_I, dst, registerOf(inst->operands[0]), registerOf(inst->operands[1]));
+        break;
+    case Opcode::DIV:
+        emit(isFloat(inst) ? Op::DIV_F : Op::DIV_I, dst, registerOf(inst->operands[0]), registerOf(inst->operands[1]));
+        break;
+    case Opcode::MOD:
+        emit(isFloat(inst) ? Op::MOD_F : Op::MOD_I, dst, registerOf(inst->operands[0]), registerOf(inst->operands[1]));
+        break;
+    case Opcode::NEG:
+        emit(isFloat(inst) ? Op::NEG_F : Op::NEG_I, dst, registerOf(inst->operands[0]));
+        break;
+    case Opcode::EQ:
+    case Opcode::NE:
+    case Opcode::LT:
+    case Opcode::GT:
+    case Opcode::LE:
+    case Opcode::GE:
+    {
+        Value *lhs = inst->operands[0];
+        Op base = isString(lhs) ? Op::EQ_S : isFloat(lhs) ? Op::EQ_F : Op::EQ_I;
+        emit(compareOp(inst->op, base), dst, registerOf(lhs), registerOf(inst->operands[1]));
+        break;
+    }
+    case Opcode::NOT:
+        emit(Op::NOT, dst, registerOf(inst->operands[0]));
+        break;
+    case Opcode::CONCAT:
+        emit(diesAt(inst->operands[0], inst) ? Op::CONCAT_STEAL : Op::CONCAT, dst, registerOf(inst->operands[0]), registerOf(inst->operands[1]));
+        break;
+    case Opcode::ITOF:
+        emit(Op::ITOF, dst, registerOf(inst->operands[0]));
+        break;
+    case Opcode::CALL:
+    case Opcode::SPAWN:
+    {
+        // The VM runs on one thread so a started task simply runs to the end right away, the wait only reads its result
+        TypeSystem result = inst->op == Opcode::SPAWN ? inst->callee->returnType->scalar : inst->scalar();
+        if (inst->op == Opcode::SPAWN && result == TypeSystem::VOID)
+            dst = NO_REGISTER;
+        size_t list = out->argumentLists.size();
+        if (list > std::numeric_limits<uint16_t>::max())
+            throw std::runtime_error("Function '" + function->name + "' has too many calls for the bytecode format");
+        out->argumentLists.push_back(inst->operands.size());
+        for (auto arg : inst->operands)
+        {
+            out->argumentLists.push_back(registerOf(arg));
+        }
+        emit(result == TypeSystem::STRING ? Op::CALL_S : Op::CALL, dst, functionIndex[inst->callee], list);
+        break;
+    }
+    case Opcode::JOIN:
+        if (dst != NO_REGISTER)
+            emit(isString(inst) ? Op::MOVE_S : Op::MOVE, dst, registerOf(inst->operands[0]));
+        break;
+    case Opcode::DETACH:
+        break; // There is no task record, the result register is all a spawn leaves
+    case Opcode::ZONE_ENTER:
+    case Opcode::ZONE_EXIT:
+        break; // The VM owns its strings, a zone changes nothing about where they live
+    case Opcode::LOAD_GLOBAL:
+        emit(isString(inst) ? Op::LOAD_GLOBAL_S : Op::LOAD_GLOBAL, dst, globalIndex[inst->global]);
+        break;
+    case Opcode::STORE_GLOBAL:
+        emit(isString(inst->operands[0]) ? Op::STORE_GLOBAL_S : Op::STORE_GLOBAL, registerOf(inst->operands[0]), globalIndex[inst->global]);
+        break;
+    case Opcode::ALLOC:
+        emit(Op::ALLOC, dst, registerOf(inst->operands[0]));
+        break;
+    case Opcode::FREE:
+        emit(Op::FREE, registerOf(inst->operands[0]));
+        break;
+    case Opcode::LOAD:
+        emit(Op::LOAD, dst, registerOf(inst->operands[0]));
+        break;
+    case Opcode::STORE:
+        emit(Op::STORE, registerOf(inst->operands[0]), registerOf(inst->operands[1]));
+        break;
+    case Opcode::NEW_ARRAY:
+        emit(Op::NEW_ARRAY, dst, registerOf(inst->operands[0]));
+        break;
+    case Opcode::LENGTH:
+        emit(Op::LENGTH, dst, registerOf(inst->operands[0]));
+        break;
+    case Opcode::ELEMENT:
+        emit(Op::ELEMENT, dst, registerOf(inst->operands[0]), registerOf(inst->operands[1]));
+        break;
+    case Opcode::CHECK_BOUNDS:
+        emit(Op::CHECK_BOUNDS, registerOf(inst->operands[0]), registerOf(inst->operands[1]));
+        break;
+    default:
+        throw std::runtime_error("Cannot compile '" + opcodeName(inst->op) + "' to bytecode");
+    }
+}
+
+void BytecodeCompiler::compileBranch(Instruction *condbr, BasicBlock *next)
+{
+    BasicBlock *block = condbr->parent;
+    BasicBlock *ifTrue = condbr->targets[0];
+    BasicBlock *ifFalse = condbr->targets[1];
+    Instruction *compare = fusedCompares.count(dynamic_cast<Instruction *>(condbr->operands[0])) ? static_cast<Instruction *>(condbr->operands[0]) : nullptr;
+
+    auto jumpWhen = [&](bool condition, size_t label)
+    {
+        if (!compare)
+        {
+            emitJump(condition ? Op::JMP_IF : Op::JMP_IFNOT, label, registerOf(condbr->operands[0]));
+            return;
+        }
+        Opcode op = compare->op;
+        if (!condition)
+        {
+            static const Opcode inverse[] = {Opcode::NE, Opcode::EQ, Opcode::GE, Opcode::LE, Opcode::GT, Opcode::LT};
+            op = inverse[static_cast<int>(op) - static_cast<int>(Opcode::EQ)];
+        }
+        static const Op jumps[] = {Op::JEQ_I, Op::JNE_I, Op::JLT_I, Op::JGT_I, Op::JLE_I, Op::JGE_I};
+        emitJump(jumps[static_cast<int>(op) - static_cast<int>(Opcode::EQ)], label, registerOf(compare->operands[0]), registerOf(compare->operands[1]));
+    };
+
+    bool truePhis = hasPhis(ifTrue);
+    bool falsePhis = hasPhis(ifFalse);
+    if (!truePhis && ifTrue == next)
+    {
+        jumpWhen(false, falsePhis ? stubLabel(block, ifFalse) : blockLabels[ifFalse]);
+    }
+    else if (!truePhis)
+    {
+        jumpWhen(true, blockLabels[ifTrue]);
+        compileEdge(block, ifFalse, next);
+    }
+    else if (!falsePhis)
+    {
+        jumpWhen(false, blockLabels[ifFalse]);
+        compileEdge(block, ifTrue, next);
+    }
+    else
+    {
+        jumpWhen(true, stubLabel(block, ifTrue));
+        compileEdge(block, ifFalse, next);
+    }
+}
+
+void BytecodeCompiler::compileEdge(BasicBlock *from, BasicBlock *to, BasicBlock *next)
+{
+    compileMoves(from, to);
+    if (to != next)
+        emitJump(Op::JMP, blockLabels[to]);
+}
+
+// The phis of a block read their inputs all at once, so the moves are ordered to never clobber a register
+// another move still has to read and cycles are broken through the scratch registers
+void BytecodeCompiler::compileMoves(BasicBlock *from, BasicBlock *to)
+{
+    struct Move
+    {
+        uint16_t dst;
+        uint16_t src;
+        bool string;
+        bool steal;
+    };
+    std::vector<Move> pending;
+    for (auto inst : to->instructions)
+    {
+        if (!inst->isPhi())
+            break;
+        for (size_t i = 0; i < inst->operands.size(); ++i)
+        {
+            if (inst->targets[i] != from)
+                continue;
+            Value *src = inst->operands[i];
+            Move move{registers[inst], registerOf(src), isString(inst), diesOnEdge(src, from, to)};
+            if (move.dst != move.src)
+                pending.push_back(move);
+            break;
+        }
+    }
+
+    auto readers = [&](uint16_t reg)
+    {
+        size_t count = 0;
+        for (auto &move : pending)
+        {
+            count += move.src == reg;
+        }
+        return count;
+    };
+    auto emitMove = [&](const Move &move)
+    {
+        if (!move.string)
+            emit(Op::MOVE, move.dst, move.src);
+        else
+            emit(move.steal ? Op::TAKE_S : Op::MOVE_S, move.dst, move.src);
+    };
+
+    while (!pending.empty())
+    {
+        bool progress = false;
+        for (size_t i = 0; i < pending.size(); ++i)
+        {
+            if (readers(pending[i].dst) != 0)
+                continue;
+            Move move = pending[i];
+            pending.erase(pending.begin() + i);
+            // The last read of a parked value hands it over
+            if (move.src == stringScratch && readers(stringScratch) == 0)
+                move.steal = true;
+            emitMove(move);
+            progress = true;
+            break;
+        }
+        if (progress)
+            continue;
+
+        // Only cycles are left, park the value of one destination so its move can go
+        Move &blocked = pending.front();
+        uint16_t parked = blocked.string ? stringScratch : scratch;
+        emitMove(Move{parked, blocked.dst, blocked.string, true});
+        for (auto &move : pending)
+        {
+            if (move.src == blocked.dst)
+            {
+                move.src = parked;
+                move.steal = false;
+            }
+        }
+    }
+}
+
+void BytecodeCompiler::compileConstantLoads(std::vector<Instr> &prefix)
+{
+    for (auto constant : constantRegisters)
+    {
+        uint16_t reg = registers[constant];
+        int16_t immediate;
+        if (constant->scalar() == TypeSystem::STRING)
+            prefix.push_back({Op::LOADK_S, reg, constantSlot(constant)});
+        else if (constant->scalar() == TypeSystem::FLOAT)
+            prefix.push_back({Op::LOADK, reg, constantSlot(constant)});
+        else if (smallInt(constant, immediate))
+            prefix.push_back({Op::LOADI, reg, static_cast<uint16_t>(immediate)});
+        else
+            prefix.push_back({Op::LOADK, reg, constantSlot(constant)});
+    }
+}
+
+//---------HELPER FUNCTIONS----------
+uint16_t BytecodeCompiler::registerOf(Value *value)
+{
+    auto it = registers.find(value);
+    if (it != registers.end())
+        return it->second;
+    if (value->kind != ValueKind::CONSTANT)
+        throw std::runtime_error("Value " + valueName(value) + " has no register in '" + function->name + "'");
+    uint16_t reg = newRegister(isString(value));
+    registers[value] = reg;
+    constantRegisters.push_back(static_cast<Constant *>(value));
+    return reg;
+}
+
+uint16_t BytecodeCompiler::newRegister(bool isString)
+{
+    if (out->registerCount == NO_REGISTER)
+        throw std::runtime_error("Function '" + function->name + "' needs more registers than the bytecode format has");
+    uint16_t reg = out->registerCount++;
+    if (isString)
+        out->stringRegisters.push_back(reg);
+    return reg;
+}
+
+uint16_t BytecodeCompiler::constantSlot(Constant *constant)
+{
+    auto it = constantIndex.find(constant);
+    if (it != constantIndex.end())
+        return it->second;
+    if (program.constants.size() > std::numeric_limits<uint16_t>::max())
+        throw std::runtime_error("Too many constants for the bytecode format");
+    uint16_t index = program.constants.size();
+    program.constants.push_back(slotOf(constant, constant->value, program.ownedStrings));
+    constantIndex[constant] = index;
+    return index;
+}
+
+void BytecodeCompiler::emit(Op op, uint16_t a, uint16_t b, uint16_t c)
+{
+    if (out->code.size() >= std::numeric_limits<uint16_t>::max())
+        throw std::runtime_error("Function '" + function->name + "' is too large for the bytecode format");
+    out->code.push_back({op, a, b, c});
+}
+
+void BytecodeCompiler::emitJump(Op op, size_t label, uint16_t a, uint16_t b)
+{
+    patches.push_back({out->code.size(), label});
+    emit(op, a, b);
+}
+
+size_t BytecodeCompiler::stubLabel(BasicBlock *from, BasicBlock *to)
+{
+    size_t label = labels.size();
+    labels.push_back(0);
+    stubs.push_back({label, from, to});
+    return label;
+}
+
+bool BytecodeCompiler::hasPhis(BasicBlock *block) const
+{
+    return !block->instructions.empty() && block->instructions.front()->isPhi();
+}
+
+bool BytecodeCompiler::smallInt(Value *value, int16_t &immediate) const
+{
+    auto constant = dynamic_cast<Constant *>(value);
+    if (!constant || constant->scalar() == TypeSystem::FLOAT || constant->scalar() == TypeSystem::STRING)
+        return false;
+    int64_t number = constant->scalar() == TypeSystem::BOOLEAN ? constant->value.boolValue
+                     : constant->scalar() == TypeSystem::CHAR  ? constant->value.charValue
+                                                                : constant->value.intValue;
+    if (number < std::numeric_limits<int16_t>::min() || number > std::numeric_limits<int16_t>::max())
+        return false;
+    immediate = number;
+    return true;
+}
+
+// A compare can become part of the branch when the branch is its only user and nothing sits in between
+Instruction *BytecodeCompiler::fusableCompare(Instruction *condbr) const
+{
+    auto compare = dynamic_cast<Instruction *>(condbr->operands[0]);
+    if (!compare || compare->parent != condbr->parent || compare->users.size() != 1)
+        return nullptr;
+    if (compare->op < Opcode::EQ || compare->op > Opcode::GE)
+        return nullptr;
+    if (isString(compare->operands[0]) || isFloat(compare->operands[0]))
+        return nullptr;
+    auto &instructions = condbr->parent->instructions;
+    if (instructions.size() < 2 || instructions[instructions.size() - 2] != compare)
+        return nullptr;
+    return compare;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "bytecode.hpp"
+#include "ir/ir.hpp"
+#include "ir/liveness.hpp"
+
+// Turns the SSA module into register bytecode.
+// Every SSA value keeps its own register so there is no allocation to do, phis become moves on the incoming edges
+class BytecodeCompiler
+{
+    Module &module;
+    BytecodeProgram program;
+    std::unordered_map<Function *, uint16_t> functionIndex;
+    std::unordered_map<GlobalVariable *, uint16_t> globalIndex;
+    std::unordered_map<Constant *, uint16_t> constantIndex; // Constants are interned by the module so the pointer is the key
+
+    // State of the function being compiled
+    BytecodeFunction *out = nullptr;
+    Function *function = nullptr;
+    std::unordered_map<Value *, uint16_t> registers;
+    std::vector<Constant *> constantRegisters;            // Loaded once at entry, in register order
+    std::unordered_map<BasicBlock *, size_t> blockLabels;
+    std::vector<size_t> labels;                           // Body offset of every label, the blocks first and then the edge stubs
+    std::vector<std::pair<size_t, size_t>> patches;       // Jump instruction and the label it goes to
+    struct Stub
+    {
+        size_t label;
+        BasicBlock *from;
+        BasicBlock *to;
+    };
+    std::vector<Stub> stubs; // Edges that need their phi moves out of line
+    std::unordered_set<Instruction *> fusedCompares;      // Compares folded into the branch that uses them
+    const Liveness *liveness = nullptr;                   // A string that dies at a use can hand its buffer over instead of being copied
+    uint16_t scratch = 0;
+    uint16_t stringScratch = 0;
+
+public:
+    explicit BytecodeCompiler(Module &module);
+    BytecodeProgram compile();
+
+private:
+    void compileFunction(Function *target);
+    void assignRegisters();
+    bool diesAt(Value *value, Instruction *inst) const;
+    bool diesOnEdge(Value *value, BasicBlock *from, BasicBlock *to) const;
+    void compileBlock(BasicBlock *block, BasicBlock *next);
+    void compileInstruction(Instruction *inst);
+    void compileBranch(Instruction *condbr, BasicBlock *next);
+    void compileEdge(BasicBlock *from, BasicBlock *to, BasicBlock *next); // Phi moves followed by the jump
+    void compileMoves(BasicBlock *from, BasicBlock *to);
+    void compileConstantLoads(std::vector<Instr> &prefix);
+
+    //---------HELPER FUNCTIONS----------
+    uint16_t registerOf(Value *value);
+    uint16_t newRegister(bool isString);
+    uint16_t constantSlot(Constant *constant);
+    void emit(Op op, uint16_t a = 0, uint16_t b = 0, uint16_t c = 0);
+    void emitJump(Op op, size_t label, uint16_t a = 0, uint16_t b = 0);
+    size_t stubLabel(BasicBlock *from, BasicBlock *to);
+    bool isString(const Value *value) const { return value->scalar() == TypeSystem::STRING; }
+    bool isFloat(const Value *value) const { return value->scalar() == TypeSystem::FLOAT; }
+    bool hasPhis(BasicBlock *block) const;
+    bool smallInt(Value *value, int16_t &immediate) const;
+    Instruction *fusableCompare(Instruction *condbr) const;
+};
@@ -0,0 +1,451 @@
+#include "vm.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include "ir/ir.hpp"
+
+static inline void retain(StringObject *str)
+{
+    if (str)
+        ++str->refs;
+}
+
+void VM::release(StringObject *str)
+{
+    if (str && --str->refs == 0)
+        delete str;
+}
+
+// Ints wrap around instead of being undefined behaviour
+static inline int64_t wrapAdd(int64_t a, int64_t b) { return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b)); }
+static inline int64_t wrapSub(int64_t a, int64_t b) { return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b)); }
+static inline int64_t wrapMul(int64_t a, int64_t b) { return static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b)); }
+
+VM::VM(const BytecodeProgram &program, size_t stackSlots) : program(program), stack(stackSlots)
+{
+    for (const auto &global : program.globals)
+    {
+        globals.push_back(global.initial);
+        if (global.isString)
+            retain(global.initial.s);
+    }
+    frames.reserve(256);
+}
+
+VM::~VM()
+{
+    for (size_t i = 0; i < globals.size(); ++i)
+    {
+        if (program.globals[i].isString)
+            release(globals[i].s);
+    }
+}
+
+Slot *VM::enter(const BytecodeFunction *function, Slot *registers)
+{
+    if (registers + function->registerCount > stack.data() + stack.size())
+        throw std::runtime_error("Stack overflow while calling '" + function->name + "'");
+    for (uint16_t reg : function->stringRegisters)
+    {
+        registers[reg].s = nullptr;
+    }
+    return registers;
+}
+
+void VM::leave(const BytecodeFunction *function, Slot *registers)
+{
+    for (uint16_t reg : function->stringRegisters)
+    {
+        release(registers[reg].s);
+    }
+}
+
+std::string VM::format(Slot value, const std::string &typeName)
+{
+    if (typeName == "int")
+        return std::to_string(value.i);
+    if (typeName == "float")
+        return floatLiteral(value.f);
+    if (typeName == "bool")
+        return value.i ? "true" : "false";
+    if (typeName == "char")
+        return "'" + escapeText(std::string(1, static_cast<char>(value.i))) + "'";
+    if (typeName == "string")
+        return "\"" + escapeText(value.s ? value.s->text : "") + "\"";
+    return "<" + typeName + ">";
+}
+
+#define A (regs[instr->a])
+#define B (regs[instr->b])
+#define C (regs[instr->c])
+
+#ifdef IRON_VM_COMPUTED_GOTO
+#define VM_CASE(name) L_##name:
+#define VM_NEXT() goto *dispatchTable[static_cast<size_t>((instr = pc++)->op)]
+#else
+#define VM_CASE(name) case Op::name:
+#define VM_NEXT() continue
+#endif
+
+Slot VM::execute(int index)
+{
+    const BytecodeFunction *function = &program.functions.at(index);
+    if (function->paramCount != 0)
+        throw std::runtime_error("'" + function->name + "' can not be run without arguments");
+
+    const size_t depth = frames.size();
+    Slot *regs = enter(function, stack.data());
+    const Instr *code = function->code.data();
+    const Instr *pc = code;
+    const Instr *instr;
+    Slot result;
+
+    // Hands control back to the caller once the callee's registers are released
+    auto returnTo = [&]() -> bool
+    {
+        if (frames.size() == depth)
+            return false;
+        const Frame &caller = frames.back();
+        function = caller.function;
+        code = function->code.data();
+        pc = caller.returnAddress;
+        regs = caller.registers;
+        frames.pop_back();
+        return true;
+    };
+
+#ifdef IRON_VM_COMPUTED_GOTO
+    // Keep the order in sync with the Op enum
+    static void *const dispatchTable[] = {
+        &&L_MOVE, &&L_MOVE_S, &&L_TAKE_S, &&L_LOADK, &&L_LOADK_S, &&L_LOADI,
+        &&L_ADD_I, &&L_SUB_I, &&L_MUL_I, &&L_DIV_I, &&L_MOD_I, &&L_NEG_I, &&L_ADDI_I, &&L_SUBI_I,
+        &&L_ADD_F, &&L_SUB_F, &&L_MUL_F, &&L_DIV_F, &&L_MOD_F, &&L_NEG_F, &&L_ITOF,
+        &&L_EQ_I, &&L_NE_I, &&L_LT_I, &&L_LE_I, &&L_GT_I, &&L_GE_I,
+        &&L_EQ_F, &&L_NE_F, &&L_LT_F, &&L_LE_F, &&L_GT_F, &&L_GE_F,
+        &&L_EQ_S, &&L_NE_S, &&L_LT_S, &&L_LE_S, &&L_GT_S, &&L_GE_S,
+        &&L_NOT, &&L_CONCAT, &&L_CONCAT_STEAL,
+        &&L_JMP, &&L_JMP_IF, &&L_JMP_IFNOT, &&L_JLT_I, &&L_JLE_I, &&L_JGT_I, &&L_JGE_I, &&L_JEQ_I, &&L_JNE_I,
+        &&L_CALL, &&L_CALL_S, &&L_RET, &&L_RET_S, &&L_RET_VOID,
+        &&L_LOAD_GLOBAL, &&L_LOAD_GLOBAL_S, &&L_STORE_GLOBAL, &&L_STORE_GLOBAL_S,
+        &&L_ALLOC, &&L_FREE, &&L_LOAD, &&L_STORE, &&L_NEW_ARRAY, &&L_LENGTH, &&L_ELEMENT, &&L_CHECK_BOUNDS};
+    static_assert(sizeof(dispatchTable) / sizeof(dispatchTable[0]) == static_cast<size_t>(Op::OP_COUNT), "every opcode needs a handler");
+    VM_NEXT();
+#else
+    for (;;)
+    {
+        instr = pc++;
+        switch (instr->op)
+        {
+#endif
+
+    //---------MOVES----------
+    VM_CASE(MOVE)
+    A = B;
+    VM_NEXT();
+    VM_CASE(MOVE_S)
+    retain(B.s);
+    release(A.s);
+    A.s = B.s;
+    VM_NEXT();
+    VM_CASE(TAKE_S)
+    release(A.s);
+    A.s = B.s;
+    B.s = nullptr;
+    VM_NEXT();
+    VM_CASE(LOADK)
+    A = program.constants[instr->b];
+    VM_NEXT();
+    VM_CASE(LOADK_S)
+    retain(program.constants[instr->b].s);
+    release(A.s);
+    A.s = program.constants[instr->b].s;
+    VM_NEXT();
+    VM_CASE(LOADI)
+    A.i = static_cast<int16_t>(instr->b);
+    VM_NEXT();
+
+    //---------INT ARITHMETIC----------
+    VM_CASE(ADD_I)
+    A.i = wrapAdd(B.i, C.i);
+    VM_NEXT();
+    VM_CASE(SUB_I)
+    A.i = wrapSub(B.i, C.i);
+    VM_NEXT();
+    VM_CASE(MUL_I)
+    A.i = wrapMul(B.i, C.i);
+    VM_NEXT();
+    VM_CASE(DIV_I)
+    if (C.i == 0)
+        throw std::runtime_error("Division by zero in '" + function->name + "'");
+    A.i = C.i == -1 ? wrapSub(0, B.i) : B.i / C.i;
+    VM_NEXT();
+    VM_CASE(MOD_I)
+    if (C.i == 0)
+        throw std::runtime_error("Modulo by zero in '" + function->name + "'");
+    A.i = C.i == -1 ? 0 : B.i % C.i;
+    VM_NEXT();
+    VM_CASE(NEG_I)
+    A.i = wrapSub(0, B.i);
+    VM_NEXT();
+    VM_CASE(ADDI_I)
+    A.i = wrapAdd(B.i, static_cast<int16_t>(instr->c));
+    VM_NEXT();
+    VM_CASE(SUBI_I)
+    A.i = wrapSub(B.i, static_cast<int16_t>(instr->c));
+    VM_NEXT();
+
+    //---------FLOAT ARITHMETIC----------
+    VM_CASE(ADD_F)
+    A.f = B.f + C.f;
+    VM_NEXT();
+    VM_CASE(SUB_F)
+    A.f = B.f - C.f;
+    VM_NEXT();
+    VM_CASE(MUL_F)
+    A.f = B.f * C.f;
+    VM_NEXT();
+    VM_CASE(DIV_F)
+    A.f = B.f / C.f;
+    VM_NEXT();
+    VM_CASE(MOD_F)
+    A.f = std::fmod(B.f, C.f);
+    VM_NEXT();
+    VM_CASE(NEG_F)
+    A.f = -B.f;
+    VM_NEXT();
+    VM_CASE(ITOF)
+    A.f = static_cast<double>(B.i);
+    VM_NEXT();
+
+    //---------COMPARISONS----------
+    VM_CASE(EQ_I)
+    A.i = B.i == C.i;
+    VM_NEXT();
+    VM_CASE(NE_I)
+    A.i = B.i != C.i;
+    VM_NEXT();
+    VM_CASE(LT_I)
+    A.i = B.i < C.i;
+    VM_NEXT();
+    VM_CASE(LE_I)
+    A.i = B.i <= C.i;
+    VM_NEXT();
+    VM_CASE(GT_I)
+    A.i = B.i > C.i;
+    VM_NEXT();
+    VM_CASE(GE_I)
+    A.i = B.i >= C.i;
+    VM_NEXT();
+    VM_CASE(EQ_F)
+    A.i = B.f == C.f;
+    VM_NEXT();
+    VM_CASE(NE_F)
+    A.i = B.f != C.f;
+    VM_NEXT();
+    VM_CASE(LT_F)
+    A.i = B.f < C.f;
+    VM_NEXT();
+    VM_CASE(LE_F)
+    A.i = B.f <= C.f;
+    VM_NEXT();
+    VM_CASE(GT_F)
+    A.i = B.f > C.f;
+    VM_NEXT();
+    VM_CASE(GE_F)
+    A.i = B.f >= C.f;
+    VM_NEXT();
+    VM_CASE(EQ_S)
+    A.i = B.s->text == C.s->text;
+    VM_NEXT();
+    VM_CASE(NE_S)
+    A.i = B.s->text != C.s->text;
+    VM_NEXT();
+    VM_CASE(LT_S)
+    A.i = B.s->text < C.s->text;
+    VM_NEXT();
+    VM_CASE(LE_S)
+    A.i = B.s->text <= C.s->text;
+    VM_NEXT();
+    VM_CASE(GT_S)
+    A.i = B.s->text > C.s->text;
+    VM_NEXT();
+    VM_CASE(GE_S)
+    A.i = B.s->text >= C.s->text;
+    VM_NEXT();
+    VM_CASE(NOT)
+    A.i = !B.i;
+    VM_NEXT();
+
+    //---------STRINGS----------
+    VM_CASE(CONCAT)
+    {
+        StringObject *joined = new StringObject{1, B.s->text + C.s->text};
+        release(A.s);
+        A.s = joined;
+        VM_NEXT();
+    }
+    VM_CASE(CONCAT_STEAL)
+    {
+        // Nobody else can see the left string, so it grows in place
+        StringObject *left = B.s;
+        if (left->refs != 1)
+        {
+            StringObject *joined = new StringObject{1, left->text + C.s->text};
+            release(A.s);
+            A.s = joined;
+            VM_NEXT();
+        }
+        left->text += C.s->text;
+        B.s = nullptr;
+        release(A.s);
+        A.s = left;
+        VM_NEXT();
+    }
+
+    //---------JUMPS----------
+    VM_CASE(JMP)
+    pc = code + instr->c;
+    VM_NEXT();
+    VM_CASE(JMP_IF)
+    if (A.i)
+        pc = code + instr->c;
+    VM_NEXT();
+    VM_CASE(JMP_IFNOT)
+    if (!A.i)
+        pc = code + instr->c;
+    VM_NEXT();
+    VM_CASE(JLT_I)
+    if (A.i < B.i)
+        pc = code + instr->c;
+    VM_NEXT();
+    VM_CASE(JLE_I)
+    if (A.i <= B.i)
+        pc = code + instr->c;
+    VM_NEXT();
+    VM_CASE(JGT_I)
+    if (A.i > B.i)
+        pc = code + instr->c;
+    VM_NEXT();
+    VM_CASE(JGE_I)
+    if (A.i >= B.i)
+        pc = code + instr->c;
+    VM_NEXT();
+    VM_CASE(JEQ_I)
+    if (A.i == B.i)
+        pc = code + instr->c;
+    VM_NEXT();
+    VM_CASE(JNE_I)
+    if (A.i != B.i)
+        pc = code + instr->c;
+    VM_NEXT();
+
+    //---------CALLS----------
+    VM_CASE(CALL)
+    VM_CASE(CALL_S)
+    {
+        const BytecodeFunction *callee = &program.functions[instr->b];
+        const uint16_t *args = &function->argumentLists[instr->c];
+        Slot *calleeRegs = enter(callee, regs + function->registerCount);
+        for (uint16_t i = 0; i < args[0]; ++i)
+        {
+            calleeRegs[i] = regs[args[i + 1]];
+            if (callee->paramIsString[i])
+                retain(calleeRegs[i].s);
+        }
+        frames.push_back({function, pc, regs, instr->a});
+        function = callee;
+        code = callee->code.data();
+        pc = code;
+        regs = calleeRegs;
+        VM_NEXT();
+    }
+    VM_CASE(RET)
+    {
+        result = A;
+        leave(function, regs);
+        uint16_t target = frames.size() > depth ? frames.back().resultRegister : NO_REGISTER;
+        if (!returnTo())
+            return result;
+        regs[target] = result;
+        VM_NEXT();
+    }
+    VM_CASE(RET_S)
+    {
+        // The reference moves to the caller instead of being released
+        result = A;
+        A.s = nullptr;
+        leave(function, regs);
+        uint16_t target = frames.size() > depth ? frames.back().resultRegister : NO_REGISTER;
+        if (!returnTo())
+            return result;
+        release(regs[target].s);
+        regs[target] = result;
+        VM_NEXT();
+    }
+    VM_CASE(RET_VOID)
+    {
+        leave(function, regs);
+        if (!returnTo())
+            return Slot{0};
+        VM_NEXT();
+    }
+
+    //---------GLOBALS----------
+    VM_CASE(LOAD_GLOBAL)
+    A = globals[instr->b];
+    VM_NEXT();
+    VM_CASE(LOAD_GLOBAL_S)
+    retain(globals[instr->b].s);
+    release(A.s);
+    A.s = globals[instr->b].s;
+    VM_NEXT();
+    VM_CASE(STORE_GLOBAL)
+    globals[instr->b] = A;
+    VM_NEXT();
+    VM_CASE(STORE_GLOBAL_S)
+    retain(A.s);
+    release(globals[instr->b].s);
+    globals[instr->b].s = A.s;
+    VM_NEXT();
+
+    //---------POINTERS----------
+    VM_CASE(ALLOC)
+    A.i = reinterpret_cast<int64_t>(std::calloc(B.i, sizeof(Slot)));
+    if (!A.i)
+        throw std::runtime_error("Out of memory");
+    VM_NEXT();
+    VM_CASE(FREE)
+    std::free(reinterpret_cast<Slot *>(A.i));
+    VM_NEXT();
+    VM_CASE(LOAD)
+    A = *reinterpret_cast<Slot *>(B.i);
+    VM_NEXT();
+    VM_CASE(STORE)
+    *reinterpret_cast<Slot *>(A.i) = B;
+    VM_NEXT();
+    VM_CASE(NEW_ARRAY)
+    if (B.i < 0)
+        throw std::runtime_error("Array with a negative length in '" + function->name + "'");
+    A.i = reinterpret_cast<int64_t>(std::calloc(B.i + 1, sizeof(Slot)));
+    if (!A.i)
+        throw std::runtime_error("Out of memory");
+    reinterpret_cast<Slot *>(A.i)->i = B.i;
+    VM_NEXT();
+    VM_CASE(LENGTH)
+    A.i = reinterpret_cast<Slot *>(B.i)->i;
+    VM_NEXT();
+    VM_CASE(ELEMENT)
+    A.i = reinterpret_cast<int64_t>(reinterpret_cast<Slot *>(B.i) + 1 + C.i);
+    VM_NEXT();
+    VM_CASE(CHECK_BOUNDS)
+    if (static_cast<uint64_t>(A.i) >= static_cast<uint64_t>(B.i))
+        throw std::runtime_error("Index out of bounds in '" + function->name + "'");
+    VM_NEXT();
+
+#ifndef IRON_VM_COMPUTED_GOTO
+        default:
+            throw std::runtime_error("Unknown opcode " + opName(instr->op) + " in '" + function->name + "'");
+        }
+    }
+#endif
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "bytecode.hpp"
+
+// Computed goto dispatch on GCC and Clang, build with IRON_VM_SWITCH_DISPATCH to get the portable switch loop
+#if defined(__GNUC__) && !defined(IRON_VM_SWITCH_DISPATCH)
+#define IRON_VM_COMPUTED_GOTO 1
+#endif
+
+// Interpreter for the register bytecode.
+// Calls never recurse in C++, every call pushes a frame and the callee's registers sit right above the caller's
+class VM
+{
+    struct Frame
+    {
+        const BytecodeFunction *function;
+        const Instr *returnAddress;
+        Slot *registers;
+        uint16_t resultRegister;
+    };
+
+    const BytecodeProgram &program;
+    std::vector<Slot> stack;
+    std::vector<Slot> globals;
+    std::vector<Frame> frames;
+
+public:
+    static constexpr size_t DEFAULT_STACK_SLOTS = 1 << 20;
+
+    explicit VM(const BytecodeProgram &program, size_t stackSlots = DEFAULT_STACK_SLOTS);
+    VM(const VM &) = delete;
+    VM &operator=(const VM &) = delete;
+    ~VM();
+
+    // Runs a function that takes no arguments, a string result belongs to the caller who has to release it
+    Slot execute(int function);
+
+    Slot global(size_t index) const { return globals[index]; }
+    static void release(StringObject *str);
+    static std::string format(Slot value, const std::string &typeName);
+
+private:
+    Slot *enter(const BytecodeFunction *function, Slot *registers);
+    void leave(const BytecodeFunction *function, Slot *registers);
+};